@@ -15,7 +15,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 /*
     A C program to repair corrupted video files that can sometimes be produced by
     DJI quadcopters.
-    Version 2024-09-06
+    Version 2026-10-14
     
     Copyright (c) 2014-2024 Live Networks, Inc.  All rights reserved.
 
@@ -167,15 +167,220 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
     - 2024-09-04: Updated support for H.265 2016p60 (for the DJI O3 Air).
                   (Thanks to Stacey Abshire for providing example files to test this.)
     - 2024-09-06: Updated the H.265 SPS, PPS, and VPS NAL units for 2160x3840p30 (type 5)
+    - 2026-10-14: NAL unit payloads (and the remainder of 'type 1' files) are now copied in large
+                  blocks, rather than one byte at a time.  (On Linux, 'type 1' repairs use
+		  "copy_file_range()" when possible.)  The repaired output is unchanged.
+                  The input file is now memory-mapped (or, if that's not possible, read into
+		  memory), and parsed using a cursor, rather than by using "fgetc()" and "fseek()".
+                  When skipping over anomalous data while looking for video, we now use a
+		  vectorized (SSE2/AVX2/NEON) scan to find possible NAL sizes, rather than
+		  checking every byte position.
+                  We also skip past the JPEG previews at the start of 'type 3' files using a
+		  vectorized search for 0xFFD9, rather than reading one byte at a time.
+                  We can now repair more than one file at a time, and the video format can be
+		  given on the command line (using "-f"), rather than typed in response to a prompt.
+                  "-f auto" detects the video format, by checking which of our SPS and PPS NAL units
+		  are consistent with the slice headers at the start of the video data.
+                  "-p" does a trial repair (in memory) of the start of the video data with each
+		  video format, and reports which formats produce consistent video.
+                  "-j" repairs (the video data of) 'type 3', 'type 4', and 'type 5' files using
+		  several threads, each of which parses part of the file.  The repaired file is
+		  the same as when using one thread.
+                  A directory may be given (to repair all of the video files in it), or a list of
+		  files (using "-L").  "-P" repairs several files at the same time (largest first),
+		  and a summary of the repairs is printed at the end.
+                  The repairs can also be built as a library ("make lib"; see "djifix.h"), which
+		  passes the repaired file to a callback function, rather than writing a file.
+                  "-m" writes the result of a 'type 2', 'type 3', 'type 4', or 'type 5' repair as
+		  a '.mp4' file (with an index, made as we go), rather than as a '.h264' file.
+                  The file to repair may be "-", to read it from 'stdin' (e.g., a pipe) as we go,
+		  keeping only a bounded window of it in memory.  The repaired file is then
+		  written to 'stdout', or to the file named with "-o".
+                  The blocks of non-video data in 'type 3' and 'type 5' files are now recognized
+		  using a table of rules (checking only the rules for the block's first byte),
+		  rather than a long chain of comparisons.  More rules can be loaded from a file
+		  (using "--rules").
+                  "--stats" writes a report (in JSON) of each repair: how long each phase took,
+		  how much was read and written, the number of NAL units of each type, the blocks
+		  of non-video data that were skipped (by rule), and where the repair lost (and
+		  found again) the video data.
+                  "--progress" prints, every few seconds, how much of the file has been read, how
+		  fast, and about how long the rest will take; "--progress-fd" writes the same, as
+		  lines of JSON, to a file descriptor.  Both look at the time only when another
+		  4 MBytes of the input have been read, so they don't slow the repair.
+                  Added a benchmark ("make bench"; "tools/djifix-bench.c") that generates a
+		  synthetic damaged file for each type of repair, and reports how fast each is
+		  repaired.
+                  Added a check ("make golden"; "tools/djifix-golden.c") that each file of a
+		  corpus is still repaired exactly as before, by comparing the SHA-256 digest of
+		  each repaired file (made in memory, using the library) with that in a manifest.
+                  "--plan" keeps a 'repair plan' for each file ("<file>.djifix-plan"): where each
+		  of the NAL units that the repair copied is, and which blocks it skipped.
+		  Repairing the file again (e.g., with another video format) then just copies
+		  those NAL units, without parsing the file.
+                  A parallel ("-j") repair now writes each part of the repaired file using
+		  "pwritev()", straight from the input file's data, rather than copying it first.
+                  Atoms with an extended (64-bit) size are now handled (rather than making us
+		  exit), and output files may be > 2 GBytes even where "long" is 32 bits.
+                  The video formats are now one table, giving each format's code, name, frame
+		  rate, and SPS/PPS(/VPS) NAL units (with their sizes, rather than a 0xfe
+		  terminator).  This also fixes 'type 5' '.h264' output, which had some stray
+		  bytes after the PPS.
+                  "--probe" just reports which type of repair each file needs (and where its
+		  data begins, and its video format), searching only the first 64 MBytes of
+		  each file; "djifix_probe()" does the same.  Skipping garbage at the start
+		  of a file is also faster.
+                  "--cache" remembers each repair ("<file>.djifix-cache"), so that a file isn't
+		  repaired again if neither it nor its repaired file has changed since.
+                  "--resume" saves a checkpoint every 256 MBytes of a 'type 3', 'type 4', or
+		  'type 5' repair (into a '.h264' file), so that an interrupted repair can
+		  continue from there.
+                  The output of a serial repair is now written 'behind' it, by up to
+		  "--queue-depth" (default 4) threads, while the input is read ahead.
+                  "--max-memory" (and "djifix_set_max_memory()") limits the memory that each
+		  repair uses for what grows with the size of the file.
+                  Scans for data now jump over the 'holes' of a sparse input file (asking
+		  the file system where they are), and over long runs of 0x00 or 0xFF bytes
+		  at the start of a file.
+                  A 'type 3' or 'type 5' repair no longer ends at an anomalous NAL unit size;
+		  like a 'type 4' repair, it skips over the anomalous bytes, and continues
+		  where video data resumes.  "--stop-on-anomaly" (and
+		  "djifix_set_stop_on_anomaly()") ends it there instead, as before.
+                  "--range START-END" (seconds) and "--nals FIRST-LAST" (and
+		  "djifix_set_range()" and "djifix_set_nal_range()") write just that part
+		  of the video, beginning at the IDR (or IRAP) picture before it.
+                  Building with "-DCPU_DISPATCH" ("make multiarch", or "make pgo", which also
+		  uses profile-guided optimization) adds AVX2 and AVX-512 versions of the
+		  vectorized scans, and uses the fastest that the CPU can run.
 */
 
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE /* for "copy_file_range()" */
+#endif
+#ifndef _FILE_OFFSET_BITS
+#define _FILE_OFFSET_BITS 64 /* so that (even on 32-bit systems) files can be > 4 GBytes */
+#endif
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <limits.h>
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <dirent.h>
+#define HAVE_MMAP 1
+#define HAVE_OPEN_MEMSTREAM 1
+#define HAVE_FSEEKO 1 /* for output files that are > 2 GBytes (when "long" is 32 bits) */
+#define HAVE_DIRENT 1 /* for repairing all of the video files in a directory */
+#define HAVE_CLOCK_GETTIME 1 /* for timing the phases of each repair ("--stats") */
+#define HAVE_FTRUNCATE 1 /* for resuming an interrupted repair ("--resume") */
+#ifndef CODE_COUNT
+#define HAVE_PTHREADS 1 /* for "-j" (but "CODE_COUNT"s counts are not thread-safe) */
+#endif
+#endif
+#if defined(__linux__) && defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 27))
+#define HAVE_COPY_FILE_RANGE 1
+#endif
+#if defined(__linux__) || defined(__FreeBSD__) || defined(__NetBSD__) || defined(__OpenBSD__)
+#define HAVE_PWRITEV 1 /* for writing the parts of a parallel ("-j") repair */
+#endif
+#ifdef DJIFIX_LIBRARY
+#include "djifix.h"
+#if defined(__GLIBC__)
+#define HAVE_FOPENCOOKIE 1 /* for writing the repaired file through a callback */
+#elif defined(__APPLE__) || defined(__FreeBSD__) || defined(__NetBSD__) || defined(__OpenBSD__)
+#define HAVE_FUNOPEN 1 /* ditto */
+#endif
+#endif
+#if defined(CPU_DISPATCH) && defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) \
+  && !defined(__AVX2__)
+#define HAVE_CPU_DISPATCH 1 /* also compile AVX2 and AVX-512 scans, and use them if the CPU can */
+#endif
+#if defined(__AVX2__) || defined(HAVE_CPU_DISPATCH)
+#include <immintrin.h>
+#endif
+#if defined(__AVX512BW__) || defined(HAVE_CPU_DISPATCH)
+#define HAVE_AVX512_SCANS 1
+#endif
+#if (defined(__AVX2__) && !defined(__AVX512BW__)) || defined(HAVE_CPU_DISPATCH)
+#define HAVE_AVX2_SCANS 1
+#endif
+#if (defined(__SSE2__) || defined(_M_X64)) && !defined(__AVX2__)
+#include <emmintrin.h>
+#define HAVE_SSE2 1
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
 
+#ifndef DJIFIX_LIBRARY
 static void usage(char const* progName) {
-  fprintf(stderr, "Usage: %s name-of-video-file-to-repair\n", progName);
+  fprintf(stderr, "Usage: %s [-m] [-o output-file] [--rules rules-file] [--stats report-file] [--progress] [--progress-fd fd] [--plan] [--cache] [--resume] [--probe] [-f video-format] [-p number-of-slices] [-j number-of-threads] [-P number-of-files] [--queue-depth n] [--max-memory MBytes] [--stop-on-anomaly] [--range START-END] [--nals FIRST-LAST] [-L list-file] name-of-video-file-or-directory-to-repair ...\n", progName);
+  fprintf(stderr, "\t-m: Write the repaired video as a '.mp4' file, even for repairs that would otherwise produce a\n");
+  fprintf(stderr, "\t\t'.h264' file (so that it doesn't need to be converted to '.mp4' afterwards).\n");
+  fprintf(stderr, "\t-o output-file: The name of the repaired file (when repairing a single file), instead of\n");
+  fprintf(stderr, "\t\tone made from the name of the file to repair.  \"-\" means 'stdout'.\n");
+  fprintf(stderr, "\t--rules rules-file: Also skip the blocks of non-video data (in 'type 3' and 'type 5' files)\n");
+  fprintf(stderr, "\t\tdescribed in \"rules-file\": one per line, as \"mask value base [shift field-mask]\"\n");
+  fprintf(stderr, "\t\t(a block begins with 4 bytes \"n\" for which (n&mask) == value, and its size is\n");
+  fprintf(stderr, "\t\tbase + ((n>>shift)&field-mask)).\n");
+  fprintf(stderr, "\t--stats report-file: When done, write a report (in JSON) of what each repair did, and how long\n");
+  fprintf(stderr, "\t\teach part of it took, to \"report-file\" (\"-\" means 'stdout').\n");
+  fprintf(stderr, "\t--progress: While repairing, print (every few seconds) how much of the file has been read, how\n");
+  fprintf(stderr, "\t\tfast, and about how long the rest will take.\n");
+  fprintf(stderr, "\t--progress-fd fd: While repairing, write the same (about once a second) to file descriptor\n");
+  fprintf(stderr, "\t\t\"fd\", as one line of JSON per update: \"file\", \"offset\", \"size\", \"mb_per_second\",\n");
+  fprintf(stderr, "\t\t\"eta_seconds\", and \"done\" (true for the last update of each repair).\n");
+  fprintf(stderr, "\t--plan: Keep a 'repair plan' for each file (in \"<file>.djifix-plan\"): where its NAL units are.\n");
+  fprintf(stderr, "\t\tWhen the file is repaired again (e.g., with another video format), the NAL units are\n");
+  fprintf(stderr, "\t\tjust copied from where the plan says, without parsing the file.\n");
+  fprintf(stderr, "\t--cache: Remember each repair (in \"<file>.djifix-cache\"), so that if neither the file nor its\n");
+  fprintf(stderr, "\t\trepaired file has changed since, and the same options are given, it isn't repaired again.\n");
+  fprintf(stderr, "\t--resume: While repairing a 'type 3', 'type 4', or 'type 5' file into a '.h264' file, save a\n");
+  fprintf(stderr, "\t\tcheckpoint (in \"<repaired file>.djifix-checkpoint\") every 256 MBytes.  If the repair is\n");
+  fprintf(stderr, "\t\tinterrupted, repairing the file again with \"--resume\" continues from the last checkpoint.\n");
+  fprintf(stderr, "\t--probe: Don't repair the files; just report (on 'stdout', one line per file) which type of repair\n");
+  fprintf(stderr, "\t\teach needs, where its data begins, and (if it can be detected) its video format.  Only the\n");
+  fprintf(stderr, "\t\tfirst 64 MBytes of each file are searched for the start of the data.\n");
+  fprintf(stderr, "\t-f video-format: The video format to use (for the files named after it), if it needs to be\n");
+  fprintf(stderr, "\t\tknown, instead of prompting for it.  This is either a letter or digit from the prompt's list,\n");
+  fprintf(stderr, "\t\tor a name from the list printed by \"%s -l\" (e.g., \"h265-2160p60\").  Either may be\n", progName);
+  fprintf(stderr, "\t\tpreceded by \"type2:\", \"type3:\", or \"type5:\", to use it only for that type of repair\n");
+  fprintf(stderr, "\t\t(e.g., \"-f type3:j -f type5:h265-2160p60\").  \"-f auto\" detects the video format from the\n");
+  fprintf(stderr, "\t\tvideo data itself (and prompts for it only if no format fits).\n");
+  fprintf(stderr, "\t-l: List the names of the video formats that \"-f\" accepts.\n");
+  fprintf(stderr, "\t-p number-of-slices: Before repairing, do a trial repair (in memory) of this many video slices\n");
+  fprintf(stderr, "\t\twith each video format, and report which formats give consistent video.  With \"-f auto\",\n");
+  fprintf(stderr, "\t\tthe best of these is used.\n");
+  fprintf(stderr, "\t-j number-of-threads: Repair (the video data of) each 'type 3', 'type 4', or 'type 5' file using\n");
+  fprintf(stderr, "\t\tthis many threads.  (The repaired file is the same as when using just one thread.)\n");
+  fprintf(stderr, "\t-P number-of-files: Repair this many files at the same time (largest first).\n");
+  fprintf(stderr, "\t--queue-depth n: While a file is repaired (by one thread), write up to this many 4-MByte blocks\n");
+  fprintf(stderr, "\t\tof the repaired file at the same time, while the rest of the file is read (ahead) and\n");
+  fprintf(stderr, "\t\tparsed (default: 4; at most 64).  0 means write the repaired file as we go.\n");
+  fprintf(stderr, "\t--max-memory MBytes: Limit the memory that each repair uses for what grows with the size of\n");
+  fprintf(stderr, "\t\tthe file (at least 32; default: no limit).  Any part of a \"-j\" repair that would need more\n");
+  fprintf(stderr, "\t\tis done by one thread; a repair whose \"-m\" file's index would need more fails.\n");
+  fprintf(stderr, "\t--stop-on-anomaly: End a 'type 3' or 'type 5' repair at the first anomalous NAL unit size,\n");
+  fprintf(stderr, "\t\tinstead of skipping over the anomalous bytes, and continuing where video data resumes.\n");
+  fprintf(stderr, "\t--range START-END: For a 'type 2'-'type 5' repair, write only the part of the video from START\n");
+  fprintf(stderr, "\t\tto END seconds (e.g., \"90-105.5\"; \"90-\" means 'to the end'), beginning at the IDR (or,\n");
+  fprintf(stderr, "\t\tfor H.265, IRAP) picture before it, so that it can be played.  (The frame rate is the video\n");
+  fprintf(stderr, "\t\tformat's; for a 'type 4' repair, 30 fps.)  The file can't be \"-\" ('stdin').\n");
+  fprintf(stderr, "\t--nals FIRST-LAST: The same, but for NAL units FIRST to LAST (numbered from 0, after the\n");
+  fprintf(stderr, "\t\tparameter sets at the start of the repaired file; \"FIRST-\" means 'to the end').\n");
+  fprintf(stderr, "\t-L list-file: Repair each of the files (or directories) named in \"list-file\", one per line.\n");
+  fprintf(stderr, "\tA directory is replaced by the \".MP4\" and \".MOV\" files in it (and its subdirectories).\n");
+  fprintf(stderr, "\tThe file to repair may be \"-\", to read it from 'stdin' (which need not be seekable) as we\n");
+  fprintf(stderr, "\t\tgo; the repaired file is then written to 'stdout' (unless \"-o\" is used).  The video\n");
+  fprintf(stderr, "\t\tformat is then never prompted for (so use \"-f\", if it's needed).\n");
 }
+#endif
 
 static int checkFor0x00000002(unsigned first4Bytes, unsigned next4Bytes) {
   /* We check not just that "first4Bytes" is 0x00000002, but also that "next4Bytes" starts
@@ -240,52 +445,1205 @@ static int checkForVideoType4(unsigned first4Bytes, unsigned next4Bytes) {
 #define fourcc_moov (('m'<<24)|('o'<<16)|('o'<<8)|'v')
 #define fourcc_wide (('w'<<24)|('i'<<16)|('d'<<8)|'e')
 
-static int get1Byte(FILE* fid, unsigned char* result); /* forward */
-static int get2Bytes(FILE* fid, unsigned* result); /* forward */
-static int get4Bytes(FILE* fid, unsigned* result); /* forward */
-static int checkAtom(FILE* fid, unsigned fourccToCheck, unsigned* numRemainingBytesToSkip); /* forward */
-static void doRepairType1(FILE* inputFID, FILE* outputFID, unsigned ftypSize); /* forward */
-static void doRepairType2(FILE* inputFID, FILE* outputFID, unsigned second4Bytes); /* forward */
-static void doRepairType3(FILE* inputFID, FILE* outputFID); /* forward */
-static void doRepairType4(FILE* inputFID, FILE* outputFID); /* forward */
-static void doRepairType5(FILE* inputFID, FILE* outputFID); /* forward */
-static void doRepairType3or5Common(FILE* inputFID, FILE* outputFID); /* forward */
-
-static char const* versionStr = "2024-09-06";
+/* A limit on the memory that a repair uses for the things that grow with the size of the file
+   ("--max-memory"): the input file's data (if it can't be mapped, or is a stream), the index
+   of NAL units kept by a parallel walk, or by the writer threads of a serial walk, and the
+   index of an MP4 file, or of a repair plan.  Whatever needs more memory than is left either
+   does without (e.g., a parallel walk is done serially instead), or fails (and says so): */
+typedef struct MemoryBudget {
+  unsigned long limit; /* in bytes; 0 means 'no limit' */
+  unsigned long used;
+} MemoryBudget;
+
+#define MIN_MAX_MEMORY 32 /* MBytes (as "usage()" says): enough for a stream's window */
+
+/* The input file is accessed as a single span of bytes - memory-mapped if possible, or else
+   read into memory - that we parse by moving a cursor ("pos") over it.
+   However, input that's read from a pipe ("-", for "stdin") is read as we go, into a bounded
+   window that holds only the part of the input near the cursor (see "fillInput()"): */
+typedef struct InputFile {
+  unsigned char const* data; /* "data[0]" is the byte at position "dataStart" */
+  unsigned long dataStart; /* always 0, except when reading a stream */
+  unsigned long size; /* the position just after the last byte that we have */
+  unsigned long pos; /* can be > "size", after seeking past the end (as with "fseek()") */
+  int atEOF; /* set by a read past the end; cleared by a seek (i.e., like "feof()") */
+  int fd; /* if >= 0, the (still open) file descriptor for the input file */
+  int isMapped;
+  int holesFD; /* if >= 0, a file descriptor for the (sparse) input file, that we ask where its holes are */
+  unsigned long holesCheckedFrom, holeStart, holeEnd; /* the first hole at or after "holesCheckedFrom" (~0UL if none) */
+  FILE* stream; /* if non-NULL, the stream that we read the input from, as we go */
+  unsigned long windowSize; /* (if not mapped) the size of the "malloc()"ed buffer at "data" */
+  MemoryBudget* memory; /* if non-NULL, what "windowSize" is taken from */
+  int streamEnded; /* (for a stream) we've read all of it, so "size" is its final size */
+  int streamFailed; /* (for a stream) it ended early, because of a read error, or lack of memory */
+  void (*onRefill)(void* opaque, unsigned long position); /* if non-NULL, called after each read from "stream" */
+  void* refillOpaque;
+  unsigned long scanLimit; /* our scans for the start of the data to repair stop here ("--probe"); normally ~0UL */
+} InputFile;
+
+typedef struct Mp4Writer Mp4Writer; /* for writing an MP4 file ("-m") */
+typedef struct VideoFormat VideoFormat; /* one of our video formats (see "videoFormats[]") */
+
+/* A rule for recognizing a block of non-video data in a 'type 3' or 'type 5' file (see
+   "findBlockRule()"), and the table of all of them, indexed by the first byte of the block: */
+typedef struct MetadataBlockRule {
+  unsigned mask, value;
+  unsigned nextMask, nextValue; /* for the 4 bytes after the 'NAL size' (nextMask 0 means 'any') */
+  int action; /* one of the "BLOCK_..." values */
+  unsigned base, shift, fieldMask; /* the block size, for "BLOCK_SKIP" (and "BLOCK_SKIP_PRINTABLE") */
+} MetadataBlockRule;
+
+#define MAX_BLOCK_RULES 256
+
+typedef struct MetadataRuleTable {
+  MetadataBlockRule rules[MAX_BLOCK_RULES];
+  unsigned numRules;
+  unsigned firstRule[257]; /* the rules beginning with byte "b" are rules[firstRule[b]..firstRule[b+1]-1] */
+} MetadataRuleTable;
+
+/* A part of the video to extract, rather than all of it ("--range" or "--nals"): */
+#define SEGMENT_BY_TIME 1
+#define SEGMENT_BY_NAL_UNITS 2
+
+typedef struct SegmentRange {
+  int kind; /* 0 (all of the video), or one of the "SEGMENT_BY_..." values */
+  double start, end; /* (SEGMENT_BY_TIME) in seconds; "end" < 0 means 'to the end' */
+  unsigned long first, last; /* (SEGMENT_BY_NAL_UNITS) numbered from 0, not counting the parameter
+				sets at the start of the repaired file; "last" ~0 means 'to the end' */
+} SegmentRange;
+
+/* The options that apply to every file that we repair: */
+typedef struct RepairOptions {
+  unsigned numProbeSlices; /* if nonzero, do trial repairs of this many slices ("-p") */
+  unsigned numThreads; /* the number of threads to use for each repair ("-j") */
+  int writeMP4; /* for 'type 2'-'type 5' repairs, write a '.mp4' file, rather than '.h264' ("-m") */
+  MetadataRuleTable const* metadataRules; /* (including any from "--rules") */
+  int showProgress; /* print the progress of each repair, from time to time ("--progress") */
+  FILE* progressFID; /* if non-NULL, where we write updates on the progress of each repair ("--progress-fd") */
+  int usePlan; /* keep a 'repair plan' for each file, and use it when repairing the file again ("--plan") */
+  int probeOnly; /* just find which type of repair each file needs, without repairing it ("--probe") */
+  int useCache; /* don't repair a file again if neither it nor its repaired file has changed ("--cache") */
+  int resume; /* save checkpoints while repairing, and continue an interrupted repair from one ("--resume") */
+  unsigned queueDepth; /* the number of blocks of output written 'behind' a serial walk; 0 means none ("--queue-depth") */
+  unsigned long maxMemory; /* the limit for each repair's "MemoryBudget" (in bytes); 0 means none ("--max-memory") */
+  int stopOnAnomaly; /* end a 'type 3' or 'type 5' repair at an anomalous NAL size ("--stop-on-anomaly") */
+  SegmentRange segmentRange; /* write only this part of the video ("--range" or "--nals") */
+} RepairOptions;
+
+#define DEFAULT_QUEUE_DEPTH 4 /* (as "usage()" says) */
+#define MAX_QUEUE_DEPTH 64
+
+/* What a repair did, and how long each part of it took, for the report made by "--stats": */
+#define PHASE_HEADER_SCAN 0 /* checking the start of the file (to see which type of repair it needs) */
+#define PHASE_JPEG_SKIP 1 /* skipping past the JPEG previews of a 'type 3' file */
+#define PHASE_FORMAT_DETECTION 2 /* finding the video format (by detecting it, or prompting for it) */
+#define PHASE_NAL_COPY 3 /* the repair itself: copying the NAL units (or, for 'type 1', the data) */
+#define NUM_REPAIR_PHASES 4
+
+#define MAX_RESYNC_EVENTS 100 /* we report the first this many */
+
+#define RESYNC_SKIPPING 1 /* an anomalous NAL size, which the repair skipped over */
+#define RESYNC_RESUMING 2 /* where the repair found video again */
+#define RESYNC_ENDED 3 /* an anomalous NAL size that ended the repair */
+
+typedef struct ResyncEvent {
+  int kind; /* one of the "RESYNC_..." values */
+  unsigned long position;
+  unsigned nalSize;
+} ResyncEvent;
+
+typedef struct RepairStats {
+  double startTime;
+  int phase; /* the phase that we're in now (-1 if none) ... */
+  double phaseStartTime; /* ... and when it began */
+  double phaseTimes[NUM_REPAIR_PHASES]; /* seconds */
+  double totalTime;
+  unsigned long inputSize, numBytesRead; /* (how far through the input file the repair got) */
+  long long numBytesWritten; /* -1 if we don't know it (for a pipe) */
+  unsigned long numNALUnits;
+  unsigned long nalHeaderCounts[256]; /* by the first byte of each NAL unit */
+  int firstNALHeader[2]; /* the first 2 bytes of the first NAL unit (to tell H.264 from H.265) */
+  unsigned long blockCounts[MAX_BLOCK_RULES], blockBytes[MAX_BLOCK_RULES]; /* by metadata rule */
+  ResyncEvent resyncEvents[MAX_RESYNC_EVENTS];
+  unsigned numResyncEvents; /* (of which we keep at most "MAX_RESYNC_EVENTS") */
+} RepairStats;
+
+/* Reporting the progress of a repair ("--progress" and "--progress-fd").  So that this costs
+   (almost) nothing, we look at the time only when the input position has moved another
+   "PROGRESS_CHECK_SIZE" bytes: */
+#define PROGRESS_CHECK_SIZE (4*1024*1024)
+#define PROGRESS_SHOW_INTERVAL 5.0 /* seconds between the progress messages that we print */
+#define PROGRESS_WRITE_INTERVAL 1.0 /* seconds between the updates that we write to "--progress-fd" */
+
+typedef struct ProgressState {
+  int showProgress; /* "--progress" */
+  FILE* fid; /* "--progress-fd" (if non-NULL) */
+  char const* fileName; /* (for "--progress-fd") */
+  unsigned long startPosition; /* where the repair itself began */
+  unsigned long nextCheckPosition; /* ~0UL if we're not reporting progress */
+  double startTime, lastShownTime, lastWrittenTime;
+} ProgressState;
+
+/* A 'repair plan' ("--plan"): what the repair of a 'type 2'-'type 5' file found - where each of
+   the NAL units that it copied is, the blocks of non-video data that it skipped, and what it
+   told the user - kept in a file ("<input file name>.djifix-plan"), so that the file can be
+   repaired again (e.g., with another video format) just by copying those NAL units, without
+   parsing it.  (The NAL units don't depend on the video format; only the SPS, PPS (and VPS)
+   NAL units that we write before them do.) */
+#define PLAN_ITEM_NAL_UNIT (-1) /* otherwise, the "kind" of an item is the index of the rule that
+				   matched a block of non-video data */
+
+typedef struct PlanItem {
+  unsigned long offset; /* (for a NAL unit, the position after its 4-byte size) */
+  unsigned long size;
+  int kind;
+} PlanItem;
+
+typedef struct PlanEvent {
+  int kind; /* one of the "WALK_EVENT_..." values */
+  unsigned long position;
+  unsigned nalSize;
+} PlanEvent;
+
+typedef struct RepairPlan {
+  /* Which file - and repair - the plan is for: */
+  unsigned long inputSize;
+  long long inputTime; /* when the input file was last modified */
+  int repairType;
+  unsigned second4Bytes; /* ('type 2' only) */
+  unsigned rulesDigest; /* of the rules for recognizing blocks of non-video data (and "--stop-on-anomaly") */
+  unsigned long startPosition; /* where the repair itself began */
+
+  /* What the repair found (in order of position): */
+  PlanItem* items;
+  unsigned numItems, maxNumItems;
+  PlanEvent* events;
+  unsigned numEvents, maxNumEvents;
+  MemoryBudget* memory; /* what "items" and "events" are taken from */
+  unsigned long endPosition; /* where the repair left the input file ... */
+  int endedAtEOF; /* ... and whether it had read past the end */
+  int metadataIsPrintable; /* (at the end) */
+  int outOfMemory;
+} RepairPlan;
+
+/* Everything that we need to know - and remember - while repairing one file.  (Because there's
+   no global state, several files can be repaired at the same time, each with its own context.) */
+typedef struct RepairContext {
+  InputFile input;
+  FILE* outputFID;
+  FILE* log; /* where we print messages about the repair: normally "stderr" */
+  int quiet; /* set during trial repairs, to suppress messages about the data */
+  int canPrompt; /* whether we may prompt for (and read) the video format, if we need it */
+
+  /* Options: */
+  int formatCodes[6]; /* indexed by repair type; 0 means 'prompt for it' */
+  unsigned numProbeSlices; /* if nonzero, do trial repairs of this many slices ("-p") */
+  unsigned numThreads; /* the number of threads to use for each repair ("-j") */
+  int writeMP4; /* for 'type 2'-'type 5' repairs, write a '.mp4' file, rather than '.h264' ("-m") */
+  MetadataRuleTable const* metadataRules;
+  char const* outputName; /* if non-NULL, the name of the repaired file ("-o"); "-" means 'stdout' */
+
+  /* What we've seen so far: */
+  unsigned printableMetadataCount;
+  int metadataIsPrintable;
+#ifdef CODE_COUNT
+  unsigned codeCount[65536];
+#endif
+
+  /* What we've found: */
+  int repairType;
+  unsigned repairType1FtypSize; /* used only for 'repair type 1' files */
+  unsigned repairType2Second4Bytes; /* used only for 'repair type 2' files */
+  int formatCode; /* the video format that the repair used ('type 2', 'type 3', and 'type 5' only) */
+
+  Mp4Writer* mp4; /* if non-NULL, we're writing the NAL units into an MP4 file */
+  RepairStats* stats; /* if non-NULL ("--stats"), we note here what the repair did */
+  ProgressState progress;
+  int usePlan; /* "--plan" */
+  int probeOnly; /* "--probe" */
+  int useCache; /* "--cache" */
+  int resume; /* "--resume" */
+  unsigned queueDepth; /* "--queue-depth" */
+  MemoryBudget memory; /* "--max-memory" */
+  int stopOnAnomaly; /* "--stop-on-anomaly" */
+  SegmentRange segmentRange; /* "--range" or "--nals" */
+  struct Extraction* extraction; /* if non-NULL ("--range" or "--nals"), we write only NAL units in the segment */
+  struct CheckpointState* checkpoints; /* if non-NULL ("--resume"), the walk saves checkpoints here */
+  RepairPlan* plan; /* if non-NULL ("--plan"), we note here what the repair finds */
+  RepairPlan* replayPlan; /* if non-NULL ("--plan"), we repair by copying the NAL units listed here */
+
+  /* The result: */
+  char* outputFileName; /* (if the repair succeeded) "malloc()"ed, and owned by the caller */
+  unsigned long outputSize;
+  int outputFailed; /* set if writing the repaired file (by another thread) failed */
+
+  /* If "log" is a memory buffer (when repairing several files at once), its contents: */
+  char* logBuffer;
+  size_t logSize;
+  size_t numLogBytesShown; /* how much of it we've already copied to "stderr" */
+#ifdef HAVE_PTHREADS
+  pthread_mutex_t* stderrMutex; /* if non-NULL, we hold this while printing to "stderr" (or prompting) */
+#endif
+} RepairContext;
+
+/* What "--probe" (or "djifix_probe()") found, looking at only the first "PROBE_WINDOW_SIZE" bytes
+   of a file for the start of the data to repair: */
+#define PROBE_WINDOW_SIZE (64*1000000UL) /* (as "usage()" says) */
+
+typedef struct ProbeResult {
+  int repairType; /* 0 if we can't repair the file */
+  unsigned long dataOffset; /* where the data that the repaired file is made from begins */
+  int formatCode; /* for 'type 2', 'type 3', and 'type 5' repairs: the video format (0 if not known) */
+} ProbeResult;
+
+/* One of the files named on the command line (or found in a directory, or list of files): */
+typedef struct RepairJob {
+  char* fileName;
+  int formatCodes[6]; /* from the "-f" options that preceded it */
+  char const* outputName; /* from "-o" (if non-NULL) */
+  unsigned long fileSize;
+  int repairIsOK;
+  int repairType;
+  char* outputFileName;
+  unsigned long outputSize;
+  RepairStats* stats; /* if non-NULL ("--stats"), what the repair did */
+  ProbeResult probe; /* ("--probe") */
+} RepairJob;
+
+static int openInputFile(InputFile* input, char const* fileName, MemoryBudget* memory); /* forward */
+#ifndef DJIFIX_LIBRARY
+static int openInputStream(InputFile* input, FILE* stream, MemoryBudget* memory); /* forward */
+#endif
+static int fillInput(InputFile* input, unsigned long endPosition); /* forward */
+static unsigned char const* inputAt(InputFile const* input, unsigned long position); /* forward */
+static void closeInputFile(InputFile* input); /* forward */
+static int seekInput(InputFile* input, long offset); /* forward */
+static int seekInputTo(InputFile* input, unsigned long position); /* forward */
+static int skipInput(InputFile* input, unsigned long numBytes); /* forward */
+static int get1Byte(InputFile* input, unsigned char* result); /* forward */
+static int get2Bytes(InputFile* input, unsigned* result); /* forward */
+static int get4Bytes(InputFile* input, unsigned* result); /* forward */
+static int peek4Bytes(InputFile* input, unsigned* result); /* forward */
+static unsigned bigEndian4(unsigned char const* p); /* forward */
+static int advanceToNalSizeCandidate(InputFile* input, unsigned windowSize); /* forward */
+static int advanceToFileStartCandidate(InputFile* input); /* forward */
+static void skipRepeatedWord(InputFile* input, unsigned word); /* forward */
+static int isPlausibleNAL(unsigned char b0, unsigned char b1); /* forward */
+static int nalSizeLooksOK(InputFile* input, unsigned long position); /* forward */
+static int skipJPEGPreviews(InputFile* input); /* forward */
+static int checkAtom(InputFile* input, unsigned fourccToCheck, unsigned long* numRemainingBytesToSkip); /* forward */
+static void copyBytes(InputFile* input, FILE* outputFID, unsigned numBytes); /* forward */
+static long long tellOutput(FILE* outputFID); /* forward */
+static int seekOutputTo(FILE* outputFID, long long position); /* forward */
+static void copyRemainingBytes(RepairContext* ctx); /* forward */
+static void initRepairContext(RepairContext* ctx, FILE* log, int const formatCodes[],
+			      RepairOptions const* options); /* forward */
+static int findRepairType(RepairContext* ctx); /* forward */
+static int repairWithType(RepairContext* ctx); /* forward */
+#ifdef HAVE_PTHREADS
+static void showRepairLog(RepairContext* ctx); /* forward */
+#endif
+static void writeJSONString(FILE* fid, char const* str); /* forward */
+#ifndef DJIFIX_LIBRARY
+static int repairFile(RepairContext* ctx, char const* inputFileName); /* forward */
+static int probeFile(RepairContext* ctx, char const* inputFileName, ProbeResult* result); /* forward */
+static char* beginRepairPlan(RepairContext* ctx, char const* inputFileName); /* forward */
+static void endRepairPlan(RepairContext* ctx, char* planFileName, int repairIsOK); /* forward */
+static int useCachedRepair(RepairContext* ctx, char const* inputFileName); /* forward */
+static void noteRepairInCache(RepairContext* ctx, char const* inputFileName, char const* outputFileName, int outputIsMP4); /* forward */
+static FILE* openCheckpointedOutput(RepairContext* ctx, char const* inputFileName,
+				   char const* outputFileName); /* forward */
+static int endCheckpoints(RepairContext* ctx, int removeFile); /* forward */
+#ifdef HAVE_PTHREADS
+static int repairJobsInParallel(RepairJob jobs[], unsigned numJobs, RepairOptions const* options,
+				unsigned numWorkers); /* forward */
+#endif
+static int addRepairJobs(RepairJob** jobs, unsigned* numJobs, char const* name, int const formatCodes[],
+			 int isListFile); /* forward */
+static void repairJobs(RepairJob jobs[], unsigned numJobs, RepairOptions const* options,
+		       unsigned numWorkers); /* forward */
+static void listFormatNames(void); /* forward */
+static void printProbeResult(FILE* fid, RepairJob const* job); /* forward */
+static void writeStatsReport(FILE* fid, RepairJob const jobs[], unsigned numJobs,
+			     MetadataRuleTable const* metadataRules); /* forward */
+static int loadMetadataRules(MetadataRuleTable* table, char const* fileName); /* forward */
+static int parseSegmentRange(char const* spec, int kind, SegmentRange* range); /* forward */
+static int parseNumberOption(char const* arg, unsigned long min, unsigned long max, unsigned long* value); /* forward */
+#endif
+static void initMetadataRuleTable(MetadataRuleTable* table); /* forward */
+static int parseFormatOption(char const* option, int formatCodes[]); /* forward */
+static int sameNameIgnoringCase(char const* name1, char const* name2); /* forward */
+static int takeMemory(MemoryBudget* budget, unsigned long numBytes); /* forward */
+static void giveBackMemory(MemoryBudget* budget, unsigned long numBytes); /* forward */
+static int growArray(MemoryBudget* budget, void** array, unsigned* maxNumElements, size_t elementSize); /* forward */
+static int beginExtraction(RepairContext* ctx); /* forward */
+static void endExtraction(RepairContext* ctx, int repairIsOK); /* forward */
+static int extractionIsDone(RepairContext const* ctx); /* forward */
+static void copyNALUnit(RepairContext* ctx, unsigned nalSize); /* forward */
+static int canPromptForFormatCode(RepairContext* ctx); /* forward */
+static int readFormatCode(RepairContext* ctx, char const* validCodes); /* forward */
+static void doRepairType1(RepairContext* ctx, unsigned ftypSize); /* forward */
+static int doRepairType2(RepairContext* ctx, unsigned second4Bytes, int formatCode); /* forward */
+static void repairType2WithFormat(RepairContext* ctx, unsigned second4Bytes, int formatCode); /* forward */
+static int doRepairType3(RepairContext* ctx, int formatCode); /* forward */
+static void repairType3WithFormat(RepairContext* ctx, int formatCode); /* forward */
+static void doRepairType4(RepairContext* ctx); /* forward */
+static int doRepairType5(RepairContext* ctx, int formatCode); /* forward */
+static void repairType5WithFormat(RepairContext* ctx, int formatCode); /* forward */
+static void doRepairType3or5Common(RepairContext* ctx); /* forward */
+static int detectFormatCode(RepairContext* ctx, int repairType, unsigned long videoPosition); /* forward */
+static int probeFormatCode(RepairContext* ctx, int repairType, unsigned second4Bytes); /* forward */
+static void addMp4NALUnit(Mp4Writer* mp4, unsigned char const* nal, unsigned long numAvailable,
+			  unsigned nalSize); /* forward */
+static void noteMp4Format(RepairContext* ctx, VideoFormat const* format); /* forward */
+#ifndef DJIFIX_LIBRARY
+static int beginMp4File(RepairContext* ctx); /* forward */
+static int endMp4File(RepairContext* ctx); /* forward */
+#endif
+
+#define AUTO_FORMAT_CODE '?' /* for "-f auto": detect the video format from the data */
+
+static char const* versionStr = "2026-10-14";
+#ifndef DJIFIX_LIBRARY
 static char const* repairedFilenameStr = "-repaired";
+#endif
 static char const* startingToRepair = "Repairing the file (please wait)...";
 static char const* cantRepair = "  We cannot repair this file!";
 
-#ifdef CODE_COUNT
-unsigned codeCount[65536];
-#endif
+#define MAX_REPAIR_THREADS 256 /* for "-j" and "-P" */
+
+#ifndef DJIFIX_LIBRARY
 int main(int argc, char** argv) {
-  char* inputFileName;
-  char* outputFileName;
-  FILE* inputFID;
-  FILE* outputFID;
-  unsigned numBytesToSkip, dummy;
-  int repairType = 1; /* by default */
-  unsigned repairType1FtypSize; /* used only for 'repair type 1' files */
-  unsigned repairType2Second4Bytes; /* used only for 'repair type 2' files */
+  int formatCodes[6] = { 0 }; /* indexed by repair type; 0 means 'prompt for it' */
+  RepairOptions options;
+  static MetadataRuleTable metadataRules;
+  unsigned numWorkers = 1; /* the number of files to repair at the same time ("-P") */
+  char const* outputName = NULL; /* "-o" */
+  char const* rulesFileName = NULL; /* "--rules" */
+  char const* statsFileName = NULL; /* "--stats" */
+  RepairJob* jobs = NULL;
+  unsigned numJobs = 0, numRepaired = 0, j;
+  int numFiles = 0, statsAreOK = 1;
+  int i;
+
+  fprintf(stderr, "%s, version %s; Copyright (c) 2014-2024 Live Networks, Inc. All rights reserved.\n", argv[0], versionStr);
+  fprintf(stderr, "The latest version of this software is available at https://djifix.live555.com/\n\n");
+
+  memset(&options, 0, sizeof options);
+  options.numThreads = 1;
+  options.metadataRules = &metadataRules;
+  options.queueDepth = DEFAULT_QUEUE_DEPTH;
+
+  /* First, check the command line, so that we don't begin repairing files if it's bad: */
+  for (i = 1; i < argc; ++i) {
+    if (strcmp(argv[i], "-l") == 0) {
+      listFormatNames();
+      return 0;
+    } else if (strcmp(argv[i], "-m") == 0) {
+      options.writeMP4 = 1;
+    } else if (strcmp(argv[i], "--rules") == 0) {
+      if (++i == argc) {
+	usage(argv[0]);
+	return 1;
+      }
+      rulesFileName = argv[i];
+    } else if (strcmp(argv[i], "--stats") == 0) {
+      if (++i == argc) {
+	usage(argv[0]);
+	return 1;
+      }
+      statsFileName = argv[i];
+    } else if (strcmp(argv[i], "--progress") == 0) {
+      options.showProgress = 1;
+    } else if (strcmp(argv[i], "--plan") == 0) {
+      options.usePlan = 1;
+    } else if (strcmp(argv[i], "--probe") == 0) {
+      options.probeOnly = 1;
+    } else if (strcmp(argv[i], "--cache") == 0) {
+      options.useCache = 1;
+    } else if (strcmp(argv[i], "--resume") == 0) {
+      options.resume = 1;
+    } else if (strcmp(argv[i], "--stop-on-anomaly") == 0) {
+      options.stopOnAnomaly = 1;
+    } else if (strcmp(argv[i], "--range") == 0 || strcmp(argv[i], "--nals") == 0) {
+      int const kind = strcmp(argv[i], "--range") == 0 ? SEGMENT_BY_TIME : SEGMENT_BY_NAL_UNITS;
+
+      if (++i == argc || !parseSegmentRange(argv[i], kind, &options.segmentRange)) {
+	usage(argv[0]);
+	return 1;
+      }
+    } else if (strcmp(argv[i], "--progress-fd") == 0) {
+      unsigned long number;
+      int fd;
 
-  do {
-    fprintf(stderr, "%s, version %s; Copyright (c) 2014-2024 Live Networks, Inc. All rights reserved.\n", argv[0], versionStr);
-    fprintf(stderr, "The latest version of this software is available at https://djifix.live555.com/\n\n");
+      if (++i == argc || !parseNumberOption(argv[i], 0, INT_MAX, &number)) {
+	usage(argv[0]);
+	return 1;
+      }
+      fd = (int)number;
+      options.progressFID = fd == 1 ? stdout : fd == 2 ? stderr : fdopen(fd, "w");
+      if (options.progressFID == NULL) {
+	fprintf(stderr, "Can't write to file descriptor %d (for \"--progress-fd\"): %s\n", fd, strerror(errno));
+	return 1;
+      }
+    } else if (strcmp(argv[i], "-o") == 0) {
+      if (++i == argc) {
+	usage(argv[0]);
+	return 1;
+      }
+      outputName = argv[i];
+    } else if (strcmp(argv[i], "-f") == 0) {
+      if (++i == argc || !parseFormatOption(argv[i], formatCodes)) {
+	if (i < argc) fprintf(stderr, "Unknown video format \"%s\"\n", argv[i]);
+	usage(argv[0]);
+	return 1;
+      }
+    } else if (strcmp(argv[i], "-p") == 0) {
+      unsigned long numProbeSlices;
 
-    if (argc != 2) {
-      usage(argv[0]);
-      break;
+      if (++i == argc || !parseNumberOption(argv[i], 1, UINT_MAX, &numProbeSlices)) {
+	usage(argv[0]);
+	return 1;
+      }
+      options.numProbeSlices = (unsigned)numProbeSlices;
+    } else if (strcmp(argv[i], "-j") == 0) {
+      unsigned long numThreads;
+
+      if (++i == argc || !parseNumberOption(argv[i], 1, MAX_REPAIR_THREADS, &numThreads)) {
+	usage(argv[0]);
+	return 1;
+      }
+      options.numThreads = (unsigned)numThreads;
+    } else if (strcmp(argv[i], "-P") == 0) {
+      unsigned long number;
+
+      if (++i == argc || !parseNumberOption(argv[i], 1, MAX_REPAIR_THREADS, &number)) {
+	usage(argv[0]);
+	return 1;
+      }
+      numWorkers = (unsigned)number;
+    } else if (strcmp(argv[i], "--queue-depth") == 0) {
+      unsigned long queueDepth;
+
+      if (++i == argc || !parseNumberOption(argv[i], 0, MAX_QUEUE_DEPTH, &queueDepth)) {
+	usage(argv[0]);
+	return 1;
+      }
+      options.queueDepth = (unsigned)queueDepth;
+    } else if (strcmp(argv[i], "--max-memory") == 0) {
+      unsigned long maxMemory;
+
+      if (++i == argc || !parseNumberOption(argv[i], 0, ~0UL/(1024*1024), &maxMemory)
+	  || (maxMemory != 0 && maxMemory < MIN_MAX_MEMORY)) {
+	usage(argv[0]);
+	return 1;
+      }
+      options.maxMemory = maxMemory*1024*1024;
+    } else if (strcmp(argv[i], "-L") == 0) {
+      if (++i == argc) {
+	usage(argv[0]);
+	return 1;
+      }
+      ++numFiles;
+    } else {
+      ++numFiles;
+    }
+  }
+  if (numFiles == 0) {
+    usage(argv[0]);
+    return 1;
+  }
+#ifndef HAVE_PTHREADS
+  if (options.numThreads > 1) fprintf(stderr, "(This version of the software was built without threads, so \"-j\" is ignored.)\n");
+  if (numWorkers > 1) fprintf(stderr, "(This version of the software was built without threads, so \"-P\" is ignored.)\n");
+#endif
+
+  /* Then make the table of rules for recognizing non-video data (with any from "--rules"): */
+  initMetadataRuleTable(&metadataRules);
+  if (rulesFileName != NULL && !loadMetadataRules(&metadataRules, rulesFileName)) return 1;
+
+  /* Then make a list of the files to repair (expanding directories, and lists of files), each
+     with the "-f" options (if any) that preceded it: */
+  memset(formatCodes, 0, sizeof formatCodes);
+  for (i = 1; i < argc; ++i) {
+    if (strcmp(argv[i], "-f") == 0) {
+      parseFormatOption(argv[++i], formatCodes);
+    } else if (strcmp(argv[i], "-m") == 0 || strcmp(argv[i], "--progress") == 0
+	       || strcmp(argv[i], "--plan") == 0 || strcmp(argv[i], "--probe") == 0
+	       || strcmp(argv[i], "--cache") == 0 || strcmp(argv[i], "--resume") == 0
+	       || strcmp(argv[i], "--stop-on-anomaly") == 0) {
+      /* already handled */
+    } else if (strcmp(argv[i], "-p") == 0 || strcmp(argv[i], "-j") == 0 || strcmp(argv[i], "-P") == 0
+	       || strcmp(argv[i], "-o") == 0 || strcmp(argv[i], "--rules") == 0
+	       || strcmp(argv[i], "--stats") == 0 || strcmp(argv[i], "--progress-fd") == 0
+	       || strcmp(argv[i], "--queue-depth") == 0 || strcmp(argv[i], "--max-memory") == 0
+	       || strcmp(argv[i], "--range") == 0 || strcmp(argv[i], "--nals") == 0) {
+      ++i; /* already handled */
+    } else {
+      int isListFile = strcmp(argv[i], "-L") == 0;
+
+      if (isListFile) ++i;
+      if (!addRepairJobs(&jobs, &numJobs, argv[i], formatCodes, isListFile)) return 1;
     }
-    inputFileName = argv[1];
+  }
+  if (numJobs == 0) {
+    fprintf(stderr, "No video files were found to repair.\n");
+    return 1;
+  }
+  if (numJobs > 1) {
+    if (outputName != NULL) {
+      fprintf(stderr, "\"-o\" can be used only when repairing a single file.\n");
+      return 1;
+    }
+    for (j = 0; j < numJobs; ++j) {
+      if (strcmp(jobs[j].fileName, "-") == 0) {
+	fprintf(stderr, "\"-\" ('stdin') can be used only as the single file to repair.\n");
+	return 1;
+      }
+    }
+  }
+  jobs[0].outputName = outputName;
+  if (options.segmentRange.kind != 0 && strcmp(jobs[0].fileName, "-") == 0) {
+    /* (We'd need to go back, to the IDR (or IRAP) picture before the segment) */
+    fprintf(stderr, "\"--range\" and \"--nals\" can't be used when reading 'stdin'.\n");
+    return 1;
+  }
+  if (options.progressFID == stdout
+      && (outputName != NULL ? strcmp(outputName, "-") == 0 : strcmp(jobs[0].fileName, "-") == 0)) {
+    fprintf(stderr, "\"--progress-fd 1\" can't be used when the repaired file is written to 'stdout'.\n");
+    return 1;
+  }
+  if (statsFileName != NULL) {
+    if (options.probeOnly) {
+      fprintf(stderr, "\"--stats\" can't be used with \"--probe\".\n");
+      return 1;
+    }
+    if (strcmp(statsFileName, "-") == 0
+	&& (outputName != NULL ? strcmp(outputName, "-") == 0 : strcmp(jobs[0].fileName, "-") == 0)) {
+      fprintf(stderr, "\"--stats -\" can't be used when the repaired file is written to 'stdout'.\n");
+      return 1;
+    }
+    for (j = 0; j < numJobs; ++j) {
+      jobs[j].stats = malloc(sizeof *jobs[j].stats);
+      if (jobs[j].stats == NULL) {
+	fprintf(stderr, "Out of memory!\n");
+	return 1;
+      }
+    }
+  }
+
+  /* Then repair the files: */
+  repairJobs(jobs, numJobs, &options, numWorkers);
+
+  for (j = 0; j < numJobs; ++j) {
+    if (jobs[j].repairIsOK) ++numRepaired;
+  }
+  if (options.probeOnly) {
+    /* Report what we found (in order), one line per file, on 'stdout': */
+    for (j = 0; j < numJobs; ++j) printProbeResult(stdout, &jobs[j]);
+  } else if (numJobs > 1) {
+    fprintf(stderr, "\nSummary:\n");
+    for (j = 0; j < numJobs; ++j) {
+      if (jobs[j].repairIsOK) {
+	fprintf(stderr, "\t%s: repaired ('type %d' repair) as \"%s\" (%lu bytes)\n",
+		jobs[j].fileName, jobs[j].repairType, jobs[j].outputFileName, jobs[j].outputSize);
+      } else {
+	fprintf(stderr, "\t%s: not repaired\n", jobs[j].fileName);
+      }
+    }
+    fprintf(stderr, "\nRepaired %u of %u files.\n", numRepaired, numJobs);
+  }
+  if (statsFileName != NULL) {
+    int const statsToStdout = strcmp(statsFileName, "-") == 0;
+    FILE* fid = statsToStdout ? stdout : fopen(statsFileName, "w");
+
+    if (fid == NULL) {
+      fprintf(stderr, "Failed to open \"%s\" for the \"--stats\" report: %s\n", statsFileName, strerror(errno));
+      statsAreOK = 0;
+    } else {
+      writeStatsReport(fid, jobs, numJobs, &metadataRules);
+      if (statsToStdout) fflush(fid); else fclose(fid);
+    }
+  }
+  for (j = 0; j < numJobs; ++j) {
+    free(jobs[j].fileName);
+    free(jobs[j].outputFileName);
+    free(jobs[j].stats);
+  }
+  free(jobs);
+  return numRepaired == numJobs && statsAreOK ? 0 : 1;
+}
+
+static int parseNumberOption(char const* arg, unsigned long min, unsigned long max, unsigned long* value) {
+  /* The (decimal) number given for a numeric option, which must be from "min" to "max".  Returns
+     0 if "arg" is anything else.  (Unlike "sscanf()", we reject a '-' sign - rather than
+     wrapping the number around - and anything after the number.) */
+  char* end;
+
+  if (*arg < '0' || *arg > '9') return 0;
+  errno = 0;
+  *value = strtoul(arg, &end, 10);
+  return *end == '\0' && errno == 0 && *value >= min && *value <= max;
+}
+
+static int parseSegmentRange(char const* spec, int kind, SegmentRange* range) {
+  /* "--range START-END" (in seconds) or "--nals FIRST-LAST", where the end may be omitted
+     (meaning 'to the end').  Returns 0 if "spec" is bad: */
+  char* end;
+
+  memset(range, 0, sizeof *range);
+  range->kind = kind;
+  if (kind == SEGMENT_BY_TIME) {
+    range->start = strtod(spec, &end);
+  } else {
+    range->first = strtoul(spec, &end, 10);
+  }
+  if (end == spec || *spec == '-' || *end != '-') return 0;
+  spec = end + 1;
+
+  if (*spec == '\0') {
+    range->end = -1;
+    range->last = ~0UL;
+  } else if (kind == SEGMENT_BY_TIME) {
+    range->end = strtod(spec, &end);
+    if (*end != '\0' || !(range->end > range->start)) return 0;
+  } else {
+    if (*spec == '-') return 0;
+    range->last = strtoul(spec, &end, 10);
+    if (*end != '\0' || range->last < range->first) return 0;
+  }
+  return range->start >= 0; /* (this also rejects "nan") */
+}
+
+static int addRepairJob(RepairJob** jobs, unsigned* numJobs, char const* fileName, int const formatCodes[],
+			unsigned long fileSize) {
+  RepairJob* newJobs = realloc(*jobs, (*numJobs + 1)*sizeof (*jobs)[0]);
+  RepairJob* job;
+
+  if (newJobs == NULL) return 0;
+  *jobs = newJobs;
+  job = &newJobs[*numJobs];
+  memset(job, 0, sizeof *job);
+  job->fileName = malloc(strlen(fileName) + 1);
+  if (job->fileName == NULL) return 0;
+  strcpy(job->fileName, fileName);
+  memcpy(job->formatCodes, formatCodes, sizeof job->formatCodes);
+  job->fileSize = fileSize;
+  ++*numJobs;
+  return 1;
+}
+
+#ifdef HAVE_DIRENT
+static int isVideoFileName(char const* name) {
+  /* Whether "name" looks like the name of a (not yet repaired) video file: a ".MP4" or ".MOV"
+     file (in either case): */
+  char const* dotPtr = strrchr(name, '.');
+
+  if (dotPtr == NULL || strstr(name, repairedFilenameStr) != NULL) return 0;
+  return sameNameIgnoringCase(dotPtr, ".mp4") || sameNameIgnoringCase(dotPtr, ".mov");
+}
 
-    /* Open the input file: */
-    inputFID  = fopen(inputFileName, "rb");
-    if (inputFID == NULL) {
-      perror("Failed to open file to repair");
+static int addDirectoryJobs(RepairJob** jobs, unsigned* numJobs, char const* dirName, int const formatCodes[]) {
+  /* Add the video files in the directory "dirName" (and - recursively - its subdirectories),
+     in order of name: */
+  DIR* dir = opendir(dirName);
+  struct dirent* entry;
+  char** names = NULL;
+  unsigned numNames = 0, maxNumNames = 0, i, j;
+  int result = 1;
+
+  if (dir == NULL) {
+    fprintf(stderr, "Failed to read directory \"%s\": %s\n", dirName, strerror(errno));
+    return 0;
+  }
+  while ((entry = readdir(dir)) != NULL) {
+    char* name;
+
+    if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
+    if (numNames == maxNumNames && !growArray(NULL, (void**)&names, &maxNumNames, sizeof names[0])) {
+      result = 0;
+      break;
+    }
+    name = malloc(strlen(dirName) + 1 + strlen(entry->d_name) + 1);
+    if (name == NULL) {
+      result = 0;
       break;
     }
+    sprintf(name, "%s/%s", dirName, entry->d_name);
+
+    /* Keep the names sorted: */
+    for (j = numNames; j > 0 && strcmp(names[j-1], name) > 0; --j) names[j] = names[j-1];
+    names[j] = name;
+    ++numNames;
+  }
+  closedir(dir);
+  if (!result) fprintf(stderr, "Out of memory while reading directory \"%s\"\n", dirName);
+
+  for (i = 0; i < numNames; ++i) {
+    struct stat sb;
+
+    if (result && stat(names[i], &sb) == 0) {
+      if (S_ISDIR(sb.st_mode)) {
+	result = addDirectoryJobs(jobs, numJobs, names[i], formatCodes);
+      } else if (S_ISREG(sb.st_mode) && isVideoFileName(names[i])) {
+	result = addRepairJob(jobs, numJobs, names[i], formatCodes, (unsigned long)sb.st_size);
+	if (!result) fprintf(stderr, "Out of memory while reading directory \"%s\"\n", dirName);
+      }
+    }
+    free(names[i]);
+  }
+  free(names);
+  return result;
+}
+#endif
+
+static int addRepairJobs(RepairJob** jobs, unsigned* numJobs, char const* name, int const formatCodes[],
+			 int isListFile) {
+  /* Add the file "name" to the list of files to repair - or, if it's a directory, the video
+     files in it - or (if "isListFile") each of the files (or directories) that it lists, one per
+     line.  Returns 0 on failure: */
+  if (isListFile) {
+    FILE* fid = fopen(name, "r");
+    char line[4096];
+    int result = 1;
+
+    if (fid == NULL) {
+      fprintf(stderr, "Failed to open list of files \"%s\": %s\n", name, strerror(errno));
+      return 0;
+    }
+    while (result && fgets(line, sizeof line, fid) != NULL) {
+      size_t len = strlen(line);
+
+      while (len > 0 && (line[len-1] == '\n' || line[len-1] == '\r')) line[--len] = '\0';
+      if (len == 0) continue; /* ignore blank lines */
+      result = addRepairJobs(jobs, numJobs, line, formatCodes, 0);
+    }
+    fclose(fid);
+    return result;
+  }
+
+  {
+    unsigned long fileSize = 0;
+#ifdef HAVE_DIRENT
+    struct stat sb;
+
+    if (stat(name, &sb) == 0) {
+      if (S_ISDIR(sb.st_mode)) return addDirectoryJobs(jobs, numJobs, name, formatCodes);
+      fileSize = (unsigned long)sb.st_size;
+    }
+#endif
+    if (!addRepairJob(jobs, numJobs, name, formatCodes, fileSize)) {
+      fprintf(stderr, "Out of memory!\n");
+      return 0;
+    }
+  }
+  return 1;
+}
+
+static void repairJob(RepairContext* ctx, RepairJob* job) {
+  if (ctx->probeOnly) {
+    job->repairIsOK = probeFile(ctx, job->fileName, &job->probe);
+    job->repairType = job->probe.repairType;
+    return;
+  }
+  ctx->outputName = job->outputName;
+  ctx->stats = job->stats;
+  job->repairIsOK = repairFile(ctx, job->fileName);
+  job->repairType = ctx->repairType;
+  job->outputFileName = ctx->outputFileName;
+  job->outputSize = ctx->outputSize;
+}
+
+static void repairJobs(RepairJob jobs[], unsigned numJobs, RepairOptions const* options,
+		       unsigned numWorkers) {
+  unsigned j;
+
+#ifdef HAVE_PTHREADS
+  if (numWorkers > 1 && numJobs > 1 && repairJobsInParallel(jobs, numJobs, options, numWorkers)) {
+    return;
+  }
+#endif
+  /* Repair each file in turn: */
+  for (j = 0; j < numJobs; ++j) {
+    RepairContext ctx;
+
+    initRepairContext(&ctx, stderr, jobs[j].formatCodes, options);
+    if (numJobs > 1) fprintf(stderr, "\n==> %s <==\n", jobs[j].fileName);
+    repairJob(&ctx, &jobs[j]);
+  }
+}
+
+static void writeStatsReport(FILE* fid, RepairJob const jobs[], unsigned numJobs,
+			     MetadataRuleTable const* metadataRules) {
+  /* Write (as JSON) what each repair did ("--stats"): */
+  static char const* const phaseNames[NUM_REPAIR_PHASES] = {
+    "header_scan", "jpeg_skip", "format_detection", "nal_copy"
+  };
+  static char const* const resyncNames[] = { "", "skipping", "resuming", "ended" };
+  unsigned j, i;
+
+  fprintf(fid, "{\n  \"version\": \"%s\",\n  \"files\": [", versionStr);
+  for (j = 0; j < numJobs; ++j) {
+    RepairJob const* job = &jobs[j];
+    RepairStats const* stats = job->stats;
+    int isH265;
+    char const* separator = "";
+
+    fprintf(fid, "%s\n    {\n      \"file\": ", j == 0 ? "" : ",");
+    writeJSONString(fid, job->fileName);
+    fprintf(fid, ",\n      \"repaired\": %s,\n      \"repair_type\": %d,\n      \"output\": ",
+	    job->repairIsOK ? "true" : "false", job->repairType);
+    if (job->repairIsOK) writeJSONString(fid, job->outputFileName); else fprintf(fid, "null");
+
+    fprintf(fid, ",\n      \"input_size\": %lu,\n      \"bytes_read\": %lu,\n      \"bytes_written\": ",
+	    stats->inputSize, stats->numBytesRead);
+    if (stats->numBytesWritten >= 0) fprintf(fid, "%lld", stats->numBytesWritten); else fprintf(fid, "null");
+
+    fprintf(fid, ",\n      \"seconds\": {");
+    for (i = 0; i < NUM_REPAIR_PHASES; ++i) fprintf(fid, " \"%s\": %.6f,", phaseNames[i], stats->phaseTimes[i]);
+    fprintf(fid, " \"total\": %.6f },\n", stats->totalTime);
+    fprintf(fid, "      \"mb_per_second\": %.3f,\n",
+	    stats->totalTime > 0 ? stats->numBytesRead/1000000.0/stats->totalTime : 0.0);
+
+    /* The NAL units, by "nal_unit_type" (as in "addMp4NALUnit()", H.265 output begins with a VPS
+       or SPS): */
+    isH265 = (stats->firstNALHeader[0] == 0x40 || stats->firstNALHeader[0] == 0x42)
+      && stats->firstNALHeader[1] == 0x01;
+    fprintf(fid, "      \"nal_units\": { \"codec\": %s, \"total\": %lu, \"by_type\": {",
+	    stats->numNALUnits == 0 ? "null" : isH265 ? "\"h265\"" : "\"h264\"", stats->numNALUnits);
+    for (i = 0; i < (isH265 ? 64u : 32u); ++i) {
+      unsigned long count = 0;
+      unsigned b0;
+
+      for (b0 = 0; b0 < 256; ++b0) {
+	if ((isH265 ? (b0>>1)&0x3F : b0&0x1F) == i) count += stats->nalHeaderCounts[b0];
+      }
+      if (count == 0) continue;
+      fprintf(fid, "%s \"%u\": %lu", separator, i, count);
+      separator = ",";
+    }
+    fprintf(fid, " } },\n");
+
+    /* The blocks of non-video data that were skipped, by the rule that they matched: */
+    fprintf(fid, "      \"metadata_blocks\": [");
+    separator = "";
+    for (i = 0; i < metadataRules->numRules; ++i) {
+      MetadataBlockRule const* rule = &metadataRules->rules[i];
+
+      if (stats->blockCounts[i] == 0) continue;
+      fprintf(fid, "%s\n        { \"rule\": %u, \"mask\": \"0x%08x\", \"value\": \"0x%08x\", \"count\": %lu, \"bytes\": %lu }",
+	      separator, i, rule->mask, rule->value, stats->blockCounts[i], stats->blockBytes[i]);
+      separator = ",";
+    }
+    fprintf(fid, "%s],\n", *separator == '\0' ? "" : "\n      ");
+
+    /* Where the repair lost (and found again) the video data: */
+    fprintf(fid, "      \"num_resync_events\": %u,\n      \"resync_events\": [", stats->numResyncEvents);
+    separator = "";
+    for (i = 0; i < stats->numResyncEvents && i < MAX_RESYNC_EVENTS; ++i) {
+      ResyncEvent const* event = &stats->resyncEvents[i];
+
+      fprintf(fid, "%s\n        { \"event\": \"%s\", \"offset\": %lu", separator, resyncNames[event->kind], event->position);
+      if (event->kind != RESYNC_RESUMING) fprintf(fid, ", \"nal_size\": \"0x%08x\"", event->nalSize);
+      fprintf(fid, " }");
+      separator = ",";
+    }
+    fprintf(fid, "%s]\n    }", *separator == '\0' ? "" : "\n      ");
+  }
+  fprintf(fid, "\n  ]\n}\n");
+}
+#endif
+
+static void initRepairContext(RepairContext* ctx, FILE* log, int const formatCodes[],
+			      RepairOptions const* options) {
+  memset(ctx, 0, sizeof *ctx);
+  ctx->input.fd = ctx->input.holesFD = -1;
+  ctx->log = log;
+  memcpy(ctx->formatCodes, formatCodes, sizeof ctx->formatCodes);
+  ctx->numProbeSlices = options->numProbeSlices;
+  ctx->numThreads = options->numThreads;
+  ctx->writeMP4 = options->writeMP4;
+  ctx->metadataRules = options->metadataRules;
+  ctx->progress.showProgress = options->showProgress;
+  ctx->progress.fid = options->progressFID;
+  ctx->progress.nextCheckPosition = ~0UL; /* until the repair itself begins */
+  ctx->usePlan = options->usePlan;
+  ctx->probeOnly = options->probeOnly;
+  ctx->useCache = options->useCache;
+  ctx->resume = options->resume;
+  ctx->queueDepth = options->queueDepth;
+  ctx->memory.limit = options->maxMemory;
+  ctx->stopOnAnomaly = options->stopOnAnomaly;
+  ctx->segmentRange = options->segmentRange;
+  if (ctx->segmentRange.kind != 0) {
+    /* A segment is extracted by a serial walk that stops where the segment ends (and its
+       repaired file isn't that of the whole file), so these don't apply: */
+    ctx->numThreads = 1;
+    ctx->queueDepth = 0;
+    ctx->useCache = 0;
+    ctx->resume = 0;
+  }
+  ctx->canPrompt = 1;
+
+  /* Each file begins with no metadata yet seen: */
+  ctx->printableMetadataCount = 0;
+  ctx->metadataIsPrintable = 1;
+}
+
+#ifdef HAVE_PTHREADS
+static void showRepairLog(RepairContext* ctx) {
+  /* If our messages are being kept in memory (because other files are being repaired at the
+     same time), copy those that we haven't yet shown to "stderr".  (The caller holds
+     "ctx->stderrMutex".) */
+  if (ctx->log == stderr) return;
+  fflush(ctx->log);
+  if (ctx->logSize > ctx->numLogBytesShown) {
+    fwrite(&ctx->logBuffer[ctx->numLogBytesShown], 1, ctx->logSize - ctx->numLogBytesShown, stderr);
+    ctx->numLogBytesShown = ctx->logSize;
+  }
+}
+#endif
+
+/* Noting what a repair did ("--stats").  Each of these does nothing if "stats" is NULL (as it is
+   unless "--stats" was given, and always during trial repairs): */
+
+static double currentTime(void) {
+  /* The time, in seconds, since some fixed point: */
+#ifdef HAVE_CLOCK_GETTIME
+  struct timespec ts;
+
+  if (clock_gettime(CLOCK_MONOTONIC, &ts) == 0) return ts.tv_sec + ts.tv_nsec/1e9;
+#endif
+  return (double)time(NULL);
+}
+
+#ifndef DJIFIX_LIBRARY
+static void beginRepairStats(RepairStats* stats) {
+  if (stats == NULL) return;
+  memset(stats, 0, sizeof *stats);
+  stats->startTime = stats->phaseStartTime = currentTime();
+  stats->phase = PHASE_HEADER_SCAN;
+  stats->numBytesWritten = -1;
+  stats->firstNALHeader[0] = stats->firstNALHeader[1] = -1;
+}
+#endif
+
+static void setRepairPhase(RepairStats* stats, int phase) {
+  /* End the current phase of the repair, and begin "phase" (-1 for none): */
+  double now;
+
+  if (stats == NULL) return;
+  now = currentTime();
+  if (stats->phase >= 0) stats->phaseTimes[stats->phase] += now - stats->phaseStartTime;
+  stats->phase = phase;
+  stats->phaseStartTime = now;
+  if (phase < 0) stats->totalTime = now - stats->startTime;
+}
+
+static void countNALUnit(RepairStats* stats, unsigned char const* nal, unsigned long numAvailable) {
+  unsigned char b0 = numAvailable > 0 ? nal[0] : 0xFF; /* we write 0xFF for missing bytes */
+
+  if (stats == NULL) return;
+  if (stats->numNALUnits++ == 0) {
+    stats->firstNALHeader[0] = b0;
+    stats->firstNALHeader[1] = numAvailable > 1 ? nal[1] : 0xFF;
+  }
+  ++stats->nalHeaderCounts[b0];
+}
+
+static void countSkippedBlock(RepairStats* stats, unsigned ruleIndex, unsigned long numBytes) {
+  if (stats == NULL) return;
+  ++stats->blockCounts[ruleIndex];
+  stats->blockBytes[ruleIndex] += numBytes;
+}
+
+static void noteResyncEvent(RepairStats* stats, int kind, unsigned long position, unsigned nalSize) {
+  ResyncEvent* event;
+
+  if (stats == NULL) return;
+  if (stats->numResyncEvents++ >= MAX_RESYNC_EVENTS) return;
+  event = &stats->resyncEvents[stats->numResyncEvents-1];
+  event->kind = kind;
+  event->position = position;
+  event->nalSize = nalSize;
+}
+
+static void planItem(RepairPlan* plan, int kind, unsigned long offset, unsigned long size) {
+  /* Note (for "--plan") a NAL unit that the repair copied, or a block that it skipped: */
+  PlanItem* item;
+
+  if (plan == NULL) return;
+  if (plan->numItems == plan->maxNumItems
+      && !growArray(plan->memory, (void**)&plan->items, &plan->maxNumItems, sizeof plan->items[0])) {
+    plan->outOfMemory = 1;
+    return;
+  }
+  item = &plan->items[plan->numItems++];
+  item->offset = offset;
+  item->size = size;
+  item->kind = kind;
+}
+
+static void planEvent(RepairPlan* plan, int kind, unsigned long position, unsigned nalSize) {
+  /* The same, for something that the repair told the user about: */
+  PlanEvent* event;
+
+  if (plan == NULL) return;
+  if (plan->numEvents == plan->maxNumEvents
+      && !growArray(plan->memory, (void**)&plan->events, &plan->maxNumEvents, sizeof plan->events[0])) {
+    plan->outOfMemory = 1;
+    return;
+  }
+  event = &plan->events[plan->numEvents++];
+  event->kind = kind;
+  event->position = position;
+  event->nalSize = nalSize;
+}
+
+#ifndef DJIFIX_LIBRARY
+static void endRepairStats(RepairContext* ctx) {
+  RepairStats* stats = ctx->stats;
+  InputFile const* input = &ctx->input;
+
+  if (stats == NULL) return;
+  setRepairPhase(stats, -1);
+  stats->inputSize = input->size;
+  stats->numBytesRead = input->pos < input->size ? input->pos : input->size;
+}
+#endif
+
+static void writeJSONString(FILE* fid, char const* str) {
+  fputc('"', fid);
+  for (; *str != '\0'; ++str) {
+    unsigned char c = *str;
+
+    if (c == '"' || c == '\\') {
+      fprintf(fid, "\\%c", c);
+    } else if (c < 0x20) {
+      fprintf(fid, "\\u%04x", c);
+    } else {
+      fputc(c, fid);
+    }
+  }
+  fputc('"', fid);
+}
+
+static void reportProgress(RepairContext* ctx, unsigned long position, int isDone) {
+  /* Print (or write to "--progress-fd") how far through the input file the repair is, if it's
+     been long enough since we last did: */
+  ProgressState* progress = &ctx->progress;
+  InputFile const* input = &ctx->input;
+  int const sizeIsKnown = input->stream == NULL || input->streamEnded;
+  double const now = currentTime();
+  double const elapsed = now - progress->startTime;
+  double rate, secondsLeft;
+
+  progress->nextCheckPosition = position + PROGRESS_CHECK_SIZE;
+  if (position > input->size) position = input->size;
+  rate = elapsed > 0 && position > progress->startPosition
+    ? (position - progress->startPosition)/1000000.0/elapsed : 0.0; /* MBytes/second */
+  secondsLeft = sizeIsKnown && rate > 0 ? (input->size - position)/1000000.0/rate : -1.0;
+
+  /* (Our messages are printed as we go only if they're going straight to "stderr"; otherwise
+     they're shown only when the repair ends, when its progress no longer matters.) */
+  if (progress->showProgress && !isDone && ctx->log == stderr
+      && now - progress->lastShownTime >= PROGRESS_SHOW_INTERVAL) {
+    progress->lastShownTime = now;
+    fprintf(ctx->log, "\n(%lu MBytes", position/1000000);
+    if (sizeIsKnown) fprintf(ctx->log, " of %lu MBytes (%d%%)", input->size/1000000,
+			     input->size == 0 ? 100 : (int)(position*100.0/input->size));
+    fprintf(ctx->log, " read, at %.1f MBytes/second", rate);
+    if (secondsLeft >= 0) fprintf(ctx->log, "; about %lu:%02lu remaining",
+				  (unsigned long)secondsLeft/60, (unsigned long)secondsLeft%60);
+    fprintf(ctx->log, ")...");
+  }
+
+  if (progress->fid != NULL && (isDone || now - progress->lastWrittenTime >= PROGRESS_WRITE_INTERVAL)) {
+    /* One line of JSON for each update.  (Several repairs may be writing these at the same
+       time, so we write each line while holding the stream's lock.) */
+    FILE* fid = progress->fid;
+
+    progress->lastWrittenTime = now;
+#ifdef HAVE_PTHREADS
+    flockfile(fid);
+#endif
+    fprintf(fid, "{\"file\": ");
+    writeJSONString(fid, progress->fileName != NULL ? progress->fileName : "");
+    fprintf(fid, ", \"offset\": %lu, \"size\": ", position);
+    if (sizeIsKnown) fprintf(fid, "%lu", input->size); else fprintf(fid, "null");
+    fprintf(fid, ", \"mb_per_second\": %.3f, \"eta_seconds\": ", rate);
+    if (secondsLeft >= 0) fprintf(fid, "%.1f", secondsLeft); else fprintf(fid, "null");
+    fprintf(fid, ", \"done\": %s}\n", isDone ? "true" : "false");
+    fflush(fid);
+#ifdef HAVE_PTHREADS
+    funlockfile(fid);
+#endif
+  }
+}
+
+static void noteProgressAt(RepairContext* ctx, unsigned long position) {
+  /* Called often (e.g., for each NAL unit), so this must be cheap: */
+  if (position >= ctx->progress.nextCheckPosition) reportProgress(ctx, position, 0);
+}
+
+static void noteProgress(RepairContext* ctx) {
+  noteProgressAt(ctx, ctx->input.pos);
+}
+
+static void noteProgressOnRefill(void* opaque, unsigned long position) {
+  /* (For a stream, we also check whenever we read more of it - e.g., while skipping over
+     anomalous bytes.) */
+  noteProgressAt((RepairContext*)opaque, position);
+}
+
+#ifndef DJIFIX_LIBRARY
+static void endProgress(RepairContext* ctx) {
+  /* The repair has ended; write a final update to "--progress-fd" (if the repair began): */
+  if (ctx->progress.nextCheckPosition == ~0UL) return;
+  reportProgress(ctx, ctx->input.pos, 1);
+  ctx->progress.nextCheckPosition = ~0UL;
+  ctx->input.onRefill = NULL;
+}
+#endif
+
+static void beginRepair(RepairContext* ctx) {
+  /* We know all that we need to, so now do the repair itself: */
+  ProgressState* progress = &ctx->progress;
+
+  fprintf(ctx->log, "%s", startingToRepair);
+  setRepairPhase(ctx->stats, PHASE_NAL_COPY);
+  if (ctx->plan != NULL) ctx->plan->startPosition = ctx->input.pos;
+  if (progress->showProgress || progress->fid != NULL) {
+    progress->startTime = progress->lastShownTime = progress->lastWrittenTime = currentTime();
+    progress->startPosition = ctx->input.pos;
+    progress->nextCheckPosition = ctx->input.pos + PROGRESS_CHECK_SIZE;
+    if (ctx->input.stream != NULL) {
+      ctx->input.onRefill = noteProgressOnRefill;
+      ctx->input.refillOpaque = ctx;
+    }
+  }
+}
+
+static void noteScanLimit(RepairContext* ctx) {
+  /* If a scan (in "findRepairType()") gave up because it reached "input->scanLimit", say so: */
+  InputFile* input = &ctx->input;
+
+  if (input->pos >= input->scanLimit) {
+    fprintf(ctx->log, "(We looked at only the first %lu MBytes of the file.)\n", input->scanLimit/1000000);
+  }
+}
+
+static int findRepairType(RepairContext* ctx) {
+  /* Check the start of the (opened) input file, to see which type of repair it needs.  Sets
+     "ctx->repairType" (and, for 'type 1' and 'type 2' repairs, what we need to know for them),
+     leaving the input file at the data to be repaired.  Returns 0 if we can't repair the file: */
+  InputFile* input = &ctx->input;
+  unsigned long numBytesToSkip, dummy;
+  int repairType = 1; /* by default */
+  unsigned repairType1FtypSize = 0; /* used only for 'repair type 1' files */
+  unsigned repairType2Second4Bytes = 0; /* used only for 'repair type 2' files */
 
+  do {
     /* Check the first 8 bytes of the file, to see whether the file starts with a 'ftyp' atom
        (repair type 1), or H.264/H.265 NAL units (repair type 2 or 3): */
     {
@@ -293,8 +1651,8 @@ int main(int argc, char** argv) {
       int fileStartIsOK;
       int amAtStartOfFile = 1;
 
-      if (!get4Bytes(inputFID, &first4Bytes) || !get4Bytes(inputFID, &next4Bytes)) {
-	fprintf(stderr, "Unable to read the start of the file.%s\n", cantRepair);
+      if (!get4Bytes(input, &first4Bytes) || !get4Bytes(input, &next4Bytes)) {
+	fprintf(ctx->log, "Unable to read the start of the file.%s\n", cantRepair);
 	break;
       }
 
@@ -303,47 +1661,55 @@ int main(int argc, char** argv) {
 	if (next4Bytes == fourcc_ftyp || next4Bytes == fourcc_isom) {
 	  /* Repair type 1 */
 	  if (first4Bytes < 8 || first4Bytes > 0x000000FF) {
-	    fprintf(stderr, "Ignoring bad length 0x%08x for initial 'ftyp' or 'isom' atom\n", first4Bytes);
-	  } else if (fseek(inputFID, first4Bytes-8, SEEK_CUR) != 0) {
-	    fprintf(stderr, "Bad length for initial 'ftyp' or 'isom' atom.%s\n", cantRepair);
+	    fprintf(ctx->log, "Ignoring bad length 0x%08x for initial 'ftyp' or 'isom' atom\n", first4Bytes);
+	  } else if (!seekInput(input, first4Bytes-8)) {
+	    fprintf(ctx->log, "Bad length for initial 'ftyp' or 'isom' atom.%s\n", cantRepair);
 	    fileStartIsOK = 0;
 	  } else {
-	    if (!amAtStartOfFile) fprintf(stderr, "Found 'ftyp' or 'isom' (at file position 0x%08lx)\n", ftell(inputFID) - 8); else fprintf(stderr, "Saw initial 'ftyp'or 'isom'.\n");
+	    if (!amAtStartOfFile) fprintf(ctx->log, "Found 'ftyp' or 'isom' (at file position 0x%08lx)\n", input->pos - 8); else fprintf(ctx->log, "Saw initial 'ftyp'or 'isom'.\n");
 	  }
 	} else if (checkFor0x00000002(first4Bytes, next4Bytes)) {
 	  /* Assume repair type 2 */
-	  if (!amAtStartOfFile) fprintf(stderr, "Found 0x00000002 (at file position 0x%08lx)\n", ftell(inputFID) - 8);
+	  if (!amAtStartOfFile) fprintf(ctx->log, "Found 0x00000002 (at file position 0x%08lx)\n", input->pos - 8);
 	  repairType = 2;
 	  repairType2Second4Bytes = next4Bytes;
 	} else if (first4Bytes == 0x00000000 || first4Bytes == 0xFFFFFFFF) {
 	  /* Skip initial 0x00000000 or 0xFFFFFFFF data at the start of the file: */
 	  if (amAtStartOfFile) {
-	    fprintf(stderr, "Skipping initial junk 0x%08X bytes at the start of the file...\n", first4Bytes);
+	    fprintf(ctx->log, "Skipping initial junk 0x%08X bytes at the start of the file...\n", first4Bytes);
 	    amAtStartOfFile = 0;
 	  }
 	  first4Bytes = next4Bytes;
-	  if (!get4Bytes(inputFID, &next4Bytes)) {
-	    fprintf(stderr, "File appears to contain nothing but zeros or 0xFF!%s\n", cantRepair);
+	  if (input->pos + 4 > input->scanLimit) {
+	    fprintf(ctx->log, "The first %lu MBytes of the file contain nothing but zeros or 0xFF.%s\n", input->scanLimit/1000000, cantRepair);
+	    fileStartIsOK = 0;
+	  } else if (!get4Bytes(input, &next4Bytes)) {
+	    fprintf(ctx->log, "File appears to contain nothing but zeros or 0xFF!%s\n", cantRepair);
 	    fileStartIsOK = 0;
 	  } else {
+	    if (next4Bytes == first4Bytes && (next4Bytes == 0x00000000 || next4Bytes == 0xFFFFFFFF)) {
+	      /* Skip a long run of it at once, then carry on from the (last) 8 bytes before the cursor: */
+	      skipRepeatedWord(input, next4Bytes);
+	      first4Bytes = bigEndian4(inputAt(input, input->pos-8));
+	      next4Bytes = bigEndian4(inputAt(input, input->pos-4));
+	    }
 	    continue;
 	  }
 	} else {
 	  /* There's garbage at the beginning of the file.  Skip until we find sane data: */
-	  unsigned char c;
-
 	  if (amAtStartOfFile) {
-	    fprintf(stderr, "Didn't see an initial 'ftyp' or 'isom' atom, or 0x00000002.  Looking for data that we understand...\n");
+	    fprintf(ctx->log, "Didn't see an initial 'ftyp' or 'isom' atom, or 0x00000002.  Looking for data that we understand...\n");
 	    amAtStartOfFile = 0;
 	  }
-	  if (!get1Byte(inputFID, &c)) {
+	  if (!advanceToFileStartCandidate(input)) {
 	    /* We reached the end of the file, without seeing any data that we understand! */
-	    fprintf(stderr, "...Unable to find sane initial data.%s\n", cantRepair);
+	    noteScanLimit(ctx);
+	    fprintf(ctx->log, "...Unable to find sane initial data.%s\n", cantRepair);
 	    fileStartIsOK = 0;
 	  } else {
-	    /* Shift "first4Bytes" and "next4Bytes" 1-byte to the left, and keep trying: */
-	    first4Bytes = ((first4Bytes<<8)&0xFFFFFF00) | ((next4Bytes>>24)&0x000000FF);
-	    next4Bytes = ((next4Bytes<<8)&0xFFFFFF00) | c;
+	    /* Keep trying, at the next position where there might be data that we understand: */
+	    first4Bytes = bigEndian4(inputAt(input, input->pos-8));
+	    next4Bytes = bigEndian4(inputAt(input, input->pos-4));
 	    continue;
 	  }
 	}
@@ -356,84 +1722,87 @@ int main(int argc, char** argv) {
 
     if (repairType == 1) {
       /* Check for a 'moov' atom next: */
-      if (checkAtom(inputFID, fourcc_moov, &numBytesToSkip)) {
-	fprintf(stderr, "Saw 'moov' (size %d == 0x%08x).\n", 8+numBytesToSkip, 8+numBytesToSkip);
-	if (fseek(inputFID, numBytesToSkip, SEEK_CUR) != 0) {
-	  fprintf(stderr, "Input file was truncated before end of 'moov'.%s\n", cantRepair);
+      if (checkAtom(input, fourcc_moov, &numBytesToSkip)) {
+	fprintf(ctx->log, "Saw 'moov' (size %lu == 0x%08lx).\n", 8+numBytesToSkip, 8+numBytesToSkip);
+	if (!skipInput(input, numBytesToSkip)) {
+	  fprintf(ctx->log, "Input file was truncated before end of 'moov'.%s\n", cantRepair);
 	  break;
 	}
       } else {
-	fprintf(stderr, "Didn't see a 'moov' atom.\n");
+	fprintf(ctx->log, "Didn't see a 'moov' atom.\n");
 	/* It's possible that this was a 'mdat' atom instead.  Check for that next: */
       }
 
       /* Check for a 'free' or a 'wide' atom that sometimes appears before 'mdat': */
-      if (checkAtom(inputFID, fourcc_free, &numBytesToSkip)) {
-	fprintf(stderr, "Saw 'free' (size %d == 0x%08x).\n", 8+numBytesToSkip, 8+numBytesToSkip);
-	if (fseek(inputFID, numBytesToSkip, SEEK_CUR) != 0) {
-	  fprintf(stderr, "Input file was truncated before end of 'free'.%s\n", cantRepair);
+      if (checkAtom(input, fourcc_free, &numBytesToSkip)) {
+	fprintf(ctx->log, "Saw 'free' (size %lu == 0x%08lx).\n", 8+numBytesToSkip, 8+numBytesToSkip);
+	if (!skipInput(input, numBytesToSkip)) {
+	  fprintf(ctx->log, "Input file was truncated before end of 'free'.%s\n", cantRepair);
 	  break;
 	}
-      } else if (checkAtom(inputFID, fourcc_wide, &numBytesToSkip)) {
-	fprintf(stderr, "Saw 'wide'.\n");
+      } else if (checkAtom(input, fourcc_wide, &numBytesToSkip)) {
+	fprintf(ctx->log, "Saw 'wide'.\n");
 	if (numBytesToSkip > 0) {
-	  fprintf(stderr, "Warning: 'wide' atom size was %d (>8)\n", 8+numBytesToSkip);
-	  if (fseek(inputFID, numBytesToSkip, SEEK_CUR) != 0) {
-	    fprintf(stderr, "Input file was truncated before end of 'wide'.%s\n", cantRepair);
+	  fprintf(ctx->log, "Warning: 'wide' atom size was %lu (>8)\n", 8+numBytesToSkip);
+	  if (!skipInput(input, numBytesToSkip)) {
+	    fprintf(ctx->log, "Input file was truncated before end of 'wide'.%s\n", cantRepair);
 	    break;
 	  }
 	}
       }
 
       /* Check for a 'mdat' atom next: */
-      if (checkAtom(inputFID, fourcc_mdat, &dummy)) {
-	fprintf(stderr, "Saw 'mdat'.\n");
+      if (checkAtom(input, fourcc_mdat, &dummy)) {
+	fprintf(ctx->log, "Saw 'mdat'.\n");
       
 	/* Check whether the 'mdat' data begins with a 'ftyp' atom: */
-	if (checkAtom(inputFID, fourcc_ftyp, &numBytesToSkip)) {
+	if (checkAtom(input, fourcc_ftyp, &numBytesToSkip)) {
 	  /* On rare occasions, this situation is repeated: The remainder of the file consists
 	     of 'ftyp', 'moov', 'mdat' - with the 'mdat' data beginning with 'ftyp' again.
 	     Check for this now:
 	  */
-	  long curPos;
+	  unsigned long curPos;
 
 	  while (1) {	
-	    unsigned nbts_moov;
-
-	    curPos = ftell(inputFID); /* remember where we are now */
-	    if (fseek(inputFID, numBytesToSkip, SEEK_CUR) != 0) break;
-	    if (!checkAtom(inputFID, fourcc_moov, &nbts_moov)) break;
-	    if (fseek(inputFID, nbts_moov, SEEK_CUR) != 0) break;
-	    if (!checkAtom(inputFID, fourcc_mdat, &dummy)) break; /* can 0x0000002 ever occur? */
-	    if (!checkAtom(inputFID, fourcc_ftyp, &numBytesToSkip)) break;
-	    fprintf(stderr, "(Saw nested 'ftyp' within 'mdat')\n");
+	    unsigned long nbts_moov;
+
+	    curPos = input->pos; /* remember where we are now */
+	    if (!skipInput(input, numBytesToSkip)) break;
+	    if (!checkAtom(input, fourcc_moov, &nbts_moov)) break;
+	    if (!skipInput(input, nbts_moov)) break;
+	    if (!checkAtom(input, fourcc_mdat, &dummy)) break; /* can 0x0000002 ever occur? */
+	    if (!checkAtom(input, fourcc_ftyp, &numBytesToSkip)) break;
+	    fprintf(ctx->log, "(Saw nested 'ftyp' within 'mdat')\n");
+	  }
+	  if (!seekInputTo(input, curPos)) { /* restore our old position */
+	    fprintf(ctx->log, "The nested 'ftyp' atoms are too large for us to read the input as a stream.%s\n", cantRepair);
+	    break;
 	  }
-	  fseek(inputFID, curPos, SEEK_SET); /* restore our old position */
 
 	  repairType1FtypSize = numBytesToSkip+8;
-	  fprintf(stderr, "Saw a 'ftyp' within the 'mdat' data.  We can repair this file.\n");
+	  fprintf(ctx->log, "Saw a 'ftyp' within the 'mdat' data.  We can repair this file.\n");
 	} else {
 	  unsigned next4Bytes;
 
-	  fprintf(stderr, "Didn't see a 'ftyp' atom inside the 'mdat' data.\n");
+	  fprintf(ctx->log, "Didn't see a 'ftyp' atom inside the 'mdat' data.\n");
 	  /* It's possible that the 'mdat' data began with 0x00000002 (i.e., a 'type 2' repair) */
 	  repairType = 2;
 	  /* But first, check for the four bytes 'm','i','j','d'; or 0xFFD8FFE0 (JFIF header);
 	     indicating a 'type 3' repair: */
-	  if (get4Bytes(inputFID, &next4Bytes)) {
+	  if (get4Bytes(input, &next4Bytes)) {
 	    if (next4Bytes == fourcc_mijd) {
-	      fprintf(stderr, "Saw 'mijd'.\n");
+	      fprintf(ctx->log, "Saw 'mijd'.\n");
 	      repairType = 3; /* New-style MP4 file containing a JPEG preview */
 	    } else if (next4Bytes == 0xFFD8FFE0) {
-	      fprintf(stderr, "Saw 'JFIF' header.\n");
+	      fprintf(ctx->log, "Saw 'JFIF' header.\n");
 	      repairType = 3; /* New-style MP4 file containing a JPEG preview */
 	    } else {
-	      fseek(inputFID, -4, SEEK_CUR);
+	      seekInput(input, -4);
 	    }
 	  }
 	}
       } else {
-	fprintf(stderr, "Didn't see a 'mdat' atom.\n");
+	fprintf(ctx->log, "Didn't see a 'mdat' atom.\n");
 	/* It's possible that the remaining bytes begin with 0x00000002 (i.e., a 'type 2' repair).*/
 	/* Check for that next: */
 	repairType = 2;
@@ -444,17 +1813,17 @@ int main(int argc, char** argv) {
 	int sawVideo = 0;
 
 	/* Check for known video occurring next: */
-	fprintf(stderr, "Looking for video data...\n");
-	if (get4Bytes(inputFID, &first4Bytes) && get4Bytes(inputFID, &next4Bytes)) {
+	fprintf(ctx->log, "Looking for video data...\n");
+	if (get4Bytes(input, &first4Bytes) && get4Bytes(input, &next4Bytes)) {
 	  while (1) {
 	    if (checkForVideo(first4Bytes, next4Bytes)) {
 	      sawVideo = 1;
 	      if (first4Bytes == 0x00000002) {
-		fprintf(stderr, "Found 0x00000002 (at file position 0x%08lx)\n", ftell(inputFID) - 8);
+		fprintf(ctx->log, "Found 0x00000002 (at file position 0x%08lx)\n", input->pos - 8);
 		repairType2Second4Bytes = next4Bytes;
 	      } else {
-		fprintf(stderr, "Found apparent H.264 or H.265 SPS (length %d, at file position 0x%08lx)\n", first4Bytes, ftell(inputFID) - 8);
-		fseek(inputFID, -8, SEEK_CUR);
+		fprintf(ctx->log, "Found apparent H.264 or H.265 SPS (length %d, at file position 0x%08lx)\n", first4Bytes, input->pos - 8);
+		seekInput(input, -8);
 		repairType = 4; /* special case */
 	      }
 	      break;
@@ -463,1000 +1832,6149 @@ int main(int argc, char** argv) {
 			(next4Bytes&0xFFFF0000) == 0x28010000)) {
 	      /* A special case: This looks like H.264 or H.265 (respectively) data for a DJI Mini 2 or Mavic Air ('type 5') video */
 	      sawVideo = 1;
-	      fprintf(stderr, "Found possible H.264 or H.265 video data, at file position 0x%08lx\n",
-		      ftell(inputFID) - 8);
-	      fseek(inputFID, -8, SEEK_CUR);
+	      fprintf(ctx->log, "Found possible H.264 or H.265 video data, at file position 0x%08lx\n",
+		      input->pos - 8);
+	      seekInput(input, -8);
 	      repairType = 5;
 	      break;
 	    } else {
-	      unsigned char c;
-
-	      if (!get1Byte(inputFID, &c)) break;/*eof*/
-	      first4Bytes = ((first4Bytes<<8)&0xFFFFFF00) | ((next4Bytes>>24)&0x000000FF);
-	      next4Bytes = ((next4Bytes<<8)&0xFFFFFF00) | c;
+	      /* Move ahead to the next position where video data might begin: */
+	      if (!advanceToNalSizeCandidate(input, 8)) break;/*eof*/
+	      first4Bytes = bigEndian4(inputAt(input, input->pos-8));
+	      next4Bytes = bigEndian4(inputAt(input, input->pos-4));
 	    }
 	  }
 	}
 
 	if (!sawVideo) {
 	  /* OK, now we have to give up: */
-	  fprintf(stderr, "Didn't see any obvious video data.%s\n", cantRepair);
+	  noteScanLimit(ctx);
+	  fprintf(ctx->log, "Didn't see any obvious video data.%s\n", cantRepair);
 	  break;
 	}
       } else if (repairType == 3) {
-	unsigned char byte1 = 0;
-	int sawEndOfJPEGs = 0;
+	int foundMovieData;
 
 	/* Skip over all JPEG previews (ending with 0xFFD9, and not then followed by 0xFFD8): */
-	fprintf(stderr, "Skipping past JPEG previews...\n");
-	while (1) {
-	  unsigned char byte2;
-
-	  if (!get1Byte(inputFID, &byte2)) break;/*eof*/
-	  if (byte1 == 0xFF && byte2 == 0xD9) {
-	    unsigned char byte3, byte4;
-	    if (!get1Byte(inputFID, &byte3) || !get1Byte(inputFID, &byte4)) break;/*eof*/
-	    if (!(byte3 == 0xFF && byte4 == 0xD8)) {
-	      fseek(inputFID, -2, SEEK_CUR);
-	      fprintf(stderr, "Found movie data (at file position 0x%08lx)\n", ftell(inputFID));
-	      sawEndOfJPEGs = 1;
-	      break;
-	    } else {
-	      byte1 = 0; /* for the next iteration */
-	    }
-	  } else {
-	    byte1 = byte2; /* for the next iteration */
-	  }
-	}
-
-	if (!sawEndOfJPEGs) {
+	fprintf(ctx->log, "Skipping past JPEG previews...\n");
+	setRepairPhase(ctx->stats, PHASE_JPEG_SKIP);
+	foundMovieData = skipJPEGPreviews(input);
+	setRepairPhase(ctx->stats, PHASE_HEADER_SCAN);
+	if (foundMovieData) {
+	  fprintf(ctx->log, "Found movie data (at file position 0x%08lx)\n", input->pos);
+	} else {
 	  /* OK, now we have to give up: */
-	  fprintf(stderr, "Didn't see end of JPEG previews.%s\n", cantRepair);
+	  noteScanLimit(ctx);
+	  fprintf(ctx->log, "Didn't see end of JPEG previews.%s\n", cantRepair);
 	  break;
 	}
 
 	/* Sometimes, the movie data here begins with a 'mdat' atom header. Check for this now: */
-	if (checkAtom(inputFID, fourcc_mdat, &dummy)) {
-	  fprintf(stderr, "Saw 'mdat'.\n");
+	if (checkAtom(input, fourcc_mdat, &dummy)) {
+	  fprintf(ctx->log, "Saw 'mdat'.\n");
 	}
       }
     }
 
-    if (repairType > 1) {
-      fprintf(stderr, "We can repair this file, but the result will be a '.h264' file (playable by the VLC or IINA media player), not a '.mp4' file.\n");
-    }
+    ctx->repairType = repairType;
+    ctx->repairType1FtypSize = repairType1FtypSize;
+    ctx->repairType2Second4Bytes = repairType2Second4Bytes;
+    return 1;
+  } while (0);
 
-    /* Now generate the output file name, and open the output file: */
-    {
-      unsigned suffixLen, outputFileNameSize;
-      char* dotPtr = strrchr(inputFileName, '.');
-      if (dotPtr == NULL) {
-	dotPtr = &inputFileName[strlen(inputFileName)];
-      }
-      *dotPtr = '\0';
-      
-      suffixLen = repairType == 1 ? 3/*mp4*/ : 4/*h264*/;
-      outputFileNameSize = (dotPtr - inputFileName) + strlen(repairedFilenameStr) + 1/*dot*/ + suffixLen + 1/*trailing '\0'*/;
-      outputFileName = malloc(outputFileNameSize);
-      sprintf(outputFileName, "%s%s.%s", inputFileName, repairedFilenameStr,
-	      repairType == 1 ? "mp4" : "h264");
+  return 0;
+}
 
-      outputFID = fopen(outputFileName, "wb");
-      if (outputFID == NULL) {
-	perror("Failed to open output file");
-	free(outputFileName);
-	break;
-      }
-    }
+static int repairWithType(RepairContext* ctx) {
+  /* Repair the input file (from its current position) into "ctx->outputFID", using the repair
+     type found by "findRepairType()".  Returns 0 if we didn't - because we never learned the
+     video format (in which case nothing was written), or because writing the output failed: */
+  int repairIsOK = 1;
+  int const repairType = ctx->repairType;
+
+  setRepairPhase(ctx->stats, PHASE_FORMAT_DETECTION); /* (until "beginRepair()") */
+  if (ctx->segmentRange.kind != 0 && repairType == 1) {
+    fprintf(ctx->log, "(\"--range\" and \"--nals\" don't apply to a 'type 1' repair, so all of the video will be written.)\n");
+  } else if (ctx->segmentRange.kind != 0 && !beginExtraction(ctx)) {
+    fprintf(ctx->log, "Out of memory.%s\n", cantRepair);
+    return 0;
+  }
+  if (repairType == 1) {
+    doRepairType1(ctx, ctx->repairType1FtypSize);
+  } else if (repairType == 2) {
+    repairIsOK = doRepairType2(ctx, ctx->repairType2Second4Bytes, ctx->formatCodes[2]);
+  } else if (repairType == 3) {
+    repairIsOK = doRepairType3(ctx, ctx->formatCodes[3]);
+  } else if (repairType == 4) {
+    doRepairType4(ctx);
+  } else if (repairType == 5) {
+    repairIsOK = doRepairType5(ctx, ctx->formatCodes[5]);
+  }
+  if (ctx->outputFailed) repairIsOK = 0;
+  if (ctx->extraction != NULL) endExtraction(ctx, repairIsOK);
 
-    /* Begin the repair: */
-    if (repairType == 1) {
-      doRepairType1(inputFID, outputFID, repairType1FtypSize);
-    } else if (repairType == 2) {
-      doRepairType2(inputFID, outputFID, repairType2Second4Bytes);
-    } else if (repairType == 3) {
-      doRepairType3(inputFID, outputFID);
-    } else if (repairType == 4) {
-      doRepairType4(inputFID, outputFID);
-    } else if (repairType == 5) {
-      doRepairType5(inputFID, outputFID);
-    }
-
-    fprintf(stderr, "...done\n");
-    fclose(outputFID);
-    fprintf(stderr, "\nRepaired file is \"%s\"\n", outputFileName);
-    free(outputFileName);
-#ifdef CODE_COUNT
-    for (unsigned i = 0; i < 65536; ++i) if (codeCount[i] > 0) fprintf(stderr, "0x%04x: %d\n", i, codeCount[i]);
-#endif
+  return repairIsOK;
+}
 
-    if (repairType > 1) {
-      fprintf(stderr, "This file can be played by the VLC media player (available at <http://www.videolan.org/vlc/>), or by the IINA media player (for MacOS; available at <https://lhc70000.github.io/iina/>).\n");
+static int probeRepairType(RepairContext* ctx, ProbeResult* result) {
+  /* Find which type of repair the (opened) input file needs - searching only the first
+     "PROBE_WINDOW_SIZE" bytes of it for the start of the data - and (if it's needed) its video
+     format, without repairing it.  Returns the repair type, or 0 if we can't repair the file: */
+  InputFile* input = &ctx->input;
+  int repairType;
+
+  memset(result, 0, sizeof *result);
+  input->scanLimit = PROBE_WINDOW_SIZE;
+  if (!findRepairType(ctx)) return 0;
+
+  repairType = result->repairType = ctx->repairType;
+  /* ('type 1' and 'type 2' repairs have already read the 8-byte 'ftyp' atom header, or the
+     0x00000002 and the first video data, respectively) */
+  result->dataOffset = repairType <= 2 ? input->pos - 8 : input->pos;
+  if (repairType == 2 || repairType == 3 || repairType == 5) {
+    result->formatCode = ctx->formatCodes[repairType];
+    if (result->formatCode == 0 || result->formatCode == AUTO_FORMAT_CODE) {
+      result->formatCode = detectFormatCode(ctx, repairType, repairType == 2 ? input->pos-2 : input->pos);
     }
+  }
+  return repairType;
+}
+
+#ifndef DJIFIX_LIBRARY
+static char* makeOutputFileName(RepairContext* ctx, char const* inputFileName, int outputIsMP4) {
+  /* The ("malloc()"ed) name of the repaired file: the one given with "-o"; or (if we're reading
+     "stdin") "-", meaning 'stdout'; or else one made from the name of the input file.  Returns
+     NULL if we run out of memory: */
+  int const inputIsStdin = strcmp(inputFileName, "-") == 0;
+  char* outputFileName;
+
+  if (ctx->outputName != NULL || inputIsStdin) {
+    char const* outputName = ctx->outputName != NULL ? ctx->outputName : "-";
+
+    outputFileName = malloc(strlen(outputName) + 1);
+    if (outputFileName != NULL) strcpy(outputFileName, outputName);
+  } else {
+    unsigned suffixLen, outputFileNameSize;
+    char const* dotPtr = strrchr(inputFileName, '.');
+    if (dotPtr == NULL) {
+      dotPtr = &inputFileName[strlen(inputFileName)];
+    }
+
+    suffixLen = outputIsMP4 ? 3/*mp4*/ : 4/*h264*/;
+    outputFileNameSize = (dotPtr - inputFileName) + strlen(repairedFilenameStr) + 1/*dot*/ + suffixLen + 1/*trailing '\0'*/;
+    outputFileName = malloc(outputFileNameSize);
+    if (outputFileName != NULL) {
+      sprintf(outputFileName, "%.*s%s.%s", (int)(dotPtr - inputFileName), inputFileName, repairedFilenameStr,
+	      outputIsMP4 ? "mp4" : "h264");
+    }
+  }
+  return outputFileName;
+}
+
+static int probeFile(RepairContext* ctx, char const* inputFileName, ProbeResult* result) {
+  /* "--probe": Find which type of repair the file needs, without repairing it: */
+  InputFile* input = &ctx->input;
+  int const inputIsStdin = strcmp(inputFileName, "-") == 0;
+
+  memset(result, 0, sizeof *result);
+  if (inputIsStdin ? !openInputStream(input, stdin, &ctx->memory) : !openInputFile(input, inputFileName, &ctx->memory)) {
+    fprintf(ctx->log, "Failed to open file to repair: %s\n", strerror(errno));
+    return 0;
+  }
+  probeRepairType(ctx, result);
+  closeInputFile(input);
+  return result->repairType != 0;
+}
+
+static int repairFile(RepairContext* ctx, char const* inputFileName) {
+  InputFile* input = &ctx->input;
+  char* outputFileName;
+  char* planFileName;
+  FILE* outputFID;
+  int repairType, repairIsOK, outputIsMP4, outputIsStdout, outputIsOK, isResumable;
+  int const inputIsStdin = strcmp(inputFileName, "-") == 0;
+  long long outputEnd;
+
+  beginRepairStats(ctx->stats);
+  do {
+    if (ctx->useCache && !inputIsStdin && useCachedRepair(ctx, inputFileName)) {
+      fprintf(ctx->log, "\nRepaired file is \"%s\"\n", ctx->outputFileName);
+      endRepairStats(ctx);
+      return 1;
+    }
+
+    /* Open the input file (or, for "-", prepare to read "stdin" as we go): */
+    if (inputIsStdin ? !openInputStream(input, stdin, &ctx->memory) : !openInputFile(input, inputFileName, &ctx->memory)) {
+      fprintf(ctx->log, "Failed to open file to repair: %s\n", strerror(errno));
+      break;
+    }
+    if (inputIsStdin) ctx->canPrompt = 0; /* because we'd read the video format from the input */
+    if (!findRepairType(ctx)) break;
+    repairType = ctx->repairType;
+    outputIsMP4 = repairType == 1 || ctx->writeMP4;
+
+    if (!outputIsMP4) {
+      fprintf(ctx->log, "We can repair this file, but the result will be a '.h264' file (playable by the VLC or IINA media player), not a '.mp4' file.\n");
+    }
+
+    /* Now generate the output file name, and open the output file: */
+    outputFileName = makeOutputFileName(ctx, inputFileName, outputIsMP4);
+    if (outputFileName == NULL) {
+      fprintf(ctx->log, "Out of memory.%s\n", cantRepair);
+      break;
+    }
+    outputIsStdout = strcmp(outputFileName, "-") == 0;
+    if (outputIsStdout && repairType > 1 && outputIsMP4 && fseek(stdout, 0, SEEK_CUR) != 0) {
+      /* We'd need to go back, to fill in the size of the 'mdat' atom: */
+      fprintf(ctx->log, "A '.mp4' file (\"-m\") can't be written to a pipe.%s\n", cantRepair);
+      free(outputFileName);
+      break;
+    }
+    if (outputIsStdout) {
+      outputFID = stdout;
+    } else if (ctx->resume && repairType >= 3 && !outputIsMP4 && !inputIsStdin && !ctx->usePlan) {
+      outputFID = openCheckpointedOutput(ctx, inputFileName, outputFileName);
+    } else {
+      outputFID = fopen(outputFileName, "wb");
+    }
+    if (outputFID == NULL) {
+      fprintf(ctx->log, "Failed to open output file: %s\n", strerror(errno));
+      free(outputFileName);
+      break;
+    }
+
+    /* Begin the repair: */
+    ctx->outputFID = outputFID;
+    if (repairType > 1 && outputIsMP4 && !beginMp4File(ctx)) {
+      fprintf(ctx->log, "Out of memory.%s\n", cantRepair);
+      if (!outputIsStdout) {
+	fclose(outputFID);
+	remove(outputFileName);
+      }
+      free(outputFileName);
+      break;
+    }
+    planFileName = ctx->usePlan && repairType > 1 && !inputIsStdin ? beginRepairPlan(ctx, inputFileName) : NULL;
+    ctx->progress.fileName = inputFileName;
+    repairIsOK = repairWithType(ctx);
+    endProgress(ctx);
+    if (ctx->mp4 != NULL && !endMp4File(ctx) && repairIsOK) {
+      fprintf(ctx->log, "\nFailed to write the MP4 file's index ('moov' atom).%s\n", cantRepair);
+      repairIsOK = 0;
+    }
+
+    /* Finish writing the output file - and, if that failed, fail the repair (before we note it in
+       the repair plan, or the cache): */
+    outputEnd = tellOutput(outputFID);
+    ctx->outputSize = outputEnd < 0 ? 0 : outputEnd; /* (we don't know it, for a pipe) */
+    outputIsOK = !ferror(outputFID);
+    if ((outputIsStdout ? fflush(outputFID) : fclose(outputFID)) != 0) outputIsOK = 0;
+    ctx->outputFID = NULL;
+    if (!outputIsOK && repairIsOK) {
+      fprintf(ctx->log, "\nFailed to write the repaired file.%s\n", cantRepair);
+      repairIsOK = 0;
+    }
+    if (planFileName != NULL) endRepairPlan(ctx, planFileName, repairIsOK);
+    isResumable = endCheckpoints(ctx, repairIsOK);
+
+    if (input->streamFailed) {
+      fprintf(ctx->log, "\n(Reading the input failed, so only the part of it that we read was repaired.)\n");
+    }
+    if (ctx->stats != NULL) ctx->stats->numBytesWritten = outputEnd;
+    endRepairStats(ctx);
+    closeInputFile(input);
+    if (!repairIsOK) {
+      /* We never learned the video format (or couldn't write, or complete, the output file).
+	 (But if we left a checkpoint, we keep what we wrote, for "--resume" to continue from.) */
+      if (isResumable) {
+	fprintf(ctx->log, "(\"%s\" has been kept, so that \"--resume\" can finish repairing it.)\n", outputFileName);
+      } else if (!outputIsStdout) {
+	remove(outputFileName);
+      }
+      free(outputFileName);
+      return 0;
+    }
+    fprintf(ctx->log, "...done\n");
+    if (ctx->useCache && !inputIsStdin && !outputIsStdout) {
+      noteRepairInCache(ctx, inputFileName, outputFileName, outputIsMP4);
+    }
+    if (outputIsStdout) {
+      fprintf(ctx->log, "\nThe repaired file was written to 'stdout'.\n");
+    } else {
+      fprintf(ctx->log, "\nRepaired file is \"%s\"\n", outputFileName);
+    }
+    ctx->outputFileName = outputFileName;
+#ifdef CODE_COUNT
+    for (unsigned i = 0; i < 65536; ++i) if (ctx->codeCount[i] > 0) fprintf(ctx->log, "0x%04x: %d\n", i, ctx->codeCount[i]);
+#endif
+
+    if (!outputIsMP4) {
+      fprintf(ctx->log, "This file can be played by the VLC media player (available at <http://www.videolan.org/vlc/>), or by the IINA media player (for MacOS; available at <https://lhc70000.github.io/iina/>).\n");
+    }
+
+    /* OK */
+    return 1;
+  } while (0);
+
+  /* An error occurred: */
+  endRepairStats(ctx);
+  closeInputFile(input);
+  return 0;
+}
+#endif
+
+/* Our video formats.  For each, the names that may be used (with "-f") as an alternative to the
+   letter or digit that's typed in response to each format prompt, what the prompt says, and the
+   parameter set NAL units that we write at the start of the repaired file: */
+
+/* The parameter set NAL units for the 'type 2' formats: */
+static unsigned char const SPS_2160p30[] = { 0x27, 0x64, 0x00, 0x33, 0xac, 0x34, 0xc8, 0x03, 0xc0, 0x04, 0x3e, 0xc0, 0x5a, 0x80, 0x80, 0x80, 0xa0, 0x00, 0x00, 0x7d, 0x20, 0x00, 0x1d, 0x4c, 0x1d, 0x0c, 0x00, 0x07, 0x27, 0x08, 0x00, 0x01, 0xc9, 0xc3, 0x97, 0x79, 0x71, 0xa1, 0x80, 0x00, 0xe4, 0xe1, 0x00, 0x00, 0x39, 0x38, 0x72, 0xef, 0x2e, 0x1f, 0x08, 0x84, 0x53, 0x80 };
+/* The following was used in an earlier version of the software, but does not appear to be correct:
+static unsigned char const SPS_2160p25[] = { 0x27, 0x64, 0x00, 0x33, 0xac, 0x34, 0xc8, 0x01, 0x00, 0x01, 0x0f, 0xb0, 0x16, 0xa0, 0x20, 0x20, 0x28, 0x00, 0x00, 0x1f, 0x40, 0x00, 0x06, 0x1a, 0x87, 0x43, 0x00, 0x01, 0xc9, 0xc2, 0x00, 0x00, 0x72, 0x70, 0xe5, 0xde, 0x5c, 0x68, 0x60, 0x00, 0x39, 0x38, 0x40, 0x00, 0x0e, 0x4e, 0x1c, 0xbb, 0xcb, 0x87, 0xc2, 0x21, 0x14, 0xe0 };
+*/
+static unsigned char const SPS_2160x4096p25[] = { 0x27, 0x64, 0x00, 0x33, 0xac, 0x34, 0xc8, 0x01, 0x00, 0x01, 0x0f, 0xb0, 0x16, 0xa0, 0x20, 0x20, 0x28, 0x00, 0x00, 0x1f, 0x40, 0x00, 0x06, 0x1a, 0x87, 0x43, 0x00, 0x01, 0xc9, 0xc2, 0x00, 0x00, 0x72, 0x70, 0xe5, 0xde, 0x5c, 0x68, 0x60, 0x00, 0x39, 0x38, 0x40, 0x00, 0x0e, 0x4e, 0x1c, 0xbb, 0xcb, 0x87, 0xc2, 0x21, 0x14, 0xe0 };
+static unsigned char const SPS_2160x3840p25[] = { 0x27, 0x64, 0x00, 0x33, 0xac, 0x34, 0xc8, 0x03, 0xc0, 0x04, 0x3e, 0xc0, 0x5a, 0x80, 0x80, 0x80, 0xa0, 0x00, 0x00, 0x7d, 0x00, 0x00, 0x18, 0x6a, 0x1d, 0x0c, 0x00, 0x07, 0x27, 0x08, 0x00, 0x01, 0xc9, 0xc3, 0x97, 0x79, 0x71, 0xa1, 0x80, 0x00, 0xe4, 0xe1, 0x00, 0x00, 0x39, 0x38, 0x72, 0xef, 0x2e, 0x1f, 0x08, 0x84, 0x53, 0x80 };
+static unsigned char const SPS_2160x4096p24[] = { 0x27, 0x64, 0x00, 0x33, 0xac, 0x34, 0xc8, 0x01, 0x00, 0x01, 0x0f, 0xb0, 0x16, 0xa0, 0x20, 0x20, 0x28, 0x00, 0x00, 0x1f, 0x48, 0x00, 0x05, 0xdc, 0x07, 0x43, 0x00, 0x01, 0xc9, 0xc2, 0x00, 0x00, 0x72, 0x70, 0xe5, 0xde, 0x5c, 0x68, 0x60, 0x00, 0x39, 0x38, 0x40, 0x00, 0x0e, 0x4e, 0x1c, 0xbb };
+static unsigned char const SPS_2160x3840p24[] = { 0x27, 0x64, 0x00, 0x33, 0xac, 0x34, 0xc8, 0x03, 0xc0, 0x04, 0x3e, 0xc0, 0x5a, 0x80, 0x80, 0x80, 0xa0, 0x00, 0x00, 0x7d, 0x20, 0x00, 0x17, 0x70, 0x1d, 0x0c, 0x00, 0x07, 0x27, 0x08, 0x00, 0x01, 0xc9, 0xc3, 0x97, 0x79, 0x71, 0xa1, 0x80, 0x00, 0xe4, 0xe1, 0x00, 0x00, 0x39, 0x38, 0x72, 0xef, 0x2e, 0x1f, 0x08, 0x84, 0x53, 0x80 };
+static unsigned char const SPS_1530p30[] = { 0x27, 0x64, 0x00, 0x29, 0xac, 0x34, 0xc8, 0x02, 0xa8, 0x0c, 0x1b, 0x01, 0x6a, 0x02, 0x02, 0x02, 0x80, 0x00, 0x01, 0xf4, 0x80, 0x00, 0x75, 0x30, 0x74, 0x30, 0x00, 0x15, 0x75, 0x20, 0x00, 0x05, 0x5d, 0x4a, 0x5d, 0xe5, 0xc6, 0x86, 0x00, 0x02, 0xae, 0xa4, 0x00, 0x00, 0xab, 0xa9, 0x4b, 0xbc, 0xb8, 0x7c, 0x22, 0x11, 0x4e, 0x00, 0x00, 0x00 };
+static unsigned char const SPS_1530p25[] = { 0x27, 0x64, 0x00, 0x32, 0xac, 0x34, 0xc8, 0x02, 0xa8, 0x0c, 0x1b, 0x01, 0x6a, 0x02, 0x02, 0x02, 0x80, 0x00, 0x01, 0xf4, 0x00, 0x00, 0x61, 0xa8, 0x74, 0x30, 0x00, 0x15, 0x75, 0x20, 0x00, 0x05, 0x5d, 0x4a, 0x5d, 0xe5, 0xc6, 0x86, 0x00, 0x02, 0xae, 0xa4, 0x00, 0x00, 0xab, 0xa9, 0x4b, 0xbc, 0xb8, 0x7c, 0x22, 0x11, 0x4e };
+static unsigned char const SPS_1530p24[] = { 0x27, 0x64, 0x00, 0x32, 0xac, 0x34, 0xc8, 0x02, 0xa8, 0x0c, 0x1b, 0x01, 0x6a, 0x02, 0x02, 0x02, 0x80, 0x00, 0x01, 0xf4, 0x80, 0x00, 0x5d, 0xc0, 0x74, 0x30, 0x00, 0x15, 0x75, 0x20, 0x00, 0x05, 0x5d, 0x4a, 0x5d, 0xe5, 0xc6, 0x86, 0x00, 0x02, 0xae, 0xa4, 0x00, 0x00, 0xab, 0xa9, 0x4b, 0xbc, 0xb8, 0x7c, 0x22, 0x11, 0x4e };
+static unsigned char const SPS_1520p60[] = { 0x27, 0x64, 0x00, 0x2a, 0xac, 0x34, 0xc8, 0x02, 0xa4, 0x0b, 0xfb, 0x01, 0x6e, 0x02, 0x02, 0x02, 0x80, 0x00, 0x01, 0xf4, 0x80, 0x00, 0xea, 0x60, 0x74, 0x30, 0x00, 0x15, 0x75, 0x20, 0x00, 0x05, 0x5d, 0x4a, 0x5d, 0xe5, 0xc6, 0x86, 0x00, 0x02, 0xae, 0xa4, 0x00, 0x00, 0xab, 0xa9, 0x4b, 0xbc, 0xb8, 0x7c, 0x22, 0x11, 0x4e, 0x00, 0x00, 0x00 };
+static unsigned char const SPS_1520p30[] = { 0x27, 0x64, 0x00, 0x29, 0xac, 0x34, 0xc8, 0x02, 0xa4, 0x0b, 0xfb, 0x01, 0x6a, 0x02, 0x02, 0x02, 0x80, 0x00, 0x01, 0xf4, 0x80, 0x00, 0x75, 0x30, 0x74, 0x30, 0x00, 0x13, 0x12, 0xc0, 0x00, 0x04, 0xc4, 0xb4, 0x5d, 0xe5, 0xc6, 0x86, 0x00, 0x02, 0x62, 0x58, 0x00, 0x00, 0x98, 0x96, 0x8b, 0xbc, 0xb8, 0x7c, 0x22, 0x11, 0x4e, 0x00, 0x00, 0x00 };
+static unsigned char const SPS_1520p25[] = { 0x27, 0x64, 0x00, 0x29, 0xac, 0x34, 0xc8, 0x02, 0xa4, 0x0b, 0xfb, 0x01, 0x6a, 0x02, 0x02, 0x02, 0x80, 0x00, 0x00, 0x03, 0x00, 0x80, 0x00, 0x00, 0x19, 0x74, 0x30, 0x00, 0x13, 0x12, 0xc0, 0x00, 0x04, 0xc4, 0xb4, 0x5d, 0xe5, 0xc6, 0x86, 0x00, 0x02, 0x62, 0x58, 0x00, 0x00, 0x98, 0x96, 0x8b, 0xbc, 0xb8, 0x7c, 0x22, 0x11, 0x4e };
+static unsigned char const SPS_1520p24[] = { 0x27, 0x64, 0x00, 0x29, 0xac, 0x34, 0xc8, 0x02, 0xa4, 0x0b, 0xfb, 0x01, 0x6a, 0x02, 0x02, 0x02, 0x80, 0x00, 0x01, 0xf4, 0x80, 0x00, 0x5d, 0xc0, 0x74, 0x30, 0x00, 0x15, 0x75, 0x20, 0x00, 0x05, 0x5d, 0x4a, 0x5d, 0xe5, 0xc6, 0x86, 0x00, 0x02, 0xae, 0xa4, 0x00, 0x00, 0xab, 0xa9, 0x4b, 0xbc, 0xb8, 0x7c, 0x22, 0x11, 0x4e, 0x00, 0x00, 0x00 };
+static unsigned char const SPS_1080p60[] = { 0x27, 0x64, 0x00, 0x2a, 0xac, 0x34, 0xc8, 0x07, 0x80, 0x22, 0x7e, 0x5c, 0x05, 0xa8, 0x08, 0x08, 0x0a, 0x00, 0x00, 0x07, 0xd2, 0x00, 0x03, 0xa9, 0x81, 0xd0, 0xc0, 0x00, 0x4c, 0x4b, 0x00, 0x00, 0x13, 0x12, 0xd1, 0x77, 0x97, 0x1a, 0x18, 0x00, 0x09, 0x89, 0x60, 0x00, 0x02, 0x62, 0x5a, 0x2e, 0xf2, 0xe1, 0xf0, 0x88, 0x45, 0x16 };
+static unsigned char const SPS_1080i60[] = { 0x27, 0x4d, 0x00, 0x2a, 0x9a, 0x66, 0x03, 0xc0, 0x22, 0x3e, 0xf0, 0x16, 0xc8, 0x00, 0x00, 0x1f, 0x48, 0x00, 0x07, 0x53, 0x07, 0x43, 0x00, 0x02, 0x36, 0x78, 0x00, 0x02, 0x36, 0x78, 0x5d, 0xe5, 0xc6, 0x86, 0x00, 0x04, 0x6c, 0xf0, 0x00, 0x04, 0x6c, 0xf0, 0xbb, 0xcb, 0x87, 0xc2, 0x21, 0x14, 0x58 };
+static unsigned char const SPS_1080p50[] = { 0x27, 0x64, 0x00, 0x29, 0xac, 0x34, 0xc8, 0x07, 0x80, 0x22, 0x7e, 0x5c, 0x05, 0xa8, 0x08, 0x08, 0x0a, 0x00, 0x00, 0x07, 0xd0, 0x00, 0x03, 0x0d, 0x41, 0xd0, 0xc0, 0x00, 0x4c, 0x4b, 0x00, 0x00, 0x13, 0x12, 0xd1, 0x77, 0x97, 0x1a, 0x18, 0x00, 0x09, 0x89, 0x60, 0x00, 0x02, 0x62, 0x5a, 0x2e, 0xf2, 0xe1, 0xf0, 0x88, 0x45, 0x16 };
+static unsigned char const SPS_1080p48[] = { 0x27, 0x64, 0x00, 0x2a, 0xac, 0x34, 0xc8, 0x07, 0x80, 0x22, 0x7e, 0x5c, 0x05, 0xa8, 0x08, 0x08, 0x0a, 0x00, 0x00, 0x07, 0xd2, 0x00, 0x02, 0xee, 0x01, 0xd0, 0xc0, 0x00, 0x4c, 0x4b, 0x00, 0x00, 0x13, 0x12, 0xd1, 0x77, 0x97, 0x1a, 0x18, 0x00, 0x09, 0x89, 0x60, 0x00, 0x02, 0x62, 0x5a, 0x2e, 0xf2, 0xe1, 0xf0, 0x88, 0x45, 0x16 };
+/* Old format; assume no longer used:
+static unsigned char const SPS_1080p30_default[] = { 0x27, 0x4d, 0x00, 0x28, 0x9a, 0x66, 0x03, 0xc0, 0x11, 0x3f, 0x2e, 0x02, 0xd9, 0x00, 0x00, 0x03, 0x03, 0xe9, 0x00, 0x00, 0xea, 0x60, 0xe8, 0x60, 0x00, 0xe2, 0x98, 0x00, 0x03, 0x8a, 0x60, 0xbb, 0xcb, 0x8d, 0x0c, 0x00, 0x1c, 0x53, 0x00, 0x00, 0x71, 0x4c, 0x17, 0x79, 0x70, 0xf8, 0x44, 0x22, 0x8b };
+*/
+static unsigned char const SPS_1080p30_default[] = { 0x67, 0x4d, 0x00, 0x1f, 0x93, 0x28, 0x08, 0x00, 0x93, 0x7f, 0xe0, 0x00, 0x20, 0x00, 0x28, 0x10, 0x00, 0x00, 0x03, 0x00, 0x10, 0x00, 0x00, 0x03, 0x03, 0xc8, 0xda, 0x08, 0x84, 0x65, 0x80 };
+static unsigned char const SPS_1080p30_advanced[] = { 0x27, 0x64, 0x00, 0x29, 0xac, 0x34, 0xc8, 0x07, 0x80, 0x22, 0x7e, 0x5c, 0x05, 0xa8, 0x08, 0x08, 0x0a, 0x00, 0x00, 0x07, 0xd2, 0x00, 0x01, 0xd4, 0xc1, 0xd0, 0xc0, 0x00, 0x4c, 0x4b, 0x00, 0x00, 0x13, 0x12, 0xd1, 0x77, 0x97, 0x1a, 0x18, 0x00, 0x09, 0x89, 0x60, 0x00, 0x02, 0x62, 0x5a, 0x2e, 0xf2, 0xe1, 0xf0, 0x88, 0x45, 0x16 };
+static unsigned char const SPS_1080p25[] = { 0x27, 0x4d, 0x00, 0x28, 0x9a, 0x66, 0x03, 0xc0, 0x11, 0x3f, 0x2e, 0x02, 0xd9, 0x00, 0x00, 0x03, 0x03, 0xe8, 0x00, 0x00, 0xc3, 0x50, 0xe8, 0x60, 0x00, 0xdc, 0xf0, 0x00, 0x03, 0x73, 0xb8, 0xbb, 0xcb, 0x8d, 0x0c, 0x00, 0x1b, 0x9e, 0x00, 0x00, 0x6e, 0x77, 0x17, 0x79, 0x70, 0xf8, 0x44, 0x22, 0x8b };
+static unsigned char const SPS_1080p24[] = { 0x27, 0x64, 0x00, 0x29, 0xac, 0x34, 0xc8, 0x07, 0x80, 0x22, 0x7e, 0x5c, 0x05, 0xa8, 0x08, 0x08, 0x0a, 0x00, 0x00, 0x07, 0xd2, 0x00, 0x01, 0x77, 0x01, 0xd0, 0xc0, 0x00, 0xbe, 0xbc, 0x00, 0x00, 0xbe, 0xbc, 0x17, 0x79, 0x71, 0xa1, 0x80, 0x01, 0x7d, 0x78, 0x00, 0x01, 0x7d, 0x78, 0x2e, 0xf2, 0xe1, 0xf0, 0x88, 0x45, 0x16, 0x00, 0x00, 0x00 };
+static unsigned char const SPS_720p60_default[] = { 0x27, 0x4d, 0x00, 0x20, 0x9a, 0x66, 0x02, 0x80, 0x2d, 0xd8, 0x0b, 0x64, 0x00, 0x00, 0x0f, 0xa4, 0x00, 0x07, 0x53, 0x03, 0xa1, 0x80, 0x03, 0x8a, 0x60, 0x00, 0x0e, 0x29, 0x82, 0xef, 0x2e, 0x34, 0x30, 0x00, 0x71, 0x4c, 0x00, 0x01, 0xc5, 0x30, 0x5d, 0xe5, 0xc3, 0xe1, 0x10, 0x8a, 0x34 };
+static unsigned char const SPS_720p60_advanced[] = { 0x27, 0x64, 0x00, 0x28, 0xac, 0x34, 0xc8, 0x05, 0x00, 0x5b, 0xb0, 0x16, 0xa0, 0x20, 0x20, 0x28, 0x00, 0x00, 0x1f, 0x48, 0x00, 0x0e, 0xa6, 0x07, 0x43, 0x00, 0x02, 0x62, 0x58, 0x00, 0x02, 0x62, 0x5a, 0x5d, 0xe5, 0xc6, 0x86, 0x00, 0x04, 0xc4, 0xb0, 0x00, 0x04, 0xc4, 0xb4, 0xbb, 0xcb, 0x87, 0xc2, 0x21, 0x14, 0x78 };
+static unsigned char const SPS_720p50[] = { 0x27, 0x64, 0x00, 0x29, 0xac, 0x34, 0xc8, 0x05, 0x00, 0x5b, 0xb0, 0x16, 0xa0, 0x20, 0x20, 0x28, 0x00, 0x00, 0x1f, 0x40, 0x00, 0x0c, 0x35, 0x07, 0x43, 0x00, 0x07, 0xa1, 0x20, 0x00, 0x1e, 0x84, 0x85, 0xde, 0x5c, 0x68, 0x60, 0x00, 0xf4, 0x24, 0x00, 0x03, 0xd0, 0x90, 0xbb, 0xcb, 0x87, 0xc2, 0x21, 0x14, 0x78 };
+static unsigned char const SPS_720p48[] = { 0x27, 0x64, 0x00, 0x28, 0xac, 0x34, 0xc8, 0x05, 0x00, 0x5b, 0xb0, 0x16, 0xa0, 0x20, 0x20, 0x28, 0x00, 0x00, 0x1f, 0x48, 0x00, 0x0b, 0xb8, 0x07, 0x43, 0x00, 0x07, 0xa1, 0x20, 0x00, 0x1e, 0x84, 0x85, 0xde, 0x5c, 0x68, 0x60, 0x00, 0xf4, 0x24, 0x00, 0x03, 0xd0, 0x90, 0xbb, 0xcb, 0x87, 0xc2, 0x21, 0x14, 0x78, 0x00 };
+static unsigned char const SPS_720p30[] = { 0x27, 0x4d, 0x00, 0x1f, 0x9a, 0x66, 0x02, 0x80, 0x2d, 0xd8, 0x0b, 0x64, 0x00, 0x00, 0x0f, 0xa4, 0x00, 0x03, 0xa9, 0x83, 0xa1, 0x80, 0x02, 0x5c, 0x40, 0x00, 0x09, 0x71, 0x02, 0xef, 0x2e, 0x34, 0x30, 0x00, 0x4b, 0x88, 0x00, 0x01, 0x2e, 0x20, 0x5d, 0xe5, 0xc3, 0xe1, 0x10, 0x8a, 0x34 };
+static unsigned char const SPS_720p25[] = { 0x27, 0x64, 0x00, 0x28, 0xac, 0x34, 0xc8, 0x05, 0x00, 0x5b, 0xb0, 0x16, 0xa0, 0x20, 0x20, 0x28, 0x00, 0x00, 0x1f, 0x40, 0x00, 0x06, 0x1a, 0x87, 0x43, 0x00, 0x0f, 0xd4, 0x80, 0x00, 0xfd, 0x4b, 0x5d, 0xe5, 0xc6, 0x86, 0x00, 0x1f, 0xa9, 0x00, 0x01, 0xfa, 0x96, 0xbb, 0xcb, 0x87, 0xc2, 0x21, 0x14, 0x78 };
+static unsigned char const SPS_720p24[] = { 0x27, 0x64, 0x00, 0x29, 0xac, 0x34, 0xc8, 0x05, 0x00, 0x5b, 0xb0, 0x16, 0xa0, 0x20, 0x20, 0x28, 0x00, 0x00, 0x1f, 0x48, 0x00, 0x05, 0xdc, 0x07, 0x43, 0x00, 0x0f, 0xd4, 0x80, 0x00, 0xfd, 0x4b, 0x5d, 0xe5, 0xc6, 0x86, 0x00, 0x1f, 0xa9, 0x00, 0x01, 0xfa, 0x96, 0xbb, 0xcb, 0x87, 0xc2, 0x21, 0x14, 0x78 };
+static unsigned char const SPS_480p30[] = { 0x27, 0x4d, 0x40, 0x1e, 0x9a, 0x66, 0x05, 0x01, 0xed, 0x80, 0xb6, 0x40, 0x00, 0x00, 0xfa, 0x40, 0x00, 0x3a, 0x98, 0x3a, 0x10, 0x00, 0x5e, 0x68, 0x00, 0x02, 0xf3, 0x40, 0xbb, 0xcb, 0x8d, 0x08, 0x00, 0x2f, 0x34, 0x00, 0x01, 0x79, 0xa0, 0x5d, 0xe5, 0xc3, 0xe1, 0x10, 0x8a, 0x3c };
+
+static unsigned char const PPS_P2VP[] =    { 0x28, 0xee, 0x3c, 0x80 };
+static unsigned char const PPS_Inspire[] = { 0x28, 0xee, 0x38, 0x30 };
+static unsigned char const PPS_For1080pNew[] = { 0x68, 0xee, 0x38, 0x80 };
+
+/* The parameter set NAL units for the 'type 3' formats: */
+static unsigned char const type3_H264_SPS_3000p30[] = { 0x27, 0x64, 0x00, 0x34, 0xad, 0x84, 0x61, 0x18, 0x46, 0x11, 0x84, 0x61, 0x18, 0x46, 0x11, 0x34, 0xc8, 0x03, 0xe8, 0x05, 0xe7, 0xe5, 0xc0, 0x5a, 0x80, 0x80, 0x80, 0xa0, 0x00, 0x00, 0x7d, 0x20, 0x00, 0x1d, 0x4c, 0x1d, 0x0c, 0x00, 0x02, 0xfa, 0xf0, 0x00, 0x00, 0x1c, 0x9c, 0x38, 0x5d, 0xe5, 0xc6, 0x86, 0x00, 0x01, 0x7d, 0x78, 0x00, 0x00, 0x0e, 0x4e, 0x1c, 0x2e, 0xf2, 0xe1, 0xf0, 0x88, 0x45, 0x12 };
+static unsigned char const type3_H264_SPS_2160x4096p60[] = { 0x27, 0x64, 0x00, 0x34, 0xac, 0x34, 0xc8, 0x01, 0x00, 0x01, 0x0f, 0xb0, 0x16, 0xa0, 0x20, 0x20, 0x28, 0x00, 0x00, 0x1f, 0x48, 0x00, 0x0e, 0xa6, 0x07, 0x43, 0x00, 0x00, 0xbe, 0xbc, 0x00, 0x00, 0x0d, 0x69, 0x3a, 0x5d, 0xe5, 0xc6, 0x86, 0x00, 0x01, 0x7d, 0x78, 0x00, 0x00, 0x1a, 0xd2, 0x74, 0xbb, 0xcb, 0x87, 0xc2, 0x21, 0x14, 0x58 };
+static unsigned char const type3_H264_SPS_2160x3840p60[] = { 0x27, 0x64, 0x00, 0x34, 0xac, 0x34, 0xc8, 0x03, 0xc0, 0x04, 0x3e, 0xc0, 0x5a, 0x80, 0x80, 0x80, 0xa0, 0x00, 0x00, 0x7d, 0x20, 0x00, 0x3a, 0x98, 0x1d, 0x0c, 0x00, 0x07, 0x27, 0x08, 0x00, 0x00, 0x80, 0xbe, 0xf5, 0xde, 0x5c, 0x68, 0x60, 0x00, 0x39, 0x38, 0x40, 0x00, 0x04, 0x05, 0xf7, 0xae, 0xf2, 0xe1, 0xf0, 0x88, 0x45, 0x16 };
+static unsigned char const type3_H264_SPS_2160x4096p50[] = { 0x27, 0x64, 0x00, 0x34, 0xac, 0x34, 0xc8, 0x01, 0x00, 0x01, 0x0f, 0xb0, 0x16, 0xa0, 0x20, 0x20, 0x28, 0x00, 0x00, 0x1f, 0x40, 0x00, 0x0c, 0x35, 0x07, 0x43, 0x00, 0x00, 0xbe, 0xbc, 0x00, 0x00, 0x0d, 0x69, 0x3a, 0x5d, 0xe5, 0xc6, 0x86, 0x00, 0x01, 0x7d, 0x78, 0x00, 0x00, 0x1a, 0xd2, 0x74, 0xbb, 0xcb, 0x87, 0xc2, 0x21, 0x14, 0x58 };
+static unsigned char const type3_H264_SPS_2160x3840p50[] = { 0x27, 0x64, 0x00, 0x34, 0xac, 0x34, 0xc8, 0x03, 0xc0, 0x04, 0x3e, 0xc0, 0x5a, 0x80, 0x80, 0x80, 0xa0, 0x00, 0x00, 0x7d, 0x00, 0x00, 0x30, 0xd4, 0x1d, 0x0c, 0x00, 0x02, 0xfa, 0xf0, 0x00, 0x00, 0x35, 0xa4, 0xe9, 0x77, 0x97, 0x1a, 0x18, 0x00, 0x05, 0xf5, 0xe0, 0x00, 0x00, 0x6b, 0x49, 0xd2, 0xef, 0x2e, 0x1f, 0x08, 0x84, 0x51, 0x60 };
+static unsigned char const type3_H264_SPS_2160x4096p48[] = { 0x27, 0x64, 0x00, 0x34, 0xac, 0x34, 0xc8, 0x01, 0x00, 0x01, 0x0f, 0xb0, 0x16, 0xa0, 0x20, 0x20, 0x28, 0x00, 0x00, 0x1f, 0x48, 0x00, 0x0b, 0xb8, 0x07, 0x43, 0x00, 0x00, 0xbe, 0xbc, 0x00, 0x00, 0x0d, 0x69, 0x3a, 0x5d, 0xe5, 0xc6, 0x86, 0x00, 0x01, 0x7d, 0x78, 0x00, 0x00, 0x1a, 0xd2, 0x74, 0xbb, 0xcb, 0x87, 0xc2, 0x21, 0x14, 0x58 };
+static unsigned char const type3_H264_SPS_2160x3840p48[] = { 0x27, 0x64, 0x00, 0x34, 0xac, 0x34, 0xc8, 0x03, 0xc0, 0x04, 0x3e, 0xc0, 0x5a, 0x80, 0x80, 0x80, 0xa0, 0x00, 0x00, 0x7d, 0x20, 0x00, 0x2e, 0xe0, 0x1d, 0x0c, 0x00, 0x02, 0xfa, 0xf0, 0x00, 0x00, 0x35, 0xa4, 0xe9, 0x77, 0x97, 0x1a, 0x18, 0x00, 0x05, 0xf5, 0xe0, 0x00, 0x00, 0x6b, 0x49, 0xd2, 0xef, 0x2e, 0x1f, 0x08, 0x84, 0x51, 0x60 };
+static unsigned char const type3_H265_SPS_2160x4096p30[] = { 0x40, 0x01, 0x0c, 0x01, 0xff, 0xff, 0x21, 0x60, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x96, 0xac, 0x09 };
+static unsigned char const type3_H264_SPS_2160x4096p30[] = { 0x27, 0x64, 0x00, 0x34, 0xac, 0x34, 0xc8, 0x01, 0x00, 0x01, 0x0f, 0xb0, 0x16, 0xa0, 0x20, 0x20, 0x28, 0x00, 0x00, 0x1f, 0x48, 0x00, 0x07, 0x53, 0x07, 0x43, 0x00, 0x00, 0xbe, 0xbc, 0x00, 0x00, 0x0d, 0x69, 0x3a, 0x5d, 0xe5, 0xc6, 0x86, 0x00, 0x01, 0x7d, 0x78, 0x00, 0x00, 0x1a, 0xd2, 0x74, 0xbb, 0xcb, 0x87, 0xc2, 0x21, 0x14, 0x58 };
+static unsigned char const type3_H265_SPS_2160x3840p30[] = { 0x40, 0x01, 0x0c, 0x01, 0xff, 0xff, 0x21, 0x60, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x96, 0xac, 0x09 };
+static unsigned char const type3_H264_SPS_2160x3840p30_DJIMini2[] = { 0x67, 0x64, 0x00, 0x33, 0xac, 0x34, 0xc8, 0x03, 0xc0, 0x04, 0x3e, 0xc0, 0x5a, 0x80, 0x80, 0x80, 0xa0, 0x00, 0x00, 0x7d, 0x20, 0x00, 0x1d, 0x4c, 0x1d, 0x0c, 0x00, 0x02, 0xfa, 0xf0, 0x00, 0x00, 0x2f, 0xaf, 0x09, 0x77, 0x97, 0x1a, 0x18, 0x00, 0x05, 0xf5, 0xe0, 0x00, 0x00, 0x5f, 0x5e, 0x12, 0xef, 0x2e, 0x1f, 0x08, 0x84, 0x51, 0x60 };
+static unsigned char const type3_H264_SPS_2160x3840p30_other[] = { 0x27, 0x64, 0x00, 0x33, 0xac, 0x34, 0xc8, 0x03, 0xc0, 0x04, 0x3e, 0xc0, 0x5a, 0x80, 0x80, 0x80, 0xa0, 0x00, 0x00, 0x7d, 0x20, 0x00, 0x1d, 0x4c, 0x1d, 0x0c, 0x00, 0x02, 0xfa, 0xf0, 0x00, 0x00, 0x35, 0xa4, 0xe9, 0x77, 0x97, 0x1a, 0x18, 0x00, 0x05, 0xf5, 0xe0, 0x00, 0x00, 0x6b, 0x49, 0xd2, 0xef, 0x2e, 0x1f, 0x08, 0x84, 0x51, 0x60 };
+static unsigned char const type3_H264_SPS_2160x4096p25[] = { 0x27, 0x64, 0x00, 0x33, 0xac, 0x34, 0xc8, 0x01, 0x00, 0x01, 0x0f, 0xb0, 0x16, 0xa0, 0x20, 0x20, 0x28, 0x00, 0x00, 0x1f, 0x40, 0x00, 0x06, 0x1a, 0x87, 0x43, 0x00, 0x00, 0xbe, 0xbc, 0x00, 0x00, 0x0d, 0x69, 0x3a, 0x5d, 0xe5, 0xc6, 0x86, 0x00, 0x01, 0x7d, 0x78, 0x00, 0x00, 0x1a, 0xd2, 0x74, 0xbb, 0xcb, 0x87, 0xc2, 0x21, 0x14, 0x58 };
+static unsigned char const type3_H265_SPS_2160x3840p25[] = { 0x40, 0x01, 0x0c, 0x01, 0xff, 0xff, 0x21, 0x60, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x96, 0xac, 0x09 };
+static unsigned char const type3_H264_SPS_2160x3840p25[] = { 0x27, 0x64, 0x00, 0x33, 0xac, 0x34, 0xc8, 0x03, 0xc0, 0x04, 0x3e, 0xc0, 0x5a, 0x80, 0x80, 0x80, 0xa0, 0x00, 0x00, 0x7d, 0x00, 0x00, 0x18, 0x6a, 0x1d, 0x0c, 0x00, 0x02, 0xfa, 0xf0, 0x00, 0x00, 0x35, 0xa4, 0xe9, 0x77, 0x97, 0x1a, 0x18, 0x00, 0x05, 0xf5, 0xe0, 0x00, 0x00, 0x6b, 0x49, 0xd2, 0xef, 0x2e, 0x1f, 0x08, 0x84, 0x51, 0x60 };
+static unsigned char const type3_H264_SPS_2160x3840p24_DJIMini2[] = { 0x67, 0x64, 0x00, 0x33, 0xac, 0x34, 0xc8, 0x03, 0xc0, 0x04, 0x3e, 0xc0, 0x5a, 0x80, 0x80, 0x80, 0xa0, 0x00, 0x00, 0x7d, 0x20, 0x00, 0x17, 0x70, 0x1d, 0x0c, 0x00, 0x02, 0xfa, 0xf0, 0x00, 0x00, 0x2f, 0xaf, 0x09, 0x77, 0x97, 0x1a, 0x18, 0x00, 0x05, 0xf5, 0xe0, 0x00, 0x00, 0x5f, 0x5e, 0x12, 0xef, 0x2e, 0x1f, 0x08, 0x84, 0x51, 0x60 };
+static unsigned char const type3_H264_SPS_2160x3840p24_other[] = { 0x27, 0x64, 0x00, 0x33, 0xac, 0x34, 0xc8, 0x03, 0xc0, 0x04, 0x3e, 0xc0, 0x5a, 0x80, 0x80, 0x80, 0xa0, 0x00, 0x00, 0x7d, 0x00, 0x00, 0x17, 0x70, 0x1d, 0x0c, 0x00, 0x02, 0xfa, 0xf0, 0x00, 0x00, 0x35, 0xa4, 0xe9, 0x77, 0x97, 0x1a, 0x18, 0x00, 0x05, 0xf5, 0xe0, 0x00, 0x00, 0x6b, 0x49, 0xd2, 0xef, 0x2e, 0x1f, 0x08, 0x84, 0x51, 0x60 };
+static unsigned char const type3_H264_SPS_1530p60[] = { 0x67, 0x64, 0x00, 0x33, 0xac, 0x34, 0xc8, 0x02, 0xa8, 0x0c, 0x1f, 0x93, 0x01, 0x6a, 0x02, 0x02, 0x02, 0x80, 0x00, 0x01, 0xf4, 0x80, 0x00, 0xea, 0x60, 0x74, 0x30, 0x00, 0x09, 0x89, 0x68, 0x00, 0x00, 0x98, 0x96, 0x85, 0xde, 0x5c, 0x68, 0x60, 0x00, 0x13, 0x12, 0xd0, 0x00, 0x01, 0x31, 0x2d, 0x0b, 0xbc, 0xb8, 0x7c, 0x22, 0x11, 0x45, 0x80 };
+static unsigned char const type3_H265_SPS_1530p50[] = { 0x40, 0x01, 0x0c, 0x01, 0xff, 0xff, 0x21, 0x60, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x96, 0xac, 0x09 };
+static unsigned char const type3_H264_SPS_1530p48[] = { 0x67, 0x64, 0x00, 0x33, 0xac, 0x34, 0xc8, 0x02, 0xa8, 0x0c, 0x1f, 0x93, 0x01, 0x6a, 0x02, 0x02, 0x02, 0x80, 0x00, 0x01, 0xf4, 0x80, 0x00, 0xbb, 0x80, 0x74, 0x30, 0x00, 0x09, 0x89, 0x68, 0x00, 0x00, 0x98, 0x96, 0x85, 0xde, 0x5c, 0x68, 0x60, 0x00, 0x13, 0x12, 0xd0, 0x00, 0x01, 0x31, 0x2d, 0x0b, 0xbc, 0xb8, 0x7c, 0x22, 0x11, 0x45, 0x80 };
+// Old data, obsoleted by newer Mavic Mini format:
+//static unsigned char const type3_H264_SPS_1530p48[] = { 0x27, 0x64, 0x00, 0x33, 0xac, 0x34, 0xc8, 0x02, 0xa8, 0x0c, 0x1f, 0x93, 0x01, 0x6a, 0x02, 0x02, 0x02, 0x80, 0x00, 0x01, 0xf4, 0x80, 0x00, 0xbb, 0x80, 0x74, 0x30, 0x00, 0x0b, 0xeb, 0xc0, 0x00, 0x00, 0xd6, 0x93, 0xa5, 0xde, 0x5c, 0x68, 0x60, 0x00, 0x17, 0xd7, 0x80, 0x00, 0x01, 0xad, 0x27, 0x4b, 0xbc, 0xb8, 0x7c, 0x22, 0x11, 0x45, 0x80 };
+// Old data, obsoleted by newer Mavic Mini format:
+//static unsigned char const type3_H264_SPS_1530p30[] = { 0x27, 0x64, 0x00, 0x32, 0xac, 0x34, 0xc8, 0x02, 0xa8, 0x0c, 0x1b, 0x01, 0x6a, 0x02, 0x02, 0x02, 0x80, 0x00, 0x01, 0xf4, 0x80, 0x00, 0x75, 0x30, 0x74, 0x30, 0x00, 0x09, 0x89, 0x68, 0x00, 0x00, 0xab, 0xa9, 0x55, 0xde, 0x5c, 0x68, 0x60, 0x00, 0x13, 0x12, 0xd0, 0x00, 0x01, 0x57, 0x52, 0xab, 0xbc, 0xb8, 0x7c, 0x22, 0x11, 0x45, 0x80 };
+// Old version of the Mavic Mini format:
+//static unsigned char const type3_H264_SPS_1530p30[] = { 0x67, 0x64, 0x00, 0x32, 0xac, 0x34, 0xc8, 0x02, 0xa8, 0x0c, 0x1b, 0x01, 0x6a, 0x02, 0x02, 0x02, 0x80, 0x00, 0x01, 0xf4, 0x80, 0x00, 0x75, 0x30, 0x74, 0x30, 0x00, 0x13, 0x12, 0xc0, 0x00, 0x04, 0xc4, 0xb4, 0x5d, 0xe5, 0xc6, 0x86, 0x00, 0x02, 0x62, 0x58, 0x00, 0x00, 0x98, 0x96, 0x8b, 0xbc, 0xb8, 0x7c, 0x22, 0x11, 0x45, 0x80 };
+static unsigned char const type3_H264_SPS_1530p30[] = { 0x67, 0x64, 0x00, 0x32, 0xac, 0x34, 0xc8, 0x02, 0xa8, 0x0c, 0x1f, 0x93, 0x01, 0x6a, 0x02, 0x02, 0x02, 0x80, 0x00, 0x01, 0xf4, 0x80, 0x00, 0x75, 0x30, 0x74, 0x30, 0x00, 0x13, 0x12, 0xc0, 0x00, 0x04, 0xc4, 0xb4, 0x5d, 0xe5, 0xc6, 0x86, 0x00, 0x02, 0x62, 0x58, 0x00, 0x00, 0x98, 0x96, 0x8b, 0xbc, 0xb8, 0x7c, 0x22, 0x11, 0x45, 0x80 };
+static unsigned char const type3_H264_SPS_1530p25[] = { 0x67, 0x64, 0x00, 0x32, 0xac, 0x34, 0xc8, 0x02, 0xa8, 0x0c, 0x1b, 0x01, 0x6a, 0x02, 0x02, 0x02, 0x80, 0x00, 0x01, 0xf4, 0x00, 0x00, 0x61, 0xa8, 0x74, 0x30, 0x00, 0x13, 0x12, 0xc0, 0x00, 0x04, 0xc4, 0xb4, 0x5d, 0xe5, 0xc6, 0x86, 0x00, 0x02, 0x62, 0x58, 0x00, 0x00, 0x98, 0x96, 0x8b, 0xbc, 0xb8, 0x7c, 0x22, 0x11, 0x45, 0x80 };
+static unsigned char const type3_H264_SPS_1530p24_MavicMini[] = { 0x67, 0x64, 0x00, 0x32, 0xac, 0x34, 0xc8, 0x02, 0xa8, 0x0c, 0x1f, 0x93, 0x01, 0x6a, 0x02, 0x02, 0x02, 0x80, 0x00, 0x01, 0xf4, 0x80, 0x00, 0x5d, 0xc0, 0x74, 0x30, 0x00, 0x13, 0x12, 0xc0, 0x00, 0x04, 0xc4, 0xb4, 0x5d, 0xe5, 0xc6, 0x86, 0x00, 0x02, 0x62, 0x58, 0x00, 0x00, 0x98, 0x96, 0x8b, 0xbc, 0xb8, 0x7c, 0x22, 0x11, 0x45, 0x80 };
+static unsigned char const type3_H264_SPS_1530p24_other[] = { 0x27, 0x64, 0x00, 0x32, 0xac, 0x34, 0xc8, 0x02, 0xa8, 0x0c, 0x1b, 0x01, 0xaa, 0x02, 0x02, 0x02, 0xa0, 0x00, 0x01, 0xf4, 0xa0, 0x00, 0x5d, 0xc0, 0xa4, 0x30, 0x00, 0x09, 0xa9, 0x68, 0x00, 0x00, 0xab, 0xa9, 0x55, 0xde, 0xac, 0x68, 0x60, 0x00, 0xa3, 0x12, 0xd0, 0x00, 0xa1, 0x57, 0x52, 0xab, 0xac, 0xb8, 0x7c, 0x22, 0xa1, 0x45, 0x80 };
+static unsigned char const type3_H265_SPS_1080p120[] = { 0x40, 0x01, 0x0c, 0x01, 0xff, 0xff, 0x21, 0x60, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x96, 0xac, 0x09 };
+static unsigned char const type3_H264_SPS_1080p120[] = { 0x27, 0x64, 0x00, 0x33, 0xac, 0x34, 0xc8, 0x07, 0x80, 0x22, 0x7e, 0x5c, 0x05, 0xa8, 0x08, 0x08, 0x0a, 0x00, 0x00, 0x07, 0xd2, 0x00, 0x07, 0x53, 0x01, 0xd0, 0xc0, 0x00, 0x2f, 0xaf, 0x00, 0x00, 0x03, 0x03, 0x5a, 0x4e, 0x97, 0x79, 0x71, 0xa1, 0x80, 0x00, 0x5f, 0x5e, 0x00, 0x00, 0x06, 0xb4, 0x9d, 0x2e, 0xf2, 0xe1, 0xf0, 0x88, 0x45, 0x16 };
+static unsigned char const type3_H265_SPS_1080p60[] = { 0x40, 0x01, 0x0c, 0x01, 0xff, 0xff, 0x21, 0x60, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x7b, 0xac, 0x09 };
+static unsigned char const type3_H264_SPS_1080p60_MavicMini[] = { 0x67, 0x64, 0x00, 0x2a, 0xac, 0x34, 0xc8, 0x07, 0x80, 0x22, 0x7e, 0x5c, 0x05, 0xa8, 0x08, 0x08, 0x0a, 0x00, 0x00, 0x07, 0xd2, 0x00, 0x03, 0xa9, 0x81, 0xd0, 0xc0, 0x00, 0x4c, 0x4b, 0x00, 0x00, 0x13, 0x12, 0xd1, 0x77, 0x97, 0x1a, 0x18, 0x00, 0x09, 0x89, 0x60, 0x00, 0x02, 0x62, 0x5a, 0x2e, 0xf2, 0xe1, 0xf0, 0x88, 0x45, 0x16 };
+static unsigned char const type3_H264_SPS_1080p60_other[] = { 0x27, 0x64, 0x00, 0x2a, 0xac, 0x34, 0xc8, 0x07, 0x80, 0x22, 0x7e, 0x5c, 0x05, 0xa8, 0x08, 0x08, 0x0a, 0x00, 0x00, 0x07, 0xd2, 0x00, 0x03, 0xa9, 0x81, 0xd0, 0xc0, 0x00, 0x26, 0x25, 0xa0, 0x00, 0x02, 0xae, 0xa5, 0x57, 0x79, 0x71, 0xa1, 0x80, 0x00, 0x4c, 0x4b, 0x40, 0x00, 0x05, 0x5d, 0x4a, 0xae, 0xf2, 0xe1, 0xf0, 0x88, 0x45, 0x16 };
+static unsigned char const type3_H264_SPS_1080p50_MavicMini[] = { 0x67, 0x64, 0x00, 0x2a, 0xac, 0x34, 0xc8, 0x07, 0x80, 0x22, 0x7e, 0x5c, 0x05, 0xa8, 0x08, 0x08, 0x0a, 0x00, 0x00, 0x07, 0xd0, 0x00, 0x03, 0x0d, 0x41, 0xd0, 0xc0, 0x00, 0x4c, 0x4b, 0x00, 0x00, 0x13, 0x12, 0xd1, 0x77, 0x97, 0x1a, 0x18, 0x00, 0x09, 0x89, 0x60, 0x00, 0x02, 0x62, 0x5a, 0x2e, 0xf2, 0xe1, 0xf0, 0x88, 0x45, 0x16 };
+static unsigned char const type3_H264_SPS_1080p48_DJIMini2[] = { 0x67, 0x64, 0x00, 0x2a, 0xac, 0x34, 0xc8, 0x07, 0x80, 0x22, 0x7e, 0x5c, 0x05, 0xa8, 0x08, 0x08, 0x0a, 0x00, 0x00, 0x07, 0xd2, 0x00, 0x02, 0xee, 0x01, 0xd0, 0xc0, 0x00, 0x4c, 0x4b, 0x00, 0x00, 0x13, 0x12, 0xd1, 0x77, 0x97, 0x1a, 0x18, 0x00, 0x09, 0x89, 0x60, 0x00, 0x02, 0x62, 0x5a, 0x2e, 0xf2, 0xe1, 0xf0, 0x88, 0x45, 0x16 };
+static unsigned char const type3_H264_SPS_1080p30_MavicMini[] = { 0x67, 0x64, 0x00, 0x28, 0xac, 0x34, 0xc8, 0x07, 0x80, 0x22, 0x7e, 0x5c, 0x05, 0xa8, 0x08, 0x08, 0x0a, 0x00, 0x00, 0x07, 0xd2, 0x00, 0x01, 0xd4, 0xc1, 0xd0, 0xc0, 0x00, 0x42, 0xc1, 0x80, 0x00, 0x10, 0xb0, 0x75, 0x77, 0x97, 0x1a, 0x18, 0x00, 0x08, 0x58, 0x30, 0x00, 0x02, 0x16, 0x0e, 0xae, 0xf2, 0xe1, 0xf0, 0x88, 0x45, 0x16 };
+static unsigned char const type3_H264_SPS_1080p30_other[] = { 0x27, 0x64, 0x00, 0x28, 0xac, 0x34, 0xc8, 0x07, 0x80, 0x22, 0x7e, 0x5c, 0x05, 0xa8, 0x08, 0x08, 0x0a, 0x00, 0x00, 0x07, 0xd2, 0x00, 0x01, 0xd4, 0xc1, 0xd0, 0xc0, 0x00, 0x72, 0x70, 0x80, 0x00, 0x08, 0x0b, 0xef, 0x5d, 0xe5, 0xc6, 0x86, 0x00, 0x03, 0x93, 0x84, 0x00, 0x00, 0x40, 0x5f, 0x7a, 0xef, 0x2e, 0x1f, 0x08, 0x84, 0x51, 0x60 };
+static unsigned char const type3_H265_SPS_1080p25[] = { 0x40, 0x01, 0x0c, 0x01, 0xff, 0xff, 0x21, 0x60, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x7b, 0xac, 0x09 };
+static unsigned char const type3_H264_SPS_1080p25_MavicMini[] = { 0x67, 0x64, 0x00, 0x28, 0xac, 0x34, 0xc8, 0x07, 0x80, 0x22, 0x7e, 0x5c, 0x05, 0xa8, 0x08, 0x08, 0x0a, 0x00, 0x00, 0x07, 0xd0, 0x00, 0x01, 0x86, 0xa1, 0xd0, 0xc0, 0x00, 0x42, 0xc1, 0x80, 0x00, 0x10, 0xb0, 0x75, 0x77, 0x97, 0x1a, 0x18, 0x00, 0x08, 0x58, 0x30, 0x00, 0x02, 0x16, 0x0e, 0xae, 0xf2, 0xe1, 0xf0, 0x88, 0x45, 0x16 };
+static unsigned char const type3_H264_SPS_1080p25_other[] = { 0x27, 0x64, 0x00, 0x28, 0xac, 0x34, 0xc8, 0x07, 0x80, 0x22, 0x7e, 0x5c, 0x05, 0xa8, 0x08, 0x08, 0x0a, 0x00, 0x00, 0x07, 0xd0, 0x00, 0x01, 0x86, 0xa1, 0xd0, 0xc0, 0x00, 0x4c, 0x4b, 0x00, 0x00, 0x15, 0x75, 0x29, 0x77, 0x97, 0x1a, 0x18, 0x00, 0x09, 0x89, 0x60, 0x00, 0x02, 0xae, 0xa5, 0x2e, 0xf2, 0xe1, 0xf0, 0x88, 0x45, 0x16 };
+static unsigned char const type3_H264_SPS_1080p24_MavicMini[] = { 0x67, 0x64, 0x00, 0x28, 0xac, 0x34, 0xc8, 0x07, 0x80, 0x22, 0x7e, 0x5c, 0x05, 0xa8, 0x08, 0x08, 0x0a, 0x00, 0x00, 0x07, 0xd2, 0x00, 0x01, 0x77, 0x01, 0xd0, 0xc0, 0x00, 0x42, 0xc1, 0x80, 0x00, 0x10, 0xb0, 0x75, 0x77, 0x97, 0x1a, 0x18, 0x00, 0x08, 0x58, 0x30, 0x00, 0x02, 0x16, 0x0e, 0xae, 0xf2, 0xe1, 0xf0, 0x88, 0x45, 0x16 };
+static unsigned char const type3_H264_SPS_1080p24_other[] = { 0x27, 0x64, 0x00, 0x28, 0xac, 0x34, 0xc8, 0x07, 0x80, 0x22, 0x7e, 0x5c, 0x05, 0xa8, 0x08, 0x08, 0x0a, 0x00, 0x00, 0x07, 0xd2, 0x00, 0x01, 0x77, 0x01, 0xd0, 0xc0, 0x00, 0x72, 0x70, 0x80, 0x00, 0x08, 0x0b, 0xef, 0x5d, 0xe5, 0xc6, 0x86, 0x00, 0x03, 0x93, 0x84, 0x00, 0x00, 0x40, 0x5f, 0x7a, 0xef, 0x2e, 0x1f, 0x08, 0x84, 0x51, 0x60 };
+static unsigned char const type3_H264_SPS_720p30[] = { 0x27, 0x64, 0x00, 0x28, 0xac, 0x34, 0xc8, 0x05, 0x00, 0x5b, 0xb0, 0x16, 0xa0, 0x20, 0x20, 0x28, 0x00, 0x00, 0x1f, 0x48, 0x00, 0x07, 0x53, 0x07, 0x43, 0x00, 0x03, 0x93, 0x80, 0x00, 0x01, 0x01, 0x7d, 0xd7, 0x79, 0x71, 0xa1, 0x80, 0x01, 0xc9, 0xc0, 0x00, 0x00, 0x80, 0xbe, 0xeb, 0xbc, 0xb8, 0x7c, 0x22, 0x11, 0x47, 0x80 };
+static unsigned char const type3_H264_SPS_480p30[] = { 0x67, 0x64, 0x00, 0x32, 0xac, 0xb4, 0x05, 0xa1, 0xed, 0x2a, 0x40, 0x00, 0x00, 0xfa, 0x00, 0x00, 0x3a, 0x98, 0x18, 0x10, 0x00, 0x1e, 0x84, 0x80, 0x06, 0xdd, 0xef, 0x7b, 0xe1, 0x78, 0x44, 0x23, 0x50 };
+
+static unsigned char const type3_H264_PPS_default[] = { 0x28, 0xee, 0x38, 0xb0 };
+static unsigned char const type3_H264_PPS_MavicMini[] = { 0x68, 0xee, 0x38, 0x30 };
+static unsigned char const type3_H264_PPS_3000p30[] = { 0x28, 0xee, 0x38, 0xe1, 0x18, 0x46, 0x11, 0x84, 0x61, 0x18, 0x46, 0x11, 0x84, 0x70 };
+static unsigned char const type3_H265_PPS_2160x4096p30[] = { 0x42, 0x01, 0x01, 0x21, 0x60, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x96, 0xa0, 0x00, 0x80, 0x08, 0x00, 0x87, 0x1f, 0xe5, 0xae, 0xed, 0x4d, 0xdd, 0xc9, 0x75, 0x80, 0xb5, 0x01, 0x01, 0x01, 0x04, 0x00, 0x00, 0x0f, 0xa0, 0x00, 0x01, 0x86, 0xa0, 0xae, 0x11, 0x08, 0x20 };
+static unsigned char const type3_H265_PPS_2160x3840p30[] = { 0x42, 0x01, 0x01, 0x21, 0x60, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x96, 0xa0, 0x01, 0xe0, 0x20, 0x02, 0x1c, 0x7f, 0x96, 0xbb, 0xb5, 0x37, 0x77, 0x25, 0xd6, 0x02, 0xd4, 0x04, 0x04, 0x04, 0x10, 0x00, 0x00, 0x3e, 0x90, 0x00, 0x07, 0x53, 0x02, 0xb8, 0x44, 0x20, 0x80 };
+static unsigned char const type3_H265_PPS_2160x3840p25[] = { 0x42, 0x01, 0x01, 0x21, 0x60, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x96, 0xa0, 0x01, 0xe0, 0x20, 0x02, 0x1c, 0x7f, 0x96, 0xbb, 0xb5, 0x37, 0x77, 0x25, 0xd6, 0x02, 0xd4, 0x04, 0x04, 0x04, 0x10, 0x00, 0x00, 0x3e, 0x80, 0x00, 0x06, 0x1a, 0x82, 0xb8, 0x44, 0x20, 0x80 };
+static unsigned char const type3_H265_PPS_1530p50[] = { 0x42, 0x01, 0x01, 0x21, 0x60, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x96, 0xa0, 0x01, 0x54, 0x20, 0x06, 0x01, 0xf2, 0x65, 0xae, 0xed, 0x4d, 0xdd, 0xc9, 0x75, 0x80, 0xb5, 0x01, 0x01, 0x01, 0x04, 0x00, 0x00, 0x0f, 0xa4, 0x00, 0x03, 0x0d, 0x40, 0xae, 0x11, 0x08, 0x20 };
+static unsigned char const type3_H265_PPS_1080p120[] = { 0x42, 0x01, 0x01, 0x21, 0x60, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x96, 0xa0, 0x03, 0xc0, 0x80, 0x10, 0xe7, 0xf9, 0x6b, 0xbb, 0x53, 0x77, 0x72, 0x5d, 0x60, 0x2d, 0x40, 0x40, 0x40, 0x41, 0x00, 0x00, 0x03, 0x03, 0xe9, 0x00, 0x01, 0xd4, 0xc0, 0x2b, 0x84, 0x42, 0x08 };
+static unsigned char const type3_H265_PPS_1080p60[] = { 0x42, 0x01, 0x01, 0x21, 0x60, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x7b, 0xa0, 0x03, 0xc0, 0x80, 0x10, 0xe7, 0xf9, 0x6b, 0xbb, 0x53, 0x77, 0x72, 0x5d, 0x60, 0x2d, 0x40, 0x40, 0x40, 0x41, 0x00, 0x00, 0x03, 0x03, 0xe9, 0x00, 0x00, 0xea, 0x60, 0x2b, 0x84, 0x42, 0x08 };
+static unsigned char const type3_H265_PPS_1080p25[] = { 0x42, 0x01, 0x01, 0x21, 0x60, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x7b, 0xa0, 0x03, 0xc0, 0x80, 0x10, 0xa7, 0xf9, 0x6b, 0xbb, 0x53, 0x77, 0x72, 0x5d, 0x60, 0x2d, 0x40, 0x40, 0x40, 0x41, 0x00, 0x00, 0x03, 0x03, 0xe8, 0x00, 0x00, 0x61, 0xa8, 0x2b, 0x84, 0x42, 0x08 };
+static unsigned char const type3_H264_PPS_480p[] = { 0x68, 0xee, 0x3c, 0xb0 };
+
+static unsigned char const type3_H265_VPS_2160x4096p30[] = { 0x44, 0x01, 0xc1, 0x72, 0xb0, 0x9c, 0x0a, 0xc1, 0x5e, 0x24 };
+static unsigned char const type3_H265_VPS_2160x3840[] = { 0x44, 0x01, 0xc1, 0x72, 0xb0, 0x9c, 0x0a, 0x01, 0x46, 0x24 };
+static unsigned char const type3_H265_VPS_1530p[] = { 0x44, 0x01, 0xc1, 0x72, 0xb0, 0x9c, 0x1d, 0x0e, 0xe2, 0x40 };
+static unsigned char const type3_H265_VPS_1080p[] = { 0x44, 0x01, 0xc1, 0x72, 0xb0, 0x9c, 0x14, 0x0a, 0x62, 0x40 };
+
+/* The parameter set NAL units for the 'type 5' formats: */
+#define type5_H264_SPS_2160x3840p30_DJIMini2 type3_H264_SPS_2160x3840p30_DJIMini2 /* same */
+static unsigned char const type5_H264_SPS_2160x3840p25[] = { 0x67, 0x64, 0x00, 0x33, 0xac, 0x4d, 0x00, 0x78, 0x00, 0x87, 0xd0, 0x80, 0x00, 0x01, 0xf4, 0x00, 0x00, 0x61, 0xa8, 0x47, 0x8a, 0x15, 0x50 };
+#define type5_H264_SPS_2160x3840p24_DJIMini2 type3_H264_SPS_2160x3840p24_DJIMini2 /* same */
+
+#define type5_H264_SPS_1080p48_DJIMini2 type3_H264_SPS_1080p48_DJIMini2 /* same */
+static unsigned char const type5_H264_SPS_1080p30_MavicAir[] = { 0x67, 0x64, 0x00, 0x29, 0xac, 0x4d, 0x00, 0xf0, 0x04, 0x4f, 0xca, 0x80 };
+static unsigned char const type5_H264_SPS_1080p25_MavicAir[] = { 0x67, 0x64, 0x00, 0x32, 0xac, 0x4d, 0x00, 0xf0, 0x04, 0x4f, 0xca, 0x80 };
+static unsigned char const type5_H264_SPS_720p30[] = { 0x67, 0x64, 0x00, 0x1f, 0xac, 0xb4, 0x02, 0x80, 0x2d, 0xd2, 0x90, 0x50, 0x60, 0x50, 0x6d, 0x0a, 0x13, 0x50 };
+static unsigned char const type5_H264_SPS_720p24[] = { 0x67, 0x42, 0x80, 0x1f, 0xda, 0x01, 0x40, 0x16, 0xe9, 0x48, 0x28, 0x30, 0x30, 0x36, 0x85, 0x09, 0xa8 };
+static unsigned char const type5_H265_SPS_2160x3840p100[] = { 0x40, 0x01, 0x0c, 0x01, 0xff, 0xff, 0x22, 0x20, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x96, 0xac, 0x0c, 0x00, 0x00, 0x03, 0x01, 0x90, 0x00, 0x00, 0x9c, 0x41, 0x40 };
+static unsigned char const type5_H265_SPS_2160x3840p60[] = { 0x40, 0x01, 0x0c, 0x01, 0xff, 0xff, 0x21, 0x60, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x96, 0xac, 0x0c, 0x00, 0x00, 0x03, 0x01, 0x90, 0x00, 0x00, 0x5d, 0xa9, 0x40 };
+static unsigned char const type5_H265_SPS_2160x3840p30[] = { 0x40, 0x01, 0x0c, 0x01, 0xff, 0xff, 0x01, 0x40, 0x00, 0x00, 0x03, 0x00, 0x80, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x96, 0xac, 0x0c, 0x00, 0x00, 0x0f, 0xa0, 0x00, 0x01, 0xc5, 0x22, 0x00, 0xfa, 0x28 };
+static unsigned char const type5_H265_SPS_2016p60[] = { 0x40, 0x01, 0x0c, 0x01, 0xff, 0xff, 0x22, 0x20, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x96, 0xac, 0x0c, 0x00, 0x00, 0x03, 0x01, 0x90, 0x00, 0x00, 0x5d, 0xa9, 0x40 };
+static unsigned char const type5_H265_SPS_1080p50[] = { 0x40, 0x01, 0x0c, 0x01, 0xff, 0xff, 0x22, 0x20, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x96, 0xac, 0x0c, 0x00, 0x00, 0x03, 0x01, 0x90, 0x00, 0x00, 0x4e, 0x21, 0x40 };
+
+#define type5_H264_PPS_DJIMini2 type3_H264_PPS_MavicMini /* same */
+static unsigned char const type5_H264_PPS_MavicAir[] = { 0x68, 0xea, 0x8f, 0x2c };
+static unsigned char const type5_H265_PPS_2160p100[] = { 0x42, 0x01, 0x01, 0x22, 0x20, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x96, 0xa0, 0x01, 0xe0, 0x20, 0x02, 0x1c, 0x7e, 0xd9, 0x6b, 0xbb, 0x72, 0x6b, 0xb1, 0x35, 0x01, 0x01, 0x01, 0x04, 0x00, 0x00, 0x03, 0x01, 0x90, 0x00, 0x00, 0x9c, 0x40,0x20 };
+static unsigned char const type5_H265_PPS_2160p60[] = { 0x42, 0x01, 0x01, 0x21, 0x60, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x96, 0xa0, 0x01, 0xe0, 0x20, 0x02, 0x1c, 0x7f, 0x96, 0xbb, 0xb7, 0x26, 0xbb, 0x13, 0x50, 0x10, 0x10, 0x10, 0x08 };
+static unsigned char const type5_H265_PPS_2160p30[] = { 0x42, 0x01, 0x01, 0x01, 0x40, 0x00, 0x00, 0x03, 0x00, 0x80, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x96, 0xa0, 0x01, 0xe0, 0x20, 0x02, 0x1c, 0x7f, 0xa2, 0xee, 0xc9, 0x57, 0x7a, 0x25, 0xd5, 0x81, 0x00, 0x00, 0x03, 0x03, 0xe8, 0x00, 0x00, 0x71, 0x48, 0xc4 };
+//static unsigned char const type5_H265_PPS_2016p60[] = { 0x42, 0x01, 0x01, 0x21, 0x60, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x96, 0xa0, 0x01, 0x50, 0x20, 0x07, 0xe1, 0xfe, 0x5a, 0xee, 0xdc, 0x9a, 0xec, 0x4d, 0x40, 0x40, 0x40, 0x40, 0x20 };
+static unsigned char const type5_H265_PPS_2016p60[] = { 0x42, 0x01, 0x01, 0x22, 0x20, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x96, 0xa0, 0x01, 0x50, 0x20, 0x07, 0xe1, 0xfb, 0x65, 0xae, 0xed, 0xc9, 0xae, 0xc4, 0xd4, 0x04, 0x04, 0x04, 0x02 };
+static unsigned char const type5_H264_SPS_1520p60[] = { 0x67, 0x64, 0x00, 0x34, 0xac, 0x4d, 0x00, 0x54, 0x01, 0x7f, 0xf2, 0xcd, 0x40, 0x40, 0x40, 0x50, 0x00, 0x00, 0x06, 0x40, 0x00, 0x02, 0xed, 0x40, 0xf1, 0xc3, 0x2a };
+static unsigned char const type5_H264_PPS_1520p60[] = { 0x68, 0xee, 0x3c, 0xb0 };
+static unsigned char const type5_H265_PPS_1080p50[] = { 0x42, 0x01, 0x01, 0x22, 0x20, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x96, 0xa0, 0x03, 0xc0, 0x80, 0x10, 0xe7, 0xed, 0x96, 0xbb, 0xb7, 0x26, 0xbb, 0x13, 0x50, 0x10, 0x10, 0x10, 0x40, 0x00, 0x00, 0x19, 0x00, 0x00, 0x04, 0xe2, 0x02 };
+static unsigned char const type5_H264_PPS_720p30[] = { 0x68, 0xee, 0x06, 0xf2, 0xc0 };
+static unsigned char const type5_H264_PPS_720p24[] = { 0x68, 0xce, 0x06, 0xf2 };
+
+static unsigned char const type5_H265_VPS_default[] = { 0x44, 0x01, 0xc0, 0x73, 0xc2, 0x5e, 0x24 };
+static unsigned char const type5_H265_VPS_2160p30[] = { 0x44, 0x01, 0xc1, 0xad, 0xf0, 0x13, 0x64 };
+static unsigned char const type5_H265_VPS_1080p50[] = { 0x44, 0x01, 0xc0, 0x73, 0x12, 0x24, 0x08, 0x90 };
+
+typedef struct ParameterSet {
+  unsigned char const* data;
+  unsigned size; /* 0 if not used */
+} ParameterSet;
+
+#define PARAMETER_SET(nal) { (nal), sizeof (nal) }
+
+struct VideoFormat {
+  int repairType; /* 2, 3, or 5 */
+  char code; /* as typed in response to this repair type's prompt (in either case, if a letter) */
+  char const* name; /* for "-f"; e.g., "h265-2160p60" */
+  char const* description; /* as shown in the prompt */
+  int codec; /* 1 for H.264; 2 for H.265 */
+  unsigned frameRate;
+  ParameterSet parameterSets[3]; /* in the order that we write them (for H.265: VPS, SPS, PPS) */
+};
+
+#define MAX_NUM_FORMATS 64 /* the most video formats that any repair type has */
+
+static VideoFormat const videoFormats[] = {
+  { 2, '0', "h264-2160p30", "2160p, 30fps", 1, 30, { PARAMETER_SET(SPS_2160p30), PARAMETER_SET(PPS_Inspire) } },
+  { 2, '1', "h264-4096x2160p25", "2160(x4096)p(4K), 25fps", 1, 25, { PARAMETER_SET(SPS_2160x4096p25), PARAMETER_SET(PPS_Inspire) } },
+  { 2, '2', "h264-2160p25", "2160(x3840)p(UHD-1), 25fps", 1, 25, { PARAMETER_SET(SPS_2160x3840p25), PARAMETER_SET(PPS_Inspire) } },
+  { 2, '3', "h264-4096x2160p24", "2160(x4096)p(4K), 24fps", 1, 24, { PARAMETER_SET(SPS_2160x4096p24), PARAMETER_SET(PPS_Inspire) } },
+  { 2, '4', "h264-2160p24", "2160(x3840)p(UHD-1), 24fps", 1, 24, { PARAMETER_SET(SPS_2160x3840p24), PARAMETER_SET(PPS_Inspire) } },
+  { 2, '5', "h264-1530p30", "1530p, 30fps", 1, 30, { PARAMETER_SET(SPS_1530p30), PARAMETER_SET(PPS_Inspire) } },
+  { 2, '6', "h264-1530p25", "1530p, 25fps", 1, 25, { PARAMETER_SET(SPS_1530p25), PARAMETER_SET(PPS_Inspire) } },
+  { 2, '7', "h264-1530p24", "1530p, 24fps", 1, 24, { PARAMETER_SET(SPS_1530p24), PARAMETER_SET(PPS_Inspire) } },
+  { 2, '8', "h264-1520p60", "1520p, 60fps", 1, 60, { PARAMETER_SET(SPS_1520p60), PARAMETER_SET(PPS_Inspire) } },
+  { 2, '9', "h264-1520p30", "1520p, 30fps", 1, 30, { PARAMETER_SET(SPS_1520p30), PARAMETER_SET(PPS_Inspire) } },
+  { 2, 'A', "h264-1520p25", "1520p, 25fps", 1, 25, { PARAMETER_SET(SPS_1520p25), PARAMETER_SET(PPS_Inspire) } },
+  { 2, 'B', "h264-1520p24", "1520p, 24fps", 1, 24, { PARAMETER_SET(SPS_1520p24), PARAMETER_SET(PPS_Inspire) } },
+  { 2, 'C', "h264-1080p60", "1080p, 60fps", 1, 60, { PARAMETER_SET(SPS_1080p60), PARAMETER_SET(PPS_Inspire) } },
+  { 2, 'D', "h264-1080i60", "1080i, 60fps", 1, 30, { PARAMETER_SET(SPS_1080i60), PARAMETER_SET(PPS_P2VP) } },
+  { 2, 'E', "h264-1080p50", "1080p, 50fps", 1, 50, { PARAMETER_SET(SPS_1080p50), PARAMETER_SET(PPS_Inspire) } },
+  { 2, 'F', "h264-1080p48", "1080p, 48fps", 1, 48, { PARAMETER_SET(SPS_1080p48), PARAMETER_SET(PPS_Inspire) } },
+  { 2, 'G', "h264-1080p30", "1080p, 30fps", 1, 30, { PARAMETER_SET(SPS_1080p30_default), PARAMETER_SET(PPS_For1080pNew) } },
+  { 2, 'H', "h264-1080p30-zenmuse", "1080p, 30fps (Zenmuse)", 1, 30, { PARAMETER_SET(SPS_1080p30_advanced), PARAMETER_SET(PPS_Inspire) } },
+  { 2, 'I', "h264-1080p25", "1080p, 25fps", 1, 25, { PARAMETER_SET(SPS_1080p25), PARAMETER_SET(PPS_P2VP) } },
+  { 2, 'J', "h264-1080p24", "1080p, 24fps", 1, 24, { PARAMETER_SET(SPS_1080p24), PARAMETER_SET(PPS_Inspire) } },
+  { 2, 'K', "h264-720p60", "720p, 60fps", 1, 60, { PARAMETER_SET(SPS_720p60_default), PARAMETER_SET(PPS_P2VP) } },
+  { 2, 'L', "h264-720p60-osmoplus", "720p, 60fps (Osmo+)", 1, 60, { PARAMETER_SET(SPS_720p60_advanced), PARAMETER_SET(PPS_Inspire) } },
+  { 2, 'M', "h264-720p50", "720p, 50fps", 1, 50, { PARAMETER_SET(SPS_720p50), PARAMETER_SET(PPS_Inspire) } },
+  { 2, 'N', "h264-720p48", "720p, 48fps", 1, 48, { PARAMETER_SET(SPS_720p48), PARAMETER_SET(PPS_Inspire) } },
+  { 2, 'O', "h264-720p30", "720p, 30fps", 1, 30, { PARAMETER_SET(SPS_720p30), PARAMETER_SET(PPS_P2VP) } },
+  { 2, 'P', "h264-720p25", "720p, 25fps", 1, 25, { PARAMETER_SET(SPS_720p25), PARAMETER_SET(PPS_Inspire) } },
+  { 2, 'Q', "h264-720p24", "720p, 24fps", 1, 24, { PARAMETER_SET(SPS_720p24), PARAMETER_SET(PPS_Inspire) } },
+  { 2, 'R', "h264-480p30", "480p, 30fps", 1, 30, { PARAMETER_SET(SPS_480p30), PARAMETER_SET(PPS_P2VP) } },
+  { 3, '0', "h264-4096x2160p60", "H.264, 2160(x4096)p(4K), 60fps", 1, 60, { PARAMETER_SET(type3_H264_SPS_2160x4096p60), PARAMETER_SET(type3_H264_PPS_default) } },
+  { 3, '1', "h264-2160p60", "H.264, 2160(x3840)p(UHD-1), 60fps", 1, 60, { PARAMETER_SET(type3_H264_SPS_2160x3840p60), PARAMETER_SET(type3_H264_PPS_default) } },
+  { 3, '2', "h264-4096x2160p50", "H.264, 2160(x4096)p(4K), 50fps", 1, 50, { PARAMETER_SET(type3_H264_SPS_2160x4096p50), PARAMETER_SET(type3_H264_PPS_default) } },
+  { 3, '3', "h264-2160p50", "H.264, 2160(x3840)p(UHD-1), 50fps", 1, 50, { PARAMETER_SET(type3_H264_SPS_2160x3840p50), PARAMETER_SET(type3_H264_PPS_default) } },
+  { 3, '4', "h264-4096x2160p48", "H.264, 2160(x4096)p(4K), 48fps", 1, 48, { PARAMETER_SET(type3_H264_SPS_2160x4096p48), PARAMETER_SET(type3_H264_PPS_default) } },
+  { 3, '5', "h264-2160p48", "H.264, 2160(x3840)p(UHD-1), 48fps", 1, 48, { PARAMETER_SET(type3_H264_SPS_2160x3840p48), PARAMETER_SET(type3_H264_PPS_default) } },
+  { 3, '6', "h265-4096x2160p30", "H.265, 2160(x4096)p(4K), 30fps", 2, 30, { PARAMETER_SET(type3_H265_SPS_2160x4096p30), PARAMETER_SET(type3_H265_PPS_2160x4096p30), PARAMETER_SET(type3_H265_VPS_2160x4096p30) } },
+  { 3, '7', "h264-4096x2160p30", "H.264, 2160(x4096)p(4K), 30fps", 1, 30, { PARAMETER_SET(type3_H264_SPS_2160x4096p30), PARAMETER_SET(type3_H264_PPS_default) } },
+  { 3, '8', "h265-2160p30", "H.265, 2160(x3840)p(UHD-1), 30fps", 2, 30, { PARAMETER_SET(type3_H265_SPS_2160x3840p30), PARAMETER_SET(type3_H265_PPS_2160x3840p30), PARAMETER_SET(type3_H265_VPS_2160x3840) } },
+  { 3, '9', "h264-2160p30-djimini2", "H.264, 2160(x3840)p(UHD-1), 30fps (DJI Mini 2)", 1, 30, { PARAMETER_SET(type3_H264_SPS_2160x3840p30_DJIMini2), PARAMETER_SET(type3_H264_PPS_MavicMini) } },
+  { 3, 'a', "h264-2160p30-other", "H.264, 2160(x3840)p(UHD-1), 30fps (other DJI drones)", 1, 30, { PARAMETER_SET(type3_H264_SPS_2160x3840p30_other), PARAMETER_SET(type3_H264_PPS_default) } },
+  { 3, 'b', "h264-4096x2160p25", "H.264, 2160(x4096)p(4K), 25fps", 1, 25, { PARAMETER_SET(type3_H264_SPS_2160x4096p25), PARAMETER_SET(type3_H264_PPS_default) } },
+  { 3, 'c', "h265-2160p25", "H.265, 2160(x3840)p(UHD-1), 25fps", 2, 25, { PARAMETER_SET(type3_H265_SPS_2160x3840p25), PARAMETER_SET(type3_H265_PPS_2160x3840p25), PARAMETER_SET(type3_H265_VPS_2160x3840) } },
+  { 3, 'd', "h264-2160p25", "H.264, 2160(x3840)p(UHD-1), 25fps", 1, 25, { PARAMETER_SET(type3_H264_SPS_2160x3840p25), PARAMETER_SET(type3_H264_PPS_default) } },
+  { 3, 'e', "h264-2160p24-djimini2", "H.264, 2160(x3840)p(UHD-1), 24fps (DJI Mini 2)", 1, 24, { PARAMETER_SET(type3_H264_SPS_2160x3840p24_DJIMini2), PARAMETER_SET(type3_H264_PPS_MavicMini) } },
+  { 3, 'f', "h264-2160p24-other", "H.264, 2160(x3840)p(UHD-1), 24fps (other DJI drones)", 1, 24, { PARAMETER_SET(type3_H264_SPS_2160x3840p24_other), PARAMETER_SET(type3_H264_PPS_default) } },
+  { 3, 'g', "h264-1530p60", "H.264, 1530p, 60fps", 1, 60, { PARAMETER_SET(type3_H264_SPS_1530p60), PARAMETER_SET(type3_H264_PPS_MavicMini) } },
+  { 3, 'h', "h265-1530p50", "H.265, 1530p, 50fps", 2, 50, { PARAMETER_SET(type3_H265_SPS_1530p50), PARAMETER_SET(type3_H265_PPS_1530p50), PARAMETER_SET(type3_H265_VPS_1530p) } },
+  { 3, 'i', "h264-1530p48", "H.264, 1530p, 48fps", 1, 48, { PARAMETER_SET(type3_H264_SPS_1530p48), PARAMETER_SET(type3_H264_PPS_MavicMini) } },
+  { 3, 'j', "h264-1530p30", "H.264, 1530p, 30fps", 1, 30, { PARAMETER_SET(type3_H264_SPS_1530p30), PARAMETER_SET(type3_H264_PPS_MavicMini) } },
+  { 3, 'k', "h264-1530p25", "H.264, 1530p, 25fps", 1, 25, { PARAMETER_SET(type3_H264_SPS_1530p25), PARAMETER_SET(type3_H264_PPS_MavicMini) } },
+  { 3, 'l', "h264-1530p24-mavicmini", "H.264, 1530p, 24fps (Mavic Mini)", 1, 24, { PARAMETER_SET(type3_H264_SPS_1530p24_MavicMini), PARAMETER_SET(type3_H264_PPS_MavicMini) } },
+  { 3, 'm', "h264-1530p24-other", "H.264, 1530p, 24fps (other DJI drones)", 1, 24, { PARAMETER_SET(type3_H264_SPS_1530p24_other), PARAMETER_SET(type3_H264_PPS_default) } },
+  //{ 3, 'n', "h265-1080p120", "H.265, 1080p, 120fps", 2, 120, { PARAMETER_SET(type3_H265_SPS_1080p120), PARAMETER_SET(type3_H265_PPS_1080p120), PARAMETER_SET(type3_H265_VPS_1080p) } },
+  //{ 3, 'o', "h264-1080p120", "H.264, 1080p, 120fps", 1, 120, { PARAMETER_SET(type3_H264_SPS_1080p120), PARAMETER_SET(type3_H264_PPS_default) } },
+  { 3, 'n', "h265-1080p60", "H.265, 1080p, 60fps", 2, 60, { PARAMETER_SET(type3_H265_SPS_1080p60), PARAMETER_SET(type3_H265_PPS_1080p60), PARAMETER_SET(type3_H265_VPS_1080p) } },
+  { 3, 'o', "h264-1080p60-mavicmini", "H.264, 1080p, 60fps (Mavic Mini)", 1, 60, { PARAMETER_SET(type3_H264_SPS_1080p60_MavicMini), PARAMETER_SET(type3_H264_PPS_MavicMini) } },
+  { 3, 'p', "h264-1080p60-other", "H.264, 1080p, 60fps (other DJI drones)", 1, 60, { PARAMETER_SET(type3_H264_SPS_1080p60_other), PARAMETER_SET(type3_H264_PPS_default) } },
+  { 3, 'q', "h264-1080p50", "H.264, 1080p, 50fps", 1, 50, { PARAMETER_SET(type3_H264_SPS_1080p50_MavicMini), PARAMETER_SET(type3_H264_PPS_MavicMini) } },
+  { 3, 'r', "h264-1080p48", "H.264, 1080p, 48fps", 1, 48, { PARAMETER_SET(type3_H264_SPS_1080p48_DJIMini2), PARAMETER_SET(type3_H264_PPS_MavicMini) } },
+  { 3, 's', "h264-1080p30-mavicmini", "H.264, 1080p, 30fps (Mavic Mini)", 1, 30, { PARAMETER_SET(type3_H264_SPS_1080p30_MavicMini), PARAMETER_SET(type3_H264_PPS_MavicMini) } },
+  { 3, 't', "h264-1080p30-other", "H.264, 1080p, 30fps (other DJI drones)", 1, 30, { PARAMETER_SET(type3_H264_SPS_1080p30_other), PARAMETER_SET(type3_H264_PPS_default) } },
+  { 3, 'u', "h265-1080p25", "H.265, 1080p, 25fps", 2, 25, { PARAMETER_SET(type3_H265_SPS_1080p25), PARAMETER_SET(type3_H265_PPS_1080p25), PARAMETER_SET(type3_H265_VPS_1080p) } },
+  { 3, 'v', "h264-1080p25-mavicmini", "H.264, 1080p, 25fps (Mavic Mini)", 1, 25, { PARAMETER_SET(type3_H264_SPS_1080p25_MavicMini), PARAMETER_SET(type3_H264_PPS_MavicMini) } },
+  { 3, 'w', "h264-1080p25-other", "H.264, 1080p, 25fps (other DJI drones)", 1, 25, { PARAMETER_SET(type3_H264_SPS_1080p25_other), PARAMETER_SET(type3_H264_PPS_default) } },
+  { 3, 'x', "h264-1080p24-mavicmini", "H.264, 1080p, 24fps (Mavic Mini)", 1, 24, { PARAMETER_SET(type3_H264_SPS_1080p24_MavicMini), PARAMETER_SET(type3_H264_PPS_MavicMini) } },
+  { 3, 'y', "h264-1080p24-other", "H.264, 1080p, 24fps (other DJI drones)", 1, 24, { PARAMETER_SET(type3_H264_SPS_1080p24_other), PARAMETER_SET(type3_H264_PPS_default) } },
+  //{ 3, 'y', "h264-720p30", "H.264, 720p, 30fps", 1, 30, { PARAMETER_SET(type3_H264_SPS_720p30), PARAMETER_SET(type3_H264_PPS_default) } },
+  { 3, 'z', "h264-480p30-flir", "H.264, 480p, 30fps (e.g., from a XL FLIR camera)", 1, 30, { PARAMETER_SET(type3_H264_SPS_480p30), PARAMETER_SET(type3_H264_PPS_480p) } },
+  { 5, '0', "h265-2160p100", "H.265, 2160(x3840)p(UHD-1), 100fps", 2, 100, { PARAMETER_SET(type5_H265_SPS_2160x3840p100), PARAMETER_SET(type5_H265_PPS_2160p100), PARAMETER_SET(type5_H265_VPS_default) } },
+  { 5, '1', "h265-2160p60", "H.265, 2160(x3840)p(UHD-1), 60fps", 2, 60, { PARAMETER_SET(type5_H265_SPS_2160x3840p60), PARAMETER_SET(type5_H265_PPS_2160p60), PARAMETER_SET(type5_H265_VPS_default) } },
+  { 5, '2', "h265-2160p30", "H.265, 2160(x3840)p(UHD-1), 30fps", 2, 30, { PARAMETER_SET(type5_H265_SPS_2160x3840p30), PARAMETER_SET(type5_H265_PPS_2160p30), PARAMETER_SET(type5_H265_VPS_2160p30) } },
+  { 5, '3', "h264-2160p30", "H.264, 2160(x3840)p(UHD-1), 30fps", 1, 30, { PARAMETER_SET(type5_H264_SPS_2160x3840p30_DJIMini2), PARAMETER_SET(type5_H264_PPS_DJIMini2) } },
+  { 5, '4', "h264-2160p25", "H.264, 2160(x3840)p(UHD-1), 25fps", 1, 25, { PARAMETER_SET(type5_H264_SPS_2160x3840p25), PARAMETER_SET(type5_H264_PPS_MavicAir) } },
+  { 5, '5', "h264-2160p24", "H.264, 2160(x3840)p(UHD-1), 24fps", 1, 24, { PARAMETER_SET(type5_H264_SPS_2160x3840p24_DJIMini2), PARAMETER_SET(type5_H264_PPS_DJIMini2) } },
+  { 5, '6', "h265-2016p60", "H.265, 2016p, 60fps", 2, 60, { PARAMETER_SET(type5_H265_SPS_2016p60), PARAMETER_SET(type5_H265_PPS_2016p60), PARAMETER_SET(type5_H265_VPS_default) } },
+  { 5, '7', "h264-1520p60", "H.264, 1520p, 60fps", 1, 60, { PARAMETER_SET(type5_H264_SPS_1520p60), PARAMETER_SET(type5_H264_PPS_1520p60) } },
+  { 5, '8', "h265-1080p50", "H.265, 1080p, 50fps", 2, 50, { PARAMETER_SET(type5_H265_SPS_1080p50), PARAMETER_SET(type5_H265_PPS_1080p50), PARAMETER_SET(type5_H265_VPS_1080p50) } },
+  { 5, '9', "h264-1080p48", "H.264, 1080p, 48fps", 1, 48, { PARAMETER_SET(type5_H264_SPS_1080p48_DJIMini2), PARAMETER_SET(type5_H264_PPS_DJIMini2) } },
+  { 5, 'A', "h264-1080p30", "H.264, 1080p, 30fps", 1, 30, { PARAMETER_SET(type5_H264_SPS_1080p30_MavicAir), PARAMETER_SET(type5_H264_PPS_MavicAir) } },
+  { 5, 'B', "h264-1080p25", "H.264, 1080p, 25fps", 1, 25, { PARAMETER_SET(type5_H264_SPS_1080p25_MavicAir), PARAMETER_SET(type5_H264_PPS_MavicAir) } },
+  { 5, 'C', "h264-720p30", "H.264, 720p, 30fps", 1, 30, { PARAMETER_SET(type5_H264_SPS_720p30), PARAMETER_SET(type5_H264_PPS_720p30) } },
+  { 5, 'D', "h264-720p24", "H.264, 720p, 24fps", 1, 24, { PARAMETER_SET(type5_H264_SPS_720p24), PARAMETER_SET(type5_H264_PPS_720p24) } },
+  { 0 }
+};
+
+static VideoFormat const* formatsForRepairType(int repairType) {
+  /* The first of the (consecutive) video formats for "repairType"; or NULL if it has none: */
+  VideoFormat const* format;
+
+  for (format = videoFormats; format->repairType != 0; ++format) {
+    if (format->repairType == repairType) return format;
+  }
+  return NULL;
+}
+
+static VideoFormat const* findVideoFormat(int repairType, int formatCode) {
+  /* The video format whose code (as typed, in either case) is "formatCode"; or NULL: */
+  VideoFormat const* format = formatsForRepairType(repairType);
+
+  for (; format != NULL && format->repairType == repairType; ++format) {
+    if ((format->code|0x20) == (formatCode|0x20)) return format;
+  }
+  return NULL;
+}
+
+static int sameNameIgnoringCase(char const* name1, char const* name2) {
+  while (*name1 != '\0' && (*name1|0x20) == (*name2|0x20)) { ++name1; ++name2; }
+  return *name1 == '\0' && *name2 == '\0';
+}
+
+static int lookUpFormat(int repairType, char const* spec) {
+  /* Return the format code (as typed in response to this repair type's prompt) for "spec" -
+     which is either a code or a name - or 0 if it's not a format for this repair type: */
+  VideoFormat const* format = formatsForRepairType(repairType);
+
+  if (format != NULL && sameNameIgnoringCase(spec, "auto")) return AUTO_FORMAT_CODE;
+  if (spec[0] != '\0' && spec[1] == '\0') {
+    format = findVideoFormat(repairType, spec[0]);
+    return format != NULL ? format->code : 0;
+  }
+  for (; format != NULL && format->repairType == repairType; ++format) {
+    if (sameNameIgnoringCase(spec, format->name)) return format->code;
+  }
+  return 0;
+}
+
+static int parseFormatOption(char const* option, int formatCodes[]) {
+  /* Record (in "formatCodes[]") the format code(s) for a "-f" option.  Returns 0 if this is not
+     a format for any repair type: */
+  int repairType, isValid = 0;
+
+  if (strncmp(option, "type", 4) == 0 && option[4] != '\0' && option[5] == ':') {
+    repairType = option[4] - '0';
+    if (formatsForRepairType(repairType) == NULL) return 0;
+    formatCodes[repairType] = lookUpFormat(repairType, &option[6]);
+    return formatCodes[repairType] != 0;
+  }
+
+  /* Otherwise, the format applies to each repair type for which it's valid: */
+  for (repairType = 2; repairType <= 5; ++repairType) {
+    int formatCode = lookUpFormat(repairType, option);
+
+    if (formatCode != 0) {
+      formatCodes[repairType] = formatCode;
+      isValid = 1;
+    }
+  }
+  return isValid;
+}
+
+#ifndef DJIFIX_LIBRARY
+static void listFormatNames(void) {
+  int repairType;
+
+  for (repairType = 2; repairType <= 5; ++repairType) {
+    VideoFormat const* format = formatsForRepairType(repairType);
+
+    if (format == NULL) continue;
+    fprintf(stderr, "Video formats for 'type %d' repairs:\n", repairType);
+    for (; format->repairType == repairType; ++format) {
+      fprintf(stderr, "\t%c\ttype%d:%s\n", format->code, repairType, format->name);
+    }
+  }
+}
+
+static void printProbeResult(FILE* fid, RepairJob const* job) {
+  /* One line, saying what "--probe" found for "job": */
+  ProbeResult const* probe = &job->probe;
+
+  if (!job->repairIsOK) {
+    fprintf(fid, "%s: can't be repaired\n", job->fileName);
+    return;
+  }
+  fprintf(fid, "%s: 'type %d' repair, data at file position 0x%08lx", job->fileName, probe->repairType, probe->dataOffset);
+  if (probe->repairType == 2 || probe->repairType == 3 || probe->repairType == 5) {
+    VideoFormat const* format = findVideoFormat(probe->repairType, probe->formatCode);
+
+    if (format != NULL) {
+      fprintf(fid, ", video format type%d:%s", probe->repairType, format->name);
+    } else {
+      fprintf(fid, ", video format not known");
+    }
+  }
+  fprintf(fid, "\n");
+}
+#endif
+
+static void printFormatMenu(RepairContext* ctx, int repairType, char* validCodes) {
+  /* Print the part of the format prompt that lists our video formats for "repairType", and set
+     "validCodes" (which has room for 2*"MAX_NUM_FORMATS" codes) to the codes that may be typed: */
+  VideoFormat const* format = formatsForRepairType(repairType);
+
+  for (; format != NULL && format->repairType == repairType; ++format) {
+    fprintf(ctx->log, "\tIf the video format was %s: Type %c, then the \"Return\" key.\n", format->description, format->code);
+    *validCodes++ = format->code;
+    if ((format->code >= 'a' && format->code <= 'z') || (format->code >= 'A' && format->code <= 'Z')) {
+      *validCodes++ = format->code^0x20; /* (the other case) */
+    }
+  }
+  *validCodes = '\0';
+}
+
+static int canPromptForFormatCode(RepairContext* ctx) {
+  if (!ctx->canPrompt) fprintf(ctx->log, "The video format is not known.%s\n", cantRepair);
+  return ctx->canPrompt;
+}
+
+static int readFormatCode(RepairContext* ctx, char const* validCodes) {
+  /* Read the video format code that the user typed (after being prompted for it).  Returns 0 if
+     it's not one of "validCodes", or EOF if we reached the end of the input instead: */
+  int formatCode;
+
+#ifdef HAVE_PTHREADS
+  /* If other files are being repaired at the same time, show our prompt (and read the answer)
+     while no other repair is printing (or prompting): */
+  if (ctx->stderrMutex != NULL) {
+    pthread_mutex_lock(ctx->stderrMutex);
+    showRepairLog(ctx);
+  }
+#endif
+  do {formatCode = getchar(); } while (formatCode == '\r' || formatCode == '\n');
+#ifdef HAVE_PTHREADS
+  if (ctx->stderrMutex != NULL) pthread_mutex_unlock(ctx->stderrMutex);
+#endif
+  if (formatCode == EOF) {
+    fprintf(ctx->log, "No video format was entered.%s\n", cantRepair);
+    return EOF;
+  }
+  if (formatCode == '\0' || strchr(validCodes, formatCode) == NULL) return 0;
+  return formatCode;
+}
+
+static int openInputFile(InputFile* input, char const* fileName, MemoryBudget* memory) {
+  FILE* fid;
+  unsigned char* buffer = NULL;
+  size_t bufferSize = 0, numRead;
+
+  memset(input, 0, sizeof *input);
+  input->fd = input->holesFD = -1;
+  input->scanLimit = ~0UL;
+  input->memory = memory;
+
+#ifdef HAVE_MMAP
+  {
+    struct stat sb;
+    int fd = open(fileName, O_RDONLY);
+
+    if (fd < 0) return 0;
+    if (fstat(fd, &sb) != 0) sb.st_mode = 0;
+    if (S_ISREG(sb.st_mode) && (off_t)(unsigned long)sb.st_size != sb.st_size) {
+      /* The file is too large for our file positions (which can happen only if "long" is 32 bits): */
+      close(fd);
+      errno = EFBIG;
+      return 0;
+    }
+    if (S_ISREG(sb.st_mode) && sb.st_size > 0 && (off_t)(size_t)sb.st_size == sb.st_size) {
+      void* mapping = mmap(NULL, (size_t)sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+      if (mapping != MAP_FAILED) {
+#ifdef MADV_SEQUENTIAL
+	madvise(mapping, (size_t)sb.st_size, MADV_SEQUENTIAL);
+#endif
+	input->data = mapping;
+	input->size = (unsigned long)sb.st_size;
+	input->fd = fd;
+	input->isMapped = 1;
+#if defined(SEEK_HOLE) && defined(SEEK_DATA)
+	/* (If less is stored for the file than its size, it's sparse: it has 'holes' - which read
+	   as zeros - that our scans for data can jump over.  See "findNextHole()".) */
+	if ((unsigned long long)sb.st_blocks*512 < (unsigned long long)sb.st_size) input->holesFD = fd;
+#endif
+	return 1;
+      }
+    }
+
+    /* We couldn't map the file (e.g., because it's a pipe), so read all of it into memory instead: */
+    fid = fdopen(fd, "rb");
+    if (fid == NULL) {
+      close(fd);
+      return 0;
+    }
+  }
+#else
+  fid = fopen(fileName, "rb");
+  if (fid == NULL) return 0;
+#endif
+  do {
+    if (input->size == bufferSize) {
+      unsigned char* newBuffer = NULL;
+
+      bufferSize = bufferSize == 0 ? 1024*1024 : 2*bufferSize;
+      errno = EFBIG; /* if the input is too large for our file positions */
+      if (bufferSize > input->size && (unsigned long)bufferSize == bufferSize) {
+	errno = ENOMEM;
+	if (takeMemory(memory, bufferSize - input->windowSize)) {
+	  newBuffer = realloc(buffer, bufferSize);
+	  if (newBuffer == NULL) giveBackMemory(memory, bufferSize - input->windowSize);
+	}
+      }
+      if (newBuffer == NULL) {
+	giveBackMemory(memory, input->windowSize);
+	free(buffer);
+	fclose(fid);
+	return 0;
+      }
+      buffer = newBuffer;
+      input->windowSize = bufferSize;
+    }
+    numRead = fread(&buffer[input->size], 1, bufferSize - input->size, fid);
+    input->size += numRead;
+  } while (numRead > 0);
+  fclose(fid);
+
+  input->data = buffer;
+  return 1;
+}
+
+#define STREAM_LOOKBEHIND (4*1024*1024) /* how much of a stream we keep, from before the cursor */
+#define STREAM_READ_SIZE (1024*1024) /* the least that we read from a stream at a time */
+
+#ifndef DJIFIX_LIBRARY
+static int openInputStream(InputFile* input, FILE* stream, MemoryBudget* memory) {
+  /* Prepare to read the input from "stream" (which need not be seekable), as we go: */
+  memset(input, 0, sizeof *input);
+  input->fd = input->holesFD = -1;
+  input->scanLimit = ~0UL;
+  if (!takeMemory(memory, 4*STREAM_LOOKBEHIND)) {
+    errno = ENOMEM;
+    return 0;
+  }
+  input->windowSize = 4*STREAM_LOOKBEHIND;
+  input->memory = memory;
+  input->data = malloc(input->windowSize);
+  if (input->data == NULL) {
+    closeInputFile(input);
+    errno = ENOMEM;
+    return 0;
+  }
+  input->stream = stream;
+  return 1;
+}
+#endif
+
+static int fillInput(InputFile* input, unsigned long endPosition) {
+  /* If we're reading a stream, make sure that we have all of the input before "endPosition",
+     by reading more (and, if we need the room, discarding whatever is more than
+     "STREAM_LOOKBEHIND" bytes before the cursor).  Returns 0 if we don't have all of it
+     (because the input ended first): */
+  unsigned char* window = (unsigned char*)input->data;
+  unsigned long keepFrom, readEnd;
+  size_t numToRead, numRead;
+
+  if (endPosition <= input->size) return 1;
+  if (input->stream == NULL || input->streamEnded) return 0;
+
+  keepFrom = input->pos > STREAM_LOOKBEHIND ? input->pos - STREAM_LOOKBEHIND : 0;
+  if (keepFrom > input->size) {
+    /* The cursor has been moved far past what we have, so skip (by reading, but not keeping)
+       the input before "keepFrom": */
+    while (input->size < keepFrom && !input->streamEnded) {
+      numToRead = keepFrom - input->size < input->windowSize ? keepFrom - input->size : input->windowSize;
+      numRead = fread(window, 1, numToRead, input->stream);
+      input->size += numRead;
+      if (numRead < numToRead) input->streamEnded = 1;
+    }
+    input->dataStart = input->size;
+    if (endPosition <= input->size) return 1;
+    if (input->streamEnded) return 0;
+  }
+
+  /* Read (at least "STREAM_READ_SIZE" bytes) into the window.  If it's not big enough, first
+     move the part that we're keeping to its start, and then (if we need to) grow it: */
+  readEnd = endPosition - input->size < STREAM_READ_SIZE ? input->size + STREAM_READ_SIZE : endPosition;
+  if (readEnd - input->dataStart > input->windowSize && keepFrom > input->dataStart) {
+    memmove(window, &window[keepFrom - input->dataStart], input->size - keepFrom);
+    input->dataStart = keepFrom;
+  }
+  if (readEnd - input->dataStart > input->windowSize) {
+    unsigned long newWindowSize = readEnd - input->dataStart;
+    unsigned char* newWindow = NULL;
+
+    if (takeMemory(input->memory, newWindowSize - input->windowSize)) {
+      newWindow = realloc(window, newWindowSize);
+      if (newWindow == NULL) giveBackMemory(input->memory, newWindowSize - input->windowSize);
+    }
+    if (newWindow == NULL) {
+      input->streamEnded = input->streamFailed = 1;
+      return 0;
+    }
+    input->data = window = newWindow;
+    input->windowSize = newWindowSize;
+  }
+  numToRead = readEnd - input->size;
+  numRead = fread(&window[input->size - input->dataStart], 1, numToRead, input->stream);
+  input->size += numRead;
+  if (numRead < numToRead) {
+    input->streamEnded = 1;
+    if (ferror(input->stream)) input->streamFailed = 1;
+  }
+  if (input->onRefill != NULL) (*input->onRefill)(input->refillOpaque, input->pos);
+  return endPosition <= input->size;
+}
+
+static int canFillInput(InputFile const* input, unsigned long endPosition) {
+  /* Could "fillInput()" read as far as "endPosition" without going over our "MemoryBudget"?
+     (If it can't, it ends the stream, so we ask first when we only want to look ahead.) */
+  unsigned long keepFrom, readEnd;
+
+  if (endPosition <= input->size || input->stream == NULL || input->streamEnded
+      || input->memory == NULL || input->memory->limit == 0) return 1;
+  keepFrom = input->pos > STREAM_LOOKBEHIND ? input->pos - STREAM_LOOKBEHIND : 0;
+  if (keepFrom < input->dataStart) keepFrom = input->dataStart;
+  if (keepFrom > input->size) keepFrom = input->size;
+  readEnd = endPosition - input->size < STREAM_READ_SIZE ? input->size + STREAM_READ_SIZE : endPosition;
+  return readEnd - keepFrom <= input->windowSize
+    || readEnd - keepFrom - input->windowSize <= input->memory->limit - input->memory->used;
+}
+
+static unsigned char const* inputAt(InputFile const* input, unsigned long position) {
+  /* The byte at "position" (which must be one that we have): */
+  return &input->data[position - input->dataStart];
+}
+
+static void closeInputFile(InputFile* input) {
+#ifdef HAVE_MMAP
+  if (input->isMapped) munmap((void*)input->data, input->size);
+  if (input->fd >= 0) close(input->fd);
+#endif
+  if (!input->isMapped) {
+    free((void*)input->data);
+    giveBackMemory(input->memory, input->windowSize);
+    input->windowSize = 0;
+  }
+  input->data = NULL;
+  input->stream = NULL; /* (we don't close it, because it's "stdin") */
+}
+
+static int seekInput(InputFile* input, long offset) {
+  /* Move the cursor "offset" bytes forward (or backward, if "offset" < 0).  As with "fseek()",
+     we may move past the end of the data (after which reads will fail), but not before its start: */
+  if (offset < 0 && (unsigned long)(-offset) > input->pos - input->dataStart) return 0;
+
+  input->pos += offset;
+  input->atEOF = 0;
+  return 1;
+}
+
+static int seekInputTo(InputFile* input, unsigned long position) {
+  /* (For a stream, we can't go back to before the input that we still have.) */
+  if (position < input->dataStart) return 0;
+
+  input->pos = position;
+  input->atEOF = 0;
+  return 1;
+}
+
+static int skipInput(InputFile* input, unsigned long numBytes) {
+  /* Move the cursor "numBytes" bytes forward.  (Unlike "seekInput()", this works for any size
+     - e.g., from a 64-bit atom size - that a position can hold.) */
+  if (numBytes > ~0UL - input->pos) return 0;
+
+  return seekInputTo(input, input->pos + numBytes);
+}
+
+static int inputHasBytes(InputFile* input, unsigned long numBytes) {
+  /* Check that there are at least "numBytes" unread bytes.  If there aren't, then (as
+     "fgetc()" would have done) read whatever is left, and note that we reached end-of-file: */
+  if (input->pos < input->size && input->size - input->pos >= numBytes) return 1;
+  if (input->stream != NULL && fillInput(input, input->pos + numBytes)) return 1;
+
+  if (input->pos < input->size) input->pos = input->size;
+  input->atEOF = 1;
+  return 0;
+}
+
+static int get1Byte(InputFile* input, unsigned char* result) {
+  if (!inputHasBytes(input, 1)) return 0;
+
+  *result = *inputAt(input, input->pos++);
+  return 1;
+}
+
+static int get2Bytes(InputFile* input, unsigned* result) {
+  unsigned char const* p;
+
+  if (!inputHasBytes(input, 2)) return 0;
+
+  p = inputAt(input, input->pos);
+  *result = (p[0]<<8)|p[1];
+  input->pos += 2;
+  return 1;
+}
+
+static int get4Bytes(InputFile* input, unsigned* result) {
+  if (!peek4Bytes(input, result)) return 0;
+
+  input->pos += 4;
+  return 1;
+}
+
+static int peek4Bytes(InputFile* input, unsigned* result) {
+  /* Like "get4Bytes()", except that we don't move past the bytes that we read: */
+  if (!inputHasBytes(input, 4)) return 0;
+
+  *result = bigEndian4(inputAt(input, input->pos));
+  return 1;
+}
+
+static unsigned bigEndian4(unsigned char const* p) {
+  return ((unsigned)p[0]<<24)|(p[1]<<16)|(p[2]<<8)|p[3];
+}
+
+/* The vectorized parts of the scans below.  Each skips - a whole vector at a time - positions
+   that can't be what the scan looks for, and returns the first position that might be (or
+   where less than a vector's worth is left), for the scan's own byte-by-byte loop to finish.
+   With "CPU_DISPATCH", the AVX2 and AVX-512 versions are compiled as well as the SSE2 ones,
+   and each scan uses the fastest that the CPU can run: */
+#ifdef HAVE_CPU_DISPATCH
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#define TARGET_AVX512 __attribute__((target("avx2,avx512f,avx512bw")))
+
+static int simdLevel(void) {
+  /* 2 if the CPU can run our AVX-512 (AVX-512BW) code; 1 if just our AVX2 code; else 0: */
+  return __builtin_cpu_supports("avx512bw") ? 2 : __builtin_cpu_supports("avx2") ? 1 : 0;
+}
+#else
+#define TARGET_AVX2
+#define TARGET_AVX512
+#endif
+
+#ifdef HAVE_AVX512_SCANS
+TARGET_AVX512 static unsigned long nalSizeCandidateAVX512(unsigned char const* data,
+							  unsigned long p, unsigned long to) {
+  __m512i const zero = _mm512_setzero_si512();
+
+  for (; p + 64 <= to; p += 64) {
+    __m512i b0 = _mm512_loadu_si512((void const*)&data[p]);
+    __m512i b123 = _mm512_or_si512(_mm512_loadu_si512((void const*)&data[p+1]),
+				   _mm512_or_si512(_mm512_loadu_si512((void const*)&data[p+2]),
+						   _mm512_loadu_si512((void const*)&data[p+3])));
+    unsigned long long mask = _mm512_cmpeq_epi8_mask(b0, zero) & _mm512_cmpneq_epi8_mask(b123, zero);
+
+    if (mask != 0) return p + __builtin_ctzll(mask);
+  }
+  return p;
+}
+
+TARGET_AVX512 static unsigned long bytePairAVX512(unsigned char const* data, unsigned long p, unsigned long to,
+						  unsigned char byte1, unsigned char byte2) {
+  __m512i const v1 = _mm512_set1_epi8((char)byte1), v2 = _mm512_set1_epi8((char)byte2);
+
+  for (; p + 64 <= to; p += 64) {
+    unsigned long long mask = _mm512_cmpeq_epi8_mask(_mm512_loadu_si512((void const*)&data[p]), v1)
+      & _mm512_cmpeq_epi8_mask(_mm512_loadu_si512((void const*)&data[p+1]), v2);
+
+    if (mask != 0) return p + __builtin_ctzll(mask);
+  }
+  return p;
+}
+
+TARGET_AVX512 static unsigned long otherByteAVX512(unsigned char const* data, unsigned long p, unsigned long to,
+						   unsigned char byte) {
+  __m512i const v = _mm512_set1_epi8((char)byte);
+
+  for (; p + 64 <= to; p += 64) {
+    unsigned long long mask = _mm512_cmpneq_epi8_mask(_mm512_loadu_si512((void const*)&data[p]), v);
+
+    if (mask != 0) return p + __builtin_ctzll(mask);
+  }
+  return p;
+}
+#endif
+
+#ifdef HAVE_AVX2_SCANS
+TARGET_AVX2 static unsigned long nalSizeCandidateAVX2(unsigned char const* data,
+						      unsigned long p, unsigned long to) {
+  __m256i const zero = _mm256_setzero_si256();
+
+  for (; p + 32 <= to; p += 32) {
+    __m256i b0 = _mm256_loadu_si256((__m256i const*)&data[p]);
+    __m256i b123 = _mm256_or_si256(_mm256_loadu_si256((__m256i const*)&data[p+1]),
+				   _mm256_or_si256(_mm256_loadu_si256((__m256i const*)&data[p+2]),
+						   _mm256_loadu_si256((__m256i const*)&data[p+3])));
+    unsigned mask = (unsigned)_mm256_movemask_epi8(_mm256_andnot_si256(_mm256_cmpeq_epi8(b123, zero),
+								       _mm256_cmpeq_epi8(b0, zero)));
+    if (mask != 0) return p + __builtin_ctz(mask);
+  }
+  return p;
+}
+
+TARGET_AVX2 static unsigned long bytePairAVX2(unsigned char const* data, unsigned long p, unsigned long to,
+					      unsigned char byte1, unsigned char byte2) {
+  __m256i const v1 = _mm256_set1_epi8((char)byte1), v2 = _mm256_set1_epi8((char)byte2);
+
+  for (; p + 32 <= to; p += 32) {
+    __m256i first = _mm256_cmpeq_epi8(_mm256_loadu_si256((__m256i const*)&data[p]), v1);
+    __m256i second = _mm256_cmpeq_epi8(_mm256_loadu_si256((__m256i const*)&data[p+1]), v2);
+    unsigned mask = (unsigned)_mm256_movemask_epi8(_mm256_and_si256(first, second));
+
+    if (mask != 0) return p + __builtin_ctz(mask);
+  }
+  return p;
+}
+
+TARGET_AVX2 static unsigned long otherByteAVX2(unsigned char const* data, unsigned long p, unsigned long to,
+					       unsigned char byte) {
+  __m256i const v = _mm256_set1_epi8((char)byte);
+
+  for (; p + 32 <= to; p += 32) {
+    unsigned mask = ~(unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((__m256i const*)&data[p]), v));
+
+    if (mask != 0) return p + __builtin_ctz(mask);
+  }
+  return p;
+}
+#endif
+
+#if defined(HAVE_SSE2)
+static unsigned long nalSizeCandidateSSE2(unsigned char const* data, unsigned long p, unsigned long to) {
+  __m128i const zero = _mm_setzero_si128();
+
+  for (; p + 16 <= to; p += 16) {
+    __m128i b0 = _mm_loadu_si128((__m128i const*)&data[p]);
+    __m128i b123 = _mm_or_si128(_mm_loadu_si128((__m128i const*)&data[p+1]),
+				_mm_or_si128(_mm_loadu_si128((__m128i const*)&data[p+2]),
+					     _mm_loadu_si128((__m128i const*)&data[p+3])));
+    unsigned mask = (unsigned)_mm_movemask_epi8(_mm_andnot_si128(_mm_cmpeq_epi8(b123, zero),
+								 _mm_cmpeq_epi8(b0, zero)));
+#if defined(__GNUC__)
+    if (mask != 0) return p + __builtin_ctz(mask);
+#else
+    if (mask != 0) break; /* and find it in the caller */
+#endif
+  }
+  return p;
+}
+
+static unsigned long bytePairSSE2(unsigned char const* data, unsigned long p, unsigned long to,
+				  unsigned char byte1, unsigned char byte2) {
+  __m128i const v1 = _mm_set1_epi8((char)byte1), v2 = _mm_set1_epi8((char)byte2);
+
+  for (; p + 16 <= to; p += 16) {
+    __m128i first = _mm_cmpeq_epi8(_mm_loadu_si128((__m128i const*)&data[p]), v1);
+    __m128i second = _mm_cmpeq_epi8(_mm_loadu_si128((__m128i const*)&data[p+1]), v2);
+    unsigned mask = (unsigned)_mm_movemask_epi8(_mm_and_si128(first, second));
+
+#if defined(__GNUC__)
+    if (mask != 0) return p + __builtin_ctz(mask);
+#else
+    if (mask != 0) break; /* and find it in the caller */
+#endif
+  }
+  return p;
+}
+
+static unsigned long otherByteSSE2(unsigned char const* data, unsigned long p, unsigned long to,
+				   unsigned char byte) {
+  __m128i const v = _mm_set1_epi8((char)byte);
+
+  for (; p + 16 <= to; p += 16) {
+    unsigned mask = 0xFFFF & ~(unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((__m128i const*)&data[p]), v));
+
+#if defined(__GNUC__)
+    if (mask != 0) return p + __builtin_ctz(mask);
+#else
+    if (mask != 0) break; /* and find it in the caller */
+#endif
+  }
+  return p;
+}
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+static unsigned long nalSizeCandidateNEON(unsigned char const* data, unsigned long p, unsigned long to) {
+  uint8x16_t const zero = vdupq_n_u8(0);
+
+  for (; p + 16 <= to; p += 16) {
+    uint8x16_t b0 = vld1q_u8(&data[p]);
+    uint8x16_t b123 = vorrq_u8(vld1q_u8(&data[p+1]), vorrq_u8(vld1q_u8(&data[p+2]), vld1q_u8(&data[p+3])));
+    uint8x16_t candidates = vbicq_u8(vceqq_u8(b0, zero), vceqq_u8(b123, zero));
+
+    if (vmaxvq_u8(candidates) != 0) break; /* and find it in the caller */
+  }
+  return p;
+}
+
+static unsigned long bytePairNEON(unsigned char const* data, unsigned long p, unsigned long to,
+				  unsigned char byte1, unsigned char byte2) {
+  uint8x16_t const v1 = vdupq_n_u8(byte1), v2 = vdupq_n_u8(byte2);
+
+  for (; p + 16 <= to; p += 16) {
+    uint8x16_t pairs = vandq_u8(vceqq_u8(vld1q_u8(&data[p]), v1), vceqq_u8(vld1q_u8(&data[p+1]), v2));
+
+    if (vmaxvq_u8(pairs) != 0) break; /* and find it in the caller */
+  }
+  return p;
+}
+
+static unsigned long otherByteNEON(unsigned char const* data, unsigned long p, unsigned long to,
+				   unsigned char byte) {
+  uint8x16_t const v = vdupq_n_u8(byte);
+
+  for (; p + 16 <= to; p += 16) {
+    if (vminvq_u8(vceqq_u8(vld1q_u8(&data[p]), v)) == 0) break; /* and find it in the caller */
+  }
+  return p;
+}
+#endif
+
+static unsigned long findNalSizeCandidate(unsigned char const* data,
+					  unsigned long from, unsigned long to) {
+  /* Return the first position "p" in [from,to) at which the 4 bytes data[p..p+3] - read as a
+     big-endian number - are in the range [1,0x00FFFFFF]: i.e., data[p] is 0, but not all
+     4 bytes are.  Every check that we make for video data (after skipping over anomalous
+     bytes) requires this, so it lets us rule out most positions (in particular, all those in
+     blocks of 0x00 or 0xFF) quickly, with a wide comparison.
+     If there's no such position, we return "to".  (Note that we read up to data[to+2].)
+  */
+  unsigned long p = from;
+
+#if defined(HAVE_CPU_DISPATCH)
+  switch (simdLevel()) {
+    case 2: p = nalSizeCandidateAVX512(data, p, to); break;
+    case 1: p = nalSizeCandidateAVX2(data, p, to); break;
+#if defined(HAVE_SSE2)
+    default: p = nalSizeCandidateSSE2(data, p, to); break;
+#endif
+  }
+#elif defined(HAVE_AVX512_SCANS)
+  p = nalSizeCandidateAVX512(data, p, to);
+#elif defined(HAVE_AVX2_SCANS)
+  p = nalSizeCandidateAVX2(data, p, to);
+#elif defined(HAVE_SSE2)
+  p = nalSizeCandidateSSE2(data, p, to);
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+  p = nalSizeCandidateNEON(data, p, to);
+#endif
+
+  for (; p < to; ++p) {
+    if (data[p] == 0 && (data[p+1]|data[p+2]|data[p+3]) != 0) return p;
+  }
+  return to;
+}
+
+static unsigned long findBytePair(unsigned char const* data, unsigned long from, unsigned long to,
+				  unsigned char byte1, unsigned char byte2) {
+  /* Return the first position "p" in [from,to) at which data[p] == "byte1" and
+     data[p+1] == "byte2", or "to" if there's none.  (Note that we read up to data[to].)
+  */
+  unsigned long p = from;
+
+#if defined(HAVE_CPU_DISPATCH)
+  switch (simdLevel()) {
+    case 2: p = bytePairAVX512(data, p, to, byte1, byte2); break;
+    case 1: p = bytePairAVX2(data, p, to, byte1, byte2); break;
+#if defined(HAVE_SSE2)
+    default: p = bytePairSSE2(data, p, to, byte1, byte2); break;
+#endif
+  }
+#elif defined(HAVE_AVX512_SCANS)
+  p = bytePairAVX512(data, p, to, byte1, byte2);
+#elif defined(HAVE_AVX2_SCANS)
+  p = bytePairAVX2(data, p, to, byte1, byte2);
+#elif defined(HAVE_SSE2)
+  p = bytePairSSE2(data, p, to, byte1, byte2);
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+  p = bytePairNEON(data, p, to, byte1, byte2);
+#endif
+
+  /* Check any remaining positions, using "memchr()" to find each "byte1": */
+  while (p < to) {
+    unsigned char const* next = memchr(&data[p], byte1, to - p);
+
+    if (next == NULL) break;
+    p = next - data;
+    if (data[p+1] == byte2) return p;
+    ++p;
+  }
+  return to;
+}
+
+static unsigned long findOtherByte(unsigned char const* data, unsigned long from, unsigned long to,
+				   unsigned char byte) {
+  /* Return the first position "p" in [from,to) at which data[p] != "byte", or "to" if there's
+     none: */
+  unsigned long p = from;
+
+#if defined(HAVE_CPU_DISPATCH)
+  switch (simdLevel()) {
+    case 2: p = otherByteAVX512(data, p, to, byte); break;
+    case 1: p = otherByteAVX2(data, p, to, byte); break;
+#if defined(HAVE_SSE2)
+    default: p = otherByteSSE2(data, p, to, byte); break;
+#endif
+  }
+#elif defined(HAVE_AVX512_SCANS)
+  p = otherByteAVX512(data, p, to, byte);
+#elif defined(HAVE_AVX2_SCANS)
+  p = otherByteAVX2(data, p, to, byte);
+#elif defined(HAVE_SSE2)
+  p = otherByteSSE2(data, p, to, byte);
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+  p = otherByteNEON(data, p, to, byte);
+#endif
+
+  for (; p < to; ++p) {
+    if (data[p] != byte) break;
+  }
+  return p;
+}
+
+static int skipJPEGPreviews(InputFile* input) {
+  /* Move the cursor past the sequence of JPEG previews that begins here: i.e., to just after
+     the first 0xFFD9 ('end of image') that's not followed immediately by 0xFFD8 ('start of
+     image').  Returns 0 (having moved to the end of the file) if there's no such position.
+  */
+  unsigned long p = input->pos, end;
+
+  while (1) {
+    end = input->size < input->scanLimit ? input->size : input->scanLimit;
+    if (p + 4 <= end) {
+      p = input->dataStart + findBytePair(input->data, p - input->dataStart, end - 1 - input->dataStart, 0xFF, 0xD9);
+      if (p + 4 <= end) {
+	if (!(inputAt(input, p)[2] == 0xFF && inputAt(input, p)[3] == 0xD8)) {
+	  input->pos = p + 2;
+	  return 1;
+	}
+	p += 4; /* skip over the 0xFFD9, and the 0xFFD8 that begins the next JPEG preview */
+	continue;
+      }
+    }
+
+    /* No 0xFFD9 (with 2 bytes after it) was found.  If we're reading a stream, read more: */
+    if (input->stream == NULL || end == input->scanLimit) break;
+    if (input->pos < p) input->pos = p; /* so that the input before here can be discarded */
+    if (!fillInput(input, p + 4)) break;
+  }
+
+  if (input->pos < end) input->pos = end;
+  input->atEOF = 1;
+  return 0;
+}
+
+static void findNextHole(InputFile* input, unsigned long position) {
+  /* Make "input->holeStart" and "input->holeEnd" describe the first 'hole' - a part of a sparse
+     input file for which nothing is stored, so that it reads as zeros - that ends after
+     "position" (or set them to ~0UL, if there's none, or we can't tell).  (We remember it, so
+     that we don't ask again until we've passed it.) */
+  if (position >= input->holesCheckedFrom && position < input->holeEnd) return;
+  input->holesCheckedFrom = position;
+  input->holeStart = input->holeEnd = ~0UL;
+#if defined(HAVE_MMAP) && defined(SEEK_HOLE) && defined(SEEK_DATA)
+  if (input->holesFD >= 0 && position < input->size) {
+    off_t const holeStart = lseek(input->holesFD, (off_t)position, SEEK_HOLE);
+
+    if (holeStart < 0) {
+      input->holesFD = -1; /* (the file system can't tell us) */
+    } else if ((unsigned long)holeStart < input->size) {
+      off_t const dataStart = lseek(input->holesFD, holeStart, SEEK_DATA);
+
+      input->holeStart = (unsigned long)holeStart;
+      input->holeEnd = dataStart < 0 ? input->size : (unsigned long)dataStart; /* (ENXIO: a hole to the end) */
+    }
+  }
+#endif
+  if (input->holesFD < 0) input->holesCheckedFrom = 0; /* (so that we don't ask again) */
+}
+
+static unsigned long scanEndBeforeHole(InputFile* input, unsigned long* position, unsigned long limit,
+				       unsigned long overlap) {
+  /* For a scan (from "*position", up to "limit") for something that can't lie within a hole (see
+     above) - except in its last "overlap" bytes: If "*position" is in a hole, move it forward
+     to the hole's last "overlap" bytes, and return the end of the hole; otherwise, return the
+     start of the next hole.  (Either way, no later than "limit".) */
+  findNextHole(input, *position);
+  if (*position >= input->holeStart) {
+    if (input->holeEnd - *position > overlap) *position = input->holeEnd - overlap;
+    if (*position > limit) *position = limit;
+    return input->holeEnd < limit ? input->holeEnd : limit;
+  }
+  return input->holeStart < limit ? input->holeStart : limit;
+}
+
+static void skipRepeatedWord(InputFile* input, unsigned word) {
+  /* The 4 bytes just before the cursor are "word" (0x00000000 or 0xFFFFFFFF).  Move the cursor
+     past as many more copies of it as follow - 4 bytes at a time, as "get4Bytes()" would - in
+     the input that we have (before "input->scanLimit").  (Zeros in a hole aren't even read.) */
+  unsigned long const end = input->size < input->scanLimit ? input->size : input->scanLimit;
+  unsigned long runEnd = input->pos;
+
+  while (runEnd < end) {
+    unsigned long const scanEnd = word == 0 ? scanEndBeforeHole(input, &runEnd, end, 0) : end;
+
+    runEnd = input->dataStart
+      + findOtherByte(input->data, runEnd - input->dataStart, scanEnd - input->dataStart, (unsigned char)word);
+    if (runEnd < scanEnd) break;
+  }
+  if (runEnd > input->pos) input->pos += (runEnd - input->pos)/4*4;
+}
+
+static int advanceToCandidate(InputFile* input, unsigned windowSize,
+			      unsigned long (*findCandidate)(unsigned char const*, unsigned long, unsigned long),
+			      int skipsHoles) {
+  /* The "windowSize" bytes just before the cursor have already been checked - and rejected.
+     Move the cursor forward (by at least 1 byte), so that the "windowSize" bytes before it begin
+     at the next position that "findCandidate()" finds.  (If "skipsHoles", it never finds one
+     that begins in a hole - before its last 3 bytes - so we jump over them.)  Returns 0 (having
+     moved to the end of the file, or to "input->scanLimit") if there's no such position.
+  */
+  unsigned long windowStart = input->pos - windowSize + 1;
+
+  while (1) {
+    unsigned long end = input->size < input->scanLimit ? input->size : input->scanLimit;
+    unsigned long limit = end >= windowSize ? end - windowSize + 1 : 0;
+
+    if (windowStart < limit) {
+      unsigned long const scanEnd = skipsHoles ? scanEndBeforeHole(input, &windowStart, limit, 3) : limit;
+
+      windowStart = input->dataStart
+	+ (*findCandidate)(input->data, windowStart - input->dataStart, scanEnd - input->dataStart);
+      if (windowStart < scanEnd) break;
+      if (scanEnd < limit) continue; /* we've reached a hole */
+    }
+
+    /* There's no such position in the input that we have.  If we're reading a stream, read more
+       (having moved the cursor to the end, so that the input before it can be discarded): */
+    if (input->pos < end) input->pos = end;
+    if (input->stream == NULL || end == input->scanLimit || !fillInput(input, input->size + 1)) {
+      input->atEOF = 1;
+      return 0;
+    }
+  }
+
+  input->pos = windowStart + windowSize;
+  return 1;
+}
+
+static int advanceToNalSizeCandidate(InputFile* input, unsigned windowSize) {
+  /* The "windowSize" (4 or 8) bytes just before the cursor have already been checked - and
+     rejected - as the start of video data.  Move the cursor forward, so that the "windowSize"
+     bytes before it begin at the next position where a NAL size might begin.  (A NAL size isn't
+     all zeros, so none begins in a hole.) */
+  return advanceToCandidate(input, windowSize, findNalSizeCandidate, 1);
+}
+
+static unsigned long findFileStartCandidate(unsigned char const* data,
+					    unsigned long from, unsigned long to) {
+  /* Return the first position "p" in [from,to) at which the 8 bytes data[p..p+7] could be
+     something that "findRepairType()" looks for at the start of a file: a small atom size (or
+     0x00000002, or 0x00000000) - beginning with 0x00 - or 0xFFFFFFFF, or an atom type of 'ftyp'
+     or 'isom'.  If there's no such position, we return "to".  (Note that we read up to
+     data[to+3].)
+  */
+  unsigned long p;
+
+  for (p = from; p < to; ++p) {
+    unsigned char const c = data[p], c4 = data[p+4];
+
+    if (c == 0x00 || c == 0xFF || c4 == 'f' || c4 == 'i') break;
+  }
+  return p;
+}
+
+static int advanceToFileStartCandidate(InputFile* input) {
+  /* The 8 bytes just before the cursor are garbage (at the start of the file).  Move the cursor
+     forward, so that the 8 bytes before it begin at the next position that could be data that
+     we understand (as "get1Byte()" would, one byte at a time): */
+  return advanceToCandidate(input, 8, findFileStartCandidate, 0);
+}
+
+static int checkAtom(InputFile* input, unsigned fourccToCheck, unsigned long* numRemainingBytesToSkip) {
+  long headerSize = 8;
+
+  do {
+    unsigned atomSize, fourcc, sizeHigh, sizeLow;
+    unsigned long long extendedSize;
+
+    if (!get4Bytes(input, &atomSize)) break;
+
+    if (!get4Bytes(input, &fourcc) || fourcc != fourccToCheck) break;
+    
+    if (atomSize == 1) {
+      /* The atom has an extended (64-bit) size, in the next 8 bytes: */
+      headerSize = 16;
+      if (!get4Bytes(input, &sizeHigh) || !get4Bytes(input, &sizeLow)) break;
+      extendedSize = ((unsigned long long)sizeHigh<<32)|sizeLow;
+    } else {
+      extendedSize = atomSize;
+    }
+
+    /* For 'mdat' atoms, ignore the size, because we don't use it: */
+    if (fourcc == fourcc_mdat) return 1;
+
+    /* Check the atom size.  It should be at least the size of its header (and, for us, fit in a
+       file position): */
+    if (extendedSize < (unsigned long long)headerSize || extendedSize - headerSize > ~0UL) break;
+    *numRemainingBytesToSkip = (unsigned long)(extendedSize - headerSize);
+
+    return 1;
+  } while (0);
+
+  /* An error occurred. Rewind over the bytes that we read (assuming we read all of the header): */
+  if (!seekInput(input, -headerSize)) {
+    fprintf(stderr, "Failed to rewind 8 bytes.%s\n", cantRepair);
+  }
+  return 0;
+}
+
+
+static void copyBytes(InputFile* input, FILE* outputFID, unsigned numBytes) {
+  /* Copy "numBytes" bytes from the input file to the output file, in one block.
+     If the input file ends early, we write 0xFF for each missing byte - as the original
+     byte-at-a-time "fputc(fgetc())" loop did - so that the repaired output is unchanged.
+  */
+  unsigned long numAvailable = input->pos < input->size ? input->size - input->pos : 0;
+  unsigned char missingBytes[4096];
+
+  if (numBytes > numAvailable && input->stream != NULL) {
+    /* Copy what we have, then read (and copy) the rest, a block at a time: */
+    while (numBytes > numAvailable) {
+      if (numAvailable > 0) {
+	fwrite(inputAt(input, input->pos), 1, numAvailable, outputFID);
+	input->pos += numAvailable;
+	numBytes -= numAvailable;
+      }
+      fillInput(input, input->pos + (numBytes < STREAM_READ_SIZE ? numBytes : STREAM_READ_SIZE));
+      numAvailable = input->pos < input->size ? input->size - input->pos : 0;
+      if (numAvailable == 0) break;
+    }
+  }
+  if (numBytes <= numAvailable) {
+    fwrite(inputAt(input, input->pos), 1, numBytes, outputFID);
+    input->pos += numBytes;
+    return;
+  }
+
+  if (numAvailable > 0) fwrite(inputAt(input, input->pos), 1, numAvailable, outputFID);
+  inputHasBytes(input, numBytes); /* moves to the end, and sets "atEOF" */
+  numBytes -= numAvailable;
+  memset(missingBytes, 0xFF, sizeof missingBytes);
+  while (numBytes > 0) {
+    unsigned numToWrite = numBytes < sizeof missingBytes ? numBytes : sizeof missingBytes;
+
+    fwrite(missingBytes, 1, numToWrite, outputFID);
+    numBytes -= numToWrite;
+  }
+}
+
+#define COPY_PIECE_SIZE (64*1024*1024) /* so that we can report progress while copying */
+
+static void copyRemainingBytes(RepairContext* ctx) {
+  /* Copy everything from the current input file position until the end of the file: */
+  InputFile* input = &ctx->input;
+  FILE* outputFID = ctx->outputFID;
+
+  if (input->stream != NULL) {
+    do {
+      if (input->pos < input->size) {
+	fwrite(inputAt(input, input->pos), 1, input->size - input->pos, outputFID);
+	input->pos = input->size;
+      }
+      noteProgress(ctx);
+    } while (fillInput(input, input->size + 1));
+    return;
+  }
+  if (input->pos >= input->size) return;
+
+#ifdef HAVE_COPY_FILE_RANGE
+  /* If we can, have the kernel do the copying, without the data passing through our mapping: */
+  if (input->fd >= 0 && fileno(outputFID) >= 0 && fflush(outputFID) == 0) {
+    loff_t inputOffset = input->pos;
+    ssize_t numCopied;
+
+    while ((numCopied = copy_file_range(input->fd, &inputOffset, fileno(outputFID), NULL,
+					input->size - inputOffset < COPY_PIECE_SIZE
+					? input->size - inputOffset : COPY_PIECE_SIZE, 0)) > 0) {
+      if ((unsigned long)inputOffset >= input->size) break;
+      noteProgressAt(ctx, inputOffset);
+    }
+    input->pos = inputOffset;
+    if (input->pos >= input->size) return;
+
+    /* "copy_file_range()" failed (e.g., because the files are on different file systems).
+       Continue copying (from wherever it got to) the usual way: */
+    if (numCopied < 0 && errno != EXDEV && errno != ENOSYS && errno != EINVAL && errno != EOPNOTSUPP) {
+      perror("copy_file_range() failed");
+    }
+  }
+#endif
+
+  while (input->pos < input->size) {
+    unsigned long numToCopy = input->size - input->pos < COPY_PIECE_SIZE ? input->size - input->pos : COPY_PIECE_SIZE;
+
+    fwrite(inputAt(input, input->pos), 1, numToCopy, outputFID);
+    input->pos += numToCopy;
+    noteProgress(ctx);
+  }
+}
+
+static void doRepairType1(RepairContext* ctx, unsigned ftypSize) {
+  FILE* outputFID = ctx->outputFID;
+
+  beginRepair(ctx);
+
+  /* Begin the repair by writing the header for the initial 'ftype' atom: */
+  fputc(ftypSize>>24, outputFID);
+  fputc(ftypSize>>16, outputFID);
+  fputc(ftypSize>>8, outputFID);
+  fputc(ftypSize, outputFID);
+
+  fputc('f', outputFID); fputc('t', outputFID); fputc('y', outputFID); fputc('p', outputFID);
+
+  /* Then complete the repair by copying from the input file to the output file: */
+  copyRemainingBytes(ctx);
+}
+
+static long long tellOutput(FILE* outputFID) {
+  /* The current position in the output file, or -1 if it doesn't have one (e.g., a pipe).
+     (Unlike "ftell()", this works for files > 2 GBytes, even when "long" is 32 bits.) */
+#ifdef HAVE_FSEEKO
+  return (long long)ftello(outputFID);
+#else
+  return (long long)ftell(outputFID);
+#endif
+}
+
+static int seekOutputTo(FILE* outputFID, long long position) {
+  /* Returns 0 if OK (as "fseek()" does): */
+#ifdef HAVE_FSEEKO
+  return fseeko(outputFID, (off_t)position, SEEK_SET);
+#else
+  if ((long long)(long)position != position) return -1;
+  return fseek(outputFID, (long)position, SEEK_SET);
+#endif
+}
+
+#define wr(c) fputc((c), outputFID)
+
+static unsigned char const startCode[4] = { 0x00, 0x00, 0x00, 0x01 };
+
+static void putStartCode(FILE* outputFID) {
+  fwrite(startCode, 1, sizeof startCode, outputFID);
+}
+
+static void putNALUnitStart(RepairContext* ctx, unsigned char const* nal, unsigned long numAvailable,
+			    unsigned nalSize) {
+  /* Begin writing a "nalSize"-byte NAL unit (whose first "numAvailable" bytes are at "nal"):
+     with a 'start code' - or, in an MP4 file, its size: */
+  FILE* outputFID = ctx->outputFID;
+
+  countNALUnit(ctx->stats, nal, numAvailable);
+  if (ctx->mp4 == NULL) {
+    putStartCode(outputFID);
+  } else {
+    wr(nalSize>>24); wr(nalSize>>16); wr(nalSize>>8); wr(nalSize);
+    addMp4NALUnit(ctx->mp4, nal, numAvailable, nalSize);
+  }
+}
+
+static void putInputNALUnitStart(RepairContext* ctx, unsigned nalSize) {
+  /* The same, for a NAL unit that we'll copy from the current position of the input file: */
+  InputFile* input = &ctx->input;
+
+  planItem(ctx->plan, PLAN_ITEM_NAL_UNIT, input->pos, nalSize);
+  if (ctx->mp4 != NULL && input->stream != NULL) {
+    fillInput(input, input->pos + (nalSize < STREAM_READ_SIZE ? nalSize : STREAM_READ_SIZE));
+  }
+  if (input->pos < input->size) {
+    putNALUnitStart(ctx, inputAt(input, input->pos), input->size - input->pos, nalSize);
+  } else {
+    putNALUnitStart(ctx, NULL, 0, nalSize);
+  }
+}
+
+static void putParameterSets(RepairContext* ctx, int repairType, int formatCode) {
+  /* Write the parameter set NAL units of a video format (each preceded by a 'start code' - or,
+     in an MP4 file, its size).  For a '.h264' file, we assemble these into one block, and write
+     it all at once: */
+  VideoFormat const* format = findVideoFormat(repairType, formatCode);
+  unsigned char header[1024];
+  unsigned headerSize = 0, i;
+
+  if (format == NULL) format = formatsForRepairType(repairType); /* shouldn't happen */
+  ctx->formatCode = format->code;
+  noteMp4Format(ctx, format);
+  for (i = 0; i < 3; ++i) {
+    ParameterSet const* parameterSet = &format->parameterSets[i];
+
+    if (parameterSet->size == 0) continue;
+    if (ctx->mp4 != NULL || sizeof startCode + parameterSet->size > sizeof header) {
+      fwrite(header, 1, headerSize, ctx->outputFID);
+      headerSize = 0;
+      putNALUnitStart(ctx, parameterSet->data, parameterSet->size, parameterSet->size);
+      fwrite(parameterSet->data, 1, parameterSet->size, ctx->outputFID);
+      continue;
+    }
+
+    countNALUnit(ctx->stats, parameterSet->data, parameterSet->size);
+    if (headerSize + sizeof startCode + parameterSet->size > sizeof header) {
+      fwrite(header, 1, headerSize, ctx->outputFID);
+      headerSize = 0;
+    }
+    memcpy(&header[headerSize], startCode, sizeof startCode);
+    memcpy(&header[headerSize + sizeof startCode], parameterSet->data, parameterSet->size);
+    headerSize += sizeof startCode + parameterSet->size;
+  }
+  fwrite(header, 1, headerSize, ctx->outputFID);
+}
+
+/* Walking through the NAL units of a 'type 3', 'type 4', or 'type 5' file.
+
+   Each "step" of a walk reads one 4-byte NAL unit size (or the start of a block of non-video
+   data), and moves past the NAL unit (or block).  Normally, each NAL unit is written to the
+   output file as soon as we find it.  But in a parallel ("-j") repair, the walk of each part
+   of the file instead records - in a "WalkChunk" - the NAL units that it finds, and the
+   position at the start of each step (a "boundary"), so that the parts can be checked against
+   each other - and written - later.
+*/
+
+typedef struct NalRun {
+  unsigned long offset; /* the position (after the 4-byte NAL size) of a NAL unit */
+  unsigned size;
+} NalRun;
+
+typedef struct WalkBoundary {
+  unsigned long position; /* where a step of the walk began */
+  unsigned numRuns; /* the number of NAL units found before it */
+} WalkBoundary;
+
+/* Something that we tell the user about, during a walk: */
+#define WALK_EVENT_METADATA 1 /* a block of printable metadata (printed if it's the first) */
+#define WALK_EVENT_METADATA_F2 2 /* the same, for a block that begins with 0x00fe462f */
+#define WALK_EVENT_ANOMALY 3 /* an anomalous NAL size that ends a 'type 3' or 'type 5' repair ("--stop-on-anomaly") */
+#define WALK_EVENT_SKIPPING 4 /* an anomalous NAL size, which the repair skips over */
+#define WALK_EVENT_RESUMING 5 /* where the repair finds video (or, for 'type 3', non-video data) again */
+#define WALK_EVENT_BLOCK 6 /* a skipped block of non-video data (only for "--stats") */
+
+typedef struct WalkEvent {
+  int kind;
+  unsigned boundary; /* the index of the boundary at which the step that saw this began */
+  unsigned long position;
+  unsigned nalSize; /* (for "WALK_EVENT_BLOCK") the index of the rule that the block matched */
+  unsigned long numBytes; /* (for "WALK_EVENT_BLOCK") the size of the block */
+} WalkEvent;
+
+typedef struct WalkChunk {
+  InputFile input; /* our own cursor over the input file */
+  int repairType;
+  MetadataRuleTable const* metadataRules;
+  int stopOnAnomaly; /* as in "NalWalk" */
+  unsigned long endPosition; /* we stop at the first boundary at or after this */
+  int initialIsPrintable; /* the "metadataIsPrintable" state that we started with */
+  unsigned flipBoundary; /* the first boundary after which "metadataIsPrintable" became 0 */
+  int lastPrintableBoundary; /* the last boundary whose step depended on "metadataIsPrintable" */
+  WalkBoundary* boundaries;
+  unsigned numBoundaries, maxNumBoundaries;
+  NalRun* runs;
+  unsigned numRuns, maxNumRuns;
+  WalkEvent* events;
+  unsigned numEvents, maxNumEvents;
+  MemoryBudget memory; /* our share of the repair's "memory", for "boundaries", "runs", and "events" */
+  int countsBlocks; /* whether we record (for "--stats") each block of non-video data that we skip */
+  int stopped; /* the walk ended (rather than reaching "endPosition") */
+  int exitIsPrintable; /* the "metadataIsPrintable" state at the end */
+  int outOfMemory;
+
+  int needsSyncPoint; /* we don't yet know where, after our start position, to begin walking */
+  int converged; /* we reached a boundary of the chunk that we were checking against ... */
+  unsigned convergedBoundary; /* ... this one */
+
+  /* Set when we stitch the chunks together: */
+  int isUsed;
+  unsigned firstUsedBoundary;
+  struct WalkChunk* bridge; /* if non-NULL, a serial walk that comes before (the used part of) this chunk */
+} WalkChunk;
+
+typedef struct NalWalk {
+  RepairContext* ctx; /* NULL if "chunk" is non-NULL */
+  InputFile* input;
+  FILE* outputFID; /* used if "chunk" is NULL */
+  WalkChunk* chunk; /* if non-NULL, we record (rather than write) what we find */
+  int repairType; /* 3 (also used for 'type 5'), or 4 */
+  MetadataRuleTable const* metadataRules;
+  int metadataIsPrintable;
+  int stopOnAnomaly; /* a 'type 3' walk ends at an anomalous NAL size (rather than skipping over it) */
+  int ended; /* the walk ended (rather than pausing, in "walkNALUnits()") */
+  struct WriteBehind* writeBehind; /* if non-NULL, we hand each NAL unit to this, to be written */
+} NalWalk;
+
+static int walkType3or5Step(NalWalk* walk); /* forward */
+static int walkType4Step(NalWalk* walk); /* forward */
+static int replayRepairPlan(RepairContext* ctx); /* forward */
+#ifdef HAVE_PTHREADS
+static int walkInParallel(NalWalk* walk, unsigned long pausePosition); /* forward */
+static unsigned long parallelWalkPausePosition(RepairContext* ctx, unsigned long pausePosition); /* forward */
+static struct WriteBehind* beginWriteBehind(RepairContext* ctx); /* forward */
+static void addWriteBehindRun(struct WriteBehind* writeBehind, NalRun const* run); /* forward */
+static void endWriteBehind(NalWalk* walk); /* forward */
+static void noteRuns(RepairContext* ctx, InputFile const* input, NalRun const* runs, unsigned numRuns); /* forward */
+#endif
+#ifndef DJIFIX_LIBRARY
+static unsigned long resumeWalk(NalWalk* walk); /* forward */
+static void saveCheckpoint(NalWalk const* walk); /* forward */
+#endif
+
+static void initNalWalk(NalWalk* walk, RepairContext* ctx, int repairType) {
+  walk->ctx = ctx;
+  walk->input = &ctx->input;
+  walk->outputFID = ctx->outputFID;
+  walk->chunk = NULL;
+  walk->repairType = repairType;
+  walk->metadataRules = ctx->metadataRules;
+  walk->metadataIsPrintable = ctx->metadataIsPrintable;
+  walk->stopOnAnomaly = ctx->stopOnAnomaly;
+  walk->ended = 0;
+  walk->writeBehind = NULL;
+}
+
+static void walkNALUnits(NalWalk* walk) {
+  /* Walk from the current position to the end of the file (or until we can't repair any more),
+     writing each NAL unit (preceded by a 'start code') to the output file.  (With "--resume",
+     we pause every "CHECKPOINT_INTERVAL" bytes, to save a checkpoint.) */
+  RepairContext* ctx = walk->ctx;
+  InputFile* input = walk->input;
+  unsigned long checkpointInterval = 0;
+
+  if (replayRepairPlan(ctx)) {
+    walk->metadataIsPrintable = ctx->replayPlan->metadataIsPrintable;
+    return;
+  }
+#ifndef DJIFIX_LIBRARY
+  if (ctx->checkpoints != NULL) checkpointInterval = resumeWalk(walk);
+#endif
+  while (!walk->ended && !input->atEOF) {
+    unsigned long pausePosition = checkpointInterval == 0 || input->pos >= ~0UL - checkpointInterval ? ~0UL
+      : input->pos + checkpointInterval;
+    int walkedInParallel = 0;
+
+#ifdef HAVE_PTHREADS
+    if (ctx->numThreads > 1) pausePosition = parallelWalkPausePosition(ctx, pausePosition);
+    walkedInParallel = ctx->numThreads > 1 && !ctx->quiet && walkInParallel(walk, pausePosition);
+    if (!walkedInParallel) walk->writeBehind = beginWriteBehind(ctx);
+#endif
+    while (!walkedInParallel && !input->atEOF && input->pos < pausePosition) {
+      if (!(walk->repairType == 4 ? walkType4Step(walk) : walkType3or5Step(walk)) || extractionIsDone(ctx)) {
+	walk->ended = 1;
+	break;
+      }
+      noteProgress(ctx);
+    }
+#ifdef HAVE_PTHREADS
+    if (walk->writeBehind != NULL) endWriteBehind(walk);
+#endif
+#ifndef DJIFIX_LIBRARY
+    if (checkpointInterval != 0 && !walk->ended && !input->atEOF) saveCheckpoint(walk);
+#endif
+  }
+}
+
+static int takeMemory(MemoryBudget* budget, unsigned long numBytes) {
+  /* Note that we're about to use "numBytes" more bytes of memory.  Returns 0 (having noted
+     nothing) if that would take us over the budget.  ("budget" may be NULL, for memory whose
+     size doesn't depend on that of the file.) */
+  if (budget == NULL) return 1;
+  if (budget->limit != 0 && (numBytes > budget->limit || budget->used > budget->limit - numBytes)) return 0;
+  budget->used += numBytes;
+  return 1;
+}
+
+static void giveBackMemory(MemoryBudget* budget, unsigned long numBytes) {
+  if (budget != NULL) budget->used -= numBytes < budget->used ? numBytes : budget->used;
+}
+
+static int growArray(MemoryBudget* budget, void** array, unsigned* maxNumElements, size_t elementSize) {
+  /* Make room for more elements at the end of a "malloc()"ed array (taking the extra memory from
+     "budget").  Returns 0 on failure: */
+  unsigned newMaxNumElements = *maxNumElements == 0 ? 256 : 2*(*maxNumElements);
+  unsigned long const extraSize = (unsigned long)(newMaxNumElements - *maxNumElements)*elementSize;
+  void* newArray;
+
+  if (!takeMemory(budget, extraSize)) return 0;
+  newArray = realloc(*array, newMaxNumElements*elementSize);
+  if (newArray == NULL) {
+    giveBackMemory(budget, extraSize);
+    return 0;
+  }
+  *array = newArray;
+  *maxNumElements = newMaxNumElements;
+  return 1;
+}
+
+/* Extracting just a segment of the video ("--range" or "--nals").  The repair goes on as usual,
+   except that each NAL unit that it copies from the input file is written only if it's in the
+   segment, and the repair stops once the segment has ended.  So that the segment can be decoded,
+   it begins at the IDR (or, for H.265, IRAP) picture before it - preceded by the latest
+   parameter set NAL units that we've seen in the input file (if any) - so until the segment
+   begins, we remember where each NAL unit since the last such picture was, to go back to it: */
+
+typedef struct ExtractedNAL {
+  unsigned long offset; /* as in "NalRun" */
+  unsigned size;
+  unsigned long index; /* the NAL unit's number (from 0) in the repaired video */
+  long frame; /* the number (from 0) of the picture that it's part of; -1 if it's not a slice */
+} ExtractedNAL;
+
+struct Extraction {
+  SegmentRange range;
+  int codec; /* 1 for H.264; 2 for H.265; 0 until we see the first NAL unit */
+  unsigned frameRate; /* ('type 4' repairs don't know it, so assume 30 fps) */
+  int frameRateIsAssumed;
+  unsigned long firstFrame, endFrame; /* (SEGMENT_BY_TIME) the pictures in the segment are firstFrame..endFrame-1 */
+  unsigned long numNALUnits, numFrames; /* what we've seen so far */
+  int started, done;
+
+  /* Before the segment begins: the NAL units since (and including) the last IRAP picture.  After
+     it begins: NAL units that aren't slices, which we write only once a slice follows them (so
+     that the segment doesn't end with the start of a picture that isn't in it): */
+  ExtractedNAL* held;
+  unsigned numHeld, maxNumHeld;
+  unsigned numHeldBeforeLastSlice; /* (before the segment begins) held[0..numHeldBeforeLastSlice-1] */
+  unsigned long parameterSetOffset[3]; /* of the latest VPS, SPS, and PPS NAL units in the input ... */
+  unsigned parameterSetSize[3]; /* ... (0 if none) */
+
+  /* What we wrote: */
+  unsigned long numWritten, firstWrittenIndex, lastWrittenIndex, firstWrittenOffset;
+  long firstWrittenFrame, lastWrittenFrame;
+};
+
+static int beginExtraction(RepairContext* ctx) {
+  /* Returns 0 if we run out of memory: */
+  struct Extraction* x = calloc(1, sizeof *x);
+  SegmentRange const* range = &ctx->segmentRange;
+
+  if (x == NULL) return 0;
+  x->range = *range;
+  x->firstWrittenFrame = x->lastWrittenFrame = -1;
+  ctx->extraction = x;
+  if (range->kind == SEGMENT_BY_TIME && range->end < 0) {
+    fprintf(ctx->log, "(Writing only the video from %g seconds to the end, beginning at the IDR (or IRAP) picture before it.)\n", range->start);
+  } else if (range->kind == SEGMENT_BY_TIME) {
+    fprintf(ctx->log, "(Writing only the video from %g to %g seconds, beginning at the IDR (or IRAP) picture before it.)\n", range->start, range->end);
+  } else if (range->last == ~0UL) {
+    fprintf(ctx->log, "(Writing only NAL units %lu to the end, beginning at the IDR (or IRAP) picture before them.)\n", range->first);
+  } else {
+    fprintf(ctx->log, "(Writing only NAL units %lu-%lu, beginning at the IDR (or IRAP) picture before them.)\n", range->first, range->last);
+  }
+  return 1;
+}
+
+static int extractionIsDone(RepairContext const* ctx) {
+  return ctx->extraction != NULL && ctx->extraction->done;
+}
+
+static void noteExtractionFormat(RepairContext* ctx, unsigned char const* header) {
+  /* At the first NAL unit: which codec - and frame rate - the video has, and so (for a time
+     range) which pictures are in the segment: */
+  struct Extraction* x = ctx->extraction;
+  VideoFormat const* format = ctx->repairType == 4 ? NULL : findVideoFormat(ctx->repairType, ctx->formatCode);
+  double endFrame;
+
+  if (format != NULL) {
+    x->codec = format->codec;
+    x->frameRate = format->frameRate;
+  } else {
+    /* ('type 4') The video begins with a SPS - or, for H.265, a VPS: */
+    x->codec = header != NULL && (header[0]>>1) == 32 && header[1] == 0x01 ? 2 : 1;
+    x->frameRate = 30;
+    x->frameRateIsAssumed = 1;
+  }
+  x->firstFrame = (unsigned long)(x->range.start*x->frameRate);
+  if (x->range.end < 0) {
+    x->endFrame = ~0UL;
+  } else {
+    endFrame = x->range.end*x->frameRate;
+    x->endFrame = (unsigned long)endFrame;
+    if (x->endFrame < endFrame) ++x->endFrame;
+  }
+}
+
+static int holdExtractedNAL(RepairContext* ctx, ExtractedNAL const* nal) {
+  /* Returns 0 if we run out of memory: */
+  struct Extraction* x = ctx->extraction;
+
+  if (x->numHeld == x->maxNumHeld
+      && !growArray(&ctx->memory, (void**)&x->held, &x->maxNumHeld, sizeof x->held[0])) return 0;
+  x->held[x->numHeld++] = *nal;
+  return 1;
+}
+
+static void writeExtractedNAL(RepairContext* ctx, ExtractedNAL const* nal) {
+  /* Write a NAL unit of the segment (which may be one that we've gone past), leaving the input
+     file after it: */
+  struct Extraction* x = ctx->extraction;
+  InputFile* input = &ctx->input;
+
+  if (input->pos != nal->offset && !seekInputTo(input, nal->offset)) return; /* (a stream that we no longer have) */
+  putInputNALUnitStart(ctx, nal->size);
+  copyBytes(input, ctx->outputFID, nal->size);
+
+  if (x->numWritten++ == 0) {
+    x->firstWrittenIndex = nal->index;
+    x->firstWrittenOffset = nal->offset;
+  }
+  x->lastWrittenIndex = nal->index;
+  if (nal->frame >= 0) {
+    if (x->firstWrittenFrame < 0) x->firstWrittenFrame = nal->frame;
+    x->lastWrittenFrame = nal->frame;
+  }
+}
+
+static void writeHeldNALs(RepairContext* ctx) {
+  /* Write (in order) the NAL units that we're holding, leaving the input file where it was: */
+  struct Extraction* x = ctx->extraction;
+  unsigned long const position = ctx->input.pos;
+  unsigned i;
+
+  for (i = 0; i < x->numHeld; ++i) writeExtractedNAL(ctx, &x->held[i]);
+  x->numHeld = 0;
+  seekInputTo(&ctx->input, position);
+}
+
+static void beginSegment(RepairContext* ctx) {
+  /* Write the latest parameter set NAL units (unless they're among those that we're holding),
+     and the NAL units since the last IRAP picture.  (The last of these is the current NAL unit,
+     so the input file is left after it.) */
+  struct Extraction* x = ctx->extraction;
+  unsigned i;
+
+  for (i = 0; i < 3; ++i) {
+    ExtractedNAL parameterSet;
+
+    if (x->parameterSetSize[i] == 0 || x->parameterSetOffset[i] >= x->held[0].offset) continue;
+    parameterSet.offset = x->parameterSetOffset[i];
+    parameterSet.size = x->parameterSetSize[i];
+    parameterSet.index = x->held[0].index;
+    parameterSet.frame = -1;
+    writeExtractedNAL(ctx, &parameterSet);
+  }
+  for (i = 0; i < x->numHeld; ++i) writeExtractedNAL(ctx, &x->held[i]);
+  x->firstWrittenOffset = x->held[0].offset; /* (for the summary: where the segment itself began) */
+  x->numHeld = 0;
+  x->started = 1;
+}
+
+static void skipNALUnit(InputFile* input, unsigned nalSize) {
+  /* Move past the NAL unit, exactly as "copyBytes()" would: */
+  if (input->pos < input->size && input->size - input->pos >= nalSize) {
+    input->pos += nalSize;
+  } else {
+    inputHasBytes(input, nalSize);
+  }
+}
+
+static void extractNALUnit(RepairContext* ctx, unsigned nalSize) {
+  /* The "copyNALUnit()" of an extraction: write the NAL unit at the current position only if
+     it's in the segment (or we'll need it to begin the segment), and move past it: */
+  struct Extraction* x = ctx->extraction;
+  InputFile* input = &ctx->input;
+  unsigned char const* header = NULL;
+  unsigned nalType = 0;
+  int isSlice = 0, isIRAP = 0, beginsPicture = 0, parameterSet = -1;
+  ExtractedNAL nal;
+
+  if (x->done) {
+    skipNALUnit(input, nalSize);
+    return;
+  }
+  if (input->stream != NULL) fillInput(input, input->pos + 3);
+  if (nalSize >= 3 && input->pos < input->size && input->size - input->pos >= 3) header = inputAt(input, input->pos);
+  if (x->codec == 0) noteExtractionFormat(ctx, header);
+
+  /* What kind of NAL unit it is: */
+  if (header != NULL && x->codec == 1) {
+    nalType = header[0]&0x1F;
+    isSlice = nalType >= 1 && nalType <= 5;
+    isIRAP = nalType == 5;
+    beginsPicture = isSlice && (header[1]&0x80) != 0; /* first_mb_in_slice == 0 */
+    if (nalType == 7 || nalType == 8) parameterSet = nalType - 6;
+  } else if (header != NULL) {
+    nalType = (header[0]>>1)&0x3F;
+    isSlice = nalType <= 31;
+    isIRAP = nalType >= 16 && nalType <= 23;
+    beginsPicture = isSlice && (header[2]&0x80) != 0; /* first_slice_segment_in_pic_flag */
+    if (nalType >= 32 && nalType <= 34) parameterSet = nalType - 32;
+  }
+  nal.offset = input->pos;
+  nal.size = nalSize;
+  nal.index = x->numNALUnits++;
+  if (beginsPicture) ++x->numFrames;
+  nal.frame = isSlice ? (long)(x->numFrames > 0 ? x->numFrames - 1 : 0) : -1;
+
+  if (!x->started) {
+    if (parameterSet >= 0) {
+      x->parameterSetOffset[parameterSet] = nal.offset;
+      x->parameterSetSize[parameterSet] = nalSize;
+    }
+    if (isIRAP && beginsPicture) {
+      /* Hold from here (keeping the NAL units since the last slice, which come before it): */
+      if (x->numHeld > x->numHeldBeforeLastSlice) {
+	memmove(x->held, &x->held[x->numHeldBeforeLastSlice], (x->numHeld - x->numHeldBeforeLastSlice)*sizeof x->held[0]);
+      }
+      x->numHeld -= x->numHeldBeforeLastSlice;
+      x->numHeldBeforeLastSlice = 0;
+    }
+    if (!holdExtractedNAL(ctx, &nal)) {
+      /* We're out of memory, so the segment will begin later than the last IRAP picture: */
+      x->numHeld = x->numHeldBeforeLastSlice = 0;
+      holdExtractedNAL(ctx, &nal); /* (this can't fail now) */
+    }
+    if (isSlice) x->numHeldBeforeLastSlice = x->numHeld;
+
+    if (x->range.kind == SEGMENT_BY_NAL_UNITS ? nal.index >= x->range.first
+	: beginsPicture && (unsigned long)nal.frame >= x->firstFrame) {
+      beginSegment(ctx);
+    } else {
+      skipNALUnit(input, nalSize);
+    }
+    return;
+  }
+
+  if (x->range.kind == SEGMENT_BY_NAL_UNITS ? nal.index > x->range.last
+      : beginsPicture && (unsigned long)nal.frame >= x->endFrame) {
+    /* The segment has ended (and we drop any NAL units that we're holding, which precede this): */
+    x->done = 1;
+    x->numHeld = 0;
+    skipNALUnit(input, nalSize);
+  } else if (x->range.kind == SEGMENT_BY_TIME && !isSlice && holdExtractedNAL(ctx, &nal)) {
+    skipNALUnit(input, nalSize);
+  } else {
+    writeHeldNALs(ctx);
+    writeExtractedNAL(ctx, &nal);
+  }
+}
+
+static void endExtraction(RepairContext* ctx, int repairIsOK) {
+  struct Extraction* x = ctx->extraction;
+
+  if (x->started && !x->done) writeHeldNALs(ctx); /* (the video ended within the segment) */
+  if (!repairIsOK) {
+    /* (Nothing was written) */
+  } else if (x->numWritten == 0) {
+    fprintf(ctx->log, "\n(The video ended before the segment began, so none of it was written.)\n");
+  } else {
+    fprintf(ctx->log, "\n(Wrote NAL units %lu-%lu, beginning at file position 0x%08lx", x->firstWrittenIndex, x->lastWrittenIndex, x->firstWrittenOffset);
+    if (x->firstWrittenFrame >= 0) {
+      fprintf(ctx->log, ": pictures %ld-%ld (%.3f-%.3f seconds, at %u fps%s)", x->firstWrittenFrame, x->lastWrittenFrame,
+	      (double)x->firstWrittenFrame/x->frameRate, (double)(x->lastWrittenFrame + 1)/x->frameRate, x->frameRate,
+	      x->frameRateIsAssumed ? " (assumed)" : "");
+    }
+    fprintf(ctx->log, ")\n");
+  }
+  giveBackMemory(&ctx->memory, (unsigned long)x->maxNumHeld*sizeof x->held[0]);
+  free(x->held);
+  free(x);
+  ctx->extraction = NULL;
+}
+
+static void copyNALUnit(RepairContext* ctx, unsigned nalSize) {
+  /* Write the "nalSize"-byte NAL unit at the current position of the input file (preceded by a
+     'start code' - or, in an MP4 file, its size), and move past it: */
+  if (ctx->extraction != NULL) {
+    extractNALUnit(ctx, nalSize);
+    return;
+  }
+  putInputNALUnitStart(ctx, nalSize);
+  copyBytes(&ctx->input, ctx->outputFID, nalSize);
+}
+
+static void emitNALUnit(NalWalk* walk, unsigned nalSize) {
+  /* Write (or record) the "nalSize"-byte NAL unit that begins at the current position, and move
+     past it: */
+  InputFile* input = walk->input;
+  WalkChunk* chunk = walk->chunk;
+
+  if (chunk == NULL && walk->writeBehind == NULL) {
+    copyNALUnit(walk->ctx, nalSize);
+    return;
+  }
+
+  if (chunk == NULL) {
+#ifdef HAVE_PTHREADS
+    /* Note the NAL unit now (for "--stats", "--plan", and an MP4 file's index), as
+       "putInputNALUnitStart()" would, but leave the writing of it to the write-behind queue: */
+    NalRun run;
+
+    run.offset = input->pos;
+    run.size = nalSize;
+    noteRuns(walk->ctx, input, &run, 1);
+    addWriteBehindRun(walk->writeBehind, &run);
+#endif
+  } else if (chunk->numRuns == chunk->maxNumRuns
+      && !growArray(&chunk->memory, (void**)&chunk->runs, &chunk->maxNumRuns, sizeof chunk->runs[0])) {
+    chunk->outOfMemory = 1;
+  } else {
+    chunk->runs[chunk->numRuns].offset = input->pos;
+    chunk->runs[chunk->numRuns].size = nalSize;
+    ++chunk->numRuns;
+  }
+  skipNALUnit(input, nalSize);
+}
+
+static void printWalkEvent(RepairContext* ctx, int kind, unsigned long position, unsigned nalSize) {
+  InputFile* input = &ctx->input;
+
+  if ((kind != WALK_EVENT_METADATA && kind != WALK_EVENT_METADATA_F2) || ctx->printableMetadataCount == 0) {
+    planEvent(ctx->plan, kind, position, nalSize); /* (only the first metadata block is printed) */
+  }
+
+  switch (kind) {
+    case WALK_EVENT_METADATA: case WALK_EVENT_METADATA_F2: {
+      if (++ctx->printableMetadataCount == 1 && !ctx->quiet) {
+	/* For the first occurrence of this metadata, print it out: */
+	unsigned long p;
+	unsigned char c;
+
+	fprintf(ctx->log, "\nSaw initial metadata block:");
+	if (kind == WALK_EVENT_METADATA_F2) {
+	  fprintf(ctx->log, "%c", 0x46); fprintf(ctx->log, "%c", 0x2f); // start of printable data
+	}
+	fillInput(input, position + 0x10000); /* (if we're reading a stream; the text is shorter than this) */
+	for (p = position; p < input->size; ++p) {
+	  c = *inputAt(input, p);
+	  fprintf(ctx->log, "%c", c);
+	  if (c == '\n' || (c == 0x00 && kind == WALK_EVENT_METADATA)) break;
+	}
+      }
+      break;
+    }
+    case WALK_EVENT_ANOMALY: {
+      if (!ctx->quiet) {
+	fprintf(ctx->log, "\n(Anomalous NAL unit size 0x%08x @ file position 0x%08lx (%lu MBytes))\n", nalSize, position, position/1000000);
+	fprintf(ctx->log, "(We can't repair any more than %lu MBytes of this file - sorry...)\n", position/1000000);
+      }
+      noteResyncEvent(ctx->stats, RESYNC_ENDED, position, nalSize);
+      break;
+    }
+    case WALK_EVENT_SKIPPING: {
+      if (!ctx->quiet) fprintf(ctx->log, "\n(Skipping over anomalous bytes (nalSize 0x%08x), starting at file position 0x%08lx (%lu MBytes))...\n", nalSize, position, position/1000000);
+      noteResyncEvent(ctx->stats, RESYNC_SKIPPING, position, nalSize);
+      break;
+    }
+    case WALK_EVENT_RESUMING: {
+      if (!ctx->quiet) fprintf(ctx->log, "...resuming at file position 0x%08lx (%lu MBytes)).  Continuing to repair the file (please wait)...", position, position/1000000);
+      noteResyncEvent(ctx->stats, RESYNC_RESUMING, position, nalSize);
+      break;
+    }
+  }
+}
+
+static WalkEvent* addChunkEvent(WalkChunk* chunk, int kind, unsigned long position, unsigned nalSize) {
+  /* Record an event for the current step of a chunk's walk.  Returns NULL if we run out of memory: */
+  WalkEvent* event;
+
+  if (chunk->numEvents == chunk->maxNumEvents
+      && !growArray(&chunk->memory, (void**)&chunk->events, &chunk->maxNumEvents, sizeof chunk->events[0])) {
+    chunk->outOfMemory = 1;
+    return NULL;
+  }
+  event = &chunk->events[chunk->numEvents++];
+  event->kind = kind;
+  event->boundary = chunk->numBoundaries - 1;
+  event->position = position;
+  event->nalSize = nalSize;
+  event->numBytes = 0;
+  return event;
+}
+
+static void walkEvent(NalWalk* walk, int kind, unsigned long position, unsigned nalSize) {
+  /* Tell the user about "kind" - now, or (in a parallel repair) once we know that the step that
+     saw it is really part of the repair: */
+  if (walk->chunk == NULL) {
+    printWalkEvent(walk->ctx, kind, position, nalSize);
+  } else {
+    addChunkEvent(walk->chunk, kind, position, nalSize);
+  }
+}
+
+static void noteSkippedBlock(NalWalk* walk, unsigned ruleIndex, unsigned long position, unsigned long numBytes) {
+  /* The same, for counting (for "--stats") a block of non-video data that the walk skipped: */
+  WalkChunk* chunk = walk->chunk;
+
+  if (chunk == NULL) {
+    countSkippedBlock(walk->ctx->stats, ruleIndex, numBytes);
+    planItem(walk->ctx->plan, (int)ruleIndex, position, numBytes);
+  } else if (chunk->countsBlocks) {
+    WalkEvent* event = addChunkEvent(chunk, WALK_EVENT_BLOCK, position, ruleIndex);
+
+    if (event != NULL) event->numBytes = numBytes;
+  }
+}
+
+static void setMetadataIsNotPrintable(NalWalk* walk) {
+  if (walk->metadataIsPrintable && walk->chunk != NULL) walk->chunk->flipBoundary = walk->chunk->numBoundaries;
+  walk->metadataIsPrintable = 0;
+}
+
+static void noteMetadataIsPrintableWasUsed(NalWalk* walk) {
+  /* The current step did something that it would not have done if "metadataIsPrintable" were 0: */
+  if (walk->chunk != NULL) walk->chunk->lastPrintableBoundary = walk->chunk->numBoundaries - 1;
+}
+
+static int replayRepairPlan(RepairContext* ctx) {
+  /* If we have a repair plan ("--plan") for a repair that begins here, do the rest of the repair
+     just by copying the NAL units that it lists (telling the user - and "--stats" - what the
+     original repair did), leaving the input file as that repair did.  Returns 0 (having done
+     nothing) if we don't: */
+  RepairPlan const* plan = ctx->replayPlan;
+  InputFile* input = &ctx->input;
+  unsigned i, e = 0;
+
+  if (plan == NULL || input->pos != plan->startPosition) return 0;
+
+  for (i = 0; i < plan->numItems && !extractionIsDone(ctx); ++i) {
+    PlanItem const* item = &plan->items[i];
+
+    for (; e < plan->numEvents && plan->events[e].position < item->offset; ++e) {
+      printWalkEvent(ctx, plan->events[e].kind, plan->events[e].position, plan->events[e].nalSize);
+    }
+    if (item->kind == PLAN_ITEM_NAL_UNIT) {
+      seekInputTo(input, item->offset);
+      copyNALUnit(ctx, item->size);
+      noteProgress(ctx);
+    } else {
+      countSkippedBlock(ctx->stats, item->kind, item->size);
+    }
+  }
+  for (; e < plan->numEvents && !extractionIsDone(ctx); ++e) {
+    printWalkEvent(ctx, plan->events[e].kind, plan->events[e].position, plan->events[e].nalSize);
+  }
+
+  seekInputTo(input, plan->endPosition);
+  input->atEOF = plan->endedAtEOF;
+  return 1;
+}
+
+#ifndef DJIFIX_LIBRARY
+/* Reading and writing the file that holds a repair plan ("--plan").  After "PLAN_FILE_MAGIC"
+   (which also ends the file), everything is a number, written 7 bits per byte (least
+   significant first, with the top bit set in every byte but the last).  Each item is written
+   as the gap between the end of the previous item and its start ('zigzag' encoded, in case
+   it's negative), its size, and its kind (+1), so an item usually takes only a few bytes: */
+#define PLAN_FILE_SUFFIX ".djifix-plan"
+#define PLAN_FILE_MAGIC "djifix repair plan\n"
+
+static void putPlanNumber(FILE* fid, unsigned long long n) {
+  while (n >= 0x80) {
+    putc((int)(n&0x7F)|0x80, fid);
+    n >>= 7;
+  }
+  putc((int)n, fid);
+}
+
+static int getPlanNumber(FILE* fid, unsigned long long* n) {
+  unsigned shift = 0;
+  int c;
+
+  *n = 0;
+  do {
+    if (shift > 63 || (c = getc(fid)) == EOF) return 0;
+    *n |= (unsigned long long)(c&0x7F)<<shift;
+    shift += 7;
+  } while (c&0x80);
+  return 1;
+}
+
+static int getPlanMagic(FILE* fid) {
+  char magic[sizeof PLAN_FILE_MAGIC];
+
+  return fread(magic, 1, sizeof magic - 1, fid) == sizeof magic - 1
+    && memcmp(magic, PLAN_FILE_MAGIC, sizeof magic - 1) == 0;
+}
+
+static unsigned metadataRulesDigest(MetadataRuleTable const* table) {
+  /* A digest (FNV-1a) of the rules for recognizing blocks of non-video data, because a plan
+     made using other rules ("--rules") may have skipped other blocks: */
+  unsigned digest = 2166136261u;
+  unsigned i, j;
+
+  for (i = 0; i < table->numRules; ++i) {
+    MetadataBlockRule const* rule = &table->rules[i];
+    unsigned fields[8];
+
+    fields[0] = rule->mask; fields[1] = rule->value; fields[2] = rule->nextMask; fields[3] = rule->nextValue;
+    fields[4] = (unsigned)rule->action; fields[5] = rule->base; fields[6] = rule->shift; fields[7] = rule->fieldMask;
+    for (j = 0; j < 8; ++j) digest = (digest^fields[j])*16777619u;
+  }
+  return digest;
+}
+
+static unsigned repairRulesDigest(RepairContext const* ctx) {
+  /* The same, also covering "--stop-on-anomaly" (with which a 'type 3' or 'type 5' repair ends
+     where it would otherwise have skipped over anomalous bytes): */
+  return (metadataRulesDigest(ctx->metadataRules)^(ctx->stopOnAnomaly ? 1 : 2))*16777619u;
+}
+
+static int comparePlanItems(void const* p1, void const* p2) {
+  unsigned long const offset1 = ((PlanItem const*)p1)->offset, offset2 = ((PlanItem const*)p2)->offset;
+
+  return offset1 < offset2 ? -1 : offset1 > offset2;
+}
+
+static int saveRepairPlan(RepairPlan* plan, char const* fileName) {
+  /* Returns 0 (with "errno" set) if we couldn't write the file: */
+  FILE* fid = fopen(fileName, "wb");
+  unsigned long prevEnd = plan->startPosition;
+  unsigned i;
+  int isOK;
+
+  if (fid == NULL) return 0;
+
+  /* (A parallel ("-j") repair notes the blocks that it skipped before the NAL units around them,
+     so put the items in order first:) */
+  qsort(plan->items, plan->numItems, sizeof plan->items[0], comparePlanItems);
+
+  fputs(PLAN_FILE_MAGIC, fid);
+  putPlanNumber(fid, strlen(versionStr));
+  fputs(versionStr, fid);
+  putPlanNumber(fid, plan->inputSize);
+  putPlanNumber(fid, (unsigned long long)plan->inputTime);
+  putPlanNumber(fid, plan->repairType);
+  putPlanNumber(fid, plan->second4Bytes);
+  putPlanNumber(fid, plan->rulesDigest);
+  putPlanNumber(fid, plan->startPosition);
+  putPlanNumber(fid, plan->endPosition);
+  putPlanNumber(fid, plan->endedAtEOF);
+  putPlanNumber(fid, plan->metadataIsPrintable);
+
+  putPlanNumber(fid, plan->numItems);
+  for (i = 0; i < plan->numItems; ++i) {
+    PlanItem const* item = &plan->items[i];
+    long long const gap = (long long)item->offset - (long long)prevEnd;
+
+    putPlanNumber(fid, gap < 0 ? ((unsigned long long)-gap<<1) - 1 : (unsigned long long)gap<<1);
+    putPlanNumber(fid, item->size);
+    putPlanNumber(fid, item->kind + 1);
+    prevEnd = item->offset + item->size;
+  }
+  putPlanNumber(fid, plan->numEvents);
+  for (i = 0; i < plan->numEvents; ++i) {
+    putPlanNumber(fid, plan->events[i].kind);
+    putPlanNumber(fid, plan->events[i].position);
+    putPlanNumber(fid, plan->events[i].nalSize);
+  }
+  fputs(PLAN_FILE_MAGIC, fid);
+
+  isOK = !ferror(fid);
+  if (fclose(fid) != 0) isOK = 0;
+  if (!isOK) remove(fileName);
+  return isOK;
+}
+
+static unsigned long repairPlanMemory(RepairPlan const* plan) {
+  return (unsigned long)plan->maxNumItems*sizeof plan->items[0] + (unsigned long)plan->maxNumEvents*sizeof plan->events[0];
+}
+
+static int loadRepairPlan(RepairPlan* plan, char const* fileName, RepairPlan const* expected) {
+  /* Read the plan, checking that it's for the repair described by "expected".  Returns 0 - with
+     "errno" set to ENOENT if there's no such file - if we can't use it: */
+  FILE* fid = fopen(fileName, "rb");
+  unsigned long long n[11];
+  unsigned long prevEnd;
+  unsigned i;
+  int isOK = 0;
+
+  memset(plan, 0, sizeof *plan);
+  plan->memory = expected->memory;
+  if (fid == NULL) return 0;
+  errno = 0;
+  do {
+    char version[64];
+
+    if (!getPlanMagic(fid) || !getPlanNumber(fid, &n[0]) || n[0] >= sizeof version) break;
+    if (fread(version, 1, (size_t)n[0], fid) != n[0]) break;
+    version[n[0]] = '\0';
+    if (strcmp(version, versionStr) != 0) break; /* (another version might have repaired it differently) */
+    for (i = 0; i < 10; ++i) {
+      if (!getPlanNumber(fid, &n[i])) break;
+    }
+    if (i < 10) break;
+    plan->inputSize = n[0];
+    plan->inputTime = (long long)n[1];
+    plan->repairType = (int)n[2];
+    plan->second4Bytes = n[3];
+    plan->rulesDigest = n[4];
+    plan->startPosition = n[5];
+    plan->endPosition = n[6];
+    plan->endedAtEOF = (int)n[7];
+    plan->metadataIsPrintable = (int)n[8];
+    if (plan->inputSize != expected->inputSize || plan->inputTime != expected->inputTime
+	|| plan->repairType != expected->repairType || plan->second4Bytes != expected->second4Bytes
+	|| plan->rulesDigest != expected->rulesDigest) break;
+
+    /* The items: */
+    if (n[9] > plan->inputSize) break; /* (each item is at least 1 byte of the input file) */
+    if (!takeMemory(plan->memory, (unsigned long)n[9]*sizeof plan->items[0])) break;
+    plan->numItems = plan->maxNumItems = (unsigned)n[9];
+    plan->items = malloc((plan->numItems + 1)*sizeof plan->items[0]);
+    if (plan->items == NULL) break;
+    prevEnd = plan->startPosition;
+    for (i = 0; i < plan->numItems; ++i) {
+      PlanItem* item = &plan->items[i];
+      unsigned long long gap, size, kind;
+
+      if (!getPlanNumber(fid, &gap) || !getPlanNumber(fid, &size) || !getPlanNumber(fid, &kind)) break;
+      if (kind > MAX_BLOCK_RULES) break;
+      item->offset = (gap&1) ? prevEnd - (unsigned long)((gap+1)>>1) : prevEnd + (unsigned long)(gap>>1);
+      item->size = size;
+      item->kind = (int)kind - 1;
+      prevEnd = item->offset + item->size;
+    }
+    if (i < plan->numItems) break;
+
+    /* The events: */
+    if (!getPlanNumber(fid, &n[10]) || n[10] > plan->inputSize) break;
+    if (!takeMemory(plan->memory, (unsigned long)n[10]*sizeof plan->events[0])) break;
+    plan->numEvents = plan->maxNumEvents = (unsigned)n[10];
+    plan->events = malloc((plan->numEvents + 1)*sizeof plan->events[0]);
+    if (plan->events == NULL) break;
+    for (i = 0; i < plan->numEvents; ++i) {
+      unsigned long long kind, position, nalSize;
+
+      if (!getPlanNumber(fid, &kind) || !getPlanNumber(fid, &position) || !getPlanNumber(fid, &nalSize)) break;
+      if (kind < WALK_EVENT_METADATA || kind > WALK_EVENT_RESUMING) break;
+      plan->events[i].kind = (int)kind;
+      plan->events[i].position = position;
+      plan->events[i].nalSize = (unsigned)nalSize;
+    }
+    if (i < plan->numEvents) break;
+
+    isOK = getPlanMagic(fid);
+  } while (0);
+
+  fclose(fid);
+  if (!isOK) {
+    MemoryBudget* memory = plan->memory;
+
+    giveBackMemory(memory, repairPlanMemory(plan));
+    free(plan->items);
+    free(plan->events);
+    memset(plan, 0, sizeof *plan);
+    plan->memory = memory;
+  }
+  return isOK;
+}
+
+static long long fileModificationTime(char const* fileName) {
+  /* (0 if we can't tell) */
+#ifdef HAVE_MMAP
+  struct stat sb;
+
+  if (stat(fileName, &sb) == 0) return (long long)sb.st_mtime;
+#endif
+  return 0;
+}
+
+static void freeRepairPlan(RepairPlan* plan) {
+  if (plan == NULL) return;
+  giveBackMemory(plan->memory, repairPlanMemory(plan));
+  free(plan->items);
+  free(plan->events);
+  free(plan);
+}
+
+static char* beginRepairPlan(RepairContext* ctx, char const* inputFileName) {
+  /* "--plan": If there's a repair plan for this file (made by an earlier repair of it), use it
+     for this repair; otherwise make one, as we go.  Returns the ("malloc()"ed) name of the plan
+     file, or NULL if we can't do either: */
+  char* planFileName = malloc(strlen(inputFileName) + strlen(PLAN_FILE_SUFFIX) + 1);
+  RepairPlan* plan = calloc(1, sizeof *plan);
+  RepairPlan* replayPlan = calloc(1, sizeof *replayPlan);
+
+  if (planFileName == NULL || plan == NULL || replayPlan == NULL) {
+    free(planFileName);
+    free(plan);
+    free(replayPlan);
+    return NULL;
+  }
+  sprintf(planFileName, "%s%s", inputFileName, PLAN_FILE_SUFFIX);
+  plan->inputSize = ctx->input.size;
+  plan->inputTime = fileModificationTime(inputFileName);
+  plan->repairType = ctx->repairType;
+  plan->second4Bytes = ctx->repairType == 2 ? ctx->repairType2Second4Bytes : 0;
+  plan->rulesDigest = repairRulesDigest(ctx);
+  plan->memory = &ctx->memory;
+
+  if (loadRepairPlan(replayPlan, planFileName, plan)) {
+    fprintf(ctx->log, "Using the repair plan \"%s\" (made by an earlier repair of this file), so the file won't be parsed again.\n", planFileName);
+    ctx->replayPlan = replayPlan;
+    freeRepairPlan(plan);
+  } else if (ctx->segmentRange.kind != 0) {
+    /* ("--range" or "--nals") A repair that stops where the segment ends can't make a plan: */
+    freeRepairPlan(plan);
+    freeRepairPlan(replayPlan);
+  } else {
+    if (errno != ENOENT) {
+      fprintf(ctx->log, "(The repair plan \"%s\" is for an earlier version of this file (or is damaged), so we'll make a new one.)\n", planFileName);
+    }
+    ctx->plan = plan;
+    freeRepairPlan(replayPlan);
+  }
+  return planFileName;
+}
+
+static void endRepairPlan(RepairContext* ctx, char* planFileName, int repairIsOK) {
+  /* After the repair: save the plan that we made (if the repair was completed), then free it: */
+  RepairPlan* plan = ctx->plan;
+
+  if (plan != NULL && repairIsOK && !plan->outOfMemory) {
+    plan->endPosition = ctx->input.pos;
+    plan->endedAtEOF = ctx->input.atEOF;
+    plan->metadataIsPrintable = ctx->metadataIsPrintable;
+    if (!saveRepairPlan(plan, planFileName)) {
+      fprintf(ctx->log, "\n(Failed to write the repair plan \"%s\": %s)\n", planFileName, strerror(errno));
+    }
+  } else if (plan != NULL && repairIsOK) {
+    fprintf(ctx->log, "\n(The repair plan \"%s\" wasn't saved, because it needed more memory than we had)\n", planFileName);
+  }
+  freeRepairPlan(ctx->plan);
+  freeRepairPlan(ctx->replayPlan);
+  ctx->plan = ctx->replayPlan = NULL;
+  free(planFileName);
+}
+
+/* The 'repair cache' ("--cache"): what the last repair of a file decided - its repair type, and
+   video format - and the repaired file that it made, kept in a file ("<input file name>.djifix-
+   cache"), so that if neither file has changed since, the file isn't repaired again.  We check
+   whether a file has changed using its size, its modification time, and a digest of part of it:
+   its start, and a number of samples spread over the rest of it.  (The cache file is written
+   as a repair plan is.) */
+#define CACHE_FILE_SUFFIX ".djifix-cache"
+#define CACHE_FILE_MAGIC "djifix repair cache\n"
+#define CACHE_HEADER_SIZE (64*1024) /* the start of the file, which the digest always includes */
+#define CACHE_NUM_SAMPLES 16
+#define CACHE_SAMPLE_SIZE 4096
+
+typedef struct FileDigest {
+  unsigned long long size;
+  long long time; /* when the file was last modified */
+  unsigned long long digest; /* (FNV-1a) of the file's size, its start, and the samples */
+} FileDigest;
+
+typedef struct RepairCache {
+  FileDigest input;
+  unsigned rulesDigest; /* of the rules for recognizing blocks of non-video data (and "--stop-on-anomaly") */
+  int repairType;
+  int formatCode; /* ('type 2', 'type 3', and 'type 5' only) */
+  int outputIsMP4;
+  FileDigest output;
+  char outputFileName[4096];
+} RepairCache;
+
+static unsigned long long addToDigest(unsigned long long digest, unsigned char const* data, size_t size) {
+  size_t i;
+
+  for (i = 0; i < size; ++i) digest = (digest^data[i])*1099511628211ULL;
+  return digest;
+}
+
+static int digestFile(char const* fileName, FileDigest* result) {
+  /* Returns 0 if we can't read the file: */
+  FILE* fid = fopen(fileName, "rb");
+  unsigned char buffer[CACHE_HEADER_SIZE];
+  unsigned long long digest = 14695981039346656037ULL;
+  long long end;
+  unsigned i;
+  int isOK = 0;
+
+  if (fid == NULL) return 0;
+  do {
+    size_t numToRead;
+    unsigned char sizeBytes[8];
+
+    if (fseek(fid, 0, SEEK_END) != 0 || (end = tellOutput(fid)) < 0) break;
+    result->size = (unsigned long long)end;
+    result->time = fileModificationTime(fileName);
+    for (i = 0; i < 8; ++i) sizeBytes[i] = (unsigned char)(result->size>>(8*i));
+    digest = addToDigest(digest, sizeBytes, sizeof sizeBytes);
+
+    numToRead = result->size < CACHE_HEADER_SIZE ? (size_t)result->size : CACHE_HEADER_SIZE;
+    if (seekOutputTo(fid, 0) != 0 || fread(buffer, 1, numToRead, fid) != numToRead) break;
+    digest = addToDigest(digest, buffer, numToRead);
+    if (result->size > CACHE_HEADER_SIZE + CACHE_SAMPLE_SIZE) {
+      /* The samples (the last of which ends at the end of the file): */
+      unsigned long long const span = result->size - CACHE_HEADER_SIZE - CACHE_SAMPLE_SIZE;
+
+      for (i = 1; i <= CACHE_NUM_SAMPLES; ++i) {
+	if (seekOutputTo(fid, (long long)(CACHE_HEADER_SIZE + span/CACHE_NUM_SAMPLES*i)) != 0
+	    || fread(buffer, 1, CACHE_SAMPLE_SIZE, fid) != CACHE_SAMPLE_SIZE) break;
+	digest = addToDigest(digest, buffer, CACHE_SAMPLE_SIZE);
+      }
+      if (i <= CACHE_NUM_SAMPLES) break;
+    }
+    result->digest = digest;
+    isOK = 1;
+  } while (0);
+
+  fclose(fid);
+  return isOK;
+}
+
+static int sameFileDigest(FileDigest const* d1, FileDigest const* d2) {
+  return d1->size == d2->size && d1->time == d2->time && d1->digest == d2->digest;
+}
+
+static void putCacheDigest(FILE* fid, FileDigest const* d) {
+  putPlanNumber(fid, d->size);
+  putPlanNumber(fid, (unsigned long long)d->time);
+  putPlanNumber(fid, d->digest);
+}
+
+static int getCacheDigest(FILE* fid, FileDigest* d) {
+  unsigned long long time;
+
+  if (!getPlanNumber(fid, &d->size) || !getPlanNumber(fid, &time) || !getPlanNumber(fid, &d->digest)) return 0;
+  d->time = (long long)time;
+  return 1;
+}
+
+static int getCacheMagic(FILE* fid) {
+  char magic[sizeof CACHE_FILE_MAGIC];
+
+  return fread(magic, 1, sizeof magic - 1, fid) == sizeof magic - 1
+    && memcmp(magic, CACHE_FILE_MAGIC, sizeof magic - 1) == 0;
+}
+
+static int loadRepairCache(RepairCache* cache, char const* fileName) {
+  /* Returns 0 - with "errno" set to ENOENT if there's no such file - if we can't read it (or
+     it's from another version of the software): */
+  FILE* fid = fopen(fileName, "rb");
+  unsigned long long n[5];
+  unsigned i;
+  int isOK = 0;
+
+  memset(cache, 0, sizeof *cache);
+  if (fid == NULL) return 0;
+  errno = 0;
+  do {
+    char version[64];
+
+    if (!getCacheMagic(fid) || !getPlanNumber(fid, &n[0]) || n[0] >= sizeof version) break;
+    if (fread(version, 1, (size_t)n[0], fid) != n[0]) break;
+    version[n[0]] = '\0';
+    if (strcmp(version, versionStr) != 0) break; /* (another version might have repaired it differently) */
+    if (!getCacheDigest(fid, &cache->input)) break;
+    for (i = 0; i < 4; ++i) {
+      if (!getPlanNumber(fid, &n[i])) break;
+    }
+    if (i < 4) break;
+    cache->rulesDigest = (unsigned)n[0];
+    cache->repairType = (int)n[1];
+    cache->formatCode = (int)n[2];
+    cache->outputIsMP4 = (int)n[3];
+    if (!getCacheDigest(fid, &cache->output)) break;
+    if (!getPlanNumber(fid, &n[4]) || n[4] == 0 || n[4] >= sizeof cache->outputFileName) break;
+    if (fread(cache->outputFileName, 1, (size_t)n[4], fid) != n[4]) break;
+    cache->outputFileName[n[4]] = '\0';
+    isOK = getCacheMagic(fid);
+  } while (0);
+
+  fclose(fid);
+  return isOK;
+}
+
+static int saveRepairCache(RepairCache const* cache, char const* fileName) {
+  /* Returns 0 (with "errno" set) if we couldn't write the file: */
+  FILE* fid = fopen(fileName, "wb");
+  int isOK;
+
+  if (fid == NULL) return 0;
+  fputs(CACHE_FILE_MAGIC, fid);
+  putPlanNumber(fid, strlen(versionStr));
+  fputs(versionStr, fid);
+  putCacheDigest(fid, &cache->input);
+  putPlanNumber(fid, cache->rulesDigest);
+  putPlanNumber(fid, cache->repairType);
+  putPlanNumber(fid, cache->formatCode);
+  putPlanNumber(fid, cache->outputIsMP4);
+  putCacheDigest(fid, &cache->output);
+  putPlanNumber(fid, strlen(cache->outputFileName));
+  fputs(cache->outputFileName, fid);
+  fputs(CACHE_FILE_MAGIC, fid);
+
+  isOK = !ferror(fid);
+  if (fclose(fid) != 0) isOK = 0;
+  if (!isOK) remove(fileName);
+  return isOK;
+}
+
+static char* cacheFileNameFor(char const* inputFileName) {
+  char* cacheFileName = malloc(strlen(inputFileName) + strlen(CACHE_FILE_SUFFIX) + 1);
+
+  if (cacheFileName != NULL) sprintf(cacheFileName, "%s%s", inputFileName, CACHE_FILE_SUFFIX);
+  return cacheFileName;
+}
+
+static int useCachedRepair(RepairContext* ctx, char const* inputFileName) {
+  /* "--cache": If this file was repaired before - in the way that it would be repaired now -
+     and neither it nor the repaired file has changed since, note that repair as ours, and
+     return 1 (without repairing the file again): */
+  char* cacheFileName = cacheFileNameFor(inputFileName);
+  char* outputFileName = NULL;
+  RepairCache cache;
+  FileDigest digest;
+  int isUsable = 0;
+
+  if (cacheFileName == NULL) return 0;
+  do {
+    int requestedFormatCode;
+
+    if (!loadRepairCache(&cache, cacheFileName)) {
+      if (errno == ENOENT) break;
+    } else {
+      /* Check that the file would be repaired the same way now: */
+      requestedFormatCode = cache.repairType >= 2 && cache.repairType <= 5 ? ctx->formatCodes[cache.repairType] : 0;
+      outputFileName = makeOutputFileName(ctx, inputFileName, cache.outputIsMP4);
+      if (cache.rulesDigest == repairRulesDigest(ctx)
+	  && cache.outputIsMP4 == (cache.repairType == 1 || ctx->writeMP4)
+	  && (requestedFormatCode == 0 || requestedFormatCode == AUTO_FORMAT_CODE
+	      || findVideoFormat(cache.repairType, requestedFormatCode) == findVideoFormat(cache.repairType, cache.formatCode))
+	  && outputFileName != NULL && strcmp(outputFileName, cache.outputFileName) == 0
+	  /* ... and that neither file has changed since: */
+	  && digestFile(inputFileName, &digest) && sameFileDigest(&digest, &cache.input)
+	  && digestFile(outputFileName, &digest) && sameFileDigest(&digest, &cache.output)) {
+	isUsable = 1;
+	break;
+      }
+    }
+    fprintf(ctx->log, "(The repair cache \"%s\" doesn't match this file, its repaired file, or the options given, so we'll repair the file again.)\n", cacheFileName);
+  } while (0);
+
+  free(cacheFileName);
+  if (!isUsable) {
+    free(outputFileName);
+    return 0;
+  }
+  fprintf(ctx->log, "This file was repaired before ('type %d' repair), and neither it nor the repaired file has changed since, so it won't be repaired again.\n", cache.repairType);
+  ctx->repairType = cache.repairType;
+  ctx->outputFileName = outputFileName;
+  ctx->outputSize = (unsigned long)cache.output.size;
+  return 1;
+}
+
+static void noteRepairInCache(RepairContext* ctx, char const* inputFileName, char const* outputFileName, int outputIsMP4) {
+  /* "--cache": After a repair, remember it (and the repaired file) in the repair cache: */
+  char* cacheFileName = cacheFileNameFor(inputFileName);
+  RepairCache cache;
+
+  if (cacheFileName == NULL) return;
+  memset(&cache, 0, sizeof cache);
+  cache.rulesDigest = repairRulesDigest(ctx);
+  cache.repairType = ctx->repairType;
+  cache.formatCode = ctx->repairType == 1 || ctx->repairType == 4 ? 0 : ctx->formatCode;
+  cache.outputIsMP4 = outputIsMP4;
+  if (strlen(outputFileName) < sizeof cache.outputFileName
+      && digestFile(inputFileName, &cache.input) && digestFile(outputFileName, &cache.output)) {
+    strcpy(cache.outputFileName, outputFileName);
+    if (!saveRepairCache(&cache, cacheFileName)) {
+      fprintf(ctx->log, "\n(Failed to write the repair cache \"%s\": %s)\n", cacheFileName, strerror(errno));
+    }
+  }
+  free(cacheFileName);
+}
+
+/* Checkpoints ("--resume"): while a 'type 3', 'type 4', or 'type 5' file is being repaired into a
+   '.h264' file, we note - every "CHECKPOINT_INTERVAL" bytes of input, in a file ("<repaired file
+   name>.djifix-checkpoint") - how far the repair has got: where in the input file the walk is,
+   what it needs to know to continue from there, and how much of the repaired file it has
+   written (which we first make sure is on the disk).  If the repair is interrupted, repairing
+   the file again with "--resume" truncates the repaired file to that size, and continues the
+   walk from there.  (The checkpoint file is written as a repair plan is; it's replaced - by
+   renaming - each time, and removed once the repair is done.) */
+#define CHECKPOINT_FILE_SUFFIX ".djifix-checkpoint"
+#define CHECKPOINT_FILE_MAGIC "djifix repair checkpoint\n"
+#ifndef CHECKPOINT_INTERVAL
+#define CHECKPOINT_INTERVAL (256*1000000UL) /* (as "usage()" says) */
+#endif
+
+typedef struct RepairCheckpoint {
+  /* Which file - and repair - the checkpoint is for: */
+  FileDigest input;
+  unsigned rulesDigest; /* of the rules for recognizing blocks of non-video data (and "--stop-on-anomaly") */
+  int repairType;
+  int formatCode; /* ('type 3' and 'type 5' only) */
+  unsigned long startPosition; /* where the walk began */
+
+  /* Where the walk had got to: */
+  unsigned long position;
+  int metadataIsPrintable;
+  unsigned printableMetadataCount;
+  unsigned long long outputSize; /* how much of the repaired file had been written */
+} RepairCheckpoint;
+
+typedef struct CheckpointState {
+  char* fileName;
+  char* newFileName; /* where we write each checkpoint, before renaming it as "fileName" */
+  RepairCheckpoint checkpoint; /* this repair's (filled in as we go) */
+  RepairCheckpoint saved; /* if "canResume", the one that an earlier repair of this file saved */
+  int canResume;
+  int wasSaved; /* we saved (at least) one checkpoint */
+  int failed; /* we couldn't save a checkpoint (so we no longer try) */
+} CheckpointState;
+
+static int getCheckpointMagic(FILE* fid) {
+  char magic[sizeof CHECKPOINT_FILE_MAGIC];
+
+  return fread(magic, 1, sizeof magic - 1, fid) == sizeof magic - 1
+    && memcmp(magic, CHECKPOINT_FILE_MAGIC, sizeof magic - 1) == 0;
+}
+
+static int loadCheckpoint(RepairCheckpoint* checkpoint, char const* fileName) {
+  /* Returns 0 - with "errno" set to ENOENT if there's no such file - if we can't read it (or
+     it's from another version of the software): */
+  FILE* fid = fopen(fileName, "rb");
+  unsigned long long n[8];
+  unsigned i;
+  int isOK = 0;
+
+  memset(checkpoint, 0, sizeof *checkpoint);
+  if (fid == NULL) return 0;
+  errno = 0;
+  do {
+    char version[64];
+
+    if (!getCheckpointMagic(fid) || !getPlanNumber(fid, &n[0]) || n[0] >= sizeof version) break;
+    if (fread(version, 1, (size_t)n[0], fid) != n[0]) break;
+    version[n[0]] = '\0';
+    if (strcmp(version, versionStr) != 0) break;
+    if (!getCacheDigest(fid, &checkpoint->input)) break;
+    for (i = 0; i < 8; ++i) {
+      if (!getPlanNumber(fid, &n[i])) break;
+    }
+    if (i < 8) break;
+    checkpoint->rulesDigest = (unsigned)n[0];
+    checkpoint->repairType = (int)n[1];
+    checkpoint->formatCode = (int)n[2];
+    checkpoint->startPosition = (unsigned long)n[3];
+    checkpoint->position = (unsigned long)n[4];
+    checkpoint->metadataIsPrintable = (int)n[5];
+    checkpoint->printableMetadataCount = (unsigned)n[6];
+    checkpoint->outputSize = n[7];
+    isOK = getCheckpointMagic(fid);
+  } while (0);
+
+  fclose(fid);
+  return isOK;
+}
+
+static int writeCheckpoint(RepairCheckpoint const* checkpoint, FILE* fid) {
+  /* Returns 0 (with "errno" set) if we couldn't write it: */
+  fputs(CHECKPOINT_FILE_MAGIC, fid);
+  putPlanNumber(fid, strlen(versionStr));
+  fputs(versionStr, fid);
+  putCacheDigest(fid, &checkpoint->input);
+  putPlanNumber(fid, checkpoint->rulesDigest);
+  putPlanNumber(fid, checkpoint->repairType);
+  putPlanNumber(fid, checkpoint->formatCode);
+  putPlanNumber(fid, checkpoint->startPosition);
+  putPlanNumber(fid, checkpoint->position);
+  putPlanNumber(fid, checkpoint->metadataIsPrintable);
+  putPlanNumber(fid, checkpoint->printableMetadataCount);
+  putPlanNumber(fid, checkpoint->outputSize);
+  fputs(CHECKPOINT_FILE_MAGIC, fid);
+  if (fflush(fid) != 0 || ferror(fid)) return 0;
+#ifdef HAVE_FTRUNCATE
+  if (fsync(fileno(fid)) != 0) return 0;
+#endif
+  return 1;
+}
+
+static FILE* openCheckpointedOutput(RepairContext* ctx, char const* inputFileName, char const* outputFileName) {
+  /* "--resume": Open the repaired file, preparing to save checkpoints of its repair (in
+     "ctx->checkpoints") - and, if an earlier repair of this file saved one (and the repaired
+     file is still there), to resume from it, keeping what that repair wrote: */
+  CheckpointState* checkpoints = calloc(1, sizeof *checkpoints);
+  RepairCheckpoint* checkpoint;
+  FILE* outputFID = NULL;
+
+  if (checkpoints != NULL) {
+    checkpoints->fileName = malloc(strlen(outputFileName) + strlen(CHECKPOINT_FILE_SUFFIX) + 1);
+    checkpoints->newFileName = malloc(strlen(outputFileName) + strlen(CHECKPOINT_FILE_SUFFIX) + 2);
+  }
+  if (checkpoints == NULL || checkpoints->fileName == NULL || checkpoints->newFileName == NULL
+      || !digestFile(inputFileName, &checkpoints->checkpoint.input)) {
+    /* We can't save checkpoints, so just repair the file: */
+    if (checkpoints != NULL) {
+      free(checkpoints->fileName);
+      free(checkpoints->newFileName);
+      free(checkpoints);
+    }
+    return fopen(outputFileName, "wb");
+  }
+  sprintf(checkpoints->fileName, "%s%s", outputFileName, CHECKPOINT_FILE_SUFFIX);
+  sprintf(checkpoints->newFileName, "%s%s~", outputFileName, CHECKPOINT_FILE_SUFFIX);
+  remove(checkpoints->newFileName); /* (in case an earlier repair stopped while writing it) */
+  checkpoint = &checkpoints->checkpoint;
+  checkpoint->rulesDigest = repairRulesDigest(ctx);
+  checkpoint->repairType = ctx->repairType;
+  ctx->checkpoints = checkpoints;
+
+  if (loadCheckpoint(&checkpoints->saved, checkpoints->fileName)) {
+    RepairCheckpoint const* saved = &checkpoints->saved;
+    FileDigest output;
+
+    if (sameFileDigest(&saved->input, &checkpoint->input)
+	&& saved->rulesDigest == checkpoint->rulesDigest && saved->repairType == checkpoint->repairType
+	&& digestFile(outputFileName, &output) && output.size >= saved->outputSize) {
+      outputFID = fopen(outputFileName, "r+b");
+      checkpoints->canResume = outputFID != NULL;
+    }
+  }
+  if (!checkpoints->canResume && errno != ENOENT) {
+    fprintf(ctx->log, "(The checkpoint \"%s\" isn't for this file (or its repaired file is missing), so we'll repair the whole file.)\n", checkpoints->fileName);
+  }
+  if (outputFID == NULL) outputFID = fopen(outputFileName, "wb");
+  if (outputFID == NULL) endCheckpoints(ctx, 0);
+  return outputFID;
+}
+
+static int endCheckpoints(RepairContext* ctx, int removeFile) {
+  /* After the repair (if it succeeded, "removeFile"), or if it never began.  Returns 1 if we
+     left a checkpoint, from which "--resume" can continue the repair: */
+  CheckpointState* checkpoints = ctx->checkpoints;
+  int isLeft;
+
+  if (checkpoints == NULL) return 0;
+  if (removeFile) {
+    remove(checkpoints->fileName);
+    remove(checkpoints->newFileName);
+  }
+  isLeft = !removeFile && (checkpoints->canResume || checkpoints->wasSaved);
+  free(checkpoints->fileName);
+  free(checkpoints->newFileName);
+  free(checkpoints);
+  ctx->checkpoints = NULL;
+  return isLeft;
+}
+
+static unsigned long resumeWalk(NalWalk* walk) {
+  /* At the start of a walk with "--resume": If the checkpoint that we loaded is for this walk,
+     move the walk - and the repaired file - to where they were when it was saved.  (Otherwise,
+     remove whatever an earlier repair left in the repaired file after what we've written.)
+     Returns how often (in bytes of input) to save a checkpoint, or 0 if we can't: */
+  RepairContext* ctx = walk->ctx;
+  CheckpointState* checkpoints = ctx->checkpoints;
+  RepairCheckpoint* checkpoint = &checkpoints->checkpoint;
+  InputFile* input = walk->input;
+  long long outputPosition;
+
+  checkpoint->formatCode = walk->repairType == 4 ? 0 : ctx->formatCode;
+  checkpoint->startPosition = input->pos;
+  fflush(walk->outputFID);
+  outputPosition = tellOutput(walk->outputFID);
+  if (outputPosition < 0) return 0;
+#ifdef HAVE_FTRUNCATE
+  if (checkpoints->canResume) {
+    RepairCheckpoint const* saved = &checkpoints->saved;
+
+    if (saved->formatCode == checkpoint->formatCode && saved->startPosition == checkpoint->startPosition
+	&& saved->position < input->size && saved->outputSize >= (unsigned long long)outputPosition
+	&& ftruncate(fileno(walk->outputFID), (off_t)saved->outputSize) == 0
+	&& seekOutputTo(walk->outputFID, (long long)saved->outputSize) == 0) {
+      fprintf(ctx->log, "\nResuming the repair from the checkpoint \"%s\": at file position 0x%08lx (%lu MBytes)...", checkpoints->fileName, saved->position, saved->position/1000000);
+      seekInputTo(input, saved->position);
+      walk->metadataIsPrintable = saved->metadataIsPrintable;
+      ctx->printableMetadataCount = saved->printableMetadataCount;
+      return CHECKPOINT_INTERVAL;
+    }
+    fprintf(ctx->log, "\n(The checkpoint \"%s\" was made with another video format, so we'll repair the whole file.)\n", checkpoints->fileName);
+  }
+  if (ftruncate(fileno(walk->outputFID), (off_t)outputPosition) != 0) return 0;
+  return CHECKPOINT_INTERVAL;
+#else
+  return 0;
+#endif
+}
+
+static void saveCheckpoint(NalWalk const* walk) {
+  /* Save a checkpoint of the walk, which is at the start of a step.  (Once we've failed to,
+     we stop trying.) */
+  RepairContext* ctx = walk->ctx;
+  CheckpointState* checkpoints = ctx->checkpoints;
+  RepairCheckpoint* checkpoint = &checkpoints->checkpoint;
+  long long outputSize;
+  FILE* fid;
+  int isOK = 0;
+
+  if (checkpoints->failed) return;
+  do {
+    /* First, make sure that what we've written so far is on the disk: */
+    if (fflush(walk->outputFID) != 0 || (outputSize = tellOutput(walk->outputFID)) < 0) break;
+#ifdef HAVE_FTRUNCATE
+    if (fsync(fileno(walk->outputFID)) != 0) break;
+#endif
+    checkpoint->position = walk->input->pos;
+    checkpoint->metadataIsPrintable = walk->metadataIsPrintable;
+    checkpoint->printableMetadataCount = ctx->printableMetadataCount;
+    checkpoint->outputSize = (unsigned long long)outputSize;
+
+    fid = fopen(checkpoints->newFileName, "wb");
+    if (fid == NULL) break;
+    isOK = writeCheckpoint(checkpoint, fid);
+    if (fclose(fid) != 0) isOK = 0;
+    if (isOK) isOK = rename(checkpoints->newFileName, checkpoints->fileName) == 0;
+    if (!isOK) remove(checkpoints->newFileName);
+  } while (0);
+
+  if (!isOK) {
+    fprintf(ctx->log, "\n(Failed to write the checkpoint \"%s\": %s)\n", checkpoints->fileName, strerror(errno));
+    checkpoints->failed = 1;
+  } else {
+    checkpoints->wasSaved = 1;
+  }
+}
+#endif
+
+
+
+static int doRepairType2(RepairContext* ctx, unsigned second4Bytes, int formatCode) {
+  InputFile* input = &ctx->input;
+  char validCodes[2*MAX_NUM_FORMATS+1];
+
+  /* The content of the SPS NAL unit depends upon which video format was used.
+     Prompt the user for this now (unless it was given on the command line, or detected):
+  */
+  if (formatCode == AUTO_FORMAT_CODE) {
+    formatCode = ctx->numProbeSlices > 0 ? probeFormatCode(ctx, 2, second4Bytes)
+      : detectFormatCode(ctx, 2, input->pos-2);
+    if (formatCode != 0) fprintf(ctx->log, "Using video format \"%c\" (detected automatically).\n", formatCode);
+  } else {
+    if (ctx->numProbeSlices > 0) probeFormatCode(ctx, 2, second4Bytes); /* just to report the results */
+    if (formatCode != 0) fprintf(ctx->log, "Using video format \"%c\" (given on the command line).\n", formatCode);
+  }
+  if (formatCode == 0 && !canPromptForFormatCode(ctx)) return 0;
+  while (formatCode == 0) {
+    fprintf(ctx->log, "First, however, we need to know which video format was used.  Enter this now.\n");
+    printFormatMenu(ctx, 2, validCodes);
+    fprintf(ctx->log, "(If you are unsure which video format was used, then guess as follows:\n");
+    fprintf(ctx->log, "\tIf your file was from a Mavic Pro: Type 7, then the \"Return\" key.\n");
+    fprintf(ctx->log, "\tIf your file was from a Phantom 2 Vision+: Type G, then the \"Return\" key.\n");
+    fprintf(ctx->log, "\tIf your file was from an Inspire: Type 3, then the \"Return\" key.\n");
+    fprintf(ctx->log, " If the resulting file is unplayable by VLC or IINA, then you may have guessed the wrong format;\n");
+    fprintf(ctx->log, " try again with another format.)\n");
+    fprintf(ctx->log, "If you know for sure that your video format was *not* one of the ones listed above, then please read FAQ number 4 at \"https://djifix.live555.com/#faq\", and we'll try to update the software to support your video format.\n");
+    formatCode = readFormatCode(ctx, validCodes);
+    if (formatCode == EOF) return 0;
+    if (formatCode != 0) break;
+    fprintf(ctx->log, "Invalid entry!\n");
+  }
+
+  beginRepair(ctx);
+  repairType2WithFormat(ctx, second4Bytes, formatCode);
+  return 1;
+}
+
+static void repairType2WithFormat(RepairContext* ctx, unsigned second4Bytes, int formatCode) {
+  InputFile* input = &ctx->input;
+  FILE* outputFID = ctx->outputFID;
+
+  /* Begin the repair by writing SPS and PPS NAL units (each preceded by a 'start code'): */
+  putParameterSets(ctx, 2, formatCode);
+
+  /* Then write the first (2-byte) NAL unit, preceded by a 'start code': */
+  {
+    unsigned char firstNAL[2];
+
+    firstNAL[0] = second4Bytes>>24; firstNAL[1] = second4Bytes>>16;
+    putNALUnitStart(ctx, firstNAL, 2, 2);
+    wr(firstNAL[0]); wr(firstNAL[1]);
+  }
+  if (replayRepairPlan(ctx)) return;
+
+  /* Then repeatedly:
+     1/ Read a 4-byte NAL unit size.
+     2/ Write a 'start code'.
+     3/ Read 'NAL unit size' bytes, and write them to the output file.
+  */
+  {
+    unsigned nalSize;
+    unsigned char c1, c2;
+
+    if (!get1Byte(input, &c1)) return;
+    if (!get1Byte(input, &c2)) return;
+    nalSize = ((second4Bytes&0xFFFF)<<16)|(c1<<8)|c2; /* for the first NAL unit */
+
+    while (!input->atEOF && !extractionIsDone(ctx)) {
+      copyNALUnit(ctx, nalSize);
+      noteProgress(ctx);
+
+      if (!get4Bytes(input, &nalSize)) return;
+      if (nalSize == 0 || nalSize > 0x008FFFFF) {
+	/* An anomalous situation (we got a NAL size that's 0, or much bigger than normal).
+	   This suggests that the data here is not really video (or is corrupt in some other way).
+	   Try to recover from this by repeatedly reading bytes until we get a 'nalSize'
+	   of 0x00000002.  With luck, that will begin sane data once again.
+	*/
+	printWalkEvent(ctx, WALK_EVENT_SKIPPING, input->pos-4, nalSize);
+	do {
+	  noteProgress(ctx);
+	  if (!advanceToNalSizeCandidate(input, 4)) return;
+	  nalSize = bigEndian4(inputAt(input, input->pos-4));
+	} while (nalSize != 2);
+	printWalkEvent(ctx, WALK_EVENT_RESUMING, input->pos-4, nalSize);
+      }
+    }
+  }
+}
+
+
+
+
+
+static int doRepairType3(RepairContext* ctx, int formatCode) {
+  InputFile* input = &ctx->input;
+  char validCodes[2*MAX_NUM_FORMATS+1];
+
+  /* The content of the SPS, PPS, and VPS NAL units depends upon which video format was used.
+     Prompt the user for this now (unless it was given on the command line, or detected):
+  */
+  if (formatCode == AUTO_FORMAT_CODE) {
+    formatCode = ctx->numProbeSlices > 0 ? probeFormatCode(ctx, 3, 0)
+      : detectFormatCode(ctx, 3, input->pos);
+    if (formatCode != 0) fprintf(ctx->log, "Using video format \"%c\" (detected automatically).\n", formatCode);
+  } else {
+    if (ctx->numProbeSlices > 0) probeFormatCode(ctx, 3, 0); /* just to report the results */
+    if (formatCode != 0) fprintf(ctx->log, "Using video format \"%c\" (given on the command line).\n", formatCode);
+  }
+  if (formatCode == 0 && !canPromptForFormatCode(ctx)) return 0;
+  while (formatCode == 0) {
+    fprintf(ctx->log, "First, however, we need to know which video format was used.  Enter this now.\n");
+    printFormatMenu(ctx, 3, validCodes);
+    fprintf(ctx->log, " If the resulting file is unplayable by VLC or IINA, then you may have guessed the wrong format;\n");
+    fprintf(ctx->log, " try again with another format.)\n");
+    fprintf(ctx->log, "If you know for sure that your video format was *not* one of the ones listed above, then please read FAQ number 4 at \"https://djifix.live555.com/#faq\", and we'll try to update the software to support your video format.\n");
+    formatCode = readFormatCode(ctx, validCodes);
+    if (formatCode == EOF) return 0;
+    if (formatCode != 0) break;
+    fprintf(ctx->log, "Invalid entry!\n");
+  }
+
+  beginRepair(ctx);
+  repairType3WithFormat(ctx, formatCode);
+  return 1;
+}
+
+static void repairType3WithFormat(RepairContext* ctx, int formatCode) {
+  /* Begin the repair by writing the video format's parameter set NAL units
+     (each preceded by a 'start code'):
+  */
+  putParameterSets(ctx, 3, formatCode);
+
+  doRepairType3or5Common(ctx);
+}
+
+static void doRepairType4(RepairContext* ctx) {
+  /* A special type of repair, when we already know that the file begins with a SPS (etc.).
+     Repeatedly:
+     1/ Read a 4-byte NAL unit size.
+     2/ Write a 'start code'.
+     3/ Read 'NAL unit size' bytes, and write them to the output file.
+  */
+  NalWalk walk;
+
+  beginRepair(ctx);
+  initNalWalk(&walk, ctx, 4);
+  walkNALUnits(&walk);
+}
+
+static int walkType4Step(NalWalk* walk) {
+  /* One step of a 'type 4' repair.  Returns 0 if the repair should end: */
+  InputFile* input = walk->input;
+  unsigned nalSize;
+
+  if (!get4Bytes(input, &nalSize)) return 0;
+  if (nalSize == 0 || nalSize > 0x008FFFFF) {
+    /* An anomalous situation (we got a NAL size that's 0, or much bigger than normal).
+       This suggests that the data here is not really video (or is corrupt in some other way).
+       Try to recover from this by repeatedly reading bytes until we see what we think is
+       video.  With luck, that will begin sane data once again.
+    */
+    unsigned next4Bytes;
+    unsigned long filePosition = input->pos-4;
+
+    walkEvent(walk, WALK_EVENT_SKIPPING, filePosition, nalSize);
+    if (!get4Bytes(input, &next4Bytes)) return 0; /*eof*/
+    while (!checkForVideoType4(nalSize, next4Bytes)) {
+      if (walk->ctx != NULL) noteProgress(walk->ctx);
+      if (!advanceToNalSizeCandidate(input, 8)) return 0;/*eof*/
+      nalSize = bigEndian4(inputAt(input, input->pos-8));
+      next4Bytes = bigEndian4(inputAt(input, input->pos-4));
+    }
+    seekInput(input, -4);
+    filePosition = input->pos-4;
+    walkEvent(walk, WALK_EVENT_RESUMING, filePosition, nalSize);
+  }
+#ifdef CODE_COUNT
+  else {
+    unsigned next4Bytes;
+    if (!peek4Bytes(input, &next4Bytes)) return 0;
+    ++walk->ctx->codeCount[next4Bytes>>16];
+    //fprintf(stderr, "#####@@@@@A nalSize 0x%08x, next4Bytes 0x%08x\n", nalSize, next4Bytes);
+  }
+#endif
+
+  emitNALUnit(walk, nalSize);
+  return 1;
+}
+
+
+
+
+static int doRepairType5(RepairContext* ctx, int formatCode) {
+  InputFile* input = &ctx->input;
+  char validCodes[2*MAX_NUM_FORMATS+1];
+
+  /* This is identical to 'type 3', except that the possible video formats are assumed
+     to be those for "DJI Mini 2" drones only.
+  */
+  /* The content of the SPS, PPS, and VPS NAL units depends upon which video format was used.
+     Prompt the user for this now (unless it was given on the command line, or detected):
+  */
+  if (formatCode == AUTO_FORMAT_CODE) {
+    formatCode = ctx->numProbeSlices > 0 ? probeFormatCode(ctx, 5, 0)
+      : detectFormatCode(ctx, 5, input->pos);
+    if (formatCode != 0) fprintf(ctx->log, "Using video format \"%c\" (detected automatically).\n", formatCode);
+  } else {
+    if (ctx->numProbeSlices > 0) probeFormatCode(ctx, 5, 0); /* just to report the results */
+    if (formatCode != 0) fprintf(ctx->log, "Using video format \"%c\" (given on the command line).\n", formatCode);
+  }
+  if (formatCode == 0 && !canPromptForFormatCode(ctx)) return 0;
+  while (formatCode == 0) {
+    fprintf(ctx->log, "First, however, we need to know which video format was used.  Enter this now.\n");
+    printFormatMenu(ctx, 5, validCodes);
+    fprintf(ctx->log, " If the resulting file is unplayable by VLC or IINA, then you may have guessed the wrong format;\n");
+    fprintf(ctx->log, " try again with another format.)\n");
+    fprintf(ctx->log, "If you know for sure that your video format was *not* one of the ones listed above, then please read FAQ number 4 at \"https://djifix.live555.com/#faq\", and we'll try to update the software to support your video format.\n");
+    formatCode = readFormatCode(ctx, validCodes);
+    if (formatCode == EOF) return 0;
+    if (formatCode != 0) break;
+    fprintf(ctx->log, "Invalid entry!\n");
+  }
+
+  beginRepair(ctx);
+  repairType5WithFormat(ctx, formatCode);
+  return 1;
+}
+
+static void repairType5WithFormat(RepairContext* ctx, int formatCode) {
+  /* Begin the repair by writing the video format's parameter set NAL units
+     (each preceded by a 'start code'):
+  */
+  putParameterSets(ctx, 5, formatCode);
+
+  doRepairType3or5Common(ctx);
+}
+
+static void doRepairType3or5Common(RepairContext* ctx) {
+  /* Repeatedly:
+     1/ Read a 4-byte NAL unit size.
+     2/ Write a 'start code'.
+     3/ Read 'NAL unit size' bytes, and write them to the output file.
+  */
+  NalWalk walk;
+
+  initNalWalk(&walk, ctx, 3);
+  walkNALUnits(&walk);
+  ctx->metadataIsPrintable = walk.metadataIsPrintable;
+}
+
+/* Recognizing the blocks of non-video ('metadata' or audio track) data that are interleaved
+   with the NAL units of 'type 3' and 'type 5' files.
+
+   Each block begins with 4 bytes that - when read as a 'NAL size' - match one of the rules
+   below: (nalSize&mask) == value (and, for some rules, the following 4 bytes must also match).
+   The rules are checked in order (so special cases come before the general rule for the same
+   track), but only those whose first byte matches the first byte of the 'NAL size' - which
+   for most NAL units is 0x00, for which there are only two rules.  Further rules (each of
+   which skips a block whose size is worked out from the 'NAL size') can be loaded from a file
+   ("--rules"); they're checked after ours.
+*/
+
+#define BLOCK_SKIP 1 /* skip a block of size "base" + ((nalSize>>shift)&fieldMask) */
+#define BLOCK_SKIP_PRINTABLE 2 /* the same, for a block of (possibly printed) printable metadata */
+#define BLOCK_TEXT 3 /* a block of printable metadata (whose size is 0x05c6) */
+#define BLOCK_BINARY_AND_TEXT 4 /* binary metadata, maybe followed by printable metadata (with a 2-byte size) */
+#define BLOCK_UNSIZED 5 /* a block that continues until what looks like the start of another block */
+#define BLOCK_TRACK4 6 /* a 'track 4' block, of size 0x00161528 or 0x001d7278 */
+
+static MetadataBlockRule const builtInBlockRules[] = {
+  /* The start of a 0x200-byte block of 'track 2' data: */
+  { 0xFFFF0000, 0x01FE0000, 0, 0, BLOCK_SKIP, 0x200, 0, 0 },
+  /* The start of a block of 'track 3 or 4' data (with some special cases): */
+  { 0xFF80FFFF, 0x12803A0A, 0, 0, BLOCK_SKIP, 0x0A83, 16, 0xFFFF },
+  { 0xFF80FFFF, 0x1280420A, 0, 0, BLOCK_SKIP, 0x0E83, 16, 0xFFFF },
+  { 0xFF80FFFF, 0x1280430A, 0, 0, BLOCK_SKIP, 0x0F03, 16, 0xFFFF },
+  { 0xFF80FFFF, 0x12804B0A, 0, 0, BLOCK_SKIP, 0x1303, 16, 0xFFFF },
+  { 0xFF80FFFF, 0x12804F0A, 0, 0, BLOCK_SKIP, 0x1503, 16, 0xFFFF },
+  { 0xFF80FFFF, 0x1280500A, 0, 0, BLOCK_SKIP, 0x1583, 16, 0xFFFF },
+  { 0xFF80FFFF, 0x1280510A, 0, 0, BLOCK_SKIP, 0x1603, 16, 0xFFFF },
+  { 0xFF80FFFF, 0x1280520A, 0, 0, BLOCK_SKIP, 0x1683, 16, 0xFFFF },
+  { 0xFF80FFFF, 0x1280570A, 0, 0, BLOCK_SKIP, 0x1903, 16, 0xFFFF },
+  { 0xFF800000, 0x12800000, 0, 0, BLOCK_SKIP, 0x1183, 16, 0xFFFF },
+  /* The start of a 0x1F9-byte block of 'track 2' data: */
+  { 0xFFFF0000, 0x211C0000, 0, 0, BLOCK_SKIP, 0x1F9, 0, 0 },
+  { 0xFFFF0000, 0x2ECF0000, 0, 0, BLOCK_SKIP, 0x1F9, 0, 0 },
+  { 0xFFFF0000, 0x38110000, 0, 0, BLOCK_SKIP, 0x1F9, 0, 0 },
+  { 0xFFFF0000, 0x5D9C0000, 0, 0, BLOCK_SKIP, 0x1F9, 0, 0 },
+  { 0xFFFF0000, 0x5DBB0000, 0, 0, BLOCK_SKIP, 0x1F9, 0, 0 },
+  { 0xFFFF0000, 0x80210000, 0, 0, BLOCK_SKIP, 0x1F9, 0, 0 },
+  /* The start of a block from a 'metadata' track: */
+  { 0xFFFFFFFF, 0x05c64e6f, 0, 0, BLOCK_TEXT, 0, 0, 0 },
+  { 0xFFFF0000, 0x00f80000, 0xFFFFFFFF, 0x20303020, BLOCK_BINARY_AND_TEXT, 0, 0, 0 },
+  /* The start of a 0x100-byte block from a 'metadata' track: */
+  { 0xFFFFFFFF, 0x00fe462f, 0, 0, BLOCK_SKIP_PRINTABLE, 0x100, 0, 0 },
+  /* The start of a 'track 3' metadata block: */
+  { 0xFFFF0000, 0x1A2D0000, 0, 0, BLOCK_SKIP, 0x2F-0x0A00, 0, 0xFFF0 },
+  /* The start of a 'track 2' metadata block: */
+  { 0xFFFF0000, 0x1A2E0000, 0, 0, BLOCK_SKIP, 0x30, 0, 0 },
+  { 0xFFFF0000, 0x1A2F0000, 0, 0, BLOCK_SKIP, 0x31, 0, 0 },
+  /* The start of a 'track 3' metadata block: */
+  { 0xFFF00000, 0x1A700000, 0, 0, BLOCK_SKIP, 0x79-0x1A77, 16, 0xFFFF },
+  /* The start of a 'track 2' metadata block (with some special cases): */
+  { 0xFF80FFFF, 0x1A80010A, 0, 0, BLOCK_SKIP, 0xE8, 0, 0 },
+  { 0xFF80FFFF, 0x1A80020A, 0, 0, BLOCK_SKIP, 0x103-0x1A80, 16, 0xFFFF },
+  { 0xFF80FFFF, 0x1A80030A, 0, 0, BLOCK_SKIP, 0x183-0x1A80, 16, 0xFFFF },
+  { 0xFF800000, 0x1A800000, 0, 0, BLOCK_SKIP, 0U-0x177d, 16, 0xFFFF },
+  /* The start of a 'track 2' metadata block whose size we can't easily deduce: */
+  { 0xFFFF0000, 0x211B0000, 0, 0, BLOCK_UNSIZED, 0, 0, 0 },
+  { 0xFFFF0000, 0x212B0000, 0, 0, BLOCK_UNSIZED, 0, 0, 0 },
+  { 0xFFFF0000, 0x214D0000, 0, 0, BLOCK_UNSIZED, 0, 0, 0 },
+  { 0xFFFF0000, 0x217B0000, 0, 0, BLOCK_UNSIZED, 0, 0, 0 },
+  /* The start of a 'track 4' metadata block: */
+  { 0xFFFFFFFF, 0x44332211, 0, 0, BLOCK_TRACK4, 0, 0, 0 }
+};
+
+#define NUM_BUILT_IN_BLOCK_RULES (sizeof builtInBlockRules/sizeof builtInBlockRules[0])
+
+static int addBlockRule(MetadataRuleTable* table, MetadataBlockRule const* rule) {
+  /* Add "rule" after the other rules - for the same first byte - that are already in "table".
+     Returns 0 if there's no more room: */
+  unsigned firstByte = rule->value>>24, i;
+
+  if (table->numRules == MAX_BLOCK_RULES) return 0;
+  for (i = table->numRules; i > table->firstRule[firstByte+1]; --i) table->rules[i] = table->rules[i-1];
+  table->rules[i] = *rule;
+  for (++firstByte; firstByte <= 256; ++firstByte) ++table->firstRule[firstByte];
+  ++table->numRules;
+  return 1;
+}
+
+static void initMetadataRuleTable(MetadataRuleTable* table) {
+  /* Make a table containing just our own rules: */
+  unsigned i;
+
+  memset(table, 0, sizeof *table);
+  for (i = 0; i < NUM_BUILT_IN_BLOCK_RULES; ++i) addBlockRule(table, &builtInBlockRules[i]);
+}
+
+#ifndef DJIFIX_LIBRARY
+static int loadMetadataRules(MetadataRuleTable* table, char const* fileName) {
+  /* Add the rules in the file "fileName": one per line, each being (in hex, or decimal):
+        mask value base [shift field-mask]
+     meaning: 4 bytes that (when read as a 'NAL size' "n") satisfy (n&mask) == value begin a
+     block of size base + ((n>>shift)&field-mask).  (The first byte of "mask" must be 0xFF.)
+     Blank lines, and anything after a '#', are ignored.  Returns 0 (after saying why) on error: */
+  FILE* fid = fopen(fileName, "r");
+  char line[1024];
+  unsigned lineNumber = 0;
+  int result = 1;
+
+  if (fid == NULL) {
+    fprintf(stderr, "Failed to open rules file \"%s\": %s\n", fileName, strerror(errno));
+    return 0;
+  }
+  while (result && fgets(line, sizeof line, fid) != NULL) {
+    MetadataBlockRule rule;
+    unsigned long fields[5];
+    char* p = line;
+    char* hashPtr = strchr(line, '#');
+    int numFields = 0;
+
+    ++lineNumber;
+    if (hashPtr != NULL) *hashPtr = '\0';
+    while (numFields < 5) {
+      char* end;
+
+      fields[numFields] = strtoul(p, &end, 0);
+      if (end == p) break;
+      p = end;
+      ++numFields;
+    }
+    while (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n') ++p;
+    if (numFields == 0 && *p == '\0') continue; /* a blank line */
+
+    memset(&rule, 0, sizeof rule);
+    rule.action = BLOCK_SKIP;
+    if (numFields >= 3) {
+      rule.mask = fields[0];
+      rule.value = fields[1];
+      rule.base = fields[2];
+    }
+    if (numFields == 5) {
+      rule.shift = fields[3];
+      rule.fieldMask = fields[4];
+    }
+    if ((numFields != 3 && numFields != 5) || *p != '\0') {
+      fprintf(stderr, "%s, line %u: Expected \"mask value base [shift field-mask]\"\n", fileName, lineNumber);
+      result = 0;
+    } else if ((rule.mask&0xFF000000) != 0xFF000000 || (rule.value&~rule.mask) != 0
+	       || rule.shift > 31 || rule.base < 4) {
+      fprintf(stderr, "%s, line %u: Bad rule (the mask must begin with 0xFF, the value must fit within the mask, the shift must be < 32, and the base must be >= 4)\n", fileName, lineNumber);
+      result = 0;
+    } else if (!addBlockRule(table, &rule)) {
+      fprintf(stderr, "%s, line %u: Too many rules (the limit is %u, including our own %u)\n",
+	      fileName, lineNumber, MAX_BLOCK_RULES, (unsigned)NUM_BUILT_IN_BLOCK_RULES);
+      result = 0;
+    }
+  }
+  fclose(fid);
+  return result;
+}
+#endif
+
+static MetadataBlockRule const* findBlockRule(MetadataRuleTable const* table,
+					      unsigned nalSize, unsigned next4Bytes) {
+  /* The first rule that "nalSize" (followed by "next4Bytes") matches, or NULL if none does: */
+  unsigned const firstByte = nalSize>>24;
+  unsigned i;
+
+  for (i = table->firstRule[firstByte]; i < table->firstRule[firstByte+1]; ++i) {
+    MetadataBlockRule const* rule = &table->rules[i];
+
+    if ((nalSize&rule->mask) == rule->value && (next4Bytes&rule->nextMask) == rule->nextValue) return rule;
+  }
+  return NULL;
+}
+
+static int skipTextBlock(NalWalk* walk, unsigned nalSize, int hasBinaryPart) {
+  /* Skip over a block from a 'metadata' track.  Returns 0 if the repair should end: */
+  InputFile* input = walk->input;
+  unsigned remainingMetadataSize, next4Bytes;
+
+  if (!hasBinaryPart) {
+    /* In this case, there is no initial binary stuff */
+    remainingMetadataSize = nalSize>>16;
+    if (!seekInput(input, -2)) return 0; /* back up to the printable metadata */
+  } else {
+    if (!seekInput(input, 0xF6)) return 0; /* skip over initial binary stuff */
+
+    /* The next two bytes might be a length count for the rest of the metadata: */
+    if (!get2Bytes(input, &remainingMetadataSize)) return 0;
+  }
+
+  // Check whether the first 4 bytes of this 'remaining data' really is printable ASCII.
+  // If it's not, then the 'two-byte count' was really the start of the next "nalSize":
+  if (remainingMetadataSize >= 4 && walk->metadataIsPrintable) {
+    if (!peek4Bytes(input, &next4Bytes)) {
+      noteMetadataIsPrintableWasUsed(walk);
+      return 0;
+    }
+
+    if (((next4Bytes>>24)&0xFF) < 0x20 || ((next4Bytes>>24)&0xFF) > 0x7E ||
+	((next4Bytes>>16)&0xFF) < 0x20 || ((next4Bytes>>16)&0xFF) > 0x7E ||
+	((next4Bytes>>8)&0xFF) < 0x20 || ((next4Bytes>>8)&0xFF) > 0x7E ||
+	(next4Bytes&0xFF) < 0x20 || (next4Bytes&0xFF) > 0x7E) {
+      // Some of these are non-printable => assume that it's not printable ASCII:
+      remainingMetadataSize = 0;
+    }
+  } else {
+    remainingMetadataSize = 0;
+  }
+
+  if (remainingMetadataSize > 0) {
+    /* Assume that printable metadata continues */
+    noteMetadataIsPrintableWasUsed(walk);
+    walkEvent(walk, WALK_EVENT_METADATA, input->pos, 0);
+    if (!seekInput(input, remainingMetadataSize)) return 0;
+  } else {
+    /* Backup to the assumed "nalSize" position */
+    if (!seekInput(input, -2)) return 0;
+    setMetadataIsNotPrintable(walk); // assumed from now on
+  }
+  return 1;
+}
+
+static int skipBlock(NalWalk* walk, MetadataBlockRule const* rule, unsigned nalSize, unsigned next4Bytes) {
+  /* Skip over the block that begins with "nalSize" (and "next4Bytes"), which matches "rule".
+     Returns 0 if the repair should end: */
+  InputFile* input = walk->input;
+
+  switch (rule->action) {
+    case BLOCK_SKIP: case BLOCK_SKIP_PRINTABLE: {
+      unsigned assumedBlockSize = rule->base + ((nalSize>>rule->shift)&rule->fieldMask);
+
+      if (rule->action == BLOCK_SKIP_PRINTABLE) walkEvent(walk, WALK_EVENT_METADATA_F2, input->pos, 0);
+      if (!seekInput(input, assumedBlockSize-4)) return 0;
+      return 1;
+    }
+    case BLOCK_TEXT: case BLOCK_BINARY_AND_TEXT: {
+      return skipTextBlock(walk, nalSize, rule->action == BLOCK_BINARY_AND_TEXT);
+    }
+    case BLOCK_UNSIZED: {
+      /* (Unfortunately we can't easily deduce the block size, but we know that
+	 the start of the following block will probably satisfy
+	 (first4Bytes&0xFFF0FFF0) == 0x1A700A00 or
+	 (first4Bytes&0xFF80FFFF) == 0x1A80020A
+      */
+      while ((next4Bytes&0xFFF0FFF0) != 0x1A700A00 &&
+	     (next4Bytes&0xFF80FFFF) != 0x1A80020A) {
+	unsigned char nextByte;
+
+	if (!get1Byte(input, &nextByte)) return 0;
+	next4Bytes = (next4Bytes<<8)|nextByte;
+      }
+      if (!seekInput(input, -4)) return 0; // seek back; we'll reread it next
+      return 1;
+    }
+    case BLOCK_TRACK4: {
+      /* The block is of size 0x00161528 or 0x001d7278 (we want to see a 0x1A next): */
+      unsigned char nextByte;
+
+      if (!seekInput(input, 0x00161528-4)) return 0;
+      if (!get1Byte(input, &nextByte)) return 0;
+      if (nextByte == 0x1A) {
+	if (!seekInput(input, -1)) return 0;
+	return 1;
+      }
+      if (!seekInput(input, 0x001d7278-0x00161528-1)) return 0;
+      return 1;
+    }
+  }
+  return 0;
+}
+
+#ifndef RESYNC_CHAIN_LENGTH
+#define RESYNC_CHAIN_LENGTH 4 /* the NAL units (or blocks) in a row that resume a 'type 3' repair */
+#endif
+
+static int type3ResumesAt(NalWalk* walk, unsigned long position) {
+  /* After skipping over anomalous bytes in a 'type 3' or 'type 5' repair: Does "position" (a
+     possible NAL size) begin "RESYNC_CHAIN_LENGTH" plausible NAL units, or blocks of non-video
+     data (whose sizes we know), one after the other?  (Random data often looks like one or
+     two.)  A chain that reaches the end of the file is also OK - as is one that reaches a
+     block whose size depends on what's in it, after at least two others: */
+  InputFile* input = walk->input;
+  unsigned i;
+
+  for (i = 0; i < RESYNC_CHAIN_LENGTH; ++i) {
+    MetadataBlockRule const* rule;
+    unsigned nalSize;
+
+    if (!canFillInput(input, position + 8)) return 0;
+    if (!fillInput(input, position + 8) && position + 8 > input->size) return i > 0 && position == input->size;
+    nalSize = bigEndian4(inputAt(input, position));
+    rule = findBlockRule(walk->metadataRules, nalSize, bigEndian4(inputAt(input, position+4)));
+    if (rule != NULL) {
+      if (rule->action != BLOCK_SKIP && rule->action != BLOCK_SKIP_PRINTABLE) return i >= 2;
+      position += (unsigned)(rule->base + ((nalSize>>rule->shift)&rule->fieldMask)); /* (as "skipBlock()" does) */
+    } else {
+      if (!isPlausibleNAL(inputAt(input, position)[4], inputAt(input, position)[5])
+	  || !canFillInput(input, position + 4 + nalSize)) return 0;
+      fillInput(input, position + 4 + nalSize); /* (only now, as this may read much more of a stream) */
+      if (!nalSizeLooksOK(input, position)) return 0;
+      position += 4 + nalSize;
+    }
+  }
+  return 1;
+}
+
+static int walkType3or5Step(NalWalk* walk) {
+  /* One step of a 'type 3' or 'type 5' repair.  Returns 0 if the repair should end: */
+  InputFile* input = walk->input;
+  unsigned nalSize, next4Bytes;
+  MetadataBlockRule const* rule;
+
+  if (!get4Bytes(input, &nalSize)) return 0;
+  if (!peek4Bytes(input, &next4Bytes)) return 0;
+  //fprintf(stderr, "#####@@@@@B @0x%08lx: nalSize 0x%08x, next4Bytes 0x%08x\n", input->pos-4, nalSize, next4Bytes);
+
+  rule = findBlockRule(walk->metadataRules, nalSize, next4Bytes);
+  if (rule != NULL) {
+    /* This 4-byte 'NAL size' is really the start of a block of non-video data.  Skip over it: */
+    unsigned long const blockStart = input->pos-4;
+    int const result = skipBlock(walk, rule, nalSize, next4Bytes);
+    unsigned long const blockEnd = input->pos < input->size ? input->pos : input->size;
+
+    if (blockEnd > blockStart) {
+      noteSkippedBlock(walk, rule - walk->metadataRules->rules, blockStart, blockEnd - blockStart);
+    }
+    return result;
+  } else if (nalSize == 0 || nalSize > 0x00FFFFFF) {
+    unsigned long filePosition = input->pos-4;
+
+    if (walk->stopOnAnomaly) {
+      walkEvent(walk, WALK_EVENT_ANOMALY, filePosition, nalSize);
+      /* We don't try to recover from this, so stop here: */
+      return 0;
+    }
+
+    /* As in a 'type 4' repair, try to recover from this by skipping over bytes until we see
+       what we think is video (or a known block of non-video data) again: */
+    walkEvent(walk, WALK_EVENT_SKIPPING, filePosition, nalSize);
+    do {
+      if (walk->ctx != NULL) noteProgress(walk->ctx);
+      if (!advanceToNalSizeCandidate(input, 4)) return 0;/*eof*/
+    } while (!type3ResumesAt(walk, input->pos-4));
+    seekInput(input, -4);
+    walkEvent(walk, WALK_EVENT_RESUMING, input->pos, bigEndian4(inputAt(input, input->pos)));
+    return 1; /* (the next step begins here) */
+  }
+
+  emitNALUnit(walk, nalSize);
+  return 1;
+}
+
+/* Automatic detection of the video format (for 'type 2', 'type 3', and 'type 5' repairs).
+
+   We collect the first few video slice NAL units from the input file, and then - for each
+   candidate video format - parse their headers using that format's SPS and PPS.  A wrong SPS
+   or PPS almost always produces slice headers that make no sense (bad or out-of-range field
+   values, 'frame_num's or picture order counts that don't follow on from one another, or
+   non-1 CABAC alignment bits), so we rank the candidates by the number of consistent slices.
+*/
+
+#define MAX_SAMPLE_SLICES 64
+#define MAX_SAMPLE_SCAN_SIZE (16*1024*1024) /* we look no further than this for sample slices */
+#define MAX_PARSED_HEADER_SIZE 256 /* we parse no more than this much of each NAL unit */
+
+typedef struct BitReader {
+  unsigned char data[MAX_PARSED_HEADER_SIZE]; /* with 'emulation prevention' bytes removed */
+  unsigned size;
+  unsigned bitPos;
+  int overrun;
+} BitReader;
+
+typedef struct VideoParams {
+  /* From the SPS: */
+  unsigned spsId;
+  unsigned chromaArrayType;
+  int separateColourPlane;
+  unsigned log2MaxFrameNum; /* H.264 only */
+  unsigned pocType; /* H.264 only */
+  int frameMbsOnly; /* H.264 only */
+  int deltaPicOrderAlwaysZero; /* H.264 only */
+  unsigned log2MaxPocLsb;
+  unsigned picSizeInUnits; /* macroblocks (H.264) or CTBs (H.265) */
+  unsigned numShortTermRefPicSets; /* H.265 only */
+  unsigned char numDeltaPocs[65]; /* H.265 only; indexed by short-term RPS (the last is for the slice's own) */
+  unsigned width, height; /* in pixels (after cropping) */
+  unsigned bitDepthLuma, bitDepthChroma;
+  unsigned numUnitsInTick, timeScale; /* from the VUI; 0 if it doesn't have timing info */
+
+  /* From the PPS: */
+  unsigned ppsId;
+  unsigned ppsSpsId;
+  int entropyCodingMode; /* H.264 only */
+  int bottomFieldPicOrderInFramePresent; /* H.264 only */
+  unsigned numRefIdxDefault[2]; /* H.264 only */
+  int weightedPred; /* H.264 only */
+  unsigned weightedBipredIdc; /* H.264 only */
+  int picInitQp; /* H.264 only */
+  int deblockingFilterControlPresent; /* H.264 only */
+  int redundantPicCntPresent; /* H.264 only */
+  int dependentSliceSegmentsEnabled; /* H.265 only */
+  int outputFlagPresent; /* H.265 only */
+  unsigned numExtraSliceHeaderBits; /* H.265 only */
+} VideoParams;
+
+typedef struct SliceHistory {
+  /* What we remember from the previous picture, to check that the next one follows on from it: */
+  int havePrev;
+  unsigned prevRefFrameNum; /* H.264 */
+  unsigned prevPocLsb; /* H.265 */
+} SliceHistory;
+
+static void initBitReader(BitReader* br, unsigned char const* from, unsigned fromSize) {
+  /* Copy (the start of) a NAL unit's payload, removing 'emulation prevention' bytes - the 0x03
+     in 0x000003: */
+  unsigned i, numZeros = 0;
+
+  br->size = br->bitPos = 0;
+  br->overrun = 0;
+  for (i = 0; i < fromSize && br->size < sizeof br->data; ++i) {
+    if (numZeros >= 2 && from[i] == 0x03) {
+      numZeros = 0;
+      continue;
+    }
+    numZeros = from[i] == 0 ? numZeros+1 : 0;
+    br->data[br->size++] = from[i];
+  }
+}
+
+static unsigned getBits(BitReader* br, unsigned numBits) {
+  unsigned result = 0;
+
+  while (numBits-- > 0) {
+    if (br->bitPos >= br->size*8) {
+      br->overrun = 1;
+      return 0;
+    }
+    result = (result<<1) | ((br->data[br->bitPos>>3] >> (7 - (br->bitPos&7))) & 1);
+    ++br->bitPos;
+  }
+  return result;
+}
+
+static unsigned getUE(BitReader* br) {
+  /* Read an unsigned Exp-Golomb-coded value: */
+  unsigned numLeadingZeros = 0;
+
+  while (getBits(br, 1) == 0) {
+    if (br->overrun || ++numLeadingZeros > 31) {
+      br->overrun = 1;
+      return 0;
+    }
+  }
+  return ((1u<<numLeadingZeros)-1) + getBits(br, numLeadingZeros);
+}
+
+static int getSE(BitReader* br) {
+  /* Read a signed Exp-Golomb-coded value: */
+  unsigned codeNum = getUE(br);
+
+  return (codeNum&1) ? (int)((codeNum+1)/2) : -(int)(codeNum/2);
+}
+
+static unsigned ceilLog2(unsigned n) {
+  unsigned result = 0;
+
+  while ((1u<<result) < n) ++result;
+  return result;
+}
+
+static int isH264SliceNAL(unsigned char b0) {
+  return (b0&0x80) == 0 && ((b0&0x1F) == 1 || ((b0&0x1F) == 5 && (b0&0x60) != 0));
+}
+
+static int isH265SliceNAL(unsigned char b0, unsigned char b1) {
+  unsigned nalType = (b0>>1)&0x3F;
+
+  /* (We also require 'nuh_layer_id' == 0, and 'nuh_temporal_id_plus1' != 0) */
+  return (b0&0x81) == 0 && (b1&0xF8) == 0 && (b1&0x07) != 0 &&
+    (nalType <= 9 || (nalType >= 16 && nalType <= 21));
+}
+
+static int isPlausibleNAL(unsigned char b0, unsigned char b1) {
+  /* Could these be the first two bytes of a H.264 or H.265 video, SEI, or 'access unit delimiter'
+     NAL unit? */
+  if (isH264SliceNAL(b0) || isH265SliceNAL(b0, b1)) return 1;
+  if ((b0&0x80) == 0 && ((b0&0x1F) == 6 || (b0&0x1F) == 9)) return 1;
+  if ((b0&0x81) == 0 && b1 == 0x01 && (((b0>>1)&0x3F) == 35 || ((b0>>1)&0x3F) == 39 || ((b0>>1)&0x3F) == 40)) return 1;
+  return 0;
+}
+
+static int nalSizeLooksOK(InputFile* input, unsigned long position) {
+  /* Does "position" appear to be the 4-byte size of a NAL unit that lies within the file? */
+  unsigned nalSize;
+
+  if (position + 6 > input->size) return 0;
+  nalSize = bigEndian4(inputAt(input, position));
+  return nalSize >= 2 && nalSize <= 0x00FFFFFF && position + 4 + nalSize <= input->size &&
+    isPlausibleNAL(inputAt(input, position)[4], inputAt(input, position)[5]);
+}
+
+static unsigned collectSampleSlices(InputFile* input, unsigned long position, unsigned maxNumSlices,
+				    unsigned long sliceOffsets[], unsigned sliceSizes[],
+				    unsigned long* endPosition) {
+  /* Beginning at "position", follow the chain of 4-byte NAL unit sizes, recording (if
+     "sliceOffsets" is not NULL) the offset and size of up to "maxNumSlices" video slice NAL
+     units, and (in "*endPosition") where the last of these ends.  When the chain breaks (e.g.,
+     at a block of non-video data), we look for it to resume at a place that's followed by
+     another plausible NAL unit - so that we're unlikely to be fooled by a chance 'NAL size': */
+  unsigned long const limit = sliceOffsets != NULL ? position + MAX_SAMPLE_SCAN_SIZE : input->size;
+  unsigned numSlices = 0;
+  int inChain = 1;
+
+  *endPosition = position;
+  while (numSlices < maxNumSlices && position < limit && position + 6 <= input->size) {
+    if (nalSizeLooksOK(input, position)) {
+      unsigned nalSize = bigEndian4(inputAt(input, position));
+      unsigned long nextPosition = position + 4 + nalSize;
+
+      if (inChain || nextPosition == input->size || nalSizeLooksOK(input, nextPosition)) {
+	unsigned char b0 = inputAt(input, position)[4], b1 = inputAt(input, position)[5];
+
+	if (isH264SliceNAL(b0) || isH265SliceNAL(b0, b1)) {
+	  if (sliceOffsets != NULL) {
+	    sliceOffsets[numSlices] = position + 4;
+	    sliceSizes[numSlices] = nalSize;
+	  }
+	  ++numSlices;
+	  *endPosition = nextPosition;
+	}
+	position = nextPosition;
+	inChain = 1;
+	continue;
+      }
+    }
+    ++position;
+    inChain = 0;
+  }
+  return numSlices;
+}
+
+static void skipH264ScalingList(BitReader* br, unsigned sizeOfScalingList) {
+  unsigned j, lastScale = 8, nextScale = 8;
+
+  for (j = 0; j < sizeOfScalingList && !br->overrun; ++j) {
+    if (nextScale != 0) nextScale = (lastScale + getSE(br) + 256)%256;
+    if (nextScale != 0) lastScale = nextScale;
+  }
+}
+
+static void skipVUIColourInfo(BitReader* br) {
+  /* Skip the fields (before the timing info, for H.264) at the start of 'vui_parameters()': */
+  if (getBits(br, 1) && getBits(br, 8) == 255) getBits(br, 32); /* aspect_ratio_info */
+  if (getBits(br, 1)) getBits(br, 1); /* overscan_info_present_flag; overscan_appropriate_flag */
+  if (getBits(br, 1)) { /* video_signal_type_present_flag */
+    getBits(br, 4); /* video_format; video_full_range_flag */
+    if (getBits(br, 1)) getBits(br, 24); /* colour_description_present_flag; colour description */
+  }
+  if (getBits(br, 1)) { getUE(br); getUE(br); } /* chroma_loc_info */
+}
+
+static int parseH264SPS(unsigned char const* nal, unsigned nalSize, VideoParams* vp) {
+  BitReader br;
+  unsigned profileIdc, chromaFormatIdc = 1, widthInMbs, heightInMapUnits, fullWidth, fullHeight;
+  unsigned cropUnitX, cropUnitY, i;
+
+  initBitReader(&br, &nal[1], nalSize-1);
+  profileIdc = getBits(&br, 8);
+  getBits(&br, 16); /* constraint flags; level_idc */
+  vp->spsId = getUE(&br);
+  vp->bitDepthLuma = vp->bitDepthChroma = 8;
+  if (profileIdc == 100 || profileIdc == 110 || profileIdc == 122 || profileIdc == 244 ||
+      profileIdc == 44 || profileIdc == 83 || profileIdc == 86 || profileIdc == 118 ||
+      profileIdc == 128 || profileIdc == 138 || profileIdc == 139 || profileIdc == 134 || profileIdc == 135) {
+    chromaFormatIdc = getUE(&br);
+    if (chromaFormatIdc == 3) vp->separateColourPlane = getBits(&br, 1);
+    vp->bitDepthLuma = getUE(&br) + 8;
+    vp->bitDepthChroma = getUE(&br) + 8;
+    getBits(&br, 1); /* qpprime_y_zero_transform_bypass_flag */
+    if (getBits(&br, 1)) { /* seq_scaling_matrix_present_flag */
+      for (i = 0; i < (chromaFormatIdc != 3 ? 8u : 12u); ++i) {
+	if (getBits(&br, 1)) skipH264ScalingList(&br, i < 6 ? 16 : 64);
+      }
+    }
+  }
+  vp->chromaArrayType = vp->separateColourPlane ? 0 : chromaFormatIdc;
+  vp->log2MaxFrameNum = getUE(&br) + 4;
+  vp->pocType = getUE(&br);
+  if (vp->pocType == 0) {
+    vp->log2MaxPocLsb = getUE(&br) + 4;
+  } else if (vp->pocType == 1) {
+    unsigned numRefFramesInPocCycle;
+
+    vp->deltaPicOrderAlwaysZero = getBits(&br, 1);
+    getSE(&br); getSE(&br); /* offset_for_non_ref_pic; offset_for_top_to_bottom_field */
+    numRefFramesInPocCycle = getUE(&br);
+    if (numRefFramesInPocCycle > 255) return 0;
+    for (i = 0; i < numRefFramesInPocCycle; ++i) getSE(&br);
+  }
+  getUE(&br); /* max_num_ref_frames */
+  getBits(&br, 1); /* gaps_in_frame_num_value_allowed_flag */
+  widthInMbs = getUE(&br) + 1;
+  heightInMapUnits = getUE(&br) + 1;
+  vp->frameMbsOnly = getBits(&br, 1);
+  vp->picSizeInUnits = widthInMbs*heightInMapUnits*(vp->frameMbsOnly ? 1 : 2);
+  if (br.overrun || chromaFormatIdc > 3 || vp->log2MaxFrameNum > 16 || vp->pocType > 2 ||
+      vp->log2MaxPocLsb > 16 || widthInMbs > 1024 || heightInMapUnits > 1024) {
+    return 0;
+  }
+
+  /* The rest of the SPS is needed only when writing an MP4 file: */
+  if (!vp->frameMbsOnly) getBits(&br, 1); /* mb_adaptive_frame_field_flag */
+  getBits(&br, 1); /* direct_8x8_inference_flag */
+  cropUnitX = vp->chromaArrayType == 0 || chromaFormatIdc == 3 ? 1 : 2;
+  cropUnitY = (vp->chromaArrayType == 0 || chromaFormatIdc != 1 ? 1 : 2)*(vp->frameMbsOnly ? 1 : 2);
+  vp->width = fullWidth = widthInMbs*16;
+  vp->height = fullHeight = heightInMapUnits*16*(vp->frameMbsOnly ? 1 : 2);
+  if (getBits(&br, 1)) { /* frame_cropping_flag */
+    vp->width -= cropUnitX*getUE(&br); vp->width -= cropUnitX*getUE(&br);
+    vp->height -= cropUnitY*getUE(&br); vp->height -= cropUnitY*getUE(&br);
+  }
+  if (getBits(&br, 1)) { /* vui_parameters_present_flag */
+    skipVUIColourInfo(&br);
+    if (getBits(&br, 1)) { /* timing_info_present_flag */
+      vp->numUnitsInTick = getBits(&br, 32);
+      vp->timeScale = getBits(&br, 32);
+    }
+  }
+  if (br.overrun || vp->width == 0 || vp->width > fullWidth || vp->height == 0 || vp->height > fullHeight) {
+    /* The cropping made no sense, so ignore it: */
+    vp->width = fullWidth;
+    vp->height = fullHeight;
+  }
+  if (br.overrun) vp->numUnitsInTick = vp->timeScale = 0;
+  return 1;
+}
+
+static int parseH264PPS(unsigned char const* nal, unsigned nalSize, VideoParams* vp) {
+  BitReader br;
+
+  initBitReader(&br, &nal[1], nalSize-1);
+  vp->ppsId = getUE(&br);
+  vp->ppsSpsId = getUE(&br);
+  vp->entropyCodingMode = getBits(&br, 1);
+  vp->bottomFieldPicOrderInFramePresent = getBits(&br, 1);
+  if (getUE(&br) != 0) return 0; /* num_slice_groups_minus1 (we don't handle slice groups) */
+  vp->numRefIdxDefault[0] = getUE(&br) + 1;
+  vp->numRefIdxDefault[1] = getUE(&br) + 1;
+  vp->weightedPred = getBits(&br, 1);
+  vp->weightedBipredIdc = getBits(&br, 2);
+  vp->picInitQp = 26 + getSE(&br);
+  getSE(&br); getSE(&br); /* pic_init_qs_minus26; chroma_qp_index_offset */
+  vp->deblockingFilterControlPresent = getBits(&br, 1);
+  getBits(&br, 1); /* constrained_intra_pred_flag */
+  vp->redundantPicCntPresent = getBits(&br, 1);
+
+  return !br.overrun && vp->numRefIdxDefault[0] <= 32 && vp->numRefIdxDefault[1] <= 32;
+}
+
+static int parseH264Slice(unsigned char const* nal, unsigned nalSize, VideoParams const* vp,
+			  SliceHistory* history) {
+  /* Parse a H.264 slice header (up to the start of the slice data), returning 1 iff it is
+     consistent with our SPS and PPS: */
+  BitReader br;
+  unsigned nalRefIdc = (nal[0]>>5)&0x3, firstMbInSlice, sliceType, frameNum, numRefIdx[2], list, i;
+  int isIDR = (nal[0]&0x1F) == 5, isB, isP, fieldPic = 0, qp;
+
+  initBitReader(&br, &nal[1], nalSize-1);
+  firstMbInSlice = getUE(&br);
+  sliceType = getUE(&br);
+  if (sliceType > 9 || getUE(&br) != vp->ppsId || firstMbInSlice >= vp->picSizeInUnits) return 0;
+  sliceType %= 5;
+  if (isIDR && sliceType != 2/*I*/ && sliceType != 4/*SI*/) return 0;
+  isB = sliceType == 1;
+  isP = sliceType == 0 || sliceType == 3/*SP*/;
+
+  if (vp->separateColourPlane) getBits(&br, 2); /* colour_plane_id */
+  frameNum = getBits(&br, vp->log2MaxFrameNum);
+  if (!vp->frameMbsOnly && getBits(&br, 1)/*field_pic_flag*/) {
+    fieldPic = 1;
+    getBits(&br, 1); /* bottom_field_flag */
+  }
+  if (isIDR) {
+    if (frameNum != 0) return 0;
+    getUE(&br); /* idr_pic_id */
+  }
+  if (vp->pocType == 0) {
+    getBits(&br, vp->log2MaxPocLsb); /* pic_order_cnt_lsb */
+    if (vp->bottomFieldPicOrderInFramePresent && !fieldPic) getSE(&br);
+  } else if (vp->pocType == 1 && !vp->deltaPicOrderAlwaysZero) {
+    getSE(&br);
+    if (vp->bottomFieldPicOrderInFramePresent && !fieldPic) getSE(&br);
+  }
+  if (vp->redundantPicCntPresent) getUE(&br);
+  if (isB) getBits(&br, 1); /* direct_spatial_mv_pred_flag */
+
+  numRefIdx[0] = vp->numRefIdxDefault[0];
+  numRefIdx[1] = vp->numRefIdxDefault[1];
+  if ((isP || isB) && getBits(&br, 1)) { /* num_ref_idx_active_override_flag */
+    numRefIdx[0] = getUE(&br) + 1;
+    if (isB) numRefIdx[1] = getUE(&br) + 1;
+    if (numRefIdx[0] > 32 || numRefIdx[1] > 32) return 0;
+  }
+
+  /* ref_pic_list_modification(): */
+  for (list = 0; list < (isB ? 2u : isP ? 1u : 0u); ++list) {
+    if (getBits(&br, 1)) { /* ref_pic_list_modification_flag_lX */
+      unsigned modificationOfPicNumsIdc;
+
+      i = 0;
+      do {
+	modificationOfPicNumsIdc = getUE(&br);
+	if (modificationOfPicNumsIdc > 3 || ++i > 33 || br.overrun) return 0;
+	if (modificationOfPicNumsIdc != 3) getUE(&br);
+      } while (modificationOfPicNumsIdc != 3);
+    }
+  }
+
+  if ((vp->weightedPred && isP) || (vp->weightedBipredIdc == 1 && isB)) {
+    /* pred_weight_table(): */
+    if (getUE(&br) > 7) return 0; /* luma_log2_weight_denom */
+    if (vp->chromaArrayType != 0 && getUE(&br) > 7) return 0; /* chroma_log2_weight_denom */
+    for (list = 0; list < (isB ? 2u : 1u); ++list) {
+      for (i = 0; i < numRefIdx[list] && !br.overrun; ++i) {
+	if (getBits(&br, 1)) { getSE(&br); getSE(&br); } /* luma weight and offset */
+	if (vp->chromaArrayType != 0 && getBits(&br, 1)) { getSE(&br); getSE(&br); getSE(&br); getSE(&br); }
+      }
+    }
+  }
+
+  if (nalRefIdc != 0) {
+    /* dec_ref_pic_marking(): */
+    if (isIDR) {
+      getBits(&br, 2); /* no_output_of_prior_pics_flag; long_term_reference_flag */
+    } else if (getBits(&br, 1)) { /* adaptive_ref_pic_marking_mode_flag */
+      unsigned mmco;
+
+      i = 0;
+      do {
+	mmco = getUE(&br);
+	if (mmco > 6 || ++i > 66 || br.overrun) return 0;
+	if (mmco == 1 || mmco == 3) getUE(&br); /* difference_of_pic_nums_minus1 */
+	if (mmco == 2) getUE(&br); /* long_term_pic_num */
+	if (mmco == 3 || mmco == 6) getUE(&br); /* long_term_frame_idx */
+	if (mmco == 4) getUE(&br); /* max_long_term_frame_idx_plus1 */
+      } while (mmco != 0);
+    }
+  }
+
+  if (vp->entropyCodingMode && (isP || isB) && getUE(&br) > 2) return 0; /* cabac_init_idc */
+  qp = vp->picInitQp + getSE(&br); /* slice_qp_delta */
+  if (qp < -12 || qp > 51) return 0;
+  if (sliceType == 3/*SP*/ || sliceType == 4/*SI*/) {
+    if (sliceType == 3) getBits(&br, 1); /* sp_for_switch_flag */
+    getSE(&br); /* slice_qs_delta */
+  }
+  if (vp->deblockingFilterControlPresent) {
+    unsigned disableDeblockingFilterIdc = getUE(&br);
+
+    if (disableDeblockingFilterIdc > 2) return 0;
+    if (disableDeblockingFilterIdc != 1) {
+      int alphaOffset = getSE(&br), betaOffset = getSE(&br);
+
+      if (alphaOffset < -6 || alphaOffset > 6 || betaOffset < -6 || betaOffset > 6) return 0;
+    }
+  }
+  if (br.overrun) return 0;
+
+  /* With CABAC, the slice data begins byte-aligned, after 'cabac_alignment_one_bit's: */
+  if (vp->entropyCodingMode) {
+    while ((br.bitPos&7) != 0) {
+      if (getBits(&br, 1) != 1) return 0;
+    }
+  }
+
+  /* The first slice of each picture should have the 'frame_num' of the previous reference
+     picture, or one more than this: */
+  if (firstMbInSlice == 0) {
+    if (history->havePrev && !isIDR &&
+	frameNum != history->prevRefFrameNum &&
+	frameNum != ((history->prevRefFrameNum + 1) & ((1u<<vp->log2MaxFrameNum)-1))) {
+      return 0;
+    }
+    if (nalRefIdc != 0) {
+      history->prevRefFrameNum = frameNum;
+      history->havePrev = 1;
+    }
+  }
+  return 1;
+}
+
+static void skipH265ScalingListData(BitReader* br) {
+  unsigned sizeId, matrixId, i;
+
+  for (sizeId = 0; sizeId < 4; ++sizeId) {
+    for (matrixId = 0; matrixId < 6 && !br->overrun; matrixId += sizeId == 3 ? 3 : 1) {
+      if (!getBits(br, 1)) { /* scaling_list_pred_mode_flag */
+	getUE(br); /* scaling_list_pred_matrix_id_delta */
+      } else {
+	unsigned coefNum = sizeId == 0 ? 16 : 64;
+
+	if (sizeId > 1) getSE(br); /* scaling_list_dc_coef_minus8 */
+	for (i = 0; i < coefNum; ++i) getSE(br);
+      }
+    }
+  }
+}
+
+static int parseH265ShortTermRefPicSet(BitReader* br, unsigned stRpsIdx, unsigned numShortTermRefPicSets,
+				       unsigned char numDeltaPocs[]) {
+  /* Parse a 'st_ref_pic_set()', recording its number of delta POCs (needed to parse any later
+     set that is predicted from it): */
+  unsigned numPocs = 0, j;
+
+  if (stRpsIdx != 0 && getBits(br, 1)) { /* inter_ref_pic_set_prediction_flag */
+    unsigned deltaIdx = stRpsIdx == numShortTermRefPicSets ? getUE(br) + 1 : 1;
+
+    if (deltaIdx > stRpsIdx) return 0;
+    getBits(br, 1); getUE(br); /* delta_rps_sign; abs_delta_rps_minus1 */
+    for (j = 0; j <= numDeltaPocs[stRpsIdx - deltaIdx] && !br->overrun; ++j) {
+      /* ('use_delta_flag' is present only if 'used_by_curr_pic_flag' is 0) */
+      if (getBits(br, 1) || getBits(br, 1)) ++numPocs;
+    }
+  } else {
+    unsigned numNegativePics = getUE(br), numPositivePics = getUE(br);
+
+    if (numNegativePics > 16 || numPositivePics > 16) return 0;
+    numPocs = numNegativePics + numPositivePics;
+    for (j = 0; j < numPocs && !br->overrun; ++j) {
+      getUE(br); getBits(br, 1); /* delta_poc_sX_minus1; used_by_curr_pic_sX_flag */
+    }
+  }
+  if (numPocs > 16) return 0;
+  numDeltaPocs[stRpsIdx] = numPocs;
+  return !br->overrun;
+}
+
+static int parseH265SPS(unsigned char const* nal, unsigned nalSize, VideoParams* vp) {
+  BitReader br;
+  unsigned maxSubLayersMinus1, chromaFormatIdc, width, height, log2CtbSize, ctbSize, i;
+  unsigned confWinOffsets[4] = { 0, 0, 0, 0 }, subWidth, subHeight;
+  int subLayerProfilePresent[8], subLayerLevelPresent[8];
+
+  initBitReader(&br, &nal[2], nalSize-2);
+  getBits(&br, 4); /* sps_video_parameter_set_id */
+  maxSubLayersMinus1 = getBits(&br, 3);
+  getBits(&br, 1); /* sps_temporal_id_nesting_flag */
+
+  /* profile_tier_level(): */
+  getBits(&br, 8); getBits(&br, 32); getBits(&br, 32); getBits(&br, 16); /* general profile */
+  getBits(&br, 8); /* general_level_idc */
+  for (i = 0; i < maxSubLayersMinus1; ++i) {
+    subLayerProfilePresent[i] = getBits(&br, 1);
+    subLayerLevelPresent[i] = getBits(&br, 1);
+  }
+  if (maxSubLayersMinus1 > 0) {
+    for (i = maxSubLayersMinus1; i < 8; ++i) getBits(&br, 2); /* reserved_zero_2bits */
+  }
+  for (i = 0; i < maxSubLayersMinus1; ++i) {
+    if (subLayerProfilePresent[i]) { getBits(&br, 32); getBits(&br, 32); getBits(&br, 24); }
+    if (subLayerLevelPresent[i]) getBits(&br, 8);
+  }
+
+  vp->spsId = getUE(&br);
+  chromaFormatIdc = getUE(&br);
+  if (chromaFormatIdc == 3) vp->separateColourPlane = getBits(&br, 1);
+  vp->chromaArrayType = vp->separateColourPlane ? 0 : chromaFormatIdc;
+  width = getUE(&br);
+  height = getUE(&br);
+  if (getBits(&br, 1)) { /* conformance_window_flag */
+    for (i = 0; i < 4; ++i) confWinOffsets[i] = getUE(&br); /* left, right, top, bottom */
+  }
+  vp->bitDepthLuma = getUE(&br) + 8;
+  vp->bitDepthChroma = getUE(&br) + 8;
+  vp->log2MaxPocLsb = getUE(&br) + 4;
+  for (i = getBits(&br, 1)/*sps_sub_layer_ordering_info_present_flag*/ ? 0 : maxSubLayersMinus1;
+       i <= maxSubLayersMinus1; ++i) {
+    getUE(&br); getUE(&br); getUE(&br);
+  }
+  log2CtbSize = getUE(&br) + 3; /* log2_min_luma_coding_block_size_minus3 */
+  log2CtbSize += getUE(&br); /* log2_diff_max_min_luma_coding_block_size */
+  getUE(&br); getUE(&br); getUE(&br); getUE(&br); /* transform block sizes and depths */
+  if (getBits(&br, 1) && getBits(&br, 1)) { /* scaling_list_enabled_flag; sps_scaling_list_data_present_flag */
+    skipH265ScalingListData(&br);
+  }
+  getBits(&br, 2); /* amp_enabled_flag; sample_adaptive_offset_enabled_flag */
+  if (getBits(&br, 1)) { /* pcm_enabled_flag */
+    getBits(&br, 8); getUE(&br); getUE(&br); getBits(&br, 1);
+  }
+  vp->numShortTermRefPicSets = getUE(&br);
+  if (vp->numShortTermRefPicSets > 64) return 0;
+  for (i = 0; i < vp->numShortTermRefPicSets; ++i) {
+    if (!parseH265ShortTermRefPicSet(&br, i, vp->numShortTermRefPicSets, vp->numDeltaPocs)) return 0;
+  }
+
+  if (br.overrun || chromaFormatIdc > 3 || vp->log2MaxPocLsb > 16 || log2CtbSize < 4 || log2CtbSize > 6 ||
+      width == 0 || height == 0 || width > 16888 || height > 16888) {
+    return 0;
+  }
+  ctbSize = 1u<<log2CtbSize;
+  vp->picSizeInUnits = ((width + ctbSize-1)/ctbSize)*((height + ctbSize-1)/ctbSize);
+
+  /* The rest of the SPS is needed only when writing an MP4 file: */
+  subWidth = vp->chromaArrayType == 1 || vp->chromaArrayType == 2 ? 2 : 1;
+  subHeight = vp->chromaArrayType == 1 ? 2 : 1;
+  vp->width = width - subWidth*(confWinOffsets[0] + confWinOffsets[1]);
+  vp->height = height - subHeight*(confWinOffsets[2] + confWinOffsets[3]);
+  if (vp->width == 0 || vp->width > width || vp->height == 0 || vp->height > height) {
+    /* The conformance window made no sense, so ignore it: */
+    vp->width = width;
+    vp->height = height;
+  }
+  if (getBits(&br, 1)) { /* long_term_ref_pics_present_flag */
+    unsigned numLongTermRefPicsSps = getUE(&br);
+
+    for (i = 0; i < numLongTermRefPicsSps && !br.overrun; ++i) getBits(&br, vp->log2MaxPocLsb + 1);
+  }
+  getBits(&br, 2); /* sps_temporal_mvp_enabled_flag; strong_intra_smoothing_enabled_flag */
+  if (getBits(&br, 1)) { /* vui_parameters_present_flag */
+    skipVUIColourInfo(&br);
+    getBits(&br, 3); /* neutral_chroma_indication_flag; field_seq_flag; frame_field_info_present_flag */
+    if (getBits(&br, 1)) { getUE(&br); getUE(&br); getUE(&br); getUE(&br); } /* default display window */
+    if (getBits(&br, 1)) { /* vui_timing_info_present_flag */
+      vp->numUnitsInTick = getBits(&br, 32);
+      vp->timeScale = getBits(&br, 32);
+    }
+  }
+  if (br.overrun) vp->numUnitsInTick = vp->timeScale = 0;
+  return 1;
+}
+
+static int parseH265PPS(unsigned char const* nal, unsigned nalSize, VideoParams* vp) {
+  BitReader br;
+
+  initBitReader(&br, &nal[2], nalSize-2);
+  vp->ppsId = getUE(&br);
+  vp->ppsSpsId = getUE(&br);
+  vp->dependentSliceSegmentsEnabled = getBits(&br, 1);
+  vp->outputFlagPresent = getBits(&br, 1);
+  vp->numExtraSliceHeaderBits = getBits(&br, 3);
+
+  return !br.overrun && vp->ppsId <= 63;
+}
+
+static int parseH265Slice(unsigned char const* nal, unsigned nalSize, VideoParams* vp,
+			  SliceHistory* history) {
+  /* Parse (the start of) a H.265 slice segment header, returning 1 iff it is consistent with
+     our SPS and PPS: */
+  BitReader br;
+  unsigned nalType = (nal[0]>>1)&0x3F;
+  int isIRAP = nalType >= 16 && nalType <= 23, isIDR = nalType == 19 || nalType == 20;
+  int firstSliceSegmentInPic, dependentSliceSegment = 0;
+
+  initBitReader(&br, &nal[2], nalSize-2);
+  firstSliceSegmentInPic = getBits(&br, 1);
+  if (isIRAP) getBits(&br, 1); /* no_output_of_prior_pics_flag */
+  if (getUE(&br) != vp->ppsId) return 0;
+  if (!firstSliceSegmentInPic) {
+    unsigned sliceSegmentAddress;
+
+    if (vp->dependentSliceSegmentsEnabled) dependentSliceSegment = getBits(&br, 1);
+    sliceSegmentAddress = getBits(&br, ceilLog2(vp->picSizeInUnits));
+    if (sliceSegmentAddress == 0 || sliceSegmentAddress >= vp->picSizeInUnits) return 0;
+  }
+
+  if (!dependentSliceSegment) {
+    unsigned sliceType;
+
+    getBits(&br, vp->numExtraSliceHeaderBits);
+    sliceType = getUE(&br);
+    if (sliceType > 2 || (isIRAP && sliceType != 2/*I*/)) return 0;
+    if (vp->outputFlagPresent) getBits(&br, 1); /* pic_output_flag */
+    if (vp->separateColourPlane) getBits(&br, 2); /* colour_plane_id */
+
+    if (!isIDR) {
+      unsigned pocLsb = getBits(&br, vp->log2MaxPocLsb);
+
+      if (!getBits(&br, 1)) { /* short_term_ref_pic_set_sps_flag */
+	if (!parseH265ShortTermRefPicSet(&br, vp->numShortTermRefPicSets, vp->numShortTermRefPicSets,
+					 vp->numDeltaPocs)) {
+	  return 0;
+	}
+      } else if (vp->numShortTermRefPicSets == 0) {
+	return 0;
+      } else if (getBits(&br, ceilLog2(vp->numShortTermRefPicSets)) >= vp->numShortTermRefPicSets) {
+	return 0;
+      }
+
+      /* Successive pictures should have nearby picture order counts: */
+      if (firstSliceSegmentInPic) {
+	unsigned maxPocLsb = 1u<<vp->log2MaxPocLsb;
+	unsigned pocDelta = (pocLsb - history->prevPocLsb) & (maxPocLsb-1);
+
+	if (history->havePrev && pocDelta > 32 && maxPocLsb - pocDelta > 32) return 0;
+	history->prevPocLsb = pocLsb;
+	history->havePrev = 1;
+      }
+    } else if (firstSliceSegmentInPic) {
+      history->prevPocLsb = 0;
+      history->havePrev = 1;
+    }
+  }
+  return !br.overrun;
+}
+
+static int loadVideoParams(VideoFormat const* format, VideoParams* vp) {
+  /* Parse the SPS and PPS from a video format's parameter set NAL units (which - for H.265 -
+     also include a VPS).  Returns 1 for H.264, 2 for H.265, or 0 if we fail to parse them.  (We
+     identify each NAL unit by its type.) */
+  int isH265 = format->codec == 2, haveSPS = 0, havePPS = 0;
+  unsigned i;
+
+  memset(vp, 0, sizeof *vp);
+  for (i = 0; i < 3; ++i) {
+    unsigned char const* nal = format->parameterSets[i].data;
+    unsigned nalSize = format->parameterSets[i].size;
+
+    if (nalSize == 0) continue;
+    if (nalSize < 3) return 0;
+    if (isH265) {
+      unsigned nalType = (nal[0]>>1)&0x3F;
+
+      if (nalType == 33) haveSPS = parseH265SPS(nal, nalSize, vp);
+      else if (nalType == 34) havePPS = parseH265PPS(nal, nalSize, vp);
+    } else {
+      unsigned nalType = nal[0]&0x1F;
+
+      if (nalType == 7) haveSPS = parseH264SPS(nal, nalSize, vp);
+      else if (nalType == 8) havePPS = parseH264PPS(nal, nalSize, vp);
+    }
+  }
+  if (!haveSPS || !havePPS || vp->ppsSpsId != vp->spsId) return 0;
+  return isH265 ? 2 : 1;
+}
+
+static int chooseFormatCode(RepairContext* ctx, VideoFormat const* formats, unsigned numFormats,
+			    int const scores[], unsigned numSlices) {
+  /* Report the best-scoring formats (the number of slices - out of "numSlices" - that are
+     consistent with each), and return the code of the best of these, if it's good enough: */
+  int order[MAX_NUM_FORMATS];
+  unsigned i, j;
+
+  /* Rank the formats (best first, keeping the table order for equal scores): */
+  for (i = 0; i < numFormats; ++i) order[i] = i;
+  for (i = 1; i < numFormats; ++i) {
+    int o = order[i];
+
+    for (j = i; j > 0 && scores[order[j-1]] < scores[o]; --j) order[j] = order[j-1];
+    order[j] = o;
+  }
+
+  if (numFormats == 0 || scores[order[0]] <= 0) {
+    fprintf(ctx->log, "None of our video formats fit this data.\n");
+    return 0;
+  }
+  for (i = 0; i < numFormats && i < 5 && scores[order[i]] > 0; ++i) {
+    fprintf(ctx->log, "\t\"%c\" (%s): %d of %u slices are consistent\n",
+	    formats[order[i]].code, formats[order[i]].name, scores[order[i]], numSlices);
+  }
+  if ((unsigned)scores[order[0]]*2 < numSlices) {
+    fprintf(ctx->log, "(None of our video formats fits this data well enough for us to choose it automatically.)\n");
+    return 0;
+  }
+  for (i = 1; i < numFormats && scores[order[i]] == scores[order[0]]; ++i) {}
+  if (i > 1) {
+    fprintf(ctx->log, "(%u video formats fit this data equally well.  If the file repaired using the first of these is unplayable, try again with another of them (using \"-f\").)\n", i);
+  }
+  return formats[order[0]].code;
+}
+
+static int detectFormatCode(RepairContext* ctx, int repairType, unsigned long videoPosition) {
+  /* Work out which of our video formats (for this repair type) best fits the video data that
+     begins at "videoPosition", returning its format code (or 0 if none fits): */
+  InputFile* input = &ctx->input;
+  VideoFormat const* formats = formatsForRepairType(repairType);
+  unsigned long sliceOffsets[MAX_SAMPLE_SLICES];
+  unsigned sliceSizes[MAX_SAMPLE_SLICES];
+  unsigned numSlices, numH264Slices = 0, numH265Slices = 0, numDataSlices, numFormats, i;
+  unsigned long endPosition;
+  int scores[MAX_NUM_FORMATS];
+  int dataCodec; /* 1 for H.264; 2 for H.265 */
+
+  if (formats == NULL) return 0;
+  fillInput(input, videoPosition + MAX_SAMPLE_SCAN_SIZE); /* (if we're reading a stream) */
+  numSlices = collectSampleSlices(input, videoPosition, MAX_SAMPLE_SLICES, sliceOffsets, sliceSizes, &endPosition);
+  for (i = 0; i < numSlices; ++i) {
+    unsigned char const* nal = inputAt(input, sliceOffsets[i]);
+
+    if (isH264SliceNAL(nal[0])) ++numH264Slices;
+    if (isH265SliceNAL(nal[0], nal[1])) ++numH265Slices;
+  }
+  if (numH264Slices == 0 && numH265Slices == 0) {
+    fprintf(ctx->log, "Didn't find any video slices from which to detect the video format.\n");
+    return 0;
+  }
+  dataCodec = numH265Slices > numH264Slices ? 2 : 1;
+  numDataSlices = dataCodec == 2 ? numH265Slices : numH264Slices;
+  fprintf(ctx->log, "Detecting the video format from the first %u video slices (which look like %s)...\n",
+	  numDataSlices, dataCodec == 2 ? "H.265" : "H.264");
+
+  /* Score each candidate format by the number of slices that are consistent with it: */
+  for (numFormats = 0; formats[numFormats].repairType == repairType && numFormats < MAX_NUM_FORMATS; ++numFormats) {
+    VideoParams vp;
+    SliceHistory history;
+
+    scores[numFormats] = -1; /* the format can't be used for this data */
+    if (formats[numFormats].codec != dataCodec || loadVideoParams(&formats[numFormats], &vp) != dataCodec) continue;
+
+    scores[numFormats] = 0;
+    memset(&history, 0, sizeof history);
+    for (i = 0; i < numSlices; ++i) {
+      unsigned char const* nal = inputAt(input, sliceOffsets[i]);
+
+      if (dataCodec == 2) {
+	if (isH265SliceNAL(nal[0], nal[1])) scores[numFormats] += parseH265Slice(nal, sliceSizes[i], &vp, &history);
+      } else {
+	if (isH264SliceNAL(nal[0])) scores[numFormats] += parseH264Slice(nal, sliceSizes[i], &vp, &history);
+      }
+    }
+  }
+
+  return chooseFormatCode(ctx, formats, numFormats, scores, numDataSlices);
+}
+
+/* Trial repairs ("-p").
+
+   For each candidate video format, we repair just the first few video slices, into memory,
+   and parse the result - the parameter set NAL units that we wrote, followed by the slices -
+   as a player would see it.  This checks our actual output (including our handling of any
+   non-video blocks), at the cost of a few MBytes of work per candidate, rather than a
+   complete rewrite of the file for each guess.
+*/
+
+static int checkTrialOutput(unsigned char const* data, unsigned long size, unsigned* numSlices) {
+  /* Parse the 'start code'-separated NAL units of a trial repair, returning the number of
+     slices that are consistent with the SPS and PPS that precede them (or -1 if we couldn't
+     parse these): */
+  VideoParams vp;
+  SliceHistory history;
+  unsigned long p = 0;
+  int isH265, haveSPS = 0, havePPS = 0, numConsistent = 0;
+
+  *numSlices = 0;
+  if (size < 6) return -1;
+  isH265 = ((data[4]>>1)&0x3F) == 32 && data[5] == 0x01; /* our H.265 output begins with a VPS */
+  memset(&vp, 0, sizeof vp);
+  memset(&history, 0, sizeof history);
+
+  while (p + 4 <= size) {
+    unsigned long nalStart = p + 4, nalEnd = nalStart;
+    unsigned char const* nal = &data[nalStart];
+    unsigned nalSize;
+
+    /* Find the next 'start code' (0x00000001), which ends this NAL unit: */
+    while (nalEnd + 4 <= size &&
+	   !(data[nalEnd] == 0 && data[nalEnd+1] == 0 && data[nalEnd+2] == 0 && data[nalEnd+3] == 1)) {
+      ++nalEnd;
+    }
+    if (nalEnd + 4 > size) nalEnd = size;
+    p = nalEnd;
+    nalSize = nalEnd - nalStart;
+    if (nalSize < 3) continue;
+
+    if (isH265) {
+      unsigned nalType = (nal[0]>>1)&0x3F;
+
+      if (nalType == 33) {
+	haveSPS = parseH265SPS(nal, nalSize, &vp);
+      } else if (nalType == 34) {
+	havePPS = parseH265PPS(nal, nalSize, &vp);
+      } else if (isH265SliceNAL(nal[0], nal[1])) {
+	if (!haveSPS || !havePPS) return -1;
+	++*numSlices;
+	numConsistent += parseH265Slice(nal, nalSize, &vp, &history);
+      }
+    } else {
+      unsigned nalType = nal[0]&0x1F;
+
+      if (nalType == 7) {
+	haveSPS = parseH264SPS(nal, nalSize, &vp);
+      } else if (nalType == 8) {
+	havePPS = parseH264PPS(nal, nalSize, &vp);
+      } else if (isH264SliceNAL(nal[0])) {
+	if (!haveSPS || !havePPS) return -1;
+	++*numSlices;
+	numConsistent += parseH264Slice(nal, nalSize, &vp, &history);
+      }
+    }
+  }
+  return numConsistent;
+}
+
+static int doTrialRepair(RepairContext* ctx, InputFile const* trialInput, int repairType,
+			 unsigned second4Bytes, int formatCode, unsigned* numSlices) {
+  /* Repair (just) "trialInput" into memory, using the video format "formatCode", and check
+     the result.  Returns the number of consistent slices (or -1).  The trial repair has its own
+     context (a copy of ours), so it doesn't affect our state: */
+  RepairContext trial;
+  unsigned char* output;
+  unsigned long outputSize;
+  FILE* outputFID;
+  int result;
+#ifdef HAVE_OPEN_MEMSTREAM
+  char* memBuffer = NULL;
+  size_t memSize = 0;
+
+  outputFID = open_memstream(&memBuffer, &memSize);
+#else
+  outputFID = tmpfile();
+#endif
+  *numSlices = 0;
+  if (outputFID == NULL) return -1;
+
+  trial = *ctx;
+  trial.input = *trialInput;
+  trial.outputFID = outputFID;
+  trial.quiet = 1;
+  trial.mp4 = NULL;
+  trial.stats = NULL;
+  trial.plan = NULL;
+  trial.replayPlan = NULL;
+  trial.extraction = NULL;
+  trial.progress.showProgress = 0;
+  trial.progress.fid = NULL;
+  if (repairType == 2) {
+    repairType2WithFormat(&trial, second4Bytes, formatCode);
+  } else if (repairType == 3) {
+    repairType3WithFormat(&trial, formatCode);
+  } else {
+    repairType5WithFormat(&trial, formatCode);
+  }
+
+#ifdef HAVE_OPEN_MEMSTREAM
+  fclose(outputFID);
+  output = (unsigned char*)memBuffer;
+  outputSize = memSize;
+#else
+  outputSize = tellOutput(outputFID);
+  output = malloc(outputSize + 1);
+  rewind(outputFID);
+  if (output != NULL) outputSize = fread(output, 1, outputSize, outputFID);
+  fclose(outputFID);
+#endif
+  if (output == NULL) return -1;
+
+  result = checkTrialOutput(output, outputSize, numSlices);
+  free(output);
+  return result;
+}
+
+static int probeFormatCode(RepairContext* ctx, int repairType, unsigned second4Bytes) {
+  /* Do a trial repair of the first "numProbeSlices" video slices with each candidate video
+     format, report the results, and return the code of the best format (or 0, if none fits): */
+  InputFile* input = &ctx->input;
+  VideoFormat const* formats = formatsForRepairType(repairType);
+  unsigned long const videoPosition = repairType == 2 ? input->pos-2 : input->pos;
+  InputFile trialInput;
+  unsigned long endPosition;
+  unsigned numFormats, maxNumSlices = 0;
+  int scores[MAX_NUM_FORMATS];
+
+  if (formats == NULL) return 0;
+
+  /* The trial input is the same as our input file, except that it ends after these slices.
+     (If we're reading a stream, the slices must be within the next "MAX_SAMPLE_SCAN_SIZE" bytes,
+     and the trial input is just what we have of it.) */
+  fillInput(input, videoPosition + MAX_SAMPLE_SCAN_SIZE);
+  if (collectSampleSlices(input, videoPosition, ctx->numProbeSlices, NULL, NULL, &endPosition) == 0) {
+    fprintf(ctx->log, "Didn't find any video slices for trial repairs.\n");
+    return 0;
+  }
+  trialInput = *input;
+  trialInput.size = endPosition;
+  trialInput.fd = -1;
+  trialInput.stream = NULL;
+  fprintf(ctx->log, "Doing trial repairs of the first %lu bytes of video data, with each video format...\n",
+	  endPosition - videoPosition);
+
+  for (numFormats = 0; formats[numFormats].repairType == repairType && numFormats < MAX_NUM_FORMATS; ++numFormats) {
+    unsigned numSlices;
+
+    scores[numFormats] = doTrialRepair(ctx, &trialInput, repairType, second4Bytes, formats[numFormats].code, &numSlices);
+    if (numSlices > maxNumSlices) maxNumSlices = numSlices;
+  }
+  return chooseFormatCode(ctx, formats, numFormats, scores, maxNumSlices);
+}
+
+/* Writing the repaired video as an MP4 file ("-m"), rather than as a '.h264' stream.
+
+   The NAL units go (unchanged, except that each is preceded by its 4-byte size, rather than
+   by a 'start code') into a single 'mdat' atom.  As we write them, we group them into samples
+   (i.e., access units), noting the size of each sample, which samples are IDR (or - for
+   H.265 - IRAP) pictures, and the first SPS, PPS (and, for H.265, VPS) NAL unit.  At the end,
+   we write a 'moov' atom that describes the samples, and fill in the size of the 'mdat' atom.
+   The samples are in decoding order, each with the same duration (from the SPS's timing info,
+   or - if it doesn't have any - the video format name).  (Copies of the parameter set NAL
+   units also remain within the samples, which players accept.)
+*/
+
+#define MP4_PARAM_SET_SPS 0
+#define MP4_PARAM_SET_PPS 1
+#define MP4_PARAM_SET_VPS 2 /* H.265 only */
+
+struct Mp4Writer {
+  int codecIsKnown, isH265; /* from the first NAL unit (a SPS, or - for H.265 - a VPS) */
+  unsigned formatFrameRate; /* from our video format; 0 if not known */
+  unsigned long mdatPosition; /* where (in the output file) the 'mdat' atom begins */
+
+  unsigned char* paramSets[3]; /* "malloc()"ed copies of the first of each type */
+  unsigned paramSetSizes[3];
+
+  unsigned* sampleSizes;
+  unsigned numSamples, maxNumSamples;
+  unsigned* syncSamples; /* the (1-based) numbers of those samples that are sync samples */
+  unsigned numSyncSamples, maxNumSyncSamples;
+  unsigned long curSampleSize; /* 0 if we haven't yet begun a sample */
+  int curSampleHasVideo, curSampleIsSync;
+  int outOfMemory;
+  MemoryBudget* memory; /* what "sampleSizes" and "syncSamples" (and the 'moov' atom) are taken from */
+};
+
+static void endMp4Sample(Mp4Writer* mp4) {
+  if (mp4->curSampleSize == 0) return;
+
+  if (mp4->numSamples == mp4->maxNumSamples
+      && !growArray(mp4->memory, (void**)&mp4->sampleSizes, &mp4->maxNumSamples, sizeof mp4->sampleSizes[0])) {
+    mp4->outOfMemory = 1;
+  } else {
+    mp4->sampleSizes[mp4->numSamples++] = (unsigned)mp4->curSampleSize;
+    if (mp4->curSampleIsSync) {
+      if (mp4->numSyncSamples == mp4->maxNumSyncSamples
+	  && !growArray(mp4->memory, (void**)&mp4->syncSamples, &mp4->maxNumSyncSamples, sizeof mp4->syncSamples[0])) {
+	mp4->outOfMemory = 1;
+      } else {
+	mp4->syncSamples[mp4->numSyncSamples++] = mp4->numSamples;
+      }
+    }
+  }
+  mp4->curSampleSize = 0;
+  mp4->curSampleHasVideo = mp4->curSampleIsSync = 0;
+}
+
+static void addMp4NALUnit(Mp4Writer* mp4, unsigned char const* nal, unsigned long numAvailable,
+			  unsigned nalSize) {
+  /* Note a "nalSize"-byte NAL unit that we're about to write (of which the first "numAvailable"
+     bytes - perhaps not all of it, if the input file was truncated - are at "nal"): */
+  unsigned char b0 = numAvailable > 0 ? nal[0] : 0xFF; /* we write 0xFF for missing bytes */
+  unsigned char b1 = numAvailable > 1 ? nal[1] : 0xFF;
+  unsigned char b2 = numAvailable > 2 ? nal[2] : 0xFF;
+  unsigned nalType;
+  int isVideo, isFirstSliceOfPicture, beginsAccessUnit, isSync, paramSet = -1;
+
+  if (!mp4->codecIsKnown) {
+    mp4->codecIsKnown = 1;
+    mp4->isH265 = (b0 == 0x40 || b0 == 0x42) && b1 == 0x01; /* a H.265 VPS or SPS */
+  }
+
+  if (mp4->isH265) {
+    nalType = (b0>>1)&0x3F;
+    isVideo = (b0&0x80) == 0 && nalType <= 31;
+    isFirstSliceOfPicture = (b2&0x80) != 0; /* first_slice_segment_in_pic_flag */
+    beginsAccessUnit = (b0&0x80) == 0 && ((nalType >= 32 && nalType <= 35) || nalType == 39 ||
+					 (nalType >= 41 && nalType <= 44) || nalType >= 48);
+    isSync = nalType >= 16 && nalType <= 21;
+    if (nalType == 32) paramSet = MP4_PARAM_SET_VPS;
+    else if (nalType == 33) paramSet = MP4_PARAM_SET_SPS;
+    else if (nalType == 34) paramSet = MP4_PARAM_SET_PPS;
+  } else {
+    nalType = b0&0x1F;
+    isVideo = (b0&0x80) == 0 && nalType >= 1 && nalType <= 5;
+    isFirstSliceOfPicture = (b1&0x80) != 0; /* first_mb_in_slice == 0 */
+    beginsAccessUnit = (b0&0x80) == 0 && ((nalType >= 6 && nalType <= 9) || (nalType >= 14 && nalType <= 18));
+    isSync = nalType == 5;
+    if (nalType == 7) paramSet = MP4_PARAM_SET_SPS;
+    else if (nalType == 8) paramSet = MP4_PARAM_SET_PPS;
+  }
+
+  /* A new sample begins with the first NAL unit of the next access unit (after the video of
+     the current one): */
+  if (mp4->curSampleHasVideo && (isVideo ? isFirstSliceOfPicture : beginsAccessUnit)) endMp4Sample(mp4);
+  if (isVideo && !mp4->curSampleHasVideo) {
+    mp4->curSampleHasVideo = 1;
+    mp4->curSampleIsSync = isSync;
+  }
+  mp4->curSampleSize += 4 + nalSize;
+
+  if (paramSet >= 0 && mp4->paramSets[paramSet] == NULL && nalSize >= 4 && nalSize <= 0xFFFF
+      && numAvailable >= nalSize) {
+    mp4->paramSets[paramSet] = malloc(nalSize);
+    if (mp4->paramSets[paramSet] == NULL) {
+      mp4->outOfMemory = 1;
+    } else {
+      memcpy(mp4->paramSets[paramSet], nal, nalSize);
+      mp4->paramSetSizes[paramSet] = nalSize;
+    }
+  }
+}
+
+static void noteMp4Format(RepairContext* ctx, VideoFormat const* format) {
+  if (ctx->mp4 != NULL) ctx->mp4->formatFrameRate = format->frameRate;
+}
+
+#ifndef DJIFIX_LIBRARY
+static int beginMp4File(RepairContext* ctx) {
+  /* Write the 'ftyp' atom, and the header of the 'mdat' atom (with a 64-bit size that we fill
+     in at the end).  Returns 0 if we run out of memory: */
+  FILE* outputFID = ctx->outputFID;
+  static unsigned char const ftypAndMdat[] = {
+    0x00, 0x00, 0x00, 0x18, 'f', 't', 'y', 'p', 'i', 's', 'o', 'm', 0x00, 0x00, 0x02, 0x00,
+    'i', 's', 'o', 'm', 'm', 'p', '4', '1',
+    0x00, 0x00, 0x00, 0x01, 'm', 'd', 'a', 't', 0, 0, 0, 0, 0, 0, 0, 0
+  };
+
+  ctx->mp4 = calloc(1, sizeof *ctx->mp4);
+  if (ctx->mp4 == NULL) return 0;
+  ctx->mp4->memory = &ctx->memory;
+  ctx->mp4->mdatPosition = tellOutput(outputFID) + 24;
+  fwrite(ftypAndMdat, 1, sizeof ftypAndMdat, outputFID);
+  return 1;
+}
+
+/* The 'moov' atom is built in memory: */
+typedef struct ByteBuffer {
+  unsigned char* data;
+  unsigned size, maxSize;
+  int failed;
+  MemoryBudget* memory;
+} ByteBuffer;
+
+static void putBytes(ByteBuffer* b, void const* from, unsigned numBytes) {
+  while (b->size + numBytes > b->maxSize && !b->failed) {
+    if (!growArray(b->memory, (void**)&b->data, &b->maxSize, 1)) b->failed = 1;
+  }
+  if (b->failed) return;
+  memcpy(&b->data[b->size], from, numBytes);
+  b->size += numBytes;
+}
+
+static void put1(ByteBuffer* b, unsigned value) {
+  unsigned char c = value;
+
+  putBytes(b, &c, 1);
+}
+
+static void put2(ByteBuffer* b, unsigned value) {
+  put1(b, value>>8); put1(b, value);
+}
+
+static void put4(ByteBuffer* b, unsigned value) {
+  put2(b, value>>16); put2(b, value);
+}
+
+static void put8(ByteBuffer* b, unsigned long long value) {
+  put4(b, (unsigned)(value>>32)); put4(b, (unsigned)value);
+}
+
+static void putZeros(ByteBuffer* b, unsigned numBytes) {
+  while (numBytes-- > 0) put1(b, 0);
+}
+
+static unsigned beginAtom(ByteBuffer* b, char const* fourcc) {
+  /* Begin an atom (whose size we fill in later, using "endAtom()"), returning where it begins: */
+  unsigned start = b->size;
+
+  put4(b, 0);
+  putBytes(b, fourcc, 4);
+  return start;
+}
+
+static unsigned beginFullAtom(ByteBuffer* b, char const* fourcc, unsigned version, unsigned flags) {
+  unsigned start = beginAtom(b, fourcc);
+
+  put4(b, (version<<24)|flags);
+  return start;
+}
+
+static void endAtom(ByteBuffer* b, unsigned start) {
+  unsigned size = b->size - start;
+
+  if (b->failed) return;
+  b->data[start] = size>>24; b->data[start+1] = size>>16; b->data[start+2] = size>>8; b->data[start+3] = size;
+}
+
+static void putTimes(ByteBuffer* b, int version) {
+  /* The creation and modification times (which we don't know): */
+  if (version == 1) {
+    put8(b, 0); put8(b, 0);
+  } else {
+    put4(b, 0); put4(b, 0);
+  }
+}
+
+static void putDuration(ByteBuffer* b, int version, unsigned long long duration) {
+  if (version == 1) put8(b, duration); else put4(b, (unsigned)duration);
+}
+
+static void putMatrix(ByteBuffer* b) {
+  put4(b, 0x00010000); put4(b, 0); put4(b, 0);
+  put4(b, 0); put4(b, 0x00010000); put4(b, 0);
+  put4(b, 0); put4(b, 0); put4(b, 0x40000000);
+}
+static void putParamSetArray(ByteBuffer* b, Mp4Writer const* mp4, int paramSet, int isH265) {
+  /* Part of an 'avcC' (SPS or PPS list) or 'hvcC' (NAL unit array): */
+  unsigned const size = mp4->paramSetSizes[paramSet];
+  static unsigned char const h265NalTypes[3] = { 33, 34, 32 };
+
+  if (isH265) {
+    put1(b, 0x80|h265NalTypes[paramSet]); /* array_completeness; NAL_unit_type */
+    put2(b, size > 0 ? 1 : 0);
+  } else {
+    put1(b, (paramSet == MP4_PARAM_SET_SPS ? 0xE0 : 0x00)|(size > 0 ? 1 : 0));
+  }
+  if (size > 0) {
+    put2(b, size);
+    putBytes(b, mp4->paramSets[paramSet], size);
+  }
+}
+
+static void putSampleEntry(ByteBuffer* b, Mp4Writer const* mp4, VideoParams const* vp) {
+  /* The 'avc1' or 'hvc1' sample description, including its 'avcC' or 'hvcC': */
+  unsigned char const* sps = mp4->paramSets[MP4_PARAM_SET_SPS];
+  unsigned const spsSize = mp4->paramSetSizes[MP4_PARAM_SET_SPS];
+  unsigned entry = beginAtom(b, mp4->isH265 ? "hvc1" : "avc1"), config, i;
+  static char const compressorName[32] = { 0 };
+
+  putZeros(b, 6); put2(b, 1); /* reserved; data_reference_index */
+  putZeros(b, 16); /* pre_defined; reserved */
+  put2(b, vp->width); put2(b, vp->height);
+  put4(b, 0x00480000); put4(b, 0x00480000); /* 72 dpi */
+  put4(b, 0); put2(b, 1); /* reserved; frame_count */
+  putBytes(b, compressorName, sizeof compressorName);
+  put2(b, 0x0018); put2(b, 0xFFFF); /* depth; pre_defined */
+
+  if (!mp4->isH265) {
+    config = beginAtom(b, "avcC");
+    put1(b, 1); /* configurationVersion */
+    for (i = 1; i <= 3; ++i) put1(b, spsSize > 3 ? sps[i] : 0); /* profile, compatibility, level */
+    put1(b, 0xFC|3); /* lengthSizeMinusOne */
+    putParamSetArray(b, mp4, MP4_PARAM_SET_SPS, 0);
+    putParamSetArray(b, mp4, MP4_PARAM_SET_PPS, 0);
+    endAtom(b, config);
+  } else {
+    BitReader br;
+    unsigned firstByte; /* sps_video_parameter_set_id; sps_max_sub_layers_minus1; sps_temporal_id_nesting_flag */
+
+    initBitReader(&br, spsSize > 2 ? &sps[2] : sps, spsSize > 2 ? spsSize-2 : 0);
+    firstByte = getBits(&br, 8);
+
+    config = beginAtom(b, "hvcC");
+    put1(b, 1); /* configurationVersion */
+    for (i = 0; i < 12; ++i) put1(b, getBits(&br, 8)); /* the general profile_tier_level() fields */
+    put2(b, 0xF000); put1(b, 0xFC); /* min_spatial_segmentation_idc; parallelismType */
+    put1(b, 0xFC|(vp->separateColourPlane ? 3 : vp->chromaArrayType));
+    put1(b, 0xF8|((vp->bitDepthLuma-8)&7)); put1(b, 0xF8|((vp->bitDepthChroma-8)&7));
+    put2(b, 0); /* avgFrameRate */
+    put1(b, ((((firstByte>>1)&7)+1)<<3)|((firstByte&1)<<2)|3); /* numTemporalLayers; temporalIdNested; lengthSizeMinusOne */
+    put1(b, 3); /* numOfArrays */
+    putParamSetArray(b, mp4, MP4_PARAM_SET_VPS, 1);
+    putParamSetArray(b, mp4, MP4_PARAM_SET_SPS, 1);
+    putParamSetArray(b, mp4, MP4_PARAM_SET_PPS, 1);
+    endAtom(b, config);
+  }
+  endAtom(b, entry);
+}
+
+static void putMoov(ByteBuffer* b, Mp4Writer const* mp4, VideoParams const* vp, unsigned timeScale,
+		    unsigned sampleDuration, unsigned long mdatEnd) {
+  unsigned long long const duration = (unsigned long long)mp4->numSamples*sampleDuration;
+  int const version = duration > 0xFFFFFFFFULL ? 1 : 0;
+  int const useCo64 = mdatEnd > 0xFFFFFFFFUL;
+  unsigned long offset = mp4->mdatPosition + 16;
+  unsigned moov, trak, mdia, minf, dinf, dref, stbl, atom, i;
+
+  moov = beginAtom(b, "moov");
+  atom = beginFullAtom(b, "mvhd", version, 0);
+  putTimes(b, version); put4(b, timeScale); putDuration(b, version, duration);
+  put4(b, 0x00010000); put2(b, 0x0100); putZeros(b, 10); /* rate; volume; reserved */
+  putMatrix(b);
+  putZeros(b, 24); put4(b, 2); /* pre_defined; next_track_ID */
+  endAtom(b, atom);
+
+  trak = beginAtom(b, "trak");
+  atom = beginFullAtom(b, "tkhd", version, 0x000003); /* track_enabled; track_in_movie */
+  putTimes(b, version); put4(b, 1); put4(b, 0); putDuration(b, version, duration); /* ...track_ID; reserved */
+  putZeros(b, 16); /* reserved; layer; alternate_group; volume; reserved */
+  putMatrix(b);
+  put4(b, vp->width<<16); put4(b, vp->height<<16);
+  endAtom(b, atom);
+
+  mdia = beginAtom(b, "mdia");
+  atom = beginFullAtom(b, "mdhd", version, 0);
+  putTimes(b, version); put4(b, timeScale); putDuration(b, version, duration);
+  put2(b, 0x55C4); put2(b, 0); /* language ("und"); pre_defined */
+  endAtom(b, atom);
+  atom = beginFullAtom(b, "hdlr", 0, 0);
+  put4(b, 0); putBytes(b, "vide", 4); putZeros(b, 12); putBytes(b, "VideoHandler", 13);
+  endAtom(b, atom);
+
+  minf = beginAtom(b, "minf");
+  atom = beginFullAtom(b, "vmhd", 0, 1);
+  putZeros(b, 8); /* graphicsmode; opcolor */
+  endAtom(b, atom);
+  dinf = beginAtom(b, "dinf");
+  dref = beginFullAtom(b, "dref", 0, 0);
+  put4(b, 1); /* entry_count */
+  atom = beginFullAtom(b, "url ", 0, 1); /* the data is in this file */
+  endAtom(b, atom);
+  endAtom(b, dref);
+  endAtom(b, dinf);
+
+  stbl = beginAtom(b, "stbl");
+  atom = beginFullAtom(b, "stsd", 0, 0);
+  put4(b, 1); /* entry_count */
+  putSampleEntry(b, mp4, vp);
+  endAtom(b, atom);
+  atom = beginFullAtom(b, "stts", 0, 0);
+  put4(b, 1); put4(b, mp4->numSamples); put4(b, sampleDuration);
+  endAtom(b, atom);
+  if (mp4->numSyncSamples < mp4->numSamples) { /* (with no 'stss', every sample is a sync sample) */
+    atom = beginFullAtom(b, "stss", 0, 0);
+    put4(b, mp4->numSyncSamples);
+    for (i = 0; i < mp4->numSyncSamples; ++i) put4(b, mp4->syncSamples[i]);
+    endAtom(b, atom);
+  }
+  atom = beginFullAtom(b, "stsc", 0, 0);
+  put4(b, 1); put4(b, 1); put4(b, 1); put4(b, 1); /* each chunk is one sample */
+  endAtom(b, atom);
+  atom = beginFullAtom(b, "stsz", 0, 0);
+  put4(b, 0); put4(b, mp4->numSamples);
+  for (i = 0; i < mp4->numSamples; ++i) put4(b, mp4->sampleSizes[i]);
+  endAtom(b, atom);
+  atom = beginFullAtom(b, useCo64 ? "co64" : "stco", 0, 0);
+  put4(b, mp4->numSamples);
+  for (i = 0; i < mp4->numSamples; ++i) {
+    if (useCo64) put8(b, offset); else put4(b, (unsigned)offset);
+    offset += mp4->sampleSizes[i];
+  }
+  endAtom(b, atom);
+  endAtom(b, stbl);
+  endAtom(b, minf);
+  endAtom(b, mdia);
+  endAtom(b, trak);
+  endAtom(b, moov);
+}
+
+static int endMp4File(RepairContext* ctx) {
+  /* Write the 'moov' atom, and fill in the size of the 'mdat' atom.  Returns 0 if we ran out of
+     memory (or couldn't write the file): */
+  Mp4Writer* mp4 = ctx->mp4;
+  FILE* outputFID = ctx->outputFID;
+  unsigned char const* sps = mp4->paramSets[MP4_PARAM_SET_SPS];
+  unsigned const spsSize = mp4->paramSetSizes[MP4_PARAM_SET_SPS];
+  unsigned long long sampleDuration = 0;
+  unsigned long mdatEnd, mdatSize;
+  unsigned timeScale = 0, i;
+  ByteBuffer moov;
+  VideoParams vp;
+  int result = 0;
+
+  endMp4Sample(mp4);
+
+  /* Use the SPS for the picture size and the frame rate (if it has timing info): */
+  memset(&vp, 0, sizeof vp);
+  if (sps != NULL) {
+    if (mp4->isH265) parseH265SPS(sps, spsSize, &vp); else parseH264SPS(sps, spsSize, &vp);
+  }
+  if (vp.bitDepthLuma < 8) vp.bitDepthLuma = vp.bitDepthChroma = 8;
+  if (vp.numUnitsInTick != 0 && vp.timeScale != 0) {
+    /* (For H.264, a 'tick' is a field, not a frame) */
+    timeScale = vp.timeScale;
+    sampleDuration = (mp4->isH265 ? 1ULL : 2ULL)*vp.numUnitsInTick;
+  }
+  if (sampleDuration == 0 || timeScale < sampleDuration || timeScale > 1000*sampleDuration) {
+    /* The SPS has no (sane) timing info, so use the format's frame rate (or else 30 fps): */
+    timeScale = 1000*(mp4->formatFrameRate != 0 ? mp4->formatFrameRate : 30);
+    sampleDuration = 1000;
+  }
+
+  fflush(outputFID);
+  mdatEnd = tellOutput(outputFID);
+  memset(&moov, 0, sizeof moov);
+  moov.memory = mp4->memory;
+  putMoov(&moov, mp4, &vp, timeScale, (unsigned)sampleDuration, mdatEnd);
+  if (!moov.failed && !mp4->outOfMemory) {
+    unsigned char size8[8];
+
+    fwrite(moov.data, 1, moov.size, outputFID);
+    mdatSize = mdatEnd - mp4->mdatPosition;
+    for (i = 0; i < 8; ++i) size8[i] = (unsigned char)((unsigned long long)mdatSize >> (56 - 8*i));
+    fflush(outputFID);
+    if (seekOutputTo(outputFID, mp4->mdatPosition + 8) == 0) {
+      fwrite(size8, 1, 8, outputFID);
+      fseek(outputFID, 0, SEEK_END);
+      result = !ferror(outputFID);
+    }
+  }
+
+  giveBackMemory(mp4->memory, moov.maxSize + (unsigned long)mp4->maxNumSamples*sizeof mp4->sampleSizes[0]
+		 + (unsigned long)mp4->maxNumSyncSamples*sizeof mp4->syncSamples[0]);
+  free(moov.data);
+  for (i = 0; i < 3; ++i) free(mp4->paramSets[i]);
+  free(mp4->sampleSizes);
+  free(mp4->syncSamples);
+  free(mp4);
+  ctx->mp4 = NULL;
+  return result;
+}
+#endif
+
+/* Parallel ("-j") repairs of 'type 3', 'type 4', and 'type 5' files.
+
+   We split the video data into (roughly) equal parts, and walk each part in a separate thread.
+   Except for the first part (which begins where the serial walk would), we can't know where a
+   NAL unit begins, so each thread first looks for a 'sync point': a position from which a walk
+   finds a chain of plausible NAL units (allowing for blocks of non-video data in between).
+   Each walk continues until it reaches (or passes) the start of the next part.
+
+   Then - serially - we stitch the parts together: The walk of each part must arrive at a
+   boundary of the next part's walk, in the same "metadataIsPrintable" state (because a walk
+   continues the same way from any such boundary).  If it doesn't (e.g., because the next
+   part's sync point was wrong, or was inside a block of non-video data), we walk serially from
+   where it did arrive, until we reach such a boundary.  So the repaired file is exactly what a
+   serial repair would produce.  Finally, we write the parts of the repaired file in parallel,
+   each (using "pwritev()") at its own offset, straight from the input file's data.
+*/
+
+#ifdef HAVE_PTHREADS
+
+#ifndef MIN_WALK_CHUNK_SIZE
+#define MIN_WALK_CHUNK_SIZE (1024*1024) /* we don't split the video data into smaller parts than this */
+#endif
+#ifndef WALK_BYTES_PER_INDEX_BYTE
+#define WALK_BYTES_PER_INDEX_BYTE 16 /* with "--max-memory": how much of the file we walk in parallel, for each byte of memory left */
+#endif
+#define WRITE_IOV_COUNT 1024 /* the most pieces that we write at once (no more than any "IOV_MAX") */
+
+static void initWalkChunk(WalkChunk* chunk, InputFile const* input, int repairType,
+			  MetadataRuleTable const* metadataRules,
+			  unsigned long startPosition, unsigned long endPosition, int isPrintable) {
+  memset(chunk, 0, sizeof *chunk);
+  chunk->input = *input;
+  chunk->input.fd = -1; /* we share the input file's data (and "holesFD"), but not its file descriptor */
+  seekInputTo(&chunk->input, startPosition);
+  chunk->repairType = repairType;
+  chunk->metadataRules = metadataRules;
+  chunk->endPosition = endPosition;
+  chunk->initialIsPrintable = isPrintable;
+  chunk->flipBoundary = ~0u;
+  chunk->lastPrintableBoundary = -1;
+}
+
+static void freeWalkChunk(WalkChunk* chunk) {
+  if (chunk->bridge != NULL) {
+    freeWalkChunk(chunk->bridge);
+    free(chunk->bridge);
+  }
+  free(chunk->boundaries);
+  free(chunk->runs);
+  free(chunk->events);
+}
+
+static int stepChunkWalk(NalWalk* walk) {
+  /* Record a boundary at the current position, then take a step from it: */
+  WalkChunk* chunk = walk->chunk;
+
+  if (chunk->numBoundaries == chunk->maxNumBoundaries
+      && !growArray(&chunk->memory, (void**)&chunk->boundaries, &chunk->maxNumBoundaries, sizeof chunk->boundaries[0])) {
+    chunk->outOfMemory = 1;
+    return 0;
+  }
+  chunk->boundaries[chunk->numBoundaries].position = walk->input->pos;
+  chunk->boundaries[chunk->numBoundaries].numRuns = chunk->numRuns;
+  ++chunk->numBoundaries;
+
+  return walk->repairType == 4 ? walkType4Step(walk) : walkType3or5Step(walk);
+}
+
+static int boundaryIsPrintable(WalkChunk const* chunk, unsigned i) {
+  /* The "metadataIsPrintable" state of "chunk"s walk, at its boundary "i": */
+  return chunk->initialIsPrintable && i < chunk->flipBoundary;
+}
+
+static int findMatchingBoundary(WalkChunk const* chunk, unsigned long position, int isPrintable,
+				unsigned* result) {
+  /* Does a walk that has reached "position" (in the state "isPrintable") continue in the same way
+     as "chunk"s walk does from one of its boundaries?  If so, set "*result" to this boundary: */
+  unsigned lo = 0, hi = chunk->numBoundaries;
+
+  /* A walk never moves backwards, so the boundaries are in order: */
+  while (lo < hi) {
+    unsigned mid = lo + (hi - lo)/2;
+
+    if (chunk->boundaries[mid].position < position) lo = mid + 1; else hi = mid;
+  }
+  for (; lo < chunk->numBoundaries && chunk->boundaries[lo].position == position; ++lo) {
+    /* A walk in state 0 also continues like one in state 1, if none of the latter's later
+       steps depended on its state.  (After that, its state becomes 0 at the same step.) */
+    if (boundaryIsPrintable(chunk, lo) == isPrintable
+	|| (!isPrintable && chunk->lastPrintableBoundary < (int)lo)) {
+      *result = lo;
+      return 1;
+    }
+  }
+  return 0;
+}
+
+static void walkChunk(WalkChunk* chunk, WalkChunk const* target) {
+  /* Walk from the chunk's current position until we reach its end position (or the walk ends),
+     recording what we find.  If "target" is non-NULL, we stop early - noting that we 'converged'
+     - if we reach a boundary of "target" from which our walk would continue the same way: */
+  NalWalk walk;
+
+  walk.ctx = NULL;
+  walk.input = &chunk->input;
+  walk.outputFID = NULL;
+  walk.chunk = chunk;
+  walk.repairType = chunk->repairType;
+  walk.metadataRules = chunk->metadataRules;
+  walk.metadataIsPrintable = chunk->initialIsPrintable;
+  walk.stopOnAnomaly = chunk->stopOnAnomaly;
+
+  while (!chunk->input.atEOF) {
+    if (target != NULL
+	&& findMatchingBoundary(target, chunk->input.pos, walk.metadataIsPrintable, &chunk->convergedBoundary)) {
+      chunk->converged = 1;
+      break;
+    }
+    if (chunk->input.pos >= chunk->endPosition) break;
+    if (!stepChunkWalk(&walk)) {
+      chunk->stopped = 1;
+      break;
+    }
+  }
+  if (chunk->input.atEOF) chunk->stopped = 1;
+  chunk->exitIsPrintable = walk.metadataIsPrintable;
+}
+
+static int confirmSyncPoint(InputFile const* input, int repairType, MetadataRuleTable const* metadataRules,
+			    unsigned long position) {
+  /* Check whether a walk from "position" finds 3 plausible NAL units - perhaps with blocks of
+     non-video data between them - without reaching anything that would end the walk: */
+  WalkChunk chunk;
+  NalWalk walk;
+  unsigned i;
+  int result;
+
+  initWalkChunk(&chunk, input, repairType, metadataRules, position, ~0UL, 1);
+  walk.ctx = NULL;
+  walk.input = &chunk.input;
+  walk.outputFID = NULL;
+  walk.chunk = &chunk;
+  walk.repairType = repairType;
+  walk.metadataRules = metadataRules;
+  walk.metadataIsPrintable = 1;
+  walk.stopOnAnomaly = 1; /* (skipping over anomalous bytes would not be 'plausible') */
+
+  for (i = 0; i < 16 && chunk.numRuns < 3 && !chunk.input.atEOF; ++i) {
+    if (!stepChunkWalk(&walk)) break;
+  }
+  result = chunk.numRuns >= 3 && !chunk.outOfMemory;
+  for (i = 0; i < chunk.numRuns && result; ++i) {
+    NalRun const* run = &chunk.runs[i];
+
+    result = run->size >= 2 && run->offset + run->size <= input->size
+      && isPlausibleNAL(input->data[run->offset], input->data[run->offset+1]);
+  }
+  freeWalkChunk(&chunk);
+  return result;
+}
+
+static unsigned long findSyncPoint(InputFile* input, int repairType, MetadataRuleTable const* metadataRules,
+				   unsigned long position, unsigned long limit) {
+  /* Return the first position in [position,limit) from which a walk appears to follow real
+     NAL units (or "limit", if there's no such position): */
+  unsigned long const to = input->size < 8 ? 0 : limit < input->size - 8 ? limit : input->size - 8;
+
+  while (position < to) {
+    unsigned long const scanEnd = scanEndBeforeHole(input, &position, to, 3); /* (as in "advanceToNalSizeCandidate()") */
+    int isCandidate;
+
+    position = findNalSizeCandidate(input->data, position, scanEnd);
+    if (position >= scanEnd) {
+      if (scanEnd < to) continue; /* we've reached a hole */
+      break;
+    }
+
+    if (repairType == 4) {
+      isCandidate = checkForVideoType4(bigEndian4(&input->data[position]), bigEndian4(&input->data[position+4]));
+    } else {
+      isCandidate = nalSizeLooksOK(input, position);
+    }
+    if (isCandidate && confirmSyncPoint(input, repairType, metadataRules, position)) return position;
+    ++position;
+  }
+  return limit;
+}
+
+static void* walkChunkThread(void* arg) {
+  WalkChunk* chunk = (WalkChunk*)arg;
+
+  if (chunk->needsSyncPoint) {
+    unsigned long limit = chunk->endPosition < chunk->input.size ? chunk->endPosition : chunk->input.size;
+
+    seekInputTo(&chunk->input, findSyncPoint(&chunk->input, chunk->repairType, chunk->metadataRules,
+					     chunk->input.pos, limit));
+  }
+  walkChunk(chunk, NULL);
+  return NULL;
+}
+
+/* Writing the NAL units that a walk found, preceded by 'start codes' (or, in an MP4 file, by
+   their sizes).  We don't copy the NAL units: each write is a list of pieces ("iovec"s) - our
+   'start code' (or a NAL unit's size), then the NAL unit itself, in the input file's data
+   (followed by 0xFF bytes, for any part of it after the end of the input file) - that
+   "writev()" (or "pwritev()") writes together: */
+#define FF_16 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF
+#define FF_256 FF_16, FF_16, FF_16, FF_16, FF_16, FF_16, FF_16, FF_16, FF_16, FF_16, FF_16, FF_16, FF_16, FF_16, FF_16, FF_16
+static unsigned char const missingBytes[4096] = { /* (constant, because writer threads share it) */
+  FF_256, FF_256, FF_256, FF_256, FF_256, FF_256, FF_256, FF_256, FF_256, FF_256, FF_256, FF_256, FF_256, FF_256, FF_256, FF_256
+};
+
+typedef struct RunWriter {
+  InputFile const* input;
+  int writeSizes; /* whether we precede each NAL unit by its size, rather than a 'start code' */
+  int fd; /* if >= 0, we write (using "pwritev()") at "offset"; otherwise to "outputFID" */
+  unsigned long offset;
+  FILE* outputFID;
+  struct iovec pieces[WRITE_IOV_COUNT];
+  unsigned numPieces;
+  unsigned char sizes[WRITE_IOV_COUNT/2][4]; /* (used if "writeSizes") */
+  unsigned numSizes;
+  int error; /* the "errno" of the first write that failed (0 if none) */
+} RunWriter;
+
+static void initRunWriter(RunWriter* w) {
+  w->numPieces = w->numSizes = 0;
+  w->error = 0;
+}
+
+static void flushRunWriter(RunWriter* w) {
+  struct iovec* piece = w->pieces;
+  unsigned numPieces = w->numPieces;
+
+  if (w->fd < 0) {
+    for (; numPieces > 0; ++piece, --numPieces) fwrite(piece->iov_base, 1, piece->iov_len, w->outputFID);
+  }
+  while (numPieces > 0 && w->error == 0) {
+#ifdef HAVE_PWRITEV
+    ssize_t numWritten = pwritev(w->fd, piece, numPieces, (off_t)w->offset);
+#else
+    ssize_t numWritten = pwrite(w->fd, piece->iov_base, piece->iov_len, (off_t)w->offset);
+#endif
+
+    if (numWritten < 0 && errno == EINTR) continue;
+    if (numWritten <= 0) {
+      w->error = numWritten < 0 && errno != 0 ? errno : EIO;
+      break;
+    }
+    w->offset += numWritten;
+
+    /* Move past what was written (which may have ended part-way through a piece): */
+    while (numPieces > 0 && (size_t)numWritten >= piece->iov_len) {
+      numWritten -= piece->iov_len;
+      ++piece;
+      --numPieces;
+    }
+    if (numWritten > 0) {
+      piece->iov_base = (char*)piece->iov_base + numWritten;
+      piece->iov_len -= numWritten;
+    }
+  }
+  w->numPieces = w->numSizes = 0;
+}
+
+static void addPiece(RunWriter* w, void const* from, unsigned long numBytes) {
+  if (w->numPieces == WRITE_IOV_COUNT) flushRunWriter(w);
+  w->pieces[w->numPieces].iov_base = (void*)from;
+  w->pieces[w->numPieces].iov_len = numBytes;
+  ++w->numPieces;
+}
+
+static void writeRuns(RunWriter* w, NalRun const* runs, unsigned numRuns) {
+  /* Write these NAL units exactly as "putNALUnitStart()" and "copyBytes()" would have done: */
+  unsigned long const inputSize = w->input->size;
+  unsigned i;
+
+  for (i = 0; i < numRuns; ++i) {
+    unsigned long numAvailable = runs[i].offset < inputSize ? inputSize - runs[i].offset : 0;
+    unsigned long numMissing;
+
+    if (numAvailable > runs[i].size) numAvailable = runs[i].size;
+    if (w->numPieces + 2 > WRITE_IOV_COUNT) flushRunWriter(w); /* (so that the NAL unit's size stays put) */
+    if (w->writeSizes) {
+      unsigned char* size = w->sizes[w->numSizes++];
+
+      size[0] = runs[i].size>>24; size[1] = runs[i].size>>16; size[2] = runs[i].size>>8; size[3] = runs[i].size;
+      addPiece(w, size, 4);
+    } else {
+      addPiece(w, startCode, 4);
+    }
+    if (numAvailable > 0) addPiece(w, &w->input->data[runs[i].offset], numAvailable);
+    for (numMissing = runs[i].size - numAvailable; numMissing > 0; ) {
+      unsigned long numToWrite = numMissing < sizeof missingBytes ? numMissing : sizeof missingBytes;
+
+      addPiece(w, missingBytes, numToWrite);
+      numMissing -= numToWrite;
+    }
+  }
+}
 
-    /* OK */
-    return 0;
-  } while (0);
+static void noteRuns(RepairContext* ctx, InputFile const* input, NalRun const* runs, unsigned numRuns) {
+  /* Tell the MP4 writer (if any), "--stats" and "--plan" (if used), about these NAL units, as
+     "putInputNALUnitStart()" would have done: */
+  unsigned i;
 
-  /* An error occurred: */
-  return 1;
+  for (i = 0; i < numRuns; ++i) {
+    unsigned char const* nal = runs[i].offset < input->size ? &input->data[runs[i].offset] : NULL;
+    unsigned long numAvailable = runs[i].offset < input->size ? input->size - runs[i].offset : 0;
+
+    countNALUnit(ctx->stats, nal, numAvailable);
+    if (ctx->mp4 != NULL) addMp4NALUnit(ctx->mp4, nal, numAvailable, runs[i].size);
+    planItem(ctx->plan, PLAN_ITEM_NAL_UNIT, runs[i].offset, runs[i].size);
+  }
 }
 
-static int get1Byte(FILE* fid, unsigned char* result) {
-  int fgetcResult;
+static unsigned long runsOutputSize(NalRun const* runs, unsigned numRuns) {
+  unsigned long size = 0;
+  unsigned i;
 
-  fgetcResult = fgetc(fid);
-  if (feof(fid) || ferror(fid)) return 0;
+  for (i = 0; i < numRuns; ++i) size += 4 + runs[i].size;
+  return size;
+}
 
-  *result = (unsigned char)fgetcResult;
-  return 1;
+static unsigned firstUsedRun(WalkChunk const* chunk) {
+  return chunk->firstUsedBoundary < chunk->numBoundaries
+    ? chunk->boundaries[chunk->firstUsedBoundary].numRuns : chunk->numRuns;
 }
 
-static int get2Bytes(FILE* fid, unsigned* result) {
-  unsigned char c1, c2;
+typedef struct ChunkWriteJob {
+  WalkChunk* chunk;
+  RunWriter writer;
+} ChunkWriteJob;
 
-  if (!get1Byte(fid, &c1)) return 0;
-  if (!get1Byte(fid, &c2)) return 0;
+static void* writeChunkThread(void* arg) {
+  /* Write the used part of a chunk (after its bridge, if any): */
+  ChunkWriteJob* job = (ChunkWriteJob*)arg;
+  WalkChunk* chunk = job->chunk;
 
-  *result = (c1<<8)|c2;
-  return 1;
+  if (chunk->bridge != NULL) writeRuns(&job->writer, chunk->bridge->runs, chunk->bridge->numRuns);
+  if (chunk->isUsed) {
+    unsigned first = firstUsedRun(chunk);
+
+    writeRuns(&job->writer, &chunk->runs[first], chunk->numRuns - first);
+  }
+  flushRunWriter(&job->writer);
+  return NULL;
 }
 
-static int get4Bytes(FILE* fid, unsigned* result) {
-  unsigned char c1, c2, c3, c4;
+static void printChunkEvents(RepairContext* ctx, WalkChunk const* chunk, unsigned firstBoundary) {
+  unsigned i;
 
-  if (!get1Byte(fid, &c1)) return 0;
-  if (!get1Byte(fid, &c2)) return 0;
-  if (!get1Byte(fid, &c3)) return 0;
-  if (!get1Byte(fid, &c4)) return 0;
+  for (i = 0; i < chunk->numEvents; ++i) {
+    WalkEvent const* event = &chunk->events[i];
 
-  *result = (c1<<24)|(c2<<16)|(c3<<8)|c4;
-  return 1;
+    if (event->boundary < firstBoundary) continue;
+    if (event->kind == WALK_EVENT_BLOCK) {
+      countSkippedBlock(ctx->stats, event->nalSize, event->numBytes);
+      planItem(ctx->plan, (int)event->nalSize, event->position, event->numBytes);
+    } else {
+      printWalkEvent(ctx, event->kind, event->position, event->nalSize);
+    }
+  }
 }
 
-static int checkAtom(FILE* fid, unsigned fourccToCheck, unsigned* numRemainingBytesToSkip) {
-  do {
-    unsigned atomSize, fourcc;
+static unsigned long parallelWalkPausePosition(RepairContext* ctx, unsigned long pausePosition) {
+  /* With "--max-memory", walk in parallel only as much of the file as the index of its NAL units
+     will (probably) fit in what's left of the memory.  (If it doesn't, that part of the file is
+     walked serially instead.) */
+  unsigned long const memoryLeft = ctx->memory.limit - ctx->memory.used;
+  unsigned long const pos = ctx->input.pos;
+  unsigned long segmentSize;
+
+  if (ctx->memory.limit == 0 || memoryLeft >= ~0UL/WALK_BYTES_PER_INDEX_BYTE) return pausePosition;
+  segmentSize = memoryLeft*WALK_BYTES_PER_INDEX_BYTE;
+  if (segmentSize/ctx->numThreads < MIN_WALK_CHUNK_SIZE || segmentSize >= pausePosition - pos) return pausePosition;
+  return pos + segmentSize;
+}
 
-    if (!get4Bytes(fid, &atomSize)) break;
+static int walkInParallel(NalWalk* walk, unsigned long pausePosition) {
+  /* Do the walk of "walkNALUnits()" using "walk->ctx->numThreads" threads - pausing (as a serial
+     walk would) at the first step that begins at or after "pausePosition".  Returns 0 - having
+     done nothing - if we can't (e.g., if the file is too small to be worth it, or we run out of
+     memory, or it's a stream, so we don't have all of it), in which case the caller should do
+     the walk serially: */
+  InputFile* input = walk->input;
+  unsigned long const startPosition = input->pos;
+  unsigned long const endPosition = pausePosition < input->size ? pausePosition : input->size;
+  unsigned long entryPosition, outputOffset;
+  unsigned numChunks = walk->ctx->numThreads, k;
+  WalkChunk* chunks;
+  ChunkWriteJob* jobs;
+  pthread_t* threads;
+  int* threadIsRunning;
+  InputFile const* finalInput = NULL;
+  int entryIsPrintable, stopped, result = 0;
+  long long base;
+  unsigned long memoryShare, memoryUsed = 0;
+
+  if (input->stream != NULL || startPosition >= endPosition) return 0;
+  if ((endPosition - startPosition)/numChunks < MIN_WALK_CHUNK_SIZE) {
+    numChunks = (endPosition - startPosition)/MIN_WALK_CHUNK_SIZE;
+  }
+  if (numChunks < 2) return 0;
 
-    if (!get4Bytes(fid, &fourcc) || fourcc != fourccToCheck) break;
-    
-    /* For 'mdat' atoms, ignore the size, because we don't use it: */
-    if (fourcc == fourcc_mdat) return 1;
+  /* Each part's walk - and the serial walk that may come before it (its 'bridge') - gets an
+     equal share of what's left of the repair's memory: */
+  memoryShare = (walk->ctx->memory.limit == 0 ? ~0UL : walk->ctx->memory.limit - walk->ctx->memory.used)/(2*numChunks);
+  if (memoryShare == 0) return 0;
 
-    if (atomSize == 1) {
-      fprintf(stderr, "Saw an extended (64-bit) atom size.  We currently don't handle this!\n");
-      exit(1);
+  chunks = calloc(numChunks, sizeof chunks[0]);
+  jobs = calloc(numChunks, sizeof jobs[0]);
+  threads = calloc(numChunks, sizeof threads[0]);
+  threadIsRunning = calloc(numChunks, sizeof threadIsRunning[0]);
+  do {
+    if (chunks == NULL || jobs == NULL || threads == NULL || threadIsRunning == NULL) break;
+
+    /* Walk each part of the file (the last part extends to the end of the file, or to where we
+       pause): */
+    for (k = 0; k < numChunks; ++k) {
+      unsigned long chunkStart = startPosition + (endPosition - startPosition)/numChunks*k;
+      unsigned long chunkEnd = k == numChunks-1 ? (pausePosition < input->size ? pausePosition : ~0UL)
+	: startPosition + (endPosition - startPosition)/numChunks*(k+1);
+
+      initWalkChunk(&chunks[k], input, walk->repairType, walk->metadataRules, chunkStart, chunkEnd,
+		    k == 0 ? walk->metadataIsPrintable : 1);
+      chunks[k].memory.limit = memoryShare;
+      chunks[k].stopOnAnomaly = walk->stopOnAnomaly;
+      chunks[k].needsSyncPoint = k > 0;
+      chunks[k].countsBlocks = walk->ctx->stats != NULL || walk->ctx->plan != NULL;
+    }
+    for (k = 0; k < numChunks; ++k) {
+      threadIsRunning[k] = pthread_create(&threads[k], NULL, walkChunkThread, &chunks[k]) == 0;
+      if (!threadIsRunning[k]) walkChunkThread(&chunks[k]);
+    }
+    for (k = 0; k < numChunks; ++k) {
+      if (threadIsRunning[k]) pthread_join(threads[k], NULL);
+      noteProgressAt(walk->ctx, chunks[k].input.pos);
+    }
+    for (k = 0; k < numChunks; ++k) {
+      if (chunks[k].outOfMemory) break;
+    }
+    if (k < numChunks) break;
+
+    /* Stitch the parts together: */
+    entryPosition = startPosition;
+    entryIsPrintable = walk->metadataIsPrintable;
+    stopped = 0;
+    for (k = 0; k < numChunks && !stopped; ++k) {
+      WalkChunk* chunk = &chunks[k];
+      unsigned first;
+
+      if (!findMatchingBoundary(chunk, entryPosition, entryIsPrintable, &first)) {
+	/* The previous walk didn't arrive at a boundary of this one, so walk serially from
+	   where it did arrive, until it does (or until the end of this part): */
+	WalkChunk* bridge = malloc(sizeof *bridge);
+
+	if (bridge == NULL) break;
+	initWalkChunk(bridge, input, walk->repairType, walk->metadataRules, entryPosition, chunk->endPosition,
+		      entryIsPrintable);
+	bridge->memory.limit = memoryShare;
+	bridge->stopOnAnomaly = walk->stopOnAnomaly;
+	bridge->countsBlocks = walk->ctx->stats != NULL || walk->ctx->plan != NULL;
+	chunk->bridge = bridge;
+	walkChunk(bridge, chunk);
+	if (bridge->outOfMemory) break;
+
+	entryIsPrintable = bridge->exitIsPrintable;
+	if (!bridge->converged) {
+	  entryPosition = bridge->input.pos;
+	  stopped = bridge->stopped;
+	  finalInput = &bridge->input;
+	  continue;
+	}
+	first = bridge->convergedBoundary;
+      }
+      chunk->isUsed = 1;
+      chunk->firstUsedBoundary = first;
+      entryIsPrintable = entryIsPrintable && chunk->exitIsPrintable;
+      entryPosition = chunk->input.pos;
+      stopped = chunk->stopped;
+      finalInput = &chunk->input;
     }
+    if (!stopped && (k < numChunks || pausePosition >= input->size)) break; /* we ran out of memory */
 
-    /* Check the atom size.  It should be >= 8. */
-    if (atomSize < 8) break;
-    *numRemainingBytesToSkip = atomSize - 8;
+    /* (What the parts' walks used now counts against the repair's memory, until we're done:) */
+    for (k = 0; k < numChunks; ++k) {
+      memoryUsed += chunks[k].memory.used;
+      if (chunks[k].bridge != NULL) memoryUsed += chunks[k].bridge->memory.used;
+    }
+    walk->ctx->memory.used += memoryUsed;
 
-    return 1;
+    /* Now that we know which steps were really part of the walk, tell the user what they saw: */
+    for (k = 0; k < numChunks; ++k) {
+      if (chunks[k].bridge != NULL) printChunkEvents(walk->ctx, chunks[k].bridge, 0);
+      if (chunks[k].isUsed) printChunkEvents(walk->ctx, &chunks[k], chunks[k].firstUsedBoundary);
+    }
+
+    /* (If we're writing an MP4 file, its index needs the NAL units in order - as do "--stats",
+       which counts them, and "--plan":) */
+    if (walk->ctx->mp4 != NULL || walk->ctx->stats != NULL || walk->ctx->plan != NULL) {
+      for (k = 0; k < numChunks; ++k) {
+	WalkChunk* chunk = &chunks[k];
+
+	if (chunk->bridge != NULL) noteRuns(walk->ctx, input, chunk->bridge->runs, chunk->bridge->numRuns);
+	if (chunk->isUsed) {
+	  noteRuns(walk->ctx, input, &chunk->runs[firstUsedRun(chunk)], chunk->numRuns - firstUsedRun(chunk));
+	}
+      }
+    }
+
+    /* Write the parts of the repaired file.  (If the output can't be written at an offset, we
+       write them in order instead.) */
+    fflush(walk->outputFID);
+    base = tellOutput(walk->outputFID);
+    outputOffset = base;
+    for (k = 0; k < numChunks; ++k) {
+      WalkChunk* chunk = &chunks[k];
+      unsigned long size = 0;
+
+      if (chunk->bridge != NULL) size += runsOutputSize(chunk->bridge->runs, chunk->bridge->numRuns);
+      if (chunk->isUsed) size += runsOutputSize(&chunk->runs[firstUsedRun(chunk)], chunk->numRuns - firstUsedRun(chunk));
+
+      jobs[k].chunk = chunk;
+      jobs[k].writer.input = input;
+      jobs[k].writer.writeSizes = walk->ctx->mp4 != NULL;
+      jobs[k].writer.fd = base < 0 ? -1 : fileno(walk->outputFID);
+      jobs[k].writer.offset = outputOffset;
+      jobs[k].writer.outputFID = walk->outputFID;
+      initRunWriter(&jobs[k].writer); /* (before any writer thread runs) */
+      outputOffset += size;
+    }
+    for (k = 0; k < numChunks; ++k) {
+      threadIsRunning[k] = base >= 0 && pthread_create(&threads[k], NULL, writeChunkThread, &jobs[k]) == 0;
+      if (!threadIsRunning[k]) writeChunkThread(&jobs[k]);
+    }
+    for (k = 0; k < numChunks; ++k) {
+      if (threadIsRunning[k]) pthread_join(threads[k], NULL);
+    }
+    for (k = 0; k < numChunks; ++k) {
+      if (jobs[k].writer.error != 0) {
+	fprintf(walk->ctx->log, "Failed to write the repaired file: %s\n", strerror(jobs[k].writer.error));
+	walk->ctx->outputFailed = 1;
+	stopped = 1;
+	break;
+      }
+    }
+    if (base >= 0) seekOutputTo(walk->outputFID, outputOffset);
+
+    /* Leave the input file, and the walk, as a serial walk would have: */
+    input->pos = finalInput->pos;
+    input->atEOF = finalInput->atEOF;
+    walk->metadataIsPrintable = entryIsPrintable;
+    walk->ended = stopped;
+    result = 1;
   } while (0);
 
-  /* An error occurred. Rewind over the bytes that we read (assuming we read all 8): */
-  if (fseek(fid, -8, SEEK_CUR) != 0) {
-    fprintf(stderr, "Failed to rewind 8 bytes.%s\n", cantRepair);
+  giveBackMemory(&walk->ctx->memory, memoryUsed);
+  if (chunks != NULL) {
+    for (k = 0; k < numChunks; ++k) freeWalkChunk(&chunks[k]);
   }
-  return 0;
+  free(chunks);
+  free(jobs);
+  free(threads);
+  free(threadIsRunning);
+  return result;
 }
 
-static void doRepairType1(FILE* inputFID, FILE* outputFID, unsigned ftypSize) {
-  fprintf(stderr, "%s", startingToRepair);
-
-  /* Begin the repair by writing the header for the initial 'ftype' atom: */
-  fputc(ftypSize>>24, outputFID);
-  fputc(ftypSize>>16, outputFID);
-  fputc(ftypSize>>8, outputFID);
-  fputc(ftypSize, outputFID);
-
-  fputc('f', outputFID); fputc('t', outputFID); fputc('y', outputFID); fputc('p', outputFID);
+#endif
 
-  /* Then complete the repair by copying from the input file to the output file: */
-  {
-    unsigned char c;
+/* Writing the repaired file 'behind' a serial walk ("--queue-depth").
+
+   Otherwise, a serial walk takes turns at parsing the input file (waiting, if need be, for it
+   to be read) and writing the repaired file (waiting, if need be, for that to be written).
+   Instead, "emitNALUnit()" hands each NAL unit to a queue: a ring of blocks, each listing (as
+   the parts of a parallel walk do) the NAL units that make up the next "WRITE_BEHIND_BLOCK_SIZE"
+   bytes of the repaired file.  Once a block is full, one of "queueDepth" writer threads writes
+   it - at its own offset, straight from the input file's data, as a parallel walk does - while
+   the walk goes on to fill the next block.  Each time we queue a block, we also ask for the
+   input file's data that the walk will soon reach to be read ahead.  The walk waits only if
+   every block is still being written.
+*/
 
-    while (get1Byte(inputFID, &c)) fputc(c, outputFID);
+#ifdef HAVE_PTHREADS
+
+#define WRITE_BEHIND_BLOCK_SIZE (4*1024*1024) /* (as "usage()" says) */
+
+typedef struct WriteBehindBlock {
+  NalRun* runs;
+  unsigned numRuns, maxNumRuns;
+  unsigned long size; /* of the part of the repaired file that "runs" make up */
+  RunWriter writer;
+  int isBusy; /* queued, or being written */
+} WriteBehindBlock;
+
+typedef struct WriteBehind {
+  RepairContext* ctx;
+  WriteBehindBlock* blocks; /* the one that the walk is filling is "blocks[numQueued%numBlocks]" */
+  unsigned numBlocks;
+  unsigned long numQueued, numTaken; /* (by the writer threads, which take blocks in order) */
+  unsigned long offset; /* where (in the output file) the block that the walk is filling goes */
+  unsigned long readAheadPosition; /* how far we've asked for the input file to be read ahead */
+  pthread_t* threads;
+  unsigned numThreads;
+  pthread_mutex_t mutex; /* protects "numQueued", "numTaken", each "isBusy", "isEnding", and "error" */
+  pthread_cond_t changed; /* signaled when a block is queued, or written (or when we're ending) */
+  int isEnding;
+  int error; /* the "errno" of the first write that failed (0 if none) */
+} WriteBehind;
+
+static void* writeBehindThread(void* arg) {
+  WriteBehind* wb = (WriteBehind*)arg;
+
+  pthread_mutex_lock(&wb->mutex);
+  while (1) {
+    WriteBehindBlock* block;
+
+    while (wb->numTaken == wb->numQueued && !wb->isEnding) pthread_cond_wait(&wb->changed, &wb->mutex);
+    if (wb->numTaken == wb->numQueued) break; /* we're ending, and every block has been taken */
+    block = &wb->blocks[wb->numTaken++ % wb->numBlocks];
+    pthread_mutex_unlock(&wb->mutex);
+
+    writeRuns(&block->writer, block->runs, block->numRuns);
+    flushRunWriter(&block->writer);
+
+    pthread_mutex_lock(&wb->mutex);
+    if (block->writer.error != 0 && wb->error == 0) wb->error = block->writer.error;
+    block->isBusy = 0;
+    pthread_cond_broadcast(&wb->changed);
   }
+  pthread_mutex_unlock(&wb->mutex);
+  return NULL;
 }
 
-#define wr(c) fputc((c), outputFID)
+static void readAheadInput(WriteBehind* wb) {
+  /* Ask for the next "queueDepth" blocks' worth of the input file (after the walk's position)
+     to be read, while we go on: */
+  InputFile const* input = &wb->ctx->input;
+  unsigned long const want = input->pos + (unsigned long)wb->numThreads*WRITE_BEHIND_BLOCK_SIZE;
+  unsigned long const to = want < input->size ? want : input->size;
+  unsigned long const from = wb->readAheadPosition > input->pos ? wb->readAheadPosition : input->pos;
+
+  if (from >= to) return;
+#if defined(HAVE_MMAP) && defined(POSIX_FADV_WILLNEED)
+  if (input->isMapped) posix_fadvise(input->fd, (off_t)from, (off_t)(to - from), POSIX_FADV_WILLNEED);
+#endif
+  wb->readAheadPosition = to;
+}
 
-static void putStartCode(FILE* outputFID) {
-  wr(0x00); wr(0x00); wr(0x00); wr(0x01);
+static void queueWriteBehindBlock(WriteBehind* wb) {
+  /* Hand the block that the walk has been filling to the writer threads; then wait (if need
+     be) until the next block has been written, so that the walk can fill it: */
+  WriteBehindBlock* block = &wb->blocks[wb->numQueued % wb->numBlocks];
+
+  wb->offset += block->size;
+  pthread_mutex_lock(&wb->mutex);
+  block->isBusy = 1;
+  ++wb->numQueued;
+  pthread_cond_broadcast(&wb->changed);
+  block = &wb->blocks[wb->numQueued % wb->numBlocks];
+  while (block->isBusy) pthread_cond_wait(&wb->changed, &wb->mutex);
+  pthread_mutex_unlock(&wb->mutex);
+
+  block->numRuns = 0;
+  block->size = 0;
+  block->writer.offset = wb->offset;
+  readAheadInput(wb);
 }
 
-static unsigned char SPS_2160p30[] = { 0x27, 0x64, 0x00, 0x33, 0xac, 0x34, 0xc8, 0x03, 0xc0, 0x04, 0x3e, 0xc0, 0x5a, 0x80, 0x80, 0x80, 0xa0, 0x00, 0x00, 0x7d, 0x20, 0x00, 0x1d, 0x4c, 0x1d, 0x0c, 0x00, 0x07, 0x27, 0x08, 0x00, 0x01, 0xc9, 0xc3, 0x97, 0x79, 0x71, 0xa1, 0x80, 0x00, 0xe4, 0xe1, 0x00, 0x00, 0x39, 0x38, 0x72, 0xef, 0x2e, 0x1f, 0x08, 0x84, 0x53, 0x80, 0xfe };
-/* The following was used in an earlier version of the software, but does not appear to be correct:
-static unsigned char SPS_2160p25[] = { 0x27, 0x64, 0x00, 0x33, 0xac, 0x34, 0xc8, 0x01, 0x00, 0x01, 0x0f, 0xb0, 0x16, 0xa0, 0x20, 0x20, 0x28, 0x00, 0x00, 0x1f, 0x40, 0x00, 0x06, 0x1a, 0x87, 0x43, 0x00, 0x01, 0xc9, 0xc2, 0x00, 0x00, 0x72, 0x70, 0xe5, 0xde, 0x5c, 0x68, 0x60, 0x00, 0x39, 0x38, 0x40, 0x00, 0x0e, 0x4e, 0x1c, 0xbb, 0xcb, 0x87, 0xc2, 0x21, 0x14, 0xe0, 0xfe };
-*/
-static unsigned char SPS_2160x4096p25[] = { 0x27, 0x64, 0x00, 0x33, 0xac, 0x34, 0xc8, 0x01, 0x00, 0x01, 0x0f, 0xb0, 0x16, 0xa0, 0x20, 0x20, 0x28, 0x00, 0x00, 0x1f, 0x40, 0x00, 0x06, 0x1a, 0x87, 0x43, 0x00, 0x01, 0xc9, 0xc2, 0x00, 0x00, 0x72, 0x70, 0xe5, 0xde, 0x5c, 0x68, 0x60, 0x00, 0x39, 0x38, 0x40, 0x00, 0x0e, 0x4e, 0x1c, 0xbb, 0xcb, 0x87, 0xc2, 0x21, 0x14, 0xe0, 0xfe }; 
-static unsigned char SPS_2160x3840p25[] = { 0x27, 0x64, 0x00, 0x33, 0xac, 0x34, 0xc8, 0x03, 0xc0, 0x04, 0x3e, 0xc0, 0x5a, 0x80, 0x80, 0x80, 0xa0, 0x00, 0x00, 0x7d, 0x00, 0x00, 0x18, 0x6a, 0x1d, 0x0c, 0x00, 0x07, 0x27, 0x08, 0x00, 0x01, 0xc9, 0xc3, 0x97, 0x79, 0x71, 0xa1, 0x80, 0x00, 0xe4, 0xe1, 0x00, 0x00, 0x39, 0x38, 0x72, 0xef, 0x2e, 0x1f, 0x08, 0x84, 0x53, 0x80, 0xfe };
-static unsigned char SPS_2160x4096p24[] = { 0x27, 0x64, 0x00, 0x33, 0xac, 0x34, 0xc8, 0x01, 0x00, 0x01, 0x0f, 0xb0, 0x16, 0xa0, 0x20, 0x20, 0x28, 0x00, 0x00, 0x1f, 0x48, 0x00, 0x05, 0xdc, 0x07, 0x43, 0x00, 0x01, 0xc9, 0xc2, 0x00, 0x00, 0x72, 0x70, 0xe5, 0xde, 0x5c, 0x68, 0x60, 0x00, 0x39, 0x38, 0x40, 0x00, 0x0e, 0x4e, 0x1c, 0xbb, 0xfe };
-static unsigned char SPS_2160x3840p24[] = { 0x27, 0x64, 0x00, 0x33, 0xac, 0x34, 0xc8, 0x03, 0xc0, 0x04, 0x3e, 0xc0, 0x5a, 0x80, 0x80, 0x80, 0xa0, 0x00, 0x00, 0x7d, 0x20, 0x00, 0x17, 0x70, 0x1d, 0x0c, 0x00, 0x07, 0x27, 0x08, 0x00, 0x01, 0xc9, 0xc3, 0x97, 0x79, 0x71, 0xa1, 0x80, 0x00, 0xe4, 0xe1, 0x00, 0x00, 0x39, 0x38, 0x72, 0xef, 0x2e, 0x1f, 0x08, 0x84, 0x53, 0x80, 0xfe };
-static unsigned char SPS_1530p30[] = { 0x27, 0x64, 0x00, 0x29, 0xac, 0x34, 0xc8, 0x02, 0xa8, 0x0c, 0x1b, 0x01, 0x6a, 0x02, 0x02, 0x02, 0x80, 0x00, 0x01, 0xf4, 0x80, 0x00, 0x75, 0x30, 0x74, 0x30, 0x00, 0x15, 0x75, 0x20, 0x00, 0x05, 0x5d, 0x4a, 0x5d, 0xe5, 0xc6, 0x86, 0x00, 0x02, 0xae, 0xa4, 0x00, 0x00, 0xab, 0xa9, 0x4b, 0xbc, 0xb8, 0x7c, 0x22, 0x11, 0x4e, 0x00, 0x00, 0x00, 0xfe };
-static unsigned char SPS_1530p25[] = { 0x27, 0x64, 0x00, 0x32, 0xac, 0x34, 0xc8, 0x02, 0xa8, 0x0c, 0x1b, 0x01, 0x6a, 0x02, 0x02, 0x02, 0x80, 0x00, 0x01, 0xf4, 0x00, 0x00, 0x61, 0xa8, 0x74, 0x30, 0x00, 0x15, 0x75, 0x20, 0x00, 0x05, 0x5d, 0x4a, 0x5d, 0xe5, 0xc6, 0x86, 0x00, 0x02, 0xae, 0xa4, 0x00, 0x00, 0xab, 0xa9, 0x4b, 0xbc, 0xb8, 0x7c, 0x22, 0x11, 0x4e, 0xfe };
-static unsigned char SPS_1530p24[] = { 0x27, 0x64, 0x00, 0x32, 0xac, 0x34, 0xc8, 0x02, 0xa8, 0x0c, 0x1b, 0x01, 0x6a, 0x02, 0x02, 0x02, 0x80, 0x00, 0x01, 0xf4, 0x80, 0x00, 0x5d, 0xc0, 0x74, 0x30, 0x00, 0x15, 0x75, 0x20, 0x00, 0x05, 0x5d, 0x4a, 0x5d, 0xe5, 0xc6, 0x86, 0x00, 0x02, 0xae, 0xa4, 0x00, 0x00, 0xab, 0xa9, 0x4b, 0xbc, 0xb8, 0x7c, 0x22, 0x11, 0x4e, 0xfe };
-static unsigned char SPS_1520p60[] = { 0x27, 0x64, 0x00, 0x2a, 0xac, 0x34, 0xc8, 0x02, 0xa4, 0x0b, 0xfb, 0x01, 0x6e, 0x02, 0x02, 0x02, 0x80, 0x00, 0x01, 0xf4, 0x80, 0x00, 0xea, 0x60, 0x74, 0x30, 0x00, 0x15, 0x75, 0x20, 0x00, 0x05, 0x5d, 0x4a, 0x5d, 0xe5, 0xc6, 0x86, 0x00, 0x02, 0xae, 0xa4, 0x00, 0x00, 0xab, 0xa9, 0x4b, 0xbc, 0xb8, 0x7c, 0x22, 0x11, 0x4e, 0x00, 0x00, 0x00, 0xfe };
-static unsigned char SPS_1520p30[] = { 0x27, 0x64, 0x00, 0x29, 0xac, 0x34, 0xc8, 0x02, 0xa4, 0x0b, 0xfb, 0x01, 0x6a, 0x02, 0x02, 0x02, 0x80, 0x00, 0x01, 0xf4, 0x80, 0x00, 0x75, 0x30, 0x74, 0x30, 0x00, 0x13, 0x12, 0xc0, 0x00, 0x04, 0xc4, 0xb4, 0x5d, 0xe5, 0xc6, 0x86, 0x00, 0x02, 0x62, 0x58, 0x00, 0x00, 0x98, 0x96, 0x8b, 0xbc, 0xb8, 0x7c, 0x22, 0x11, 0x4e, 0x00, 0x00, 0x00, 0xfe };
-static unsigned char SPS_1520p25[] = { 0x27, 0x64, 0x00, 0x29, 0xac, 0x34, 0xc8, 0x02, 0xa4, 0x0b, 0xfb, 0x01, 0x6a, 0x02, 0x02, 0x02, 0x80, 0x00, 0x00, 0x03, 0x00, 0x80, 0x00, 0x00, 0x19, 0x74, 0x30, 0x00, 0x13, 0x12, 0xc0, 0x00, 0x04, 0xc4, 0xb4, 0x5d, 0xe5, 0xc6, 0x86, 0x00, 0x02, 0x62, 0x58, 0x00, 0x00, 0x98, 0x96, 0x8b, 0xbc, 0xb8, 0x7c, 0x22, 0x11, 0x4e, 0xfe };
-static unsigned char SPS_1520p24[] = { 0x27, 0x64, 0x00, 0x29, 0xac, 0x34, 0xc8, 0x02, 0xa4, 0x0b, 0xfb, 0x01, 0x6a, 0x02, 0x02, 0x02, 0x80, 0x00, 0x01, 0xf4, 0x80, 0x00, 0x5d, 0xc0, 0x74, 0x30, 0x00, 0x15, 0x75, 0x20, 0x00, 0x05, 0x5d, 0x4a, 0x5d, 0xe5, 0xc6, 0x86, 0x00, 0x02, 0xae, 0xa4, 0x00, 0x00, 0xab, 0xa9, 0x4b, 0xbc, 0xb8, 0x7c, 0x22, 0x11, 0x4e, 0x00, 0x00, 0x00, 0xfe };
-static unsigned char SPS_1080p60[] = { 0x27, 0x64, 0x00, 0x2a, 0xac, 0x34, 0xc8, 0x07, 0x80, 0x22, 0x7e, 0x5c, 0x05, 0xa8, 0x08, 0x08, 0x0a, 0x00, 0x00, 0x07, 0xd2, 0x00, 0x03, 0xa9, 0x81, 0xd0, 0xc0, 0x00, 0x4c, 0x4b, 0x00, 0x00, 0x13, 0x12, 0xd1, 0x77, 0x97, 0x1a, 0x18, 0x00, 0x09, 0x89, 0x60, 0x00, 0x02, 0x62, 0x5a, 0x2e, 0xf2, 0xe1, 0xf0, 0x88, 0x45, 0x16, 0xfe };
-static unsigned char SPS_1080i60[] = { 0x27, 0x4d, 0x00, 0x2a, 0x9a, 0x66, 0x03, 0xc0, 0x22, 0x3e, 0xf0, 0x16, 0xc8, 0x00, 0x00, 0x1f, 0x48, 0x00, 0x07, 0x53, 0x07, 0x43, 0x00, 0x02, 0x36, 0x78, 0x00, 0x02, 0x36, 0x78, 0x5d, 0xe5, 0xc6, 0x86, 0x00, 0x04, 0x6c, 0xf0, 0x00, 0x04, 0x6c, 0xf0, 0xbb, 0xcb, 0x87, 0xc2, 0x21, 0x14, 0x58, 0xfe };
-static unsigned char SPS_1080p50[] = { 0x27, 0x64, 0x00, 0x29, 0xac, 0x34, 0xc8, 0x07, 0x80, 0x22, 0x7e, 0x5c, 0x05, 0xa8, 0x08, 0x08, 0x0a, 0x00, 0x00, 0x07, 0xd0, 0x00, 0x03, 0x0d, 0x41, 0xd0, 0xc0, 0x00, 0x4c, 0x4b, 0x00, 0x00, 0x13, 0x12, 0xd1, 0x77, 0x97, 0x1a, 0x18, 0x00, 0x09, 0x89, 0x60, 0x00, 0x02, 0x62, 0x5a, 0x2e, 0xf2, 0xe1, 0xf0, 0x88, 0x45, 0x16, 0xfe };
-static unsigned char SPS_1080p48[] = { 0x27, 0x64, 0x00, 0x2a, 0xac, 0x34, 0xc8, 0x07, 0x80, 0x22, 0x7e, 0x5c, 0x05, 0xa8, 0x08, 0x08, 0x0a, 0x00, 0x00, 0x07, 0xd2, 0x00, 0x02, 0xee, 0x01, 0xd0, 0xc0, 0x00, 0x4c, 0x4b, 0x00, 0x00, 0x13, 0x12, 0xd1, 0x77, 0x97, 0x1a, 0x18, 0x00, 0x09, 0x89, 0x60, 0x00, 0x02, 0x62, 0x5a, 0x2e, 0xf2, 0xe1, 0xf0, 0x88, 0x45, 0x16, 0xfe };
-/* Old format; assume no longer used:
-static unsigned char SPS_1080p30_default[] = { 0x27, 0x4d, 0x00, 0x28, 0x9a, 0x66, 0x03, 0xc0, 0x11, 0x3f, 0x2e, 0x02, 0xd9, 0x00, 0x00, 0x03, 0x03, 0xe9, 0x00, 0x00, 0xea, 0x60, 0xe8, 0x60, 0x00, 0xe2, 0x98, 0x00, 0x03, 0x8a, 0x60, 0xbb, 0xcb, 0x8d, 0x0c, 0x00, 0x1c, 0x53, 0x00, 0x00, 0x71, 0x4c, 0x17, 0x79, 0x70, 0xf8, 0x44, 0x22, 0x8b, 0xfe };
-*/
-static unsigned char SPS_1080p30_default[] = { 0x67, 0x4d, 0x00, 0x1f, 0x93, 0x28, 0x08, 0x00, 0x93, 0x7f, 0xe0, 0x00, 0x20, 0x00, 0x28, 0x10, 0x00, 0x00, 0x03, 0x00, 0x10, 0x00, 0x00, 0x03, 0x03, 0xc8, 0xda, 0x08, 0x84, 0x65, 0x80, 0xfe };
-static unsigned char SPS_1080p30_advanced[] = { 0x27, 0x64, 0x00, 0x29, 0xac, 0x34, 0xc8, 0x07, 0x80, 0x22, 0x7e, 0x5c, 0x05, 0xa8, 0x08, 0x08, 0x0a, 0x00, 0x00, 0x07, 0xd2, 0x00, 0x01, 0xd4, 0xc1, 0xd0, 0xc0, 0x00, 0x4c, 0x4b, 0x00, 0x00, 0x13, 0x12, 0xd1, 0x77, 0x97, 0x1a, 0x18, 0x00, 0x09, 0x89, 0x60, 0x00, 0x02, 0x62, 0x5a, 0x2e, 0xf2, 0xe1, 0xf0, 0x88, 0x45, 0x16, 0xfe };
-static unsigned char SPS_1080p25[] = { 0x27, 0x4d, 0x00, 0x28, 0x9a, 0x66, 0x03, 0xc0, 0x11, 0x3f, 0x2e, 0x02, 0xd9, 0x00, 0x00, 0x03, 0x03, 0xe8, 0x00, 0x00, 0xc3, 0x50, 0xe8, 0x60, 0x00, 0xdc, 0xf0, 0x00, 0x03, 0x73, 0xb8, 0xbb, 0xcb, 0x8d, 0x0c, 0x00, 0x1b, 0x9e, 0x00, 0x00, 0x6e, 0x77, 0x17, 0x79, 0x70, 0xf8, 0x44, 0x22, 0x8b, 0xfe };
-static unsigned char SPS_1080p24[] = { 0x27, 0x64, 0x00, 0x29, 0xac, 0x34, 0xc8, 0x07, 0x80, 0x22, 0x7e, 0x5c, 0x05, 0xa8, 0x08, 0x08, 0x0a, 0x00, 0x00, 0x07, 0xd2, 0x00, 0x01, 0x77, 0x01, 0xd0, 0xc0, 0x00, 0xbe, 0xbc, 0x00, 0x00, 0xbe, 0xbc, 0x17, 0x79, 0x71, 0xa1, 0x80, 0x01, 0x7d, 0x78, 0x00, 0x01, 0x7d, 0x78, 0x2e, 0xf2, 0xe1, 0xf0, 0x88, 0x45, 0x16, 0x00, 0x00, 0x00, 0xfe };
-static unsigned char SPS_720p60_default[] = { 0x27, 0x4d, 0x00, 0x20, 0x9a, 0x66, 0x02, 0x80, 0x2d, 0xd8, 0x0b, 0x64, 0x00, 0x00, 0x0f, 0xa4, 0x00, 0x07, 0x53, 0x03, 0xa1, 0x80, 0x03, 0x8a, 0x60, 0x00, 0x0e, 0x29, 0x82, 0xef, 0x2e, 0x34, 0x30, 0x00, 0x71, 0x4c, 0x00, 0x01, 0xc5, 0x30, 0x5d, 0xe5, 0xc3, 0xe1, 0x10, 0x8a, 0x34, 0xfe };
-static unsigned char SPS_720p60_advanced[] = { 0x27, 0x64, 0x00, 0x28, 0xac, 0x34, 0xc8, 0x05, 0x00, 0x5b, 0xb0, 0x16, 0xa0, 0x20, 0x20, 0x28, 0x00, 0x00, 0x1f, 0x48, 0x00, 0x0e, 0xa6, 0x07, 0x43, 0x00, 0x02, 0x62, 0x58, 0x00, 0x02, 0x62, 0x5a, 0x5d, 0xe5, 0xc6, 0x86, 0x00, 0x04, 0xc4, 0xb0, 0x00, 0x04, 0xc4, 0xb4, 0xbb, 0xcb, 0x87, 0xc2, 0x21, 0x14, 0x78, 0xfe };
-static unsigned char SPS_720p50[] = { 0x27, 0x64, 0x00, 0x29, 0xac, 0x34, 0xc8, 0x05, 0x00, 0x5b, 0xb0, 0x16, 0xa0, 0x20, 0x20, 0x28, 0x00, 0x00, 0x1f, 0x40, 0x00, 0x0c, 0x35, 0x07, 0x43, 0x00, 0x07, 0xa1, 0x20, 0x00, 0x1e, 0x84, 0x85, 0xde, 0x5c, 0x68, 0x60, 0x00, 0xf4, 0x24, 0x00, 0x03, 0xd0, 0x90, 0xbb, 0xcb, 0x87, 0xc2, 0x21, 0x14, 0x78, 0xfe };
-static unsigned char SPS_720p48[] = { 0x27, 0x64, 0x00, 0x28, 0xac, 0x34, 0xc8, 0x05, 0x00, 0x5b, 0xb0, 0x16, 0xa0, 0x20, 0x20, 0x28, 0x00, 0x00, 0x1f, 0x48, 0x00, 0x0b, 0xb8, 0x07, 0x43, 0x00, 0x07, 0xa1, 0x20, 0x00, 0x1e, 0x84, 0x85, 0xde, 0x5c, 0x68, 0x60, 0x00, 0xf4, 0x24, 0x00, 0x03, 0xd0, 0x90, 0xbb, 0xcb, 0x87, 0xc2, 0x21, 0x14, 0x78, 0x00, 0xfe };
-static unsigned char SPS_720p30[] = { 0x27, 0x4d, 0x00, 0x1f, 0x9a, 0x66, 0x02, 0x80, 0x2d, 0xd8, 0x0b, 0x64, 0x00, 0x00, 0x0f, 0xa4, 0x00, 0x03, 0xa9, 0x83, 0xa1, 0x80, 0x02, 0x5c, 0x40, 0x00, 0x09, 0x71, 0x02, 0xef, 0x2e, 0x34, 0x30, 0x00, 0x4b, 0x88, 0x00, 0x01, 0x2e, 0x20, 0x5d, 0xe5, 0xc3, 0xe1, 0x10, 0x8a, 0x34, 0xfe };
-static unsigned char SPS_720p25[] = { 0x27, 0x64, 0x00, 0x28, 0xac, 0x34, 0xc8, 0x05, 0x00, 0x5b, 0xb0, 0x16, 0xa0, 0x20, 0x20, 0x28, 0x00, 0x00, 0x1f, 0x40, 0x00, 0x06, 0x1a, 0x87, 0x43, 0x00, 0x0f, 0xd4, 0x80, 0x00, 0xfd, 0x4b, 0x5d, 0xe5, 0xc6, 0x86, 0x00, 0x1f, 0xa9, 0x00, 0x01, 0xfa, 0x96, 0xbb, 0xcb, 0x87, 0xc2, 0x21, 0x14, 0x78, 0xfe };
-static unsigned char SPS_720p24[] = { 0x27, 0x64, 0x00, 0x29, 0xac, 0x34, 0xc8, 0x05, 0x00, 0x5b, 0xb0, 0x16, 0xa0, 0x20, 0x20, 0x28, 0x00, 0x00, 0x1f, 0x48, 0x00, 0x05, 0xdc, 0x07, 0x43, 0x00, 0x0f, 0xd4, 0x80, 0x00, 0xfd, 0x4b, 0x5d, 0xe5, 0xc6, 0x86, 0x00, 0x1f, 0xa9, 0x00, 0x01, 0xfa, 0x96, 0xbb, 0xcb, 0x87, 0xc2, 0x21, 0x14, 0x78, 0xfe };
-static unsigned char SPS_480p30[] = { 0x27, 0x4d, 0x40, 0x1e, 0x9a, 0x66, 0x05, 0x01, 0xed, 0x80, 0xb6, 0x40, 0x00, 0x00, 0xfa, 0x40, 0x00, 0x3a, 0x98, 0x3a, 0x10, 0x00, 0x5e, 0x68, 0x00, 0x02, 0xf3, 0x40, 0xbb, 0xcb, 0x8d, 0x08, 0x00, 0x2f, 0x34, 0x00, 0x01, 0x79, 0xa0, 0x5d, 0xe5, 0xc3, 0xe1, 0x10, 0x8a, 0x3c, 0xfe };
-
-static unsigned char PPS_P2VP[] =    { 0x28, 0xee, 0x3c, 0x80, 0xfe };
-static unsigned char PPS_Inspire[] = { 0x28, 0xee, 0x38, 0x30, 0xfe };
-static unsigned char PPS_For1080pNew[] = { 0x68, 0xee, 0x38, 0x80, 0xfe };
-
-static void doRepairType2(FILE* inputFID, FILE* outputFID, unsigned second4Bytes) {
-  /* Begin the repair by writing SPS and PPS NAL units (each preceded by a 'start code'): */
-  {
-    int formatCode;
-    unsigned char* sps;
-    unsigned char* pps;
-    unsigned char c;
+static void freeWriteBehindBlocks(WriteBehind* wb) {
+  unsigned k;
 
-    /* The content of the SPS NAL unit depends upon which video format was used.
-       Prompt the user for this now:
-    */
-    while (1) {
-      fprintf(stderr, "First, however, we need to know which video format was used.  Enter this now.\n");
-      fprintf(stderr, "\tIf the video format was 2160p, 30fps: Type 0, then the \"Return\" key.\n");
-      fprintf(stderr, "\tIf the video format was 2160(x4096)p(4K), 25fps: Type 1, then the \"Return\" key.\n");
-      fprintf(stderr, "\tIf the video format was 2160(x3840)p(UHD-1), 25fps: Type 2, then the \"Return\" key.\n");
-      fprintf(stderr, "\tIf the video format was 2160(x4096)p(4K), 24fps: Type 3, then the \"Return\" key.\n");
-      fprintf(stderr, "\tIf the video format was 2160(x3840)p(UHD-1), 24fps: Type 4, then the \"Return\" key.\n");
-      fprintf(stderr, "\tIf the video format was 1530p, 30fps: Type 5, then the \"Return\" key.\n");
-      fprintf(stderr, "\tIf the video format was 1530p, 25fps: Type 6, then the \"Return\" key.\n");
-      fprintf(stderr, "\tIf the video format was 1530p, 24fps: Type 7, then the \"Return\" key.\n");
-      fprintf(stderr, "\tIf the video format was 1520p, 60fps: Type 8, then the \"Return\" key.\n");
-      fprintf(stderr, "\tIf the video format was 1520p, 30fps: Type 9, then the \"Return\" key.\n");
-      fprintf(stderr, "\tIf the video format was 1520p, 25fps: Type A, then the \"Return\" key.\n");
-      fprintf(stderr, "\tIf the video format was 1520p, 24fps: Type B, then the \"Return\" key.\n");
-      fprintf(stderr, "\tIf the video format was 1080p, 60fps: Type C, then the \"Return\" key.\n");
-      fprintf(stderr, "\tIf the video format was 1080i, 60fps: Type D, then the \"Return\" key.\n");
-      fprintf(stderr, "\tIf the video format was 1080p, 50fps: Type E, then the \"Return\" key.\n");
-      fprintf(stderr, "\tIf the video format was 1080p, 48fps: Type F, then the \"Return\" key.\n");
-      fprintf(stderr, "\tIf the video format was 1080p, 30fps: Type G, then the \"Return\" key.\n");
-      fprintf(stderr, "\tIf the video format was 1080p, 30fps (Zenmuse): Type H, then the \"Return\" key.\n");
-      fprintf(stderr, "\tIf the video format was 1080p, 25fps: Type I, then the \"Return\" key.\n");
-      fprintf(stderr, "\tIf the video format was 1080p, 24fps: Type J, then the \"Return\" key.\n");
-      fprintf(stderr, "\tIf the video format was 720p, 60fps: Type K, then the \"Return\" key.\n");
-      fprintf(stderr, "\tIf the video format was 720p, 60fps (Osmo+): Type L, then the \"Return\" key.\n");
-      fprintf(stderr, "\tIf the video format was 720p, 50fps: Type M, then the \"Return\" key.\n");
-      fprintf(stderr, "\tIf the video format was 720p, 48fps: Type N, then the \"Return\" key.\n");
-      fprintf(stderr, "\tIf the video format was 720p, 30fps: Type O, then the \"Return\" key.\n");
-      fprintf(stderr, "\tIf the video format was 720p, 25fps: Type P, then the \"Return\" key.\n");
-      fprintf(stderr, "\tIf the video format was 720p, 24fps: Type Q, then the \"Return\" key.\n");
-      fprintf(stderr, "\tIf the video format was 480p, 30fps: Type R, then the \"Return\" key.\n");
-      fprintf(stderr, "(If you are unsure which video format was used, then guess as follows:\n");
-      fprintf(stderr, "\tIf your file was from a Mavic Pro: Type 7, then the \"Return\" key.\n");
-      fprintf(stderr, "\tIf your file was from a Phantom 2 Vision+: Type G, then the \"Return\" key.\n");
-      fprintf(stderr, "\tIf your file was from an Inspire: Type 3, then the \"Return\" key.\n");
-      fprintf(stderr, " If the resulting file is unplayable by VLC or IINA, then you may have guessed the wrong format;\n");
-      fprintf(stderr, " try again with another format.)\n");
-      fprintf(stderr, "If you know for sure that your video format was *not* one of the ones listed above, then please read FAQ number 4 at \"https://djifix.live555.com/#faq\", and we'll try to update the software to support your video format.\n");
-      do {formatCode = getchar(); } while (formatCode == '\r' && formatCode == '\n');
-      if ((formatCode >= '0' && formatCode <= '9') ||
-	  (formatCode >= 'a' && formatCode <= 'r') ||
-	  (formatCode >= 'A' && formatCode <= 'R')) {
-	break;
-      }
-      fprintf(stderr, "Invalid entry!\n");
-    }     
-
-    fprintf(stderr, "%s", startingToRepair);
-    switch (formatCode) {
-      case '0': { sps = SPS_2160p30; pps = PPS_Inspire; break; }
-      case '1': { sps = SPS_2160x4096p25; pps = PPS_Inspire; break; }
-      case '2': { sps = SPS_2160x3840p25; pps = PPS_Inspire; break; }
-      case '3': { sps = SPS_2160x4096p24; pps = PPS_Inspire; break; }
-      case '4': { sps = SPS_2160x3840p24; pps = PPS_Inspire; break; }
-      case '5': { sps = SPS_1530p30; pps = PPS_Inspire; break; }
-      case '6': { sps = SPS_1530p25; pps = PPS_Inspire; break; }
-      case '7': { sps = SPS_1530p24; pps = PPS_Inspire; break; }
-      case '8': { sps = SPS_1520p60; pps = PPS_Inspire; break; }
-      case '9': { sps = SPS_1520p30; pps = PPS_Inspire; break; }
-      case 'a': case 'A': { sps = SPS_1520p25; pps = PPS_Inspire; break; }
-      case 'b': case 'B': { sps = SPS_1520p24; pps = PPS_Inspire; break; }
-      case 'c': case 'C': { sps = SPS_1080p60; pps = PPS_Inspire; break; }
-      case 'd': case 'D': { sps = SPS_1080i60; pps = PPS_P2VP; break; }
-      case 'e': case 'E': { sps = SPS_1080p50; pps = PPS_Inspire; break; }
-      case 'f': case 'F': { sps = SPS_1080p48; pps = PPS_Inspire; break; }
-      case 'g': case 'G': { sps = SPS_1080p30_default; pps = PPS_For1080pNew; break; }
-      case 'h': case 'H': { sps = SPS_1080p30_advanced; pps = PPS_Inspire; break; }
-      case 'i': case 'I': { sps = SPS_1080p25; pps = PPS_P2VP; break; }
-      case 'j': case 'J': { sps = SPS_1080p24; pps = PPS_Inspire; break; }
-      case 'k': case 'K': { sps = SPS_720p60_default; pps = PPS_P2VP; break; }
-      case 'l': case 'L': { sps = SPS_720p60_advanced; pps = PPS_Inspire; break; }
-      case 'm': case 'M': { sps = SPS_720p50; pps = PPS_Inspire; break; }
-      case 'n': case 'N': { sps = SPS_720p48; pps = PPS_Inspire; break; }
-      case 'o': case 'O': { sps = SPS_720p30; pps = PPS_P2VP; break; }
-      case 'p': case 'P': { sps = SPS_720p25; pps = PPS_Inspire; break; }
-      case 'q': case 'Q': { sps = SPS_720p24; pps = PPS_Inspire; break; }
-      case 'r': case 'R': { sps = SPS_480p30; pps = PPS_P2VP; break; }
-      default: { sps = SPS_1080p30_default; pps = PPS_P2VP; break; } /* shouldn't happen */
-    };
-
-    /*SPS*/
-    putStartCode(outputFID);
-    while ((c = *sps++) != 0xfe) wr(c);
+  for (k = 0; k < wb->numBlocks; ++k) {
+    giveBackMemory(&wb->ctx->memory, (unsigned long)wb->blocks[k].maxNumRuns*sizeof wb->blocks[k].runs[0]);
+    free(wb->blocks[k].runs);
+  }
+  free(wb->blocks);
+}
 
-    /*PPS*/
-    putStartCode(outputFID);
-    while ((c = *pps++) != 0xfe) wr(c);
+static WriteBehind* beginWriteBehind(RepairContext* ctx) {
+  /* Before a serial walk: Returns NULL - so that the walk writes each NAL unit as it goes - if
+     we can't (or needn't) write behind it (e.g., if the output can't be written at an offset,
+     or the input is a stream, most of which we don't keep): */
+  WriteBehind* wb;
+  long long base;
+  unsigned k;
+
+  if (ctx->queueDepth == 0 || ctx->quiet || ctx->input.stream != NULL || fileno(ctx->outputFID) < 0) return NULL;
+  fflush(ctx->outputFID);
+  base = tellOutput(ctx->outputFID);
+  if (base < 0) return NULL;
+
+  wb = calloc(1, sizeof *wb);
+  if (wb == NULL) return NULL;
+  wb->ctx = ctx;
+  wb->numBlocks = ctx->queueDepth + 1;
+  wb->blocks = calloc(wb->numBlocks, sizeof wb->blocks[0]);
+  wb->threads = calloc(ctx->queueDepth, sizeof wb->threads[0]);
+  wb->offset = (unsigned long)base;
+  for (k = 0; wb->blocks != NULL && k < wb->numBlocks; ++k) {
+    WriteBehindBlock* block = &wb->blocks[k];
+
+    /* (Each block has room for some NAL units to begin with, so that "addWriteBehindRun()" always
+       has room for at least one:) */
+    if (!growArray(&wb->ctx->memory, (void**)&block->runs, &block->maxNumRuns, sizeof block->runs[0])) break;
+    block->writer.input = &ctx->input;
+    block->writer.writeSizes = ctx->mp4 != NULL;
+    block->writer.fd = fileno(ctx->outputFID);
+    block->writer.offset = wb->offset;
+    block->writer.outputFID = ctx->outputFID;
+    initRunWriter(&block->writer); /* (before any writer thread runs) */
+  }
+  if (wb->threads != NULL && wb->blocks != NULL && k == wb->numBlocks) {
+    pthread_mutex_init(&wb->mutex, NULL);
+    pthread_cond_init(&wb->changed, NULL);
+    for (; wb->numThreads < ctx->queueDepth; ++wb->numThreads) {
+      if (pthread_create(&wb->threads[wb->numThreads], NULL, writeBehindThread, wb) != 0) break;
+    }
+    if (wb->numThreads > 0) {
+      readAheadInput(wb);
+      return wb;
+    }
+    pthread_mutex_destroy(&wb->mutex);
+    pthread_cond_destroy(&wb->changed);
   }
 
-  /* Then write the first (2-byte) NAL unit, preceded by a 'start code': */
-  putStartCode(outputFID);
-  wr(second4Bytes>>24); wr(second4Bytes>>16);
+  if (wb->blocks != NULL) freeWriteBehindBlocks(wb);
+  free(wb->threads);
+  free(wb);
+  return NULL;
+}
 
-  /* Then repeatedly:
-     1/ Read a 4-byte NAL unit size.
-     2/ Write a 'start code'.
-     3/ Read 'NAL unit size' bytes, and write them to the output file.
-  */
-  {
-    unsigned nalSize;
-    unsigned char c1, c2;
+static void addWriteBehindRun(WriteBehind* wb, NalRun const* run) {
+  WriteBehindBlock* block = &wb->blocks[wb->numQueued % wb->numBlocks];
 
-    if (!get1Byte(inputFID, &c1)) return;
-    if (!get1Byte(inputFID, &c2)) return;
-    nalSize = ((second4Bytes&0xFFFF)<<16)|(c1<<8)|c2; /* for the first NAL unit */
+  if (block->numRuns == block->maxNumRuns
+      && !growArray(&wb->ctx->memory, (void**)&block->runs, &block->maxNumRuns, sizeof block->runs[0])) {
+    /* We're out of memory, so write what we have (the next block has room for this): */
+    queueWriteBehindBlock(wb);
+    block = &wb->blocks[wb->numQueued % wb->numBlocks];
+  }
+  block->runs[block->numRuns++] = *run;
+  block->size += 4 + run->size;
+  if (block->size >= WRITE_BEHIND_BLOCK_SIZE) queueWriteBehindBlock(wb);
+}
 
-    while (!feof(inputFID)) {
-      putStartCode(outputFID);
-      while (nalSize-- > 0) {
-	wr(fgetc(inputFID));
-      }
+static void endWriteBehind(NalWalk* walk) {
+  /* After a serial walk: Write what's left, wait until everything has been written, and leave
+     the output file as the walk would have: */
+  WriteBehind* wb = walk->writeBehind;
+  WriteBehindBlock* block = &wb->blocks[wb->numQueued % wb->numBlocks];
+  unsigned k;
+
+  pthread_mutex_lock(&wb->mutex);
+  if (block->numRuns > 0) {
+    wb->offset += block->size;
+    block->isBusy = 1;
+    ++wb->numQueued;
+  }
+  wb->isEnding = 1;
+  pthread_cond_broadcast(&wb->changed);
+  pthread_mutex_unlock(&wb->mutex);
+  for (k = 0; k < wb->numThreads; ++k) pthread_join(wb->threads[k], NULL);
+
+  if (wb->error != 0) {
+    fprintf(wb->ctx->log, "Failed to write the repaired file: %s\n", strerror(wb->error));
+    wb->ctx->outputFailed = 1;
+    walk->ended = 1;
+  }
+  seekOutputTo(wb->ctx->outputFID, wb->offset);
+
+  pthread_mutex_destroy(&wb->mutex);
+  pthread_cond_destroy(&wb->changed);
+  freeWriteBehindBlocks(wb);
+  free(wb->threads);
+  free(wb);
+  walk->writeBehind = NULL;
+}
 
-      if (!get4Bytes(inputFID, &nalSize)) return;
-      if (nalSize == 0 || nalSize > 0x008FFFFF) {
-	/* An anomalous situation (we got a NAL size that's 0, or much bigger than normal).
-	   This suggests that the data here is not really video (or is corrupt in some other way).
-	   Try to recover from this by repeatedly reading bytes until we get a 'nalSize'
-	   of 0x00000002.  With luck, that will begin sane data once again.
-	*/
-	unsigned char c;
-	unsigned long filePosition = ftell(inputFID)-4;
+#endif
 
-	fprintf(stderr, "\n(Skipping over anomalous bytes (nalSize 0x%08x), starting at file position 0x%08lx (%lu MBytes))...\n", nalSize, filePosition, filePosition/1000000);
-	do {
-	  if (!get1Byte(inputFID, &c)) return;
-	  nalSize = (nalSize<<8)|c;
-	} while (nalSize != 2);
+/* Repairing several files at the same time ("-P").
 
-	filePosition = ftell(inputFID)-4;
-	fprintf(stderr, "...resuming at file position 0x%08lx (%lu MBytes)).  Continuing to repair the file (please wait)...", filePosition, filePosition/1000000);
-      }
+   A fixed number of worker threads take files from a shared queue - largest first, so that
+   the largest files (which take longest) don't end up being repaired last, while the other
+   workers are idle - until the queue is empty.  Each repair prints its messages into its own
+   memory buffer, which is copied to "stderr" (as a whole) when the repair ends, so that the
+   messages for different files aren't mixed together.  (If a repair needs to prompt for
+   its video format, it first copies its messages so far, and prompts, while no other repair
+   is printing or prompting.)
+*/
+
+#if defined(HAVE_PTHREADS) && !defined(DJIFIX_LIBRARY)
+
+typedef struct RepairPool {
+  RepairJob* jobs;
+  unsigned* queue; /* indices into "jobs", largest file first */
+  unsigned numJobs, nextJob;
+  RepairOptions const* options;
+  pthread_mutex_t queueMutex; /* protects "nextJob" */
+  pthread_mutex_t stderrMutex;
+} RepairPool;
+
+static void repairPoolJob(RepairPool* pool, RepairJob* job) {
+  RepairContext ctx;
+
+  initRepairContext(&ctx, NULL, job->formatCodes, pool->options);
+  ctx.log = open_memstream(&ctx.logBuffer, &ctx.logSize);
+  if (ctx.log == NULL) ctx.log = stderr; /* we can't keep our messages together, but we can still repair */
+  ctx.stderrMutex = &pool->stderrMutex;
+
+  pthread_mutex_lock(&pool->stderrMutex);
+  if (ctx.log == stderr) fprintf(stderr, "\n==> %s <==\n", job->fileName);
+  pthread_mutex_unlock(&pool->stderrMutex);
+  if (ctx.log != stderr) fprintf(ctx.log, "\n==> %s <==\n", job->fileName);
+
+  repairJob(&ctx, job);
+
+  pthread_mutex_lock(&pool->stderrMutex);
+  if (ctx.log != stderr) {
+    fflush(ctx.log);
+    if (ctx.numLogBytesShown > 0 && ctx.logSize > ctx.numLogBytesShown) {
+      fprintf(stderr, "\n==> %s (continued) <==\n", job->fileName);
     }
+    showRepairLog(&ctx);
+  }
+  pthread_mutex_unlock(&pool->stderrMutex);
+
+  if (ctx.log != stderr) {
+    fclose(ctx.log);
+    free(ctx.logBuffer);
   }
 }
 
+static void* repairWorkerThread(void* arg) {
+  RepairPool* pool = (RepairPool*)arg;
 
-static unsigned char type3_H264_SPS_3000p30[] = { 0x27, 0x64, 0x00, 0x34, 0xad, 0x84, 0x61, 0x18, 0x46, 0x11, 0x84, 0x61, 0x18, 0x46, 0x11, 0x34, 0xc8, 0x03, 0xe8, 0x05, 0xe7, 0xe5, 0xc0, 0x5a, 0x80, 0x80, 0x80, 0xa0, 0x00, 0x00, 0x7d, 0x20, 0x00, 0x1d, 0x4c, 0x1d, 0x0c, 0x00, 0x02, 0xfa, 0xf0, 0x00, 0x00, 0x1c, 0x9c, 0x38, 0x5d, 0xe5, 0xc6, 0x86, 0x00, 0x01, 0x7d, 0x78, 0x00, 0x00, 0x0e, 0x4e, 0x1c, 0x2e, 0xf2, 0xe1, 0xf0, 0x88, 0x45, 0x12, 0xfe };
-static unsigned char type3_H264_SPS_2160x4096p60[] = { 0x27, 0x64, 0x00, 0x34, 0xac, 0x34, 0xc8, 0x01, 0x00, 0x01, 0x0f, 0xb0, 0x16, 0xa0, 0x20, 0x20, 0x28, 0x00, 0x00, 0x1f, 0x48, 0x00, 0x0e, 0xa6, 0x07, 0x43, 0x00, 0x00, 0xbe, 0xbc, 0x00, 0x00, 0x0d, 0x69, 0x3a, 0x5d, 0xe5, 0xc6, 0x86, 0x00, 0x01, 0x7d, 0x78, 0x00, 0x00, 0x1a, 0xd2, 0x74, 0xbb, 0xcb, 0x87, 0xc2, 0x21, 0x14, 0x58, 0xfe };
-static unsigned char type3_H264_SPS_2160x3840p60[] = { 0x27, 0x64, 0x00, 0x34, 0xac, 0x34, 0xc8, 0x03, 0xc0, 0x04, 0x3e, 0xc0, 0x5a, 0x80, 0x80, 0x80, 0xa0, 0x00, 0x00, 0x7d, 0x20, 0x00, 0x3a, 0x98, 0x1d, 0x0c, 0x00, 0x07, 0x27, 0x08, 0x00, 0x00, 0x80, 0xbe, 0xf5, 0xde, 0x5c, 0x68, 0x60, 0x00, 0x39, 0x38, 0x40, 0x00, 0x04, 0x05, 0xf7, 0xae, 0xf2, 0xe1, 0xf0, 0x88, 0x45, 0x16, 0xfe };
-static unsigned char type3_H264_SPS_2160x4096p50[] = { 0x27, 0x64, 0x00, 0x34, 0xac, 0x34, 0xc8, 0x01, 0x00, 0x01, 0x0f, 0xb0, 0x16, 0xa0, 0x20, 0x20, 0x28, 0x00, 0x00, 0x1f, 0x40, 0x00, 0x0c, 0x35, 0x07, 0x43, 0x00, 0x00, 0xbe, 0xbc, 0x00, 0x00, 0x0d, 0x69, 0x3a, 0x5d, 0xe5, 0xc6, 0x86, 0x00, 0x01, 0x7d, 0x78, 0x00, 0x00, 0x1a, 0xd2, 0x74, 0xbb, 0xcb, 0x87, 0xc2, 0x21, 0x14, 0x58, 0xfe };
-static unsigned char type3_H264_SPS_2160x3840p50[] = { 0x27, 0x64, 0x00, 0x34, 0xac, 0x34, 0xc8, 0x03, 0xc0, 0x04, 0x3e, 0xc0, 0x5a, 0x80, 0x80, 0x80, 0xa0, 0x00, 0x00, 0x7d, 0x00, 0x00, 0x30, 0xd4, 0x1d, 0x0c, 0x00, 0x02, 0xfa, 0xf0, 0x00, 0x00, 0x35, 0xa4, 0xe9, 0x77, 0x97, 0x1a, 0x18, 0x00, 0x05, 0xf5, 0xe0, 0x00, 0x00, 0x6b, 0x49, 0xd2, 0xef, 0x2e, 0x1f, 0x08, 0x84, 0x51, 0x60, 0xfe };
-static unsigned char type3_H264_SPS_2160x4096p48[] = { 0x27, 0x64, 0x00, 0x34, 0xac, 0x34, 0xc8, 0x01, 0x00, 0x01, 0x0f, 0xb0, 0x16, 0xa0, 0x20, 0x20, 0x28, 0x00, 0x00, 0x1f, 0x48, 0x00, 0x0b, 0xb8, 0x07, 0x43, 0x00, 0x00, 0xbe, 0xbc, 0x00, 0x00, 0x0d, 0x69, 0x3a, 0x5d, 0xe5, 0xc6, 0x86, 0x00, 0x01, 0x7d, 0x78, 0x00, 0x00, 0x1a, 0xd2, 0x74, 0xbb, 0xcb, 0x87, 0xc2, 0x21, 0x14, 0x58, 0xfe };
-static unsigned char type3_H264_SPS_2160x3840p48[] = { 0x27, 0x64, 0x00, 0x34, 0xac, 0x34, 0xc8, 0x03, 0xc0, 0x04, 0x3e, 0xc0, 0x5a, 0x80, 0x80, 0x80, 0xa0, 0x00, 0x00, 0x7d, 0x20, 0x00, 0x2e, 0xe0, 0x1d, 0x0c, 0x00, 0x02, 0xfa, 0xf0, 0x00, 0x00, 0x35, 0xa4, 0xe9, 0x77, 0x97, 0x1a, 0x18, 0x00, 0x05, 0xf5, 0xe0, 0x00, 0x00, 0x6b, 0x49, 0xd2, 0xef, 0x2e, 0x1f, 0x08, 0x84, 0x51, 0x60, 0xfe };
-static unsigned char type3_H265_SPS_2160x4096p30[] = { 0x40, 0x01, 0x0c, 0x01, 0xff, 0xff, 0x21, 0x60, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x96, 0xac, 0x09, 0xfe };
-static unsigned char type3_H264_SPS_2160x4096p30[] = { 0x27, 0x64, 0x00, 0x34, 0xac, 0x34, 0xc8, 0x01, 0x00, 0x01, 0x0f, 0xb0, 0x16, 0xa0, 0x20, 0x20, 0x28, 0x00, 0x00, 0x1f, 0x48, 0x00, 0x07, 0x53, 0x07, 0x43, 0x00, 0x00, 0xbe, 0xbc, 0x00, 0x00, 0x0d, 0x69, 0x3a, 0x5d, 0xe5, 0xc6, 0x86, 0x00, 0x01, 0x7d, 0x78, 0x00, 0x00, 0x1a, 0xd2, 0x74, 0xbb, 0xcb, 0x87, 0xc2, 0x21, 0x14, 0x58, 0xfe };
-static unsigned char type3_H265_SPS_2160x3840p30[] = { 0x40, 0x01, 0x0c, 0x01, 0xff, 0xff, 0x21, 0x60, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x96, 0xac, 0x09, 0xfe };
-static unsigned char type3_H264_SPS_2160x3840p30_DJIMini2[] = { 0x67, 0x64, 0x00, 0x33, 0xac, 0x34, 0xc8, 0x03, 0xc0, 0x04, 0x3e, 0xc0, 0x5a, 0x80, 0x80, 0x80, 0xa0, 0x00, 0x00, 0x7d, 0x20, 0x00, 0x1d, 0x4c, 0x1d, 0x0c, 0x00, 0x02, 0xfa, 0xf0, 0x00, 0x00, 0x2f, 0xaf, 0x09, 0x77, 0x97, 0x1a, 0x18, 0x00, 0x05, 0xf5, 0xe0, 0x00, 0x00, 0x5f, 0x5e, 0x12, 0xef, 0x2e, 0x1f, 0x08, 0x84, 0x51, 0x60, 0xfe };
-static unsigned char type3_H264_SPS_2160x3840p30_other[] = { 0x27, 0x64, 0x00, 0x33, 0xac, 0x34, 0xc8, 0x03, 0xc0, 0x04, 0x3e, 0xc0, 0x5a, 0x80, 0x80, 0x80, 0xa0, 0x00, 0x00, 0x7d, 0x20, 0x00, 0x1d, 0x4c, 0x1d, 0x0c, 0x00, 0x02, 0xfa, 0xf0, 0x00, 0x00, 0x35, 0xa4, 0xe9, 0x77, 0x97, 0x1a, 0x18, 0x00, 0x05, 0xf5, 0xe0, 0x00, 0x00, 0x6b, 0x49, 0xd2, 0xef, 0x2e, 0x1f, 0x08, 0x84, 0x51, 0x60, 0xfe };
-static unsigned char type3_H264_SPS_2160x4096p25[] = { 0x27, 0x64, 0x00, 0x33, 0xac, 0x34, 0xc8, 0x01, 0x00, 0x01, 0x0f, 0xb0, 0x16, 0xa0, 0x20, 0x20, 0x28, 0x00, 0x00, 0x1f, 0x40, 0x00, 0x06, 0x1a, 0x87, 0x43, 0x00, 0x00, 0xbe, 0xbc, 0x00, 0x00, 0x0d, 0x69, 0x3a, 0x5d, 0xe5, 0xc6, 0x86, 0x00, 0x01, 0x7d, 0x78, 0x00, 0x00, 0x1a, 0xd2, 0x74, 0xbb, 0xcb, 0x87, 0xc2, 0x21, 0x14, 0x58, 0xfe };
-static unsigned char type3_H265_SPS_2160x3840p25[] = { 0x40, 0x01, 0x0c, 0x01, 0xff, 0xff, 0x21, 0x60, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x96, 0xac, 0x09, 0xfe };
-static unsigned char type3_H264_SPS_2160x3840p25[] = { 0x27, 0x64, 0x00, 0x33, 0xac, 0x34, 0xc8, 0x03, 0xc0, 0x04, 0x3e, 0xc0, 0x5a, 0x80, 0x80, 0x80, 0xa0, 0x00, 0x00, 0x7d, 0x00, 0x00, 0x18, 0x6a, 0x1d, 0x0c, 0x00, 0x02, 0xfa, 0xf0, 0x00, 0x00, 0x35, 0xa4, 0xe9, 0x77, 0x97, 0x1a, 0x18, 0x00, 0x05, 0xf5, 0xe0, 0x00, 0x00, 0x6b, 0x49, 0xd2, 0xef, 0x2e, 0x1f, 0x08, 0x84, 0x51, 0x60, 0xfe };
-static unsigned char type3_H264_SPS_2160x3840p24_DJIMini2[] = { 0x67, 0x64, 0x00, 0x33, 0xac, 0x34, 0xc8, 0x03, 0xc0, 0x04, 0x3e, 0xc0, 0x5a, 0x80, 0x80, 0x80, 0xa0, 0x00, 0x00, 0x7d, 0x20, 0x00, 0x17, 0x70, 0x1d, 0x0c, 0x00, 0x02, 0xfa, 0xf0, 0x00, 0x00, 0x2f, 0xaf, 0x09, 0x77, 0x97, 0x1a, 0x18, 0x00, 0x05, 0xf5, 0xe0, 0x00, 0x00, 0x5f, 0x5e, 0x12, 0xef, 0x2e, 0x1f, 0x08, 0x84, 0x51, 0x60, 0xfe };
-static unsigned char type3_H264_SPS_2160x3840p24_other[] = { 0x27, 0x64, 0x00, 0x33, 0xac, 0x34, 0xc8, 0x03, 0xc0, 0x04, 0x3e, 0xc0, 0x5a, 0x80, 0x80, 0x80, 0xa0, 0x00, 0x00, 0x7d, 0x00, 0x00, 0x17, 0x70, 0x1d, 0x0c, 0x00, 0x02, 0xfa, 0xf0, 0x00, 0x00, 0x35, 0xa4, 0xe9, 0x77, 0x97, 0x1a, 0x18, 0x00, 0x05, 0xf5, 0xe0, 0x00, 0x00, 0x6b, 0x49, 0xd2, 0xef, 0x2e, 0x1f, 0x08, 0x84, 0x51, 0x60, 0xfe };
-static unsigned char type3_H264_SPS_1530p60[] = { 0x67, 0x64, 0x00, 0x33, 0xac, 0x34, 0xc8, 0x02, 0xa8, 0x0c, 0x1f, 0x93, 0x01, 0x6a, 0x02, 0x02, 0x02, 0x80, 0x00, 0x01, 0xf4, 0x80, 0x00, 0xea, 0x60, 0x74, 0x30, 0x00, 0x09, 0x89, 0x68, 0x00, 0x00, 0x98, 0x96, 0x85, 0xde, 0x5c, 0x68, 0x60, 0x00, 0x13, 0x12, 0xd0, 0x00, 0x01, 0x31, 0x2d, 0x0b, 0xbc, 0xb8, 0x7c, 0x22, 0x11, 0x45, 0x80, 0xfe };
-static unsigned char type3_H265_SPS_1530p50[] = { 0x40, 0x01, 0x0c, 0x01, 0xff, 0xff, 0x21, 0x60, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x96, 0xac, 0x09, 0xfe };
-static unsigned char type3_H264_SPS_1530p48[] = { 0x67, 0x64, 0x00, 0x33, 0xac, 0x34, 0xc8, 0x02, 0xa8, 0x0c, 0x1f, 0x93, 0x01, 0x6a, 0x02, 0x02, 0x02, 0x80, 0x00, 0x01, 0xf4, 0x80, 0x00, 0xbb, 0x80, 0x74, 0x30, 0x00, 0x09, 0x89, 0x68, 0x00, 0x00, 0x98, 0x96, 0x85, 0xde, 0x5c, 0x68, 0x60, 0x00, 0x13, 0x12, 0xd0, 0x00, 0x01, 0x31, 0x2d, 0x0b, 0xbc, 0xb8, 0x7c, 0x22, 0x11, 0x45, 0x80, 0xfe };
-// Old data, obsoleted by newer Mavic Mini format:
-//static unsigned char type3_H264_SPS_1530p48[] = { 0x27, 0x64, 0x00, 0x33, 0xac, 0x34, 0xc8, 0x02, 0xa8, 0x0c, 0x1f, 0x93, 0x01, 0x6a, 0x02, 0x02, 0x02, 0x80, 0x00, 0x01, 0xf4, 0x80, 0x00, 0xbb, 0x80, 0x74, 0x30, 0x00, 0x0b, 0xeb, 0xc0, 0x00, 0x00, 0xd6, 0x93, 0xa5, 0xde, 0x5c, 0x68, 0x60, 0x00, 0x17, 0xd7, 0x80, 0x00, 0x01, 0xad, 0x27, 0x4b, 0xbc, 0xb8, 0x7c, 0x22, 0x11, 0x45, 0x80, 0xfe };
-// Old data, obsoleted by newer Mavic Mini format:
-//static unsigned char type3_H264_SPS_1530p30[] = { 0x27, 0x64, 0x00, 0x32, 0xac, 0x34, 0xc8, 0x02, 0xa8, 0x0c, 0x1b, 0x01, 0x6a, 0x02, 0x02, 0x02, 0x80, 0x00, 0x01, 0xf4, 0x80, 0x00, 0x75, 0x30, 0x74, 0x30, 0x00, 0x09, 0x89, 0x68, 0x00, 0x00, 0xab, 0xa9, 0x55, 0xde, 0x5c, 0x68, 0x60, 0x00, 0x13, 0x12, 0xd0, 0x00, 0x01, 0x57, 0x52, 0xab, 0xbc, 0xb8, 0x7c, 0x22, 0x11, 0x45, 0x80, 0xfe };
-// Old version of the Mavic Mini format:
-//static unsigned char type3_H264_SPS_1530p30[] = { 0x67, 0x64, 0x00, 0x32, 0xac, 0x34, 0xc8, 0x02, 0xa8, 0x0c, 0x1b, 0x01, 0x6a, 0x02, 0x02, 0x02, 0x80, 0x00, 0x01, 0xf4, 0x80, 0x00, 0x75, 0x30, 0x74, 0x30, 0x00, 0x13, 0x12, 0xc0, 0x00, 0x04, 0xc4, 0xb4, 0x5d, 0xe5, 0xc6, 0x86, 0x00, 0x02, 0x62, 0x58, 0x00, 0x00, 0x98, 0x96, 0x8b, 0xbc, 0xb8, 0x7c, 0x22, 0x11, 0x45, 0x80, 0xfe };
-static unsigned char type3_H264_SPS_1530p30[] = { 0x67, 0x64, 0x00, 0x32, 0xac, 0x34, 0xc8, 0x02, 0xa8, 0x0c, 0x1f, 0x93, 0x01, 0x6a, 0x02, 0x02, 0x02, 0x80, 0x00, 0x01, 0xf4, 0x80, 0x00, 0x75, 0x30, 0x74, 0x30, 0x00, 0x13, 0x12, 0xc0, 0x00, 0x04, 0xc4, 0xb4, 0x5d, 0xe5, 0xc6, 0x86, 0x00, 0x02, 0x62, 0x58, 0x00, 0x00, 0x98, 0x96, 0x8b, 0xbc, 0xb8, 0x7c, 0x22, 0x11, 0x45, 0x80, 0xfe };
-static unsigned char type3_H264_SPS_1530p25[] = { 0x67, 0x64, 0x00, 0x32, 0xac, 0x34, 0xc8, 0x02, 0xa8, 0x0c, 0x1b, 0x01, 0x6a, 0x02, 0x02, 0x02, 0x80, 0x00, 0x01, 0xf4, 0x00, 0x00, 0x61, 0xa8, 0x74, 0x30, 0x00, 0x13, 0x12, 0xc0, 0x00, 0x04, 0xc4, 0xb4, 0x5d, 0xe5, 0xc6, 0x86, 0x00, 0x02, 0x62, 0x58, 0x00, 0x00, 0x98, 0x96, 0x8b, 0xbc, 0xb8, 0x7c, 0x22, 0x11, 0x45, 0x80, 0xfe };
-static unsigned char type3_H264_SPS_1530p24_MavicMini[] = { 0x67, 0x64, 0x00, 0x32, 0xac, 0x34, 0xc8, 0x02, 0xa8, 0x0c, 0x1f, 0x93, 0x01, 0x6a, 0x02, 0x02, 0x02, 0x80, 0x00, 0x01, 0xf4, 0x80, 0x00, 0x5d, 0xc0, 0x74, 0x30, 0x00, 0x13, 0x12, 0xc0, 0x00, 0x04, 0xc4, 0xb4, 0x5d, 0xe5, 0xc6, 0x86, 0x00, 0x02, 0x62, 0x58, 0x00, 0x00, 0x98, 0x96, 0x8b, 0xbc, 0xb8, 0x7c, 0x22, 0x11, 0x45, 0x80, 0xfe };
-static unsigned char type3_H264_SPS_1530p24_other[] = { 0x27, 0x64, 0x00, 0x32, 0xac, 0x34, 0xc8, 0x02, 0xa8, 0x0c, 0x1b, 0x01, 0xaa, 0x02, 0x02, 0x02, 0xa0, 0x00, 0x01, 0xf4, 0xa0, 0x00, 0x5d, 0xc0, 0xa4, 0x30, 0x00, 0x09, 0xa9, 0x68, 0x00, 0x00, 0xab, 0xa9, 0x55, 0xde, 0xac, 0x68, 0x60, 0x00, 0xa3, 0x12, 0xd0, 0x00, 0xa1, 0x57, 0x52, 0xab, 0xac, 0xb8, 0x7c, 0x22, 0xa1, 0x45, 0x80, 0xfe };
-static unsigned char type3_H265_SPS_1080p120[] = { 0x40, 0x01, 0x0c, 0x01, 0xff, 0xff, 0x21, 0x60, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x96, 0xac, 0x09, 0xfe };
-static unsigned char type3_H264_SPS_1080p120[] = { 0x27, 0x64, 0x00, 0x33, 0xac, 0x34, 0xc8, 0x07, 0x80, 0x22, 0x7e, 0x5c, 0x05, 0xa8, 0x08, 0x08, 0x0a, 0x00, 0x00, 0x07, 0xd2, 0x00, 0x07, 0x53, 0x01, 0xd0, 0xc0, 0x00, 0x2f, 0xaf, 0x00, 0x00, 0x03, 0x03, 0x5a, 0x4e, 0x97, 0x79, 0x71, 0xa1, 0x80, 0x00, 0x5f, 0x5e, 0x00, 0x00, 0x06, 0xb4, 0x9d, 0x2e, 0xf2, 0xe1, 0xf0, 0x88, 0x45, 0x16, 0xfe };
-static unsigned char type3_H265_SPS_1080p60[] = { 0x40, 0x01, 0x0c, 0x01, 0xff, 0xff, 0x21, 0x60, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x7b, 0xac, 0x09, 0xfe };
-static unsigned char type3_H264_SPS_1080p60_MavicMini[] = { 0x67, 0x64, 0x00, 0x2a, 0xac, 0x34, 0xc8, 0x07, 0x80, 0x22, 0x7e, 0x5c, 0x05, 0xa8, 0x08, 0x08, 0x0a, 0x00, 0x00, 0x07, 0xd2, 0x00, 0x03, 0xa9, 0x81, 0xd0, 0xc0, 0x00, 0x4c, 0x4b, 0x00, 0x00, 0x13, 0x12, 0xd1, 0x77, 0x97, 0x1a, 0x18, 0x00, 0x09, 0x89, 0x60, 0x00, 0x02, 0x62, 0x5a, 0x2e, 0xf2, 0xe1, 0xf0, 0x88, 0x45, 0x16, 0xfe };
-static unsigned char type3_H264_SPS_1080p60_other[] = { 0x27, 0x64, 0x00, 0x2a, 0xac, 0x34, 0xc8, 0x07, 0x80, 0x22, 0x7e, 0x5c, 0x05, 0xa8, 0x08, 0x08, 0x0a, 0x00, 0x00, 0x07, 0xd2, 0x00, 0x03, 0xa9, 0x81, 0xd0, 0xc0, 0x00, 0x26, 0x25, 0xa0, 0x00, 0x02, 0xae, 0xa5, 0x57, 0x79, 0x71, 0xa1, 0x80, 0x00, 0x4c, 0x4b, 0x40, 0x00, 0x05, 0x5d, 0x4a, 0xae, 0xf2, 0xe1, 0xf0, 0x88, 0x45, 0x16, 0xfe };
-static unsigned char type3_H264_SPS_1080p50_MavicMini[] = { 0x67, 0x64, 0x00, 0x2a, 0xac, 0x34, 0xc8, 0x07, 0x80, 0x22, 0x7e, 0x5c, 0x05, 0xa8, 0x08, 0x08, 0x0a, 0x00, 0x00, 0x07, 0xd0, 0x00, 0x03, 0x0d, 0x41, 0xd0, 0xc0, 0x00, 0x4c, 0x4b, 0x00, 0x00, 0x13, 0x12, 0xd1, 0x77, 0x97, 0x1a, 0x18, 0x00, 0x09, 0x89, 0x60, 0x00, 0x02, 0x62, 0x5a, 0x2e, 0xf2, 0xe1, 0xf0, 0x88, 0x45, 0x16, 0xfe };
-static unsigned char type3_H264_SPS_1080p48_DJIMini2[] = { 0x67, 0x64, 0x00, 0x2a, 0xac, 0x34, 0xc8, 0x07, 0x80, 0x22, 0x7e, 0x5c, 0x05, 0xa8, 0x08, 0x08, 0x0a, 0x00, 0x00, 0x07, 0xd2, 0x00, 0x02, 0xee, 0x01, 0xd0, 0xc0, 0x00, 0x4c, 0x4b, 0x00, 0x00, 0x13, 0x12, 0xd1, 0x77, 0x97, 0x1a, 0x18, 0x00, 0x09, 0x89, 0x60, 0x00, 0x02, 0x62, 0x5a, 0x2e, 0xf2, 0xe1, 0xf0, 0x88, 0x45, 0x16, 0xfe };
-static unsigned char type3_H264_SPS_1080p30_MavicMini[] = { 0x67, 0x64, 0x00, 0x28, 0xac, 0x34, 0xc8, 0x07, 0x80, 0x22, 0x7e, 0x5c, 0x05, 0xa8, 0x08, 0x08, 0x0a, 0x00, 0x00, 0x07, 0xd2, 0x00, 0x01, 0xd4, 0xc1, 0xd0, 0xc0, 0x00, 0x42, 0xc1, 0x80, 0x00, 0x10, 0xb0, 0x75, 0x77, 0x97, 0x1a, 0x18, 0x00, 0x08, 0x58, 0x30, 0x00, 0x02, 0x16, 0x0e, 0xae, 0xf2, 0xe1, 0xf0, 0x88, 0x45, 0x16, 0xfe };
-static unsigned char type3_H264_SPS_1080p30_other[] = { 0x27, 0x64, 0x00, 0x28, 0xac, 0x34, 0xc8, 0x07, 0x80, 0x22, 0x7e, 0x5c, 0x05, 0xa8, 0x08, 0x08, 0x0a, 0x00, 0x00, 0x07, 0xd2, 0x00, 0x01, 0xd4, 0xc1, 0xd0, 0xc0, 0x00, 0x72, 0x70, 0x80, 0x00, 0x08, 0x0b, 0xef, 0x5d, 0xe5, 0xc6, 0x86, 0x00, 0x03, 0x93, 0x84, 0x00, 0x00, 0x40, 0x5f, 0x7a, 0xef, 0x2e, 0x1f, 0x08, 0x84, 0x51, 0x60, 0xfe };
-static unsigned char type3_H265_SPS_1080p25[] = { 0x40, 0x01, 0x0c, 0x01, 0xff, 0xff, 0x21, 0x60, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x7b, 0xac, 0x09, 0xfe };
-static unsigned char type3_H264_SPS_1080p25_MavicMini[] = { 0x67, 0x64, 0x00, 0x28, 0xac, 0x34, 0xc8, 0x07, 0x80, 0x22, 0x7e, 0x5c, 0x05, 0xa8, 0x08, 0x08, 0x0a, 0x00, 0x00, 0x07, 0xd0, 0x00, 0x01, 0x86, 0xa1, 0xd0, 0xc0, 0x00, 0x42, 0xc1, 0x80, 0x00, 0x10, 0xb0, 0x75, 0x77, 0x97, 0x1a, 0x18, 0x00, 0x08, 0x58, 0x30, 0x00, 0x02, 0x16, 0x0e, 0xae, 0xf2, 0xe1, 0xf0, 0x88, 0x45, 0x16, 0xfe };
-static unsigned char type3_H264_SPS_1080p25_other[] = { 0x27, 0x64, 0x00, 0x28, 0xac, 0x34, 0xc8, 0x07, 0x80, 0x22, 0x7e, 0x5c, 0x05, 0xa8, 0x08, 0x08, 0x0a, 0x00, 0x00, 0x07, 0xd0, 0x00, 0x01, 0x86, 0xa1, 0xd0, 0xc0, 0x00, 0x4c, 0x4b, 0x00, 0x00, 0x15, 0x75, 0x29, 0x77, 0x97, 0x1a, 0x18, 0x00, 0x09, 0x89, 0x60, 0x00, 0x02, 0xae, 0xa5, 0x2e, 0xf2, 0xe1, 0xf0, 0x88, 0x45, 0x16, 0xfe };
-static unsigned char type3_H264_SPS_1080p24_MavicMini[] = { 0x67, 0x64, 0x00, 0x28, 0xac, 0x34, 0xc8, 0x07, 0x80, 0x22, 0x7e, 0x5c, 0x05, 0xa8, 0x08, 0x08, 0x0a, 0x00, 0x00, 0x07, 0xd2, 0x00, 0x01, 0x77, 0x01, 0xd0, 0xc0, 0x00, 0x42, 0xc1, 0x80, 0x00, 0x10, 0xb0, 0x75, 0x77, 0x97, 0x1a, 0x18, 0x00, 0x08, 0x58, 0x30, 0x00, 0x02, 0x16, 0x0e, 0xae, 0xf2, 0xe1, 0xf0, 0x88, 0x45, 0x16, 0xfe };
-static unsigned char type3_H264_SPS_1080p24_other[] = { 0x27, 0x64, 0x00, 0x28, 0xac, 0x34, 0xc8, 0x07, 0x80, 0x22, 0x7e, 0x5c, 0x05, 0xa8, 0x08, 0x08, 0x0a, 0x00, 0x00, 0x07, 0xd2, 0x00, 0x01, 0x77, 0x01, 0xd0, 0xc0, 0x00, 0x72, 0x70, 0x80, 0x00, 0x08, 0x0b, 0xef, 0x5d, 0xe5, 0xc6, 0x86, 0x00, 0x03, 0x93, 0x84, 0x00, 0x00, 0x40, 0x5f, 0x7a, 0xef, 0x2e, 0x1f, 0x08, 0x84, 0x51, 0x60, 0xfe };
-static unsigned char type3_H264_SPS_720p30[] = { 0x27, 0x64, 0x00, 0x28, 0xac, 0x34, 0xc8, 0x05, 0x00, 0x5b, 0xb0, 0x16, 0xa0, 0x20, 0x20, 0x28, 0x00, 0x00, 0x1f, 0x48, 0x00, 0x07, 0x53, 0x07, 0x43, 0x00, 0x03, 0x93, 0x80, 0x00, 0x01, 0x01, 0x7d, 0xd7, 0x79, 0x71, 0xa1, 0x80, 0x01, 0xc9, 0xc0, 0x00, 0x00, 0x80, 0xbe, 0xeb, 0xbc, 0xb8, 0x7c, 0x22, 0x11, 0x47, 0x80, 0xfe };
-static unsigned char type3_H264_SPS_480p30[] = { 0x67, 0x64, 0x00, 0x32, 0xac, 0xb4, 0x05, 0xa1, 0xed, 0x2a, 0x40, 0x00, 0x00, 0xfa, 0x00, 0x00, 0x3a, 0x98, 0x18, 0x10, 0x00, 0x1e, 0x84, 0x80, 0x06, 0xdd, 0xef, 0x7b, 0xe1, 0x78, 0x44, 0x23, 0x50, 0xfe };
-
-static unsigned char type3_H264_PPS_default[] = { 0x28, 0xee, 0x38, 0xb0, 0xfe };
-static unsigned char type3_H264_PPS_MavicMini[] = { 0x68, 0xee, 0x38, 0x30, 0xfe };
-static unsigned char type3_H264_PPS_3000p30[] = { 0x28, 0xee, 0x38, 0xe1, 0x18, 0x46, 0x11, 0x84, 0x61, 0x18, 0x46, 0x11, 0x84, 0x70, 0xfe };
-static unsigned char type3_H265_PPS_2160x4096p30[] = { 0x42, 0x01, 0x01, 0x21, 0x60, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x96, 0xa0, 0x00, 0x80, 0x08, 0x00, 0x87, 0x1f, 0xe5, 0xae, 0xed, 0x4d, 0xdd, 0xc9, 0x75, 0x80, 0xb5, 0x01, 0x01, 0x01, 0x04, 0x00, 0x00, 0x0f, 0xa0, 0x00, 0x01, 0x86, 0xa0, 0xae, 0x11, 0x08, 0x20, 0xfe };
-static unsigned char type3_H265_PPS_2160x3840p30[] = { 0x42, 0x01, 0x01, 0x21, 0x60, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x96, 0xa0, 0x01, 0xe0, 0x20, 0x02, 0x1c, 0x7f, 0x96, 0xbb, 0xb5, 0x37, 0x77, 0x25, 0xd6, 0x02, 0xd4, 0x04, 0x04, 0x04, 0x10, 0x00, 0x00, 0x3e, 0x90, 0x00, 0x07, 0x53, 0x02, 0xb8, 0x44, 0x20, 0x80, 0xfe };
-static unsigned char type3_H265_PPS_2160x3840p25[] = { 0x42, 0x01, 0x01, 0x21, 0x60, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x96, 0xa0, 0x01, 0xe0, 0x20, 0x02, 0x1c, 0x7f, 0x96, 0xbb, 0xb5, 0x37, 0x77, 0x25, 0xd6, 0x02, 0xd4, 0x04, 0x04, 0x04, 0x10, 0x00, 0x00, 0x3e, 0x80, 0x00, 0x06, 0x1a, 0x82, 0xb8, 0x44, 0x20, 0x80, 0xfe };
-static unsigned char type3_H265_PPS_1530p50[] = { 0x42, 0x01, 0x01, 0x21, 0x60, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x96, 0xa0, 0x01, 0x54, 0x20, 0x06, 0x01, 0xf2, 0x65, 0xae, 0xed, 0x4d, 0xdd, 0xc9, 0x75, 0x80, 0xb5, 0x01, 0x01, 0x01, 0x04, 0x00, 0x00, 0x0f, 0xa4, 0x00, 0x03, 0x0d, 0x40, 0xae, 0x11, 0x08, 0x20, 0xfe };
-static unsigned char type3_H265_PPS_1080p120[] = { 0x42, 0x01, 0x01, 0x21, 0x60, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x96, 0xa0, 0x03, 0xc0, 0x80, 0x10, 0xe7, 0xf9, 0x6b, 0xbb, 0x53, 0x77, 0x72, 0x5d, 0x60, 0x2d, 0x40, 0x40, 0x40, 0x41, 0x00, 0x00, 0x03, 0x03, 0xe9, 0x00, 0x01, 0xd4, 0xc0, 0x2b, 0x84, 0x42, 0x08, 0xfe };
-static unsigned char type3_H265_PPS_1080p60[] = { 0x42, 0x01, 0x01, 0x21, 0x60, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x7b, 0xa0, 0x03, 0xc0, 0x80, 0x10, 0xe7, 0xf9, 0x6b, 0xbb, 0x53, 0x77, 0x72, 0x5d, 0x60, 0x2d, 0x40, 0x40, 0x40, 0x41, 0x00, 0x00, 0x03, 0x03, 0xe9, 0x00, 0x00, 0xea, 0x60, 0x2b, 0x84, 0x42, 0x08, 0xfe };
-static unsigned char type3_H265_PPS_1080p25[] = { 0x42, 0x01, 0x01, 0x21, 0x60, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x7b, 0xa0, 0x03, 0xc0, 0x80, 0x10, 0xa7, 0xf9, 0x6b, 0xbb, 0x53, 0x77, 0x72, 0x5d, 0x60, 0x2d, 0x40, 0x40, 0x40, 0x41, 0x00, 0x00, 0x03, 0x03, 0xe8, 0x00, 0x00, 0x61, 0xa8, 0x2b, 0x84, 0x42, 0x08, 0xfe };
-static unsigned char type3_H264_PPS_480p[] = { 0x68, 0xee, 0x3c, 0xb0, 0xfe };
-
-static unsigned char type3_H265_VPS_2160x4096p30[] = { 0x44, 0x01, 0xc1, 0x72, 0xb0, 0x9c, 0x0a, 0xc1, 0x5e, 0x24, 0xfe };
-static unsigned char type3_H265_VPS_2160x3840[] = { 0x44, 0x01, 0xc1, 0x72, 0xb0, 0x9c, 0x0a, 0x01, 0x46, 0x24, 0xfe };
-static unsigned char type3_H265_VPS_1530p[] = { 0x44, 0x01, 0xc1, 0x72, 0xb0, 0x9c, 0x1d, 0x0e, 0xe2, 0x40, 0xfe };
-static unsigned char type3_H265_VPS_1080p[] = { 0x44, 0x01, 0xc1, 0x72, 0xb0, 0x9c, 0x14, 0x0a, 0x62, 0x40, 0xfe };
-
-
-static unsigned printableMetadataCount = 0;
-
-static void doRepairType3(FILE* inputFID, FILE* outputFID) {
-  /* Begin the repair by writing SPS, PPS, and (for H.265) VPS NAL units
-     (each preceded by a 'start code'):
-  */
-  {
-    int formatCode;
-    unsigned char* sps;
-    unsigned char* pps;
-    unsigned char* vps = NULL; /* by default, for H.264 */
-    unsigned char c;
-
-    /* The content of the SPS, PPS, and VPS NAL units depends upon which video format was used.
-       Prompt the user for this now:
-    */
-    while (1) {
-      fprintf(stderr, "First, however, we need to know which video format was used.  Enter this now.\n");
-      fprintf(stderr, "\tIf the video format was H.264, 2160(x4096)p(4K), 60fps: Type 0, then the \"Return\" key.\n");
-      fprintf(stderr, "\tIf the video format was H.264, 2160(x3840)p(UHD-1), 60fps: Type 1, then the \"Return\" key.\n");
-      fprintf(stderr, "\tIf the video format was H.264, 2160(x4096)p(4K), 50fps: Type 2, then the \"Return\" key.\n");
-      fprintf(stderr, "\tIf the video format was H.264, 2160(x3840)p(UHD-1), 50fps: Type 3, then the \"Return\" key.\n");
-      fprintf(stderr, "\tIf the video format was H.264, 2160(x4096)p(4K), 48fps: Type 4, then the \"Return\" key.\n");
-      fprintf(stderr, "\tIf the video format was H.264, 2160(x3840)p(UHD-1), 48fps: Type 5, then the \"Return\" key.\n");
-      fprintf(stderr, "\tIf the video format was H.265, 2160(x4096)p(4K), 30fps: Type 6, then the \"Return\" key.\n");
-      fprintf(stderr, "\tIf the video format was H.264, 2160(x4096)p(4K), 30fps: Type 7, then the \"Return\" key.\n");
-      fprintf(stderr, "\tIf the video format was H.265, 2160(x3840)p(UHD-1), 30fps: Type 8, then the \"Return\" key.\n");
-      fprintf(stderr, "\tIf the video format was H.264, 2160(x3840)p(UHD-1), 30fps (DJI Mini 2): Type 9, then the \"Return\" key.\n");
-      fprintf(stderr, "\tIf the video format was H.264, 2160(x3840)p(UHD-1), 30fps (other DJI drones): Type a, then the \"Return\" key.\n");
-      fprintf(stderr, "\tIf the video format was H.264, 2160(x4096)p(4K), 25fps: Type b, then the \"Return\" key.\n");
-      fprintf(stderr, "\tIf the video format was H.265, 2160(x3840)p(UHD-1), 25fps: Type c, then the \"Return\" key.\n");
-      fprintf(stderr, "\tIf the video format was H.264, 2160(x3840)p(UHD-1), 25fps: Type d, then the \"Return\" key.\n");
-      fprintf(stderr, "\tIf the video format was H.264, 2160(x3840)p(UHD-1), 24fps (DJI Mini 2): Type e, then the \"Return\" key.\n");
-      fprintf(stderr, "\tIf the video format was H.264, 2160(x3840)p(UHD-1), 24fps (other DJI drones): Type f, then the \"Return\" key.\n");
-      fprintf(stderr, "\tIf the video format was H.264, 1530p, 60fps: Type g, then the \"Return\" key.\n");
-      fprintf(stderr, "\tIf the video format was H.265, 1530p, 50fps: Type h, then the \"Return\" key.\n");
-      fprintf(stderr, "\tIf the video format was H.264, 1530p, 48fps: Type i, then the \"Return\" key.\n");
-      fprintf(stderr, "\tIf the video format was H.264, 1530p, 30fps: Type j, then the \"Return\" key.\n");
-      fprintf(stderr, "\tIf the video format was H.264, 1530p, 25fps: Type k, then the \"Return\" key.\n");
-      fprintf(stderr, "\tIf the video format was H.264, 1530p, 24fps (Mavic Mini): Type l, then the \"Return\" key.\n");
-      fprintf(stderr, "\tIf the video format was H.264, 1530p, 24fps (other DJI drones): Type m, then the \"Return\" key.\n");
-      //      fprintf(stderr, "\tIf the video format was H.265, 1080p, 120fps: Type m, then the \"Return\" key.\n");
-      //      fprintf(stderr, "\tIf the video format was H.264, 1080p, 120fps: Type n, then the \"Return\" key.\n");
-      fprintf(stderr, "\tIf the video format was H.265, 1080p, 60fps: Type n, then the \"Return\" key.\n");
-      fprintf(stderr, "\tIf the video format was H.264, 1080p, 60fps (Mavic Mini): Type o, then the \"Return\" key.\n");
-      fprintf(stderr, "\tIf the video format was H.264, 1080p, 60fps (other DJI drones): Type p, then the \"Return\" key.\n");
-      fprintf(stderr, "\tIf the video format was H.264, 1080p, 50fps: Type q, then the \"Return\" key.\n");
-      fprintf(stderr, "\tIf the video format was H.264, 1080p, 48fps: Type r, then the \"Return\" key.\n");
-      fprintf(stderr, "\tIf the video format was H.264, 1080p, 30fps (Mavic Mini): Type s, then the \"Return\" key.\n");
-      fprintf(stderr, "\tIf the video format was H.264, 1080p, 30fps (other DJI drones): Type t, then the \"Return\" key.\n");
-      fprintf(stderr, "\tIf the video format was H.265, 1080p, 25fps: Type u, then the \"Return\" key.\n");
-      fprintf(stderr, "\tIf the video format was H.264, 1080p, 25fps (Mavic Mini): Type v, then the \"Return\" key.\n");
-      fprintf(stderr, "\tIf the video format was H.264, 1080p, 25fps (other DJI drones): Type w, then the \"Return\" key.\n");
-      fprintf(stderr, "\tIf the video format was H.264, 1080p, 24fps (Mavic Mini): Type x, then the \"Return\" key.\n");
-      fprintf(stderr, "\tIf the video format was H.264, 1080p, 24fps (other DJI drones): Type y, then the \"Return\" key.\n");
-      //      fprintf(stderr, "\tIf the video format was H.264, 720p, 30fps: Type y, then the \"Return\" key.\n");
-      fprintf(stderr, "\tIf the video format was H.264, 480p, 30fps (e.g., from a XL FLIR camera): Type z, then the \"Return\" key.\n");
-      fprintf(stderr, " If the resulting file is unplayable by VLC or IINA, then you may have guessed the wrong format;\n");
-      fprintf(stderr, " try again with another format.)\n");
-      fprintf(stderr, "If you know for sure that your video format was *not* one of the ones listed above, then please read FAQ number 4 at \"https://djifix.live555.com/#faq\", and we'll try to update the software to support your video format.\n");
-      do {formatCode = getchar(); } while (formatCode == '\r' && formatCode == '\n');
-      if ((formatCode >= '0' && formatCode <= '9') ||
-	  (formatCode >= 'a' && formatCode <= 'z') ||
-	  (formatCode >= 'A' && formatCode <= 'Z')) {
-	break;
-      }
-      fprintf(stderr, "Invalid entry!\n");
-    }     
-
-    fprintf(stderr, "%s", startingToRepair);
-    switch (formatCode) {
-      case '0': { sps = type3_H264_SPS_2160x4096p60; pps = type3_H264_PPS_default; break; }
-      case '1': { sps = type3_H264_SPS_2160x3840p60; pps = type3_H264_PPS_default; break; }
-      case '2': { sps = type3_H264_SPS_2160x4096p50; pps = type3_H264_PPS_default; break; }
-      case '3': { sps = type3_H264_SPS_2160x3840p50; pps = type3_H264_PPS_default; break; }
-      case '4': { sps = type3_H264_SPS_2160x4096p48; pps = type3_H264_PPS_default; break; }
-      case '5': { sps = type3_H264_SPS_2160x3840p48; pps = type3_H264_PPS_default; break; }
-      case '6': { sps = type3_H265_SPS_2160x4096p30; pps = type3_H265_PPS_2160x4096p30; vps = type3_H265_VPS_2160x4096p30; break; }
-      case '7': { sps = type3_H264_SPS_2160x4096p30; pps = type3_H264_PPS_default; break; }
-      case '8': { sps = type3_H265_SPS_2160x3840p30; pps = type3_H265_PPS_2160x3840p30; vps = type3_H265_VPS_2160x3840; break; }
-      case '9': { sps = type3_H264_SPS_2160x3840p30_DJIMini2; pps = type3_H264_PPS_MavicMini; break; }
-      case 'a': case 'A': { sps = type3_H264_SPS_2160x3840p30_other; pps = type3_H264_PPS_default; break; }
-      case 'b': case 'B': { sps = type3_H264_SPS_2160x4096p25; pps = type3_H264_PPS_default; break; }
-      case 'c': case 'C': { sps = type3_H265_SPS_2160x3840p25; pps = type3_H265_PPS_2160x3840p25; vps = type3_H265_VPS_2160x3840; break; }
-      case 'd': case 'D': { sps = type3_H264_SPS_2160x3840p25; pps = type3_H264_PPS_default; break; }
-      case 'e': case 'E': { sps = type3_H264_SPS_2160x3840p24_DJIMini2; pps = type3_H264_PPS_MavicMini; break; }
-      case 'f': case 'F': { sps = type3_H264_SPS_2160x3840p24_other; pps = type3_H264_PPS_default; break; }
-      case 'g': case 'G': { sps = type3_H264_SPS_1530p60; pps = type3_H264_PPS_MavicMini; break; }
-      case 'h': case 'H': { sps = type3_H265_SPS_1530p50; pps = type3_H265_PPS_1530p50; vps = type3_H265_VPS_1530p; break; }
-      case 'i': case 'I': { sps = type3_H264_SPS_1530p48; pps = type3_H264_PPS_MavicMini; break; }
-      case 'j': case 'J': { sps = type3_H264_SPS_1530p30; pps = type3_H264_PPS_MavicMini; break; }
-      case 'k': case 'K': { sps = type3_H264_SPS_1530p25; pps = type3_H264_PPS_MavicMini; break; }
-      case 'l': case 'L': { sps = type3_H264_SPS_1530p24_MavicMini; pps = type3_H264_PPS_MavicMini; break; }
-      case 'm': case 'M': { sps = type3_H264_SPS_1530p24_other; pps = type3_H264_PPS_default; break; }
-	//      case 'n': case 'N': { sps = type3_H265_SPS_1080p120; pps = type3_H265_PPS_1080p120; vps = type3_H265_VPS_1080p; break; }
-	//      case 'o': case 'O': { sps = type3_H264_SPS_1080p120; pps = type3_H264_PPS_default; break; }
-      case 'n': case 'N': { sps = type3_H265_SPS_1080p60; pps = type3_H265_PPS_1080p60; vps = type3_H265_VPS_1080p; break; }
-      case 'o': case 'O': { sps = type3_H264_SPS_1080p60_MavicMini; pps = type3_H264_PPS_MavicMini; break; }
-      case 'p': case 'P': { sps = type3_H264_SPS_1080p60_other; pps = type3_H264_PPS_default; break; }
-      case 'q': case 'Q': { sps = type3_H264_SPS_1080p50_MavicMini; pps = type3_H264_PPS_MavicMini; break; }
-      case 'r': case 'R': { sps = type3_H264_SPS_1080p48_DJIMini2; pps = type3_H264_PPS_MavicMini; break; }
-      case 's': case 'S': { sps = type3_H264_SPS_1080p30_MavicMini; pps = type3_H264_PPS_MavicMini; break; }
-      case 't': case 'T': { sps = type3_H264_SPS_1080p30_other; pps = type3_H264_PPS_default; break; }
-      case 'u': case 'U': { sps = type3_H265_SPS_1080p25; pps = type3_H265_PPS_1080p25; vps = type3_H265_VPS_1080p; break; }
-      case 'v': case 'V': { sps = type3_H264_SPS_1080p25_MavicMini; pps = type3_H264_PPS_MavicMini; break; }
-      case 'w': case 'W': { sps = type3_H264_SPS_1080p25_other; pps = type3_H264_PPS_default; break; }
-      case 'x': case 'X': { sps = type3_H264_SPS_1080p24_MavicMini; pps = type3_H264_PPS_MavicMini; break; }
-      case 'y': case 'Y': { sps = type3_H264_SPS_1080p24_other; pps = type3_H264_PPS_default; break; }
-      case 'z': case 'Z': { sps = type3_H264_SPS_480p30; pps = type3_H264_PPS_480p; break; }
-//      case 'y': case 'Y': { sps = type3_H264_SPS_720p30; pps = type3_H264_PPS_default; break; }
-      default: { sps = type3_H264_SPS_2160x3840p30_other; pps = type3_H264_PPS_default; break; } /* shouldn't happen */
-    };
-
-    /*SPS*/
-    putStartCode(outputFID);
-    while ((c = *sps++) != 0xfe) wr(c);
+  while (1) {
+    RepairJob* job = NULL;
 
-    /*PPS*/
-    putStartCode(outputFID);
-    while ((c = *pps++) != 0xfe) wr(c);
+    pthread_mutex_lock(&pool->queueMutex);
+    if (pool->nextJob < pool->numJobs) job = &pool->jobs[pool->queue[pool->nextJob++]];
+    pthread_mutex_unlock(&pool->queueMutex);
+    if (job == NULL) break;
 
-    /*VPS*/
-    if (vps != NULL) {
-      putStartCode(outputFID);
-      while ((c = *vps++) != 0xfe) wr(c);
-    }
+    repairPoolJob(pool, job);
+  }
+  return NULL;
+}
+
+static int repairJobsInParallel(RepairJob jobs[], unsigned numJobs, RepairOptions const* options,
+				unsigned numWorkers) {
+  /* Repair "jobs" using "numWorkers" worker threads.  Returns 0 - having done nothing - if we
+     can't start any threads, in which case the caller should repair the files in turn: */
+  RepairPool pool;
+  pthread_t* workers;
+  unsigned i, j, numStarted;
+
+  if (numWorkers > numJobs) numWorkers = numJobs;
+  pool.jobs = jobs;
+  pool.queue = malloc(numJobs*sizeof pool.queue[0]);
+  pool.numJobs = numJobs;
+  pool.nextJob = 0;
+  pool.options = options;
+  workers = malloc(numWorkers*sizeof workers[0]);
+  if (pool.queue == NULL || workers == NULL) {
+    free(pool.queue);
+    free(workers);
+    return 0;
+  }
+
+  /* Sort the queue by file size (largest first, keeping the command-line order for equal sizes): */
+  for (i = 0; i < numJobs; ++i) {
+    for (j = i; j > 0 && jobs[pool.queue[j-1]].fileSize < jobs[i].fileSize; --j) pool.queue[j] = pool.queue[j-1];
+    pool.queue[j] = i;
   }
 
-  doRepairType3or5Common(inputFID, outputFID);
+  pthread_mutex_init(&pool.queueMutex, NULL);
+  pthread_mutex_init(&pool.stderrMutex, NULL);
+  for (numStarted = 0; numStarted < numWorkers; ++numStarted) {
+    if (pthread_create(&workers[numStarted], NULL, repairWorkerThread, &pool) != 0) break;
+  }
+  if (numStarted > 0) {
+    for (i = 0; i < numStarted; ++i) pthread_join(workers[i], NULL);
+  }
+  pthread_mutex_destroy(&pool.queueMutex);
+  pthread_mutex_destroy(&pool.stderrMutex);
+  free(pool.queue);
+  free(workers);
+  return numStarted > 0;
 }
 
-static void doRepairType4(FILE* inputFID, FILE* outputFID) {
-  /* A special type of repair, when we already know that the file begins with a SPS (etc.).
-     Repeatedly:
-     1/ Read a 4-byte NAL unit size.
-     2/ Write a 'start code'.
-     3/ Read 'NAL unit size' bytes, and write them to the output file.
-  */
-  unsigned nalSize;
+#endif
 
-  fprintf(stderr, "%s", startingToRepair);
-  while (!feof(inputFID)) {
-    if (!get4Bytes(inputFID, &nalSize)) return;
-    if (nalSize == 0 || nalSize > 0x008FFFFF) {
-      /* An anomalous situation (we got a NAL size that's 0, or much bigger than normal).
-	 This suggests that the data here is not really video (or is corrupt in some other way).
-	 Try to recover from this by repeatedly reading bytes until we see what we think is
-	 video.  With luck, that will begin sane data once again.
-	*/
-      unsigned next4Bytes;
-      unsigned long filePosition = ftell(inputFID)-4;
+/* The library interface ("libdjifix"; see "djifix.h").
 
-      fprintf(stderr, "\n(Skipping over anomalous bytes (nalSize 0x%08x), starting at file position 0x%08lx (%lu MBytes))...\n", nalSize, filePosition, filePosition/1000000);
-      if (!get4Bytes(inputFID, &next4Bytes)) return; /*eof*/
-      while (!checkForVideoType4(nalSize, next4Bytes)) {
-	unsigned char c;
+   A repair writes the repaired file to a "FILE*" (as it does for "djifix" itself), but here that
+   "FILE*" is a custom stream, which passes (large blocks of) what's written to it to the caller's
+   "write" function.  (On systems that don't have custom streams, we write to a temporary file
+   instead, and then pass its contents to the "write" function.)
+*/
 
-	if (!get1Byte(inputFID, &c)) return;/*eof*/
-	nalSize = ((nalSize<<8)&0xFFFFFF00) | ((next4Bytes>>24)&0x000000FF);
-	next4Bytes = ((next4Bytes<<8)&0xFFFFFF00) | c;
-      }
-      fseek(inputFID, -4, SEEK_CUR);
-      filePosition = ftell(inputFID)-4;
-      fprintf(stderr, "...resuming at file position 0x%08lx (%lu MBytes)).  Continuing to repair the file (please wait)...", filePosition, filePosition/1000000);
-    }
-#ifdef CODE_COUNT
-    else {
-      unsigned next4Bytes;
-      if (!get4Bytes(inputFID, &next4Bytes)) return;
-      fseek(inputFID, -4, SEEK_CUR);
-      ++codeCount[next4Bytes>>16];
-      //fprintf(stderr, "#####@@@@@A nalSize 0x%08x, next4Bytes 0x%08x\n", nalSize, next4Bytes);
-    }
+#ifdef DJIFIX_LIBRARY
+
+#define SINK_BUFFER_SIZE (1024*1024)
+
+typedef struct OutputSink {
+  djifix_write_func write; /* NULL means 'discard what's written' */
+  void* opaque;
+  int failed;
+} OutputSink;
+
+struct djifix_ctx {
+  int formatCodes[6]; /* as for "-f" */
+  unsigned numThreads; /* as for "-j" */
+  unsigned long maxMemory; /* in bytes, as for "--max-memory"; 0 means 'no limit' */
+  int stopOnAnomaly; /* as for "--stop-on-anomaly" */
+  SegmentRange segmentRange; /* as for "--range" or "--nals" */
+  FILE* log; /* the caller's; NULL means 'discard messages' */
+  OutputSink discardSink;
+  FILE* discardLog; /* (made when first needed) a stream that discards messages */
+  MetadataRuleTable metadataRules;
+};
+
+static int writeToSink(OutputSink* sink, void const* data, unsigned long size) {
+  if (sink->failed) return 0;
+  if (sink->write != NULL && size > 0 && (*sink->write)(sink->opaque, data, size) != 0) sink->failed = 1;
+  return !sink->failed;
+}
+
+#if defined(HAVE_FOPENCOOKIE)
+static ssize_t sinkStreamWrite(void* cookie, char const* data, size_t size) {
+  return writeToSink((OutputSink*)cookie, data, size) ? (ssize_t)size : 0;
+}
+#elif defined(HAVE_FUNOPEN)
+static int sinkStreamWrite(void* cookie, char const* data, int size) {
+  return writeToSink((OutputSink*)cookie, data, size) ? size : -1;
+}
 #endif
 
-    putStartCode(outputFID);
-    while (nalSize-- > 0) {
-      wr(fgetc(inputFID));
-    }
+static FILE* openSinkStream(OutputSink* sink) {
+  /* Returns a stream that passes what's written to it to "sink" (or NULL, on failure): */
+#if defined(HAVE_FOPENCOOKIE)
+  cookie_io_functions_t functions;
+
+  memset(&functions, 0, sizeof functions);
+  functions.write = sinkStreamWrite;
+  return fopencookie(sink, "w", functions);
+#elif defined(HAVE_FUNOPEN)
+  return funopen(sink, NULL, sinkStreamWrite, NULL, NULL);
+#else
+  (void)sink;
+  return tmpfile();
+#endif
+}
+
+static int closeSinkStream(OutputSink* sink, FILE* fid) {
+  /* Close a stream made by "openSinkStream()".  Returns 1 if everything that was written to it
+     reached "sink": */
+#if !defined(HAVE_FOPENCOOKIE) && !defined(HAVE_FUNOPEN)
+  char* buffer = malloc(SINK_BUFFER_SIZE);
+  size_t numRead;
+
+  if (buffer == NULL || fflush(fid) != 0 || fseek(fid, 0, SEEK_SET) != 0) sink->failed = 1;
+  while (!sink->failed && (numRead = fread(buffer, 1, SINK_BUFFER_SIZE, fid)) > 0) {
+    writeToSink(sink, buffer, numRead);
   }
+  if (ferror(fid)) sink->failed = 1;
+  free(buffer);
+#endif
+  if (fclose(fid) != 0) sink->failed = 1;
+  return !sink->failed;
 }
 
-#define type5_H264_SPS_2160x3840p30_DJIMini2 type3_H264_SPS_2160x3840p30_DJIMini2 /* same */
-static unsigned char type5_H264_SPS_2160x3840p25[] = { 0x67, 0x64, 0x00, 0x33, 0xac, 0x4d, 0x00, 0x78, 0x00, 0x87, 0xd0, 0x80, 0x00, 0x01, 0xf4, 0x00, 0x00, 0x61, 0xa8, 0x47, 0x8a, 0x15, 0x50, 0xfe };
-#define type5_H264_SPS_2160x3840p24_DJIMini2 type3_H264_SPS_2160x3840p24_DJIMini2 /* same */
+static FILE* logStream(djifix_ctx* dctx) {
+  if (dctx->log != NULL) return dctx->log;
+#if defined(HAVE_FOPENCOOKIE) || defined(HAVE_FUNOPEN)
+  if (dctx->discardLog == NULL) dctx->discardLog = openSinkStream(&dctx->discardSink);
+  if (dctx->discardLog != NULL) return dctx->discardLog;
+#endif
+  return stderr; /* we can't discard messages, so show them */
+}
 
-#define type5_H264_SPS_1080p48_DJIMini2 type3_H264_SPS_1080p48_DJIMini2 /* same */
-static unsigned char type5_H264_SPS_1080p30_MavicAir[] = { 0x67, 0x64, 0x00, 0x29, 0xac, 0x4d, 0x00, 0xf0, 0x04, 0x4f, 0xca, 0x80, 0xfe };
-static unsigned char type5_H264_SPS_1080p25_MavicAir[] = { 0x67, 0x64, 0x00, 0x32, 0xac, 0x4d, 0x00, 0xf0, 0x04, 0x4f, 0xca, 0x80, 0xfe };
-static unsigned char type5_H264_SPS_720p30[] = { 0x67, 0x64, 0x00, 0x1f, 0xac, 0xb4, 0x02, 0x80, 0x2d, 0xd2, 0x90, 0x50, 0x60, 0x50, 0x6d, 0x0a, 0x13, 0x50, 0xfe };
-static unsigned char type5_H264_SPS_720p24[] = { 0x67, 0x42, 0x80, 0x1f, 0xda, 0x01, 0x40, 0x16, 0xe9, 0x48, 0x28, 0x30, 0x30, 0x36, 0x85, 0x09, 0xa8, 0xfe };
-static unsigned char type5_H265_SPS_2160x3840p100[] = { 0x40, 0x01, 0x0c, 0x01, 0xff, 0xff, 0x22, 0x20, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x96, 0xac, 0x0c, 0x00, 0x00, 0x03, 0x01, 0x90, 0x00, 0x00, 0x9c, 0x41, 0x40, 0xfe };
-static unsigned char type5_H265_SPS_2160x3840p60[] = { 0x40, 0x01, 0x0c, 0x01, 0xff, 0xff, 0x21, 0x60, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x96, 0xac, 0x0c, 0x00, 0x00, 0x03, 0x01, 0x90, 0x00, 0x00, 0x5d, 0xa9, 0x40, 0xfe };
-static unsigned char type5_H265_SPS_2160x3840p30[] = { 0x40, 0x01, 0x0c, 0x01, 0xff, 0xff, 0x01, 0x40, 0x00, 0x00, 0x03, 0x00, 0x80, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x96, 0xac, 0x0c, 0x00, 0x00, 0x0f, 0xa0, 0x00, 0x01, 0xc5, 0x22, 0x00, 0xfa, 0x28, 0xfe };
-static unsigned char type5_H265_SPS_2016p60[] = { 0x40, 0x01, 0x0c, 0x01, 0xff, 0xff, 0x22, 0x20, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x96, 0xac, 0x0c, 0x00, 0x00, 0x03, 0x01, 0x90, 0x00, 0x00, 0x5d, 0xa9, 0x40, 0xfe };
-static unsigned char type5_H265_SPS_1080p50[] = { 0x40, 0x01, 0x0c, 0x01, 0xff, 0xff, 0x22, 0x20, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x96, 0xac, 0x0c, 0x00, 0x00, 0x03, 0x01, 0x90, 0x00, 0x00, 0x4e, 0x21, 0x40, 0xfe };
+static void initLibraryRepairContext(RepairContext* ctx, djifix_ctx* dctx) {
+  RepairOptions options;
+
+  memset(&options, 0, sizeof options);
+  options.numThreads = dctx->numThreads;
+  options.maxMemory = dctx->maxMemory;
+  options.stopOnAnomaly = dctx->stopOnAnomaly;
+  options.segmentRange = dctx->segmentRange;
+  options.metadataRules = &dctx->metadataRules;
+  initRepairContext(ctx, logStream(dctx), dctx->formatCodes, &options);
+  ctx->canPrompt = 0;
+}
 
-#define type5_H264_PPS_DJIMini2 type3_H264_PPS_MavicMini /* same */
-static unsigned char type5_H264_PPS_MavicAir[] = { 0x68, 0xea, 0x8f, 0x2c, 0xfe };
-static unsigned char type5_H265_PPS_2160p100[] = { 0x42, 0x01, 0x01, 0x22, 0x20, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x96, 0xa0, 0x01, 0xe0, 0x20, 0x02, 0x1c, 0x7e, 0xd9, 0x6b, 0xbb, 0x72, 0x6b, 0xb1, 0x35, 0x01, 0x01, 0x01, 0x04, 0x00, 0x00, 0x03, 0x01, 0x90, 0x00, 0x00, 0x9c, 0x40,0x20, 0xfe };
-static unsigned char type5_H265_PPS_2160p60[] = { 0x42, 0x01, 0x01, 0x21, 0x60, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x96, 0xa0, 0x01, 0xe0, 0x20, 0x02, 0x1c, 0x7f, 0x96, 0xbb, 0xb7, 0x26, 0xbb, 0x13, 0x50, 0x10, 0x10, 0x10, 0x08, 0xfe };
-static unsigned char type5_H265_PPS_2160p30[] = { 0x42, 0x01, 0x01, 0x01, 0x40, 0x00, 0x00, 0x03, 0x00, 0x80, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x96, 0xa0, 0x01, 0xe0, 0x20, 0x02, 0x1c, 0x7f, 0xa2, 0xee, 0xc9, 0x57, 0x7a, 0x25, 0xd5, 0x81, 0x00, 0x00, 0x03, 0x03, 0xe8, 0x00, 0x00, 0x71, 0x48, 0xc4, 0xfe };
-//static unsigned char type5_H265_PPS_2016p60[] = { 0x42, 0x01, 0x01, 0x21, 0x60, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x96, 0xa0, 0x01, 0x50, 0x20, 0x07, 0xe1, 0xfe, 0xfe, 0x5a, 0xee, 0xdc, 0x9a, 0xec, 0x4d, 0x40, 0x40, 0x40, 0x40, 0x20, 0xfe };
-//    /* Note: Because 0xfe appears in this PPS, we indicate this by repeating it. */
-static unsigned char type5_H265_PPS_2016p60[] = { 0x42, 0x01, 0x01, 0x22, 0x20, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x96, 0xa0, 0x01, 0x50, 0x20, 0x07, 0xe1, 0xfb, 0x65, 0xae, 0xed, 0xc9, 0xae, 0xc4, 0xd4, 0x04, 0x04, 0x04, 0x02, 0xfe };
-static unsigned char type5_H264_SPS_1520p60[] = { 0x67, 0x64, 0x00, 0x34, 0xac, 0x4d, 0x00, 0x54, 0x01, 0x7f, 0xf2, 0xcd, 0x40, 0x40, 0x40, 0x50, 0x00, 0x00, 0x06, 0x40, 0x00, 0x02, 0xed, 0x40, 0xf1, 0xc3, 0x2a, 0xfe }; 
-static unsigned char type5_H264_PPS_1520p60[] = { 0x68, 0xee, 0x3c, 0xb0, 0xfe };
-static unsigned char type5_H265_PPS_1080p50[] = { 0x42, 0x01, 0x01, 0x22, 0x20, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x96, 0xa0, 0x03, 0xc0, 0x80, 0x10, 0xe7, 0xed, 0x96, 0xbb, 0xb7, 0x26, 0xbb, 0x13, 0x50, 0x10, 0x10, 0x10, 0x40, 0x00, 0x00, 0x19, 0x00, 0x00, 0x04, 0xe2, 0x02, 0xfe };
-static unsigned char type5_H264_PPS_720p30[] = { 0x68, 0xee, 0x06, 0xf2, 0xc0, 0xfe };
-static unsigned char type5_H264_PPS_720p24[] = { 0x68, 0xce, 0x06, 0xf2, 0xfe };
-
-static unsigned char type5_H265_VPS_default[] = { 0x44, 0x01, 0xc0, 0x73, 0xc2, 0x5e, 0x24, 0xfe };
-static unsigned char type5_H265_VPS_2160p30[] = { 0x44, 0x01, 0xc1, 0xad, 0xf0, 0x13, 0x64, 0xfe };
-static unsigned char type5_H265_VPS_1080p50[] = { 0x44, 0x01, 0xc0, 0x73, 0x12, 0x24, 0x08, 0x90, 0xfe };
-
-
-static void doRepairType5(FILE* inputFID, FILE* outputFID) {
-  /* This is identical to 'type 3', except that the possible video formats are assumed
-     to be those for "DJI Mini 2" drones only.
-  */
-  /* Begin the repair by writing SPS, PPS, and (for H.265) VPS NAL units
-     (each preceded by a 'start code'):
-  */
-  {
-    int formatCode;
-    unsigned char* sps;
-    unsigned char* pps;
-    unsigned char* vps = NULL; /* by default, for H.264 */
-    unsigned char c;
-
-    /* The content of the SPS, PPS, and VPS NAL units depends upon which video format was used.
-       Prompt the user for this now:
-    */
-    while (1) {
-      fprintf(stderr, "First, however, we need to know which video format was used.  Enter this now.\n");
-      fprintf(stderr, "\tIf the video format was H.265, 2160(x3840)p(UHD-1), 100fps: Type 0, then the \"Return\" key.\n");
-      fprintf(stderr, "\tIf the video format was H.265, 2160(x3840)p(UHD-1), 60fps: Type 1, then the \"Return\" key.\n");
-      fprintf(stderr, "\tIf the video format was H.265, 2160(x3840)p(UHD-1), 30fps: Type 2, then the \"Return\" key.\n");
-      fprintf(stderr, "\tIf the video format was H.264, 2160(x3840)p(UHD-1), 30fps: Type 3, then the \"Return\" key.\n");
-      fprintf(stderr, "\tIf the video format was H.264, 2160(x3840)p(UHD-1), 25fps: Type 4, then the \"Return\" key.\n");
-      fprintf(stderr, "\tIf the video format was H.264, 2160(x3840)p(UHD-1), 24fps: Type 5, then the \"Return\" key.\n");
-      fprintf(stderr, "\tIf the video format was H.265, 2016p, 60fps: Type 6, then the \"Return\" key.\n");
-      fprintf(stderr, "\tIf the video format was H.264, 1520p, 60fps: Type 7, then the \"Return\" key.\n");
-      fprintf(stderr, "\tIf the video format was H.265, 1080p, 50fps: Type 8, then the \"Return\" key.\n");
-      fprintf(stderr, "\tIf the video format was H.264, 1080p, 48fps: Type 9, then the \"Return\" key.\n");
-      fprintf(stderr, "\tIf the video format was H.264, 1080p, 30fps: Type A, then the \"Return\" key.\n");
-      fprintf(stderr, "\tIf the video format was H.264, 1080p, 25fps: Type B, then the \"Return\" key.\n");
-
-      fprintf(stderr, "\tIf the video format was H.264, 720p, 30fps: Type C, then the \"Return\" key.\n");
-      fprintf(stderr, "\tIf the video format was H.264, 720p, 24fps: Type D, then the \"Return\" key.\n");
-      fprintf(stderr, " If the resulting file is unplayable by VLC or IINA, then you may have guessed the wrong format;\n");
-      fprintf(stderr, " try again with another format.)\n");
-      fprintf(stderr, "If you know for sure that your video format was *not* one of the ones listed above, then please read FAQ number 4 at \"https://djifix.live555.com/#faq\", and we'll try to update the software to support your video format.\n");
-      do {formatCode = getchar(); } while (formatCode == '\r' && formatCode == '\n');
-      if ((formatCode >= '0' && formatCode <= '9') ||
-	  (formatCode >= 'a' && formatCode <= 'd') ||
-	  (formatCode >= 'A' && formatCode <= 'D')) {
-	break;
-      }
-      fprintf(stderr, "Invalid entry!\n");
-    }     
-
-    fprintf(stderr, "%s", startingToRepair);
-    switch (formatCode) {
-      case '0': { sps = type5_H265_SPS_2160x3840p100; pps = type5_H265_PPS_2160p100; vps = type5_H265_VPS_default; break; }
-      case '1': { sps = type5_H265_SPS_2160x3840p60; pps = type5_H265_PPS_2160p60; vps = type5_H265_VPS_default; break; }
-      case '2': { sps = type5_H265_SPS_2160x3840p30; pps = type5_H265_PPS_2160p30; vps = type5_H265_VPS_2160p30; break; }
-      case '3': { sps = type5_H264_SPS_2160x3840p30_DJIMini2; pps = type5_H264_PPS_DJIMini2; break; }
-      case '4': { sps = type5_H264_SPS_2160x3840p25; pps = type5_H264_PPS_MavicAir; break; }
-      case '5': { sps = type5_H264_SPS_2160x3840p24_DJIMini2; pps = type5_H264_PPS_DJIMini2; break; }
-      case '6': { sps = type5_H265_SPS_2016p60; pps = type5_H265_PPS_2016p60; vps = type5_H265_VPS_default; break; }
-      case '7': { sps = type5_H264_SPS_1520p60; pps = type5_H264_PPS_1520p60; break; }
-      case '8': { sps = type5_H265_SPS_1080p50; pps = type5_H265_PPS_1080p50; vps = type5_H265_VPS_1080p50; break; }
-      case '9': { sps = type5_H264_SPS_1080p48_DJIMini2; pps = type5_H264_PPS_DJIMini2; break; }
-      case 'a': case 'A': { sps = type5_H264_SPS_1080p30_MavicAir; pps = type5_H264_PPS_MavicAir; break; }
-      case 'b': case 'B': { sps = type5_H264_SPS_1080p25_MavicAir; pps = type5_H264_PPS_MavicAir; break; }
-      case 'c': case 'C': { sps = type5_H264_SPS_720p30; pps = type5_H264_PPS_720p30; break; }
-      case 'd': case 'D': { sps = type5_H264_SPS_720p24; pps = type5_H264_PPS_720p24; break; }
-      default: { sps = type5_H264_SPS_2160x3840p30_DJIMini2; pps = type5_H264_PPS_DJIMini2; break; } /* shouldn't happen */
-    };
-
-    /*SPS*/
-    putStartCode(outputFID);
-    while ((c = *sps++) != 0xfe) wr(c);
+char const* djifix_version(void) {
+  return versionStr;
+}
 
-    /*PPS*/
-    putStartCode(outputFID);
-    while ((c = *pps++) != 0xfe) wr(c);
-    if (*pps++ == 0xfe) wr(c); /* Hack because 0xfe appears in one of the PPSs */
-    while ((c = *pps++) != 0xfe) wr(c); /* ditto */
+djifix_ctx* djifix_new(void) {
+  djifix_ctx* dctx = malloc(sizeof *dctx);
 
-    /*VPS*/
-    if (vps != NULL) {
-      putStartCode(outputFID);
-      while ((c = *vps++) != 0xfe) wr(c);
-    }
-  }
+  if (dctx == NULL) return NULL;
+  memset(dctx, 0, sizeof *dctx);
+  parseFormatOption("auto", dctx->formatCodes);
+  dctx->numThreads = 1;
+  initMetadataRuleTable(&dctx->metadataRules);
+  return dctx;
+}
 
-  doRepairType3or5Common(inputFID, outputFID);
+void djifix_free(djifix_ctx* dctx) {
+  if (dctx == NULL) return;
+  if (dctx->discardLog != NULL) fclose(dctx->discardLog);
+  free(dctx);
 }
 
-static int metadataIsPrintable = 1;
+int djifix_set_format(djifix_ctx* dctx, char const* format) {
+  return parseFormatOption(format, dctx->formatCodes);
+}
 
-static void doRepairType3or5Common(FILE* inputFID, FILE* outputFID) {
-  /* Repeatedly:
-     1/ Read a 4-byte NAL unit size.
-     2/ Write a 'start code'.
-     3/ Read 'NAL unit size' bytes, and write them to the output file.
-  */
-  {
-    unsigned nalSize, next4Bytes;
+void djifix_set_threads(djifix_ctx* dctx, unsigned numThreads) {
+  if (numThreads == 0) numThreads = 1;
+  if (numThreads > MAX_REPAIR_THREADS) numThreads = MAX_REPAIR_THREADS;
+  dctx->numThreads = numThreads;
+}
 
-    while (!feof(inputFID)) {
-      if (!get4Bytes(inputFID, &nalSize)) return;
-      if (!get4Bytes(inputFID, &next4Bytes)) return;
-      fseek(inputFID, -4, SEEK_CUR); // seek back over "next4Bytes"
-      //fprintf(stderr, "#####@@@@@B @0x%08lx: nalSize 0x%08x, next4Bytes 0x%08x\n", ftell(inputFID)-4, nalSize, next4Bytes);
+void djifix_set_max_memory(djifix_ctx* dctx, unsigned long maxMemory) {
+  dctx->maxMemory = maxMemory;
+}
 
-      if ((nalSize&0xFFFF0000) == 0x01FE0000) {
-	/* This 4-byte 'NAL size' is really the start of a 0x200-byte block of 'track 2' data.
-	   Skip over it:
-	*/
-	if (fseek(inputFID, 0x200-4, SEEK_CUR) != 0) break;
-	continue;
-      } else if ((nalSize&0xFF800000) == 0x12800000) {
-	/* This 4-byte 'NAL size' is really the start of a block of 'track 3 or 4' data.
-	   Skip over it:
-	*/
-	unsigned assumedBlockSize;
-	if ((nalSize&0x0000FFFF) == 0x00003A0A) { /* special case */
-	  assumedBlockSize = (nalSize>>16) + 0x0A83;
-	  //fprintf(stderr, "\t#####@@@@@1 assumedBlockSize: %x\n", assumedBlockSize);
-	} else if ((nalSize&0x0000FFFF) == 0x0000420A) { /* special case */
-	  assumedBlockSize = (nalSize>>16) + 0x0E83;
-	  //fprintf(stderr, "\t#####@@@@@2 assumedBlockSize: %x\n", assumedBlockSize);
-	} else if ((nalSize&0x0000FFFF) == 0x0000430A) { /* special case */
-	  assumedBlockSize = (nalSize>>16) + 0x0F03;
-	  //fprintf(stderr, "\t#####@@@@@3 assumedBlockSize: %x\n", assumedBlockSize);
-	} else if ((nalSize&0x0000FFFF) == 0x00004B0A) { /* special case */
-	  assumedBlockSize = (nalSize>>16) + 0x1303;
-	  //fprintf(stderr, "\t#####@@@@@4 assumedBlockSize: %x\n", assumedBlockSize);
-	} else if ((nalSize&0x0000FFFF) == 0x00004F0A) { /* special case */
-	  assumedBlockSize = (nalSize>>16) + 0x1503;
-	  //fprintf(stderr, "\t#####@@@@@4.5 assumedBlockSize: %x\n", assumedBlockSize);
-	} else if ((nalSize&0x0000FFFF) == 0x0000500A) { /* special case */
-	  assumedBlockSize = (nalSize>>16) + 0x1583;
-	  //fprintf(stderr, "\t#####@@@@@5 assumedBlockSize: %x\n", assumedBlockSize);
-	} else if ((nalSize&0x0000FFFF) == 0x0000510A) { /* special case */
-	  assumedBlockSize = (nalSize>>16) + 0x1603;
-	  //fprintf(stderr, "\t#####@@@@@6 assumedBlockSize: %x\n", assumedBlockSize);
-	} else if ((nalSize&0x0000FFFF) == 0x0000520A) { /* special case */
-	  assumedBlockSize = (nalSize>>16) + 0x1683;
-	  //fprintf(stderr, "\t#####@@@@@6.1 assumedBlockSize: %x\n", assumedBlockSize);
-	} else if ((nalSize&0x0000FFFF) == 0x0000570A) { /* special case */
-	  assumedBlockSize = (nalSize>>16) + 0x1903;
-	  //fprintf(stderr, "\t#####@@@@@6.2 assumedBlockSize: %x\n", assumedBlockSize);
-	} else {
-	  assumedBlockSize = (nalSize>>16) + 0x1183;
-	  //fprintf(stderr, "\t#####@@@@@7 assumedBlockSize: %x\n", assumedBlockSize);
-	}
-	if (fseek(inputFID, assumedBlockSize-4, SEEK_CUR) != 0) break;
-	continue;
-      } else if ((nalSize&0xFFFF0000) == 0x211C0000 ||
-		 (nalSize&0xFFFF0000) == 0x2ECF0000 ||
-		 (nalSize&0xFFFF0000) == 0x38110000 ||
-		 (nalSize&0xFFFF0000) == 0x5D9C0000 ||
-		 (nalSize&0xFFFF0000) == 0x5DBB0000 ||
-		 (nalSize&0xFFFF0000) == 0x80210000) {
-	/* This 4-byte 'NAL size' is really the start of a 0x1F9-byte block of 'track 2' data.
-	   Skip over it:
-	*/
-	if (fseek(inputFID, 0x1F9-4, SEEK_CUR) != 0) break;
-	continue;
-      } else if (nalSize == 0x05c64e6f ||
-		 ( ((nalSize&0xFFFF0000) == 0x00f80000) && (next4Bytes == 0x20303020) )) { 
-	/* This 4-byte 'NAL size' is really the start of a block from a 'metadata' track.
-	   Skip over it:
-	*/
-	unsigned remainingMetadataSize;
-	if (nalSize == 0x05c64e6f) {
-	  /* In this case, there is no initial binary stuff */
-	  remainingMetadataSize = 0x05c6;
-	  if (fseek(inputFID, -2, SEEK_CUR) != 0) break; /* back up to the printable metadata */
-	} else {
-	  if (fseek(inputFID, 0xF6, SEEK_CUR) != 0) break; /* skip over initial binary stuff */
+void djifix_set_stop_on_anomaly(djifix_ctx* dctx, int stopOnAnomaly) {
+  dctx->stopOnAnomaly = stopOnAnomaly != 0;
+}
 
-	  /* The next two bytes might be a length count for the rest of the metadata: */
-	  if (!get2Bytes(inputFID, &remainingMetadataSize)) return;
-	}
+int djifix_set_range(djifix_ctx* dctx, double startSeconds, double endSeconds) {
+  if (!(startSeconds >= 0) || (endSeconds >= 0 && !(endSeconds > startSeconds))) return 0;
+  memset(&dctx->segmentRange, 0, sizeof dctx->segmentRange);
+  if (startSeconds > 0 || endSeconds >= 0) {
+    dctx->segmentRange.kind = SEGMENT_BY_TIME;
+    dctx->segmentRange.start = startSeconds;
+    dctx->segmentRange.end = endSeconds >= 0 ? endSeconds : -1;
+  }
+  return 1;
+}
 
-	// Check whether the first 4 bytes of this 'remaining data' really is printable ASCII.
-	// If it's not, then the 'two-byte count' was really the start of the next "nalSize":
-	if (remainingMetadataSize >= 4 && metadataIsPrintable) {
-	  if (!get4Bytes(inputFID, &next4Bytes)) return;
-	  fseek(inputFID, -4, SEEK_CUR); // seek back over "next4Bytes" 
-	  
-	  if (((next4Bytes>>24)&0xFF) < 0x20 || ((next4Bytes>>24)&0xFF) > 0x7E ||
-	      ((next4Bytes>>16)&0xFF) < 0x20 || ((next4Bytes>>16)&0xFF) > 0x7E ||
-	      ((next4Bytes>>8)&0xFF) < 0x20 || ((next4Bytes>>8)&0xFF) > 0x7E ||
-	      (next4Bytes&0xFF) < 0x20 || (next4Bytes&0xFF) > 0x7E) {
-	    // Some of these are non-printable => assume that it's not printable ASCII:
-	    remainingMetadataSize = 0;
-	  }
-	} else {
-	  remainingMetadataSize = 0;
-	}
+int djifix_set_nal_range(djifix_ctx* dctx, unsigned long first, unsigned long last) {
+  if (last < first) return 0;
+  memset(&dctx->segmentRange, 0, sizeof dctx->segmentRange);
+  if (first > 0 || last != ~0UL) {
+    dctx->segmentRange.kind = SEGMENT_BY_NAL_UNITS;
+    dctx->segmentRange.first = first;
+    dctx->segmentRange.last = last;
+  }
+  return 1;
+}
 
-	if (remainingMetadataSize > 0) {
-	  /* Assume that printable metadata continues */
-	  if (++printableMetadataCount == 1) {
-	    /* For the first occurrence of this metadata, print it out: */
-	    unsigned long savePos = ftell(inputFID);
-	    unsigned char c;
-
-	    fprintf(stderr, "\nSaw initial metadata block:");
-	    do {
-	      c = fgetc(inputFID);
-	      fprintf(stderr, "%c", c);
-	    } while (c != '\n' && c != 0x00);
-	    fseek(inputFID, savePos, SEEK_SET); /* restore our old position */
-	  }
-	  if (fseek(inputFID, remainingMetadataSize, SEEK_CUR) != 0) break;
-	} else {
-	  /* Backup to the assumed "nalSize" position */
-	  if (fseek(inputFID, -2, SEEK_CUR) != 0) break;
-	  metadataIsPrintable = 0; // assumed from now on
-	}
-	continue;
-      } else if (nalSize == 0x00fe462f) {
-	/* This 4-byte 'NAL size' is really the start of a 0x100-byte block from a 'metadata' track.
-	   Skip over it:
-	*/
-	if (++printableMetadataCount == 1) {
-	  // For the first occurrence of this metadata, print it out:
-	  unsigned long savePos = ftell(inputFID);
-	  unsigned char c;
-
-	  fprintf(stderr, "\nSaw initial metadata block:");
-	  fprintf(stderr, "%c", 0x46); fprintf(stderr, "%c", 0x2f); // start of printable data
-	  do {
-	    c = fgetc(inputFID);
-	    fprintf(stderr, "%c", c);
-	  } while (c != '\n');
-	  fseek(inputFID, savePos, SEEK_SET); /* restore our old position */
-	}
-	if (fseek(inputFID, 0x100-4, SEEK_CUR) != 0) break;
-	continue;
-      } else if ((nalSize&0xFFFF0000) == 0x1A2D0000) {
-	/* This 4-byte 'NAL size' is really the start of a 'track 3' metadata block.
-	   Skip over it:
-	*/
-	unsigned assumedBlockSize = 0x2F + (nalSize&0x0000FFF0)-0x0A00;
-	//fprintf(stderr, "\t#####@@@@@7.5 assumedBlockSize: %x\n", assumedBlockSize);
-	if (fseek(inputFID, assumedBlockSize-4, SEEK_CUR) != 0) break;
-	continue;
-      } else if ((nalSize&0xFFFE0000) == 0x1A2E0000) {
-	/* This 4-byte 'NAL size' is really the start of a 'track 2' metadata block.
-	   Skip over it:
-	*/
-	if (fseek(inputFID, 0x30+((nalSize&0x00010000)?1:0)-4, SEEK_CUR) != 0) break;
-	continue;
-      } else if ((nalSize&0xFFF00000) == 0x1A700000) {
-	/* This 4-byte 'NAL size' is really the start of a 'track 3' metadata block.
-	   Skip over it:
-	*/
-	if (fseek(inputFID, 0x79 + (nalSize>>16)-0x1A77-4, SEEK_CUR) != 0) break;
-	continue;
-      } else if ((nalSize&0xFF800000) == 0x1A800000) {
-	/* This 4-byte 'NAL size' is really the start of a 'track 2' metadata block.
-	   Skip over it:
-	*/
-	unsigned assumedBlockSize;
-	if ((nalSize&0xFF80FFFF) == 0x1A80010A) { /* special case */
-	  assumedBlockSize = 0xE8;
-	  //fprintf(stderr, "\t#####@@@@@8 assumedBlockSize: %x\n", assumedBlockSize);
-	} else if ((nalSize&0xFF80FFFF) == 0x1A80020A) { /* special case */
-	  assumedBlockSize = 0x103 + (nalSize>>16)-0x1A80;
-	  //fprintf(stderr, "\t#####@@@@@9 assumedBlockSize: %x\n", assumedBlockSize);
-	} else if ((nalSize&0xFF80FFFF) == 0x1A80030A) { /* special case */
-	  assumedBlockSize = 0x183 + (nalSize>>16)-0x1A80;
-	  //fprintf(stderr, "\t#####@@@@@A assumedBlockSize: %x\n", assumedBlockSize);
-	} else {
-	  assumedBlockSize = (nalSize>>16)-0x177d;
-	  //fprintf(stderr, "\t#####@@@@@B assumedBlockSize: %x\n", assumedBlockSize);
-	}
-	if (fseek(inputFID, assumedBlockSize-4, SEEK_CUR) != 0) break;
-	continue;
-      } else if ((nalSize&0xFFFF0000) == 0x211B0000 ||
-		 (nalSize&0xFFFF0000) == 0x212B0000 ||
-		 (nalSize&0xFFFF0000) == 0x214D0000 ||
-		 (nalSize&0xFFFF0000) == 0x217B0000) {
-	/* This 4-byte 'NAL size' is really the start of a 'track 2' metadata block.
-	   (Unfortunately we can't easily deduce the block size, but we know that
-	   the start of the following block will probably satisfy
-	   (first4Bytes&0xFFF0FFF0) == 0x1A700A00 or
-	   (first4Bytes&0xFF80FFFF) == 0x1A80020A
-	   Skip over it:
-	*/
-	while ((next4Bytes&0xFFF0FFF0) != 0x1A700A00 &&
-	       (next4Bytes&0xFF80FFFF) != 0x1A80020A) {
-	  unsigned char nextByte;
+void djifix_set_log(djifix_ctx* dctx, FILE* log) {
+  dctx->log = log;
+}
 
-	  if (!get1Byte(inputFID, &nextByte)) return;
-	  next4Bytes = (next4Bytes<<8)|nextByte;
-	}
-	if (fseek(inputFID, -4, SEEK_CUR) != 0) break; // seek back; we'll reread it next
-	continue;
-      } else if (nalSize == 0x44332211) {
-	/* This 4-byte 'NAL size' is really the start of a 'track 4' metadata block
-	   of size 0x00161528 or 0x001d7278 (we want to see a 0x1A next).
-	   Skip over it:
-	*/
-	if (fseek(inputFID, 0x00161528-4, SEEK_CUR) != 0) break;
+int djifix_probe(djifix_ctx* dctx, char const* fileName, djifix_probe_info* info) {
+  RepairContext ctx;
+  InputFile* input = &ctx.input;
+  ProbeResult result;
 
-	{
-	  unsigned char nextByte;
-	  if (!get1Byte(inputFID, &nextByte)) return;
-	  if (nextByte == 0x1A) {
-	    if (fseek(inputFID, -1, SEEK_CUR) != 0) break;
-	    continue;
-	  }
-	}
+  initLibraryRepairContext(&ctx, dctx);
+  if (info != NULL) memset(info, 0, sizeof *info);
+  if (!openInputFile(input, fileName, &ctx.memory)) {
+    fprintf(ctx.log, "Failed to open file to repair: %s\n", strerror(errno));
+    return 0;
+  }
 
-	if (fseek(inputFID, 0x001d7278-0x00161528-1, SEEK_CUR) != 0) break;
-	continue;
-      } else if (nalSize == 0 || nalSize > 0x00FFFFFF) {
-	unsigned long filePosition = ftell(inputFID)-4;
+  if (probeRepairType(&ctx, &result) && info != NULL) {
+    info->repair_type = result.repairType;
+    info->output_is_mp4 = result.repairType == 1;
+    info->file_size = input->size;
+    info->data_offset = result.dataOffset;
+    info->format_code = result.formatCode;
+  }
+  closeInputFile(input);
+  return result.repairType;
+}
 
-	fprintf(stderr, "\n(Anomalous NAL unit size 0x%08x @ file position 0x%08lx (%lu MBytes))\n", nalSize, filePosition, filePosition/1000000);
-	fprintf(stderr, "(We can't repair any more than %lu MBytes of this file - sorry...)\n", filePosition/1000000);
-	/* We can't recover from this, so stop here: */
-	break;
-      }
+int djifix_repair(djifix_ctx* dctx, char const* fileName, djifix_write_func write, void* opaque) {
+  RepairContext ctx;
+  OutputSink sink;
+  char* buffer = NULL;
+  int repairIsOK = 0;
 
-      putStartCode(outputFID);
-      while (nalSize-- > 0) {
-	wr(fgetc(inputFID));
-      }
+  initLibraryRepairContext(&ctx, dctx);
+  sink.write = write;
+  sink.opaque = opaque;
+  sink.failed = 0;
+  do {
+    if (!openInputFile(&ctx.input, fileName, &ctx.memory)) {
+      fprintf(ctx.log, "Failed to open file to repair: %s\n", strerror(errno));
+      break;
     }
-  }
+    if (!findRepairType(&ctx)) break;
+
+    ctx.outputFID = openSinkStream(&sink);
+    if (ctx.outputFID == NULL) {
+      fprintf(ctx.log, "Failed to open the output stream: %s\n", strerror(errno));
+      break;
+    }
+    buffer = malloc(SINK_BUFFER_SIZE);
+    if (buffer != NULL) setvbuf(ctx.outputFID, buffer, _IOFBF, SINK_BUFFER_SIZE);
+
+    repairIsOK = repairWithType(&ctx);
+    if (!closeSinkStream(&sink, ctx.outputFID) && repairIsOK) {
+      fprintf(ctx.log, "Failed to write the repaired file.\n");
+      repairIsOK = 0;
+    }
+    ctx.outputFID = NULL;
+    if (repairIsOK) fprintf(ctx.log, "...done\n");
+  } while (0);
+
+  free(buffer);
+  closeInputFile(&ctx.input);
+  fflush(ctx.log);
+  return repairIsOK;
 }
+
+#endif
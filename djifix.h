@@ -0,0 +1,76 @@
+/* The interface to "libdjifix": the repairs done by "djifix", as a library.
+   (Build this using "make lib", which compiles "djifix.c" with -DDJIFIX_LIBRARY.)
+
+   Each repair has its own state, so different threads may repair different files at the same
+   time, each using its own "djifix_ctx".  (But a "djifix_ctx" must not be used by more than
+   one thread at a time.)  Nothing is ever read from the terminal: if the video format of a file
+   isn't given (using "djifix_set_format()") and can't be detected, the repair fails.
+*/
+
+#ifndef DJIFIX_H
+#define DJIFIX_H
+
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct djifix_ctx djifix_ctx;
+
+/* Called (in order) with each block of the repaired file.  Returns 0 if OK; anything else makes
+   the repair fail (and it's not called again for this repair): */
+typedef int (*djifix_write_func)(void* opaque, void const* data, unsigned long size);
+
+/* What "djifix_probe()" found: */
+typedef struct djifix_probe_info {
+  int repair_type; /* 1-5 (as described at the start of "djifix.c") */
+  int output_is_mp4; /* 1 for 'type 1' repairs; for the others, the output is a '.h264' stream */
+  unsigned long file_size;
+  unsigned long data_offset; /* where the data that the repaired file is made from begins */
+  int format_code; /* the video format (from the list printed by "djifix -l") that the repair
+		      would use; 0 if it's not needed ('type 1' and 'type 4'), or not known */
+} djifix_probe_info;
+
+char const* djifix_version(void);
+
+/* Returns NULL if we run out of memory.  By default, the video format is detected ("-f auto"),
+   one thread is used for each repair, and messages about the repair are discarded: */
+djifix_ctx* djifix_new(void);
+void djifix_free(djifix_ctx* ctx);
+
+/* "format" is as for "djifix -f" (e.g., "auto", "type5:h265-2160p60").  Returns 0 if it's not
+   a known video format: */
+int djifix_set_format(djifix_ctx* ctx, char const* format);
+void djifix_set_threads(djifix_ctx* ctx, unsigned numThreads); /* as for "djifix -j" */
+void djifix_set_log(djifix_ctx* ctx, FILE* log); /* where messages go; NULL means discard them */
+
+/* As for "djifix --max-memory", but in bytes: a limit on the memory that each repair uses for
+   what grows with the size of the file (0, the default, means no limit): */
+void djifix_set_max_memory(djifix_ctx* ctx, unsigned long maxMemory);
+
+/* As for "djifix --stop-on-anomaly": if "stopOnAnomaly" is nonzero, a 'type 3' or 'type 5'
+   repair ends at the first anomalous NAL unit size, rather than skipping over it (the default): */
+void djifix_set_stop_on_anomaly(djifix_ctx* ctx, int stopOnAnomaly);
+
+/* As for "djifix --range" and "djifix --nals": write only part of the video ('type 2'-'type 5'
+   repairs), beginning at the IDR (or IRAP) picture before it.  An "endSeconds" < 0 (or a "last"
+   of ~0UL) means 'to the end', so (0, -1) - the default - means all of it.  Each replaces the
+   other's range.  Returns 0 (changing nothing) if the range is empty: */
+int djifix_set_range(djifix_ctx* ctx, double startSeconds, double endSeconds);
+int djifix_set_nal_range(djifix_ctx* ctx, unsigned long first, unsigned long last);
+
+/* Check which type of repair the file needs, without writing anything.  (As with "djifix
+   --probe", only the first 64 MBytes of the file are searched for the start of the data.)
+   Returns the repair type (1-5), or 0 if we can't repair the file.  ("info" may be NULL.) */
+int djifix_probe(djifix_ctx* ctx, char const* fileName, djifix_probe_info* info);
+
+/* Repair the file, passing the repaired data to "write".  Returns 1 on success, or 0 if the
+   file can't be repaired (in which case "write" may already have been called): */
+int djifix_repair(djifix_ctx* ctx, char const* fileName, djifix_write_func write, void* opaque);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,587 @@
+/**********
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**********/
+/*
+    A benchmark for "djifix" ("make bench").
+
+    We generate a synthetic damaged file for each type of repair (as described at the start of
+    "djifix.c"), and then repair each of them (in memory, using the library interface) a few
+    times, reporting the best rate (in MBytes/second of input) for each repair type - and a
+    checksum of the repaired file, which should change only if the repair itself is meant to:
+    - 'type 1': 'ftyp','moov','mdat', with the 'mdat' data beginning with (nested) 'ftyp',
+      'moov','mdat' - and then 'ftyp' again.
+    - 'type 2': 0x00000002 (each 2-byte NAL unit that begins a frame), then NAL units, with a
+      zero-filled hole that the repair skips over (to the next 0x00000002).
+    - 'type 3': JPEG previews, then NAL units interleaved with the blocks of non-video data
+      that the rules in "builtInBlockRules" describe.
+    - 'type 4': an SPS and PPS (from the tables that 'type 2' repairs use), then NAL units, with
+      zero-filled holes that the repair skips over.
+    - 'type 5': H.265 NAL units (and non-video blocks), ending in a zero-filled hole (as when a
+      recording is cut short), where the repair stops.
+    The video slices begin with slice headers that are consistent with the video format that
+    "make bench" (and "make golden") gives for each repair type ("benchFormats"), as a real
+    recording's would be - so that detecting the format ("-f auto", "-p") finds this format
+    (the first, in the table order, of any that fit equally well).
+    The files are the same each time (we use our own pseudo-random numbers), so they can also
+    be kept ("-k"), or just generated ("-g"), and used as a test corpus (as "make golden" does).
+
+    This includes "djifix.c" itself (as the library, with "DJIFIX_LIBRARY" defined), so that it
+    can use the same video format tables, and rules for non-video blocks, as the repairs do.
+    (So code in "djifix.c" that only the command-line program uses must be inside
+    "#ifndef DJIFIX_LIBRARY", or this gets 'unused function' warnings.)
+
+    Usage: djifix-bench [-s size-in-MBytes] [-r number-of-runs] [-j number-of-threads] [-k] [-g] [directory]
+*/
+
+#define DJIFIX_LIBRARY 1
+#include "../djifix.c"
+
+#define BENCH_DEFAULT_SIZE 64 /* MBytes, for each file */
+#define BENCH_DEFAULT_NUM_RUNS 3
+#define BENCH_MIN_NAL_SIZE 0x100
+#define BENCH_MAX_NAL_SIZE 60000
+#define BENCH_MAX_BLOCK_SIZE 0x20000
+#define BENCH_POOL_SIZE (1024*1024) /* the (pseudo-random) bytes that we copy NAL data from */
+#define BENCH_SLICES_PER_PICTURE 4
+#define BENCH_PICTURES_PER_IDR 8
+#define BENCH_MAX_HEADER_SIZE 64
+
+/* The video format that we repair each type of file with - and whose slice headers we write: */
+static char const* const benchFormats[6] = { NULL, "auto", "type2:0", "type3:0", "auto", "type5:0" };
+
+typedef struct BenchFile {
+  FILE* fid;
+  unsigned long size; /* the number of bytes written so far */
+  unsigned long long seed; /* for "benchRandom()" */
+  unsigned char* pool;
+  VideoParams const* vp; /* for our slice headers (NULL if the file has no video) */
+  unsigned numSlices; /* the number of slices (with headers) written so far */
+} BenchFile;
+
+typedef struct BenchBits {
+  /* A NAL unit's first bytes - with 'emulation prevention' 0x03 bytes - written a bit at a time: */
+  unsigned char data[BENCH_MAX_HEADER_SIZE];
+  unsigned size;
+  unsigned numZeros; /* the number of 0x00 bytes at the end of "data" */
+  unsigned pendingBits, numPendingBits;
+} BenchBits;
+
+static unsigned benchRandom(BenchFile* bf) {
+  /* A simple (64-bit 'xorshift') pseudo-random number generator, so that the files we
+     generate are the same on every system: */
+  unsigned long long x = bf->seed;
+
+  x ^= x<<13; x ^= x>>7; x ^= x<<17;
+  bf->seed = x;
+  return (unsigned)(x>>16);
+}
+
+static void put4Bytes(BenchFile* bf, unsigned value) {
+  fputc(value>>24, bf->fid); fputc(value>>16, bf->fid); fputc(value>>8, bf->fid); fputc(value, bf->fid);
+  bf->size += 4;
+}
+
+static void putData(BenchFile* bf, unsigned char const* data, unsigned long numBytes) {
+  fwrite(data, 1, numBytes, bf->fid);
+  bf->size += numBytes;
+}
+
+static void putRandomData(BenchFile* bf, unsigned long numBytes) {
+  while (numBytes > 0) {
+    unsigned long offset = benchRandom(bf)%(BENCH_POOL_SIZE/2);
+    unsigned long numToPut = numBytes < BENCH_POOL_SIZE/2 ? numBytes : BENCH_POOL_SIZE/2;
+
+    putData(bf, &bf->pool[offset], numToPut);
+    numBytes -= numToPut;
+  }
+}
+
+static void putZeroBytes(BenchFile* bf, unsigned long numBytes) {
+  while (numBytes-- > 0) fputc(0, bf->fid), ++bf->size;
+}
+
+static void putBits(BenchBits* bb, unsigned value, unsigned numBits) {
+  while (numBits-- > 0) {
+    bb->pendingBits = (bb->pendingBits<<1) | ((value>>numBits)&1);
+    if (++bb->numPendingBits == 8) {
+      unsigned char c = bb->pendingBits;
+
+      if (bb->numZeros >= 2 && c <= 3) { bb->data[bb->size++] = 0x03; bb->numZeros = 0; }
+      bb->data[bb->size++] = c;
+      bb->numZeros = c == 0 ? bb->numZeros + 1 : 0;
+      bb->pendingBits = bb->numPendingBits = 0;
+    }
+  }
+}
+
+static void putUE(BenchBits* bb, unsigned value) {
+  /* (An 'Exp-Golomb' code, as read by "getUE()") */
+  unsigned numBits = 0;
+
+  while ((value + 1)>>(numBits + 1) != 0) ++numBits;
+  putBits(bb, 0, numBits);
+  putBits(bb, value + 1, numBits + 1);
+}
+
+static void putSE(BenchBits* bb, int value) {
+  putUE(bb, value > 0 ? 2*value - 1 : -2*value);
+}
+
+static void putAlignmentBits(BenchBits* bb) {
+  /* Fill out the last byte with 1 bits (as 'cabac_alignment_one_bit's would): */
+  while (bb->numPendingBits != 0) putBits(bb, 1, 1);
+}
+
+static void putAtom(BenchFile* bf, unsigned fourcc, unsigned long bodySize) {
+  /* An atom whose body is "bodySize" pseudo-random bytes ('mdat' atoms get size 0, as in a
+     damaged file): */
+  put4Bytes(bf, fourcc == fourcc_mdat ? 0 : 8 + bodySize);
+  put4Bytes(bf, fourcc);
+  if (fourcc == fourcc_ftyp) {
+    static unsigned char const ftypBody[] = { 'i','s','o','m', 0,0,0,1, 'i','s','o','m','a','v','c','1' };
+
+    putData(bf, ftypBody, sizeof ftypBody);
+    bodySize -= sizeof ftypBody;
+  }
+  putRandomData(bf, bodySize);
+}
+
+static void putTableNAL(BenchFile* bf, ParameterSet const* nal) {
+  /* One of the SPS or PPS NAL units from "djifix.c"'s video formats, with its size: */
+  put4Bytes(bf, nal->size);
+  putData(bf, nal->data, nal->size);
+}
+
+static void putNALWithHeader(BenchFile* bf, MetadataRuleTable const* rules,
+			     unsigned char const* header, unsigned headerSize) {
+  /* A NAL unit (with its 4-byte size) that begins with the given bytes, followed by pseudo-random
+     data.  (Its size is chosen so that it can't be mistaken for the start of a non-video block.) */
+  unsigned size, next4Bytes = 0, i;
+
+  for (i = 0; i < 4; ++i) next4Bytes = (next4Bytes<<8) | (i < headerSize ? header[i] : 0);
+  do {
+    size = BENCH_MIN_NAL_SIZE + benchRandom(bf)%(BENCH_MAX_NAL_SIZE - BENCH_MIN_NAL_SIZE);
+  } while (findBlockRule(rules, size, next4Bytes) != NULL);
+
+  put4Bytes(bf, size);
+  putData(bf, header, headerSize);
+  putRandomData(bf, size - headerSize);
+}
+
+static void putNAL(BenchFile* bf, MetadataRuleTable const* rules, unsigned char header0, unsigned char header1) {
+  /* A NAL unit of pseudo-random data, beginning with the given 2 bytes: */
+  unsigned char header[2];
+
+  header[0] = header0; header[1] = header1;
+  putNALWithHeader(bf, rules, header, 2);
+}
+
+static void putH264SliceHeader(BenchBits* bb, VideoParams const* vp, unsigned firstMb,
+			       unsigned pictureNum, int isIDR) {
+  /* The header of an I (in an IDR picture) or P slice, as "parseH264Slice()" reads it: */
+  putUE(bb, firstMb);
+  putUE(bb, isIDR ? 7/*I*/ : 5/*P*/);
+  putUE(bb, vp->ppsId);
+  if (vp->separateColourPlane) putBits(bb, 0, 2);
+  putBits(bb, pictureNum, vp->log2MaxFrameNum); /* frame_num (each picture is a reference picture) */
+  if (!vp->frameMbsOnly) putBits(bb, 0, 1); /* field_pic_flag */
+  if (isIDR) putUE(bb, 0); /* idr_pic_id */
+  if (vp->pocType == 0) {
+    putBits(bb, 2*pictureNum, vp->log2MaxPocLsb);
+    if (vp->bottomFieldPicOrderInFramePresent) putSE(bb, 0);
+  } else if (vp->pocType == 1 && !vp->deltaPicOrderAlwaysZero) {
+    putSE(bb, 0);
+    if (vp->bottomFieldPicOrderInFramePresent) putSE(bb, 0);
+  }
+  if (vp->redundantPicCntPresent) putUE(bb, 0);
+  if (!isIDR) {
+    unsigned i;
+
+    putBits(bb, 0, 1); /* num_ref_idx_active_override_flag */
+    putBits(bb, 0, 1); /* ref_pic_list_modification_flag_l0 */
+    if (vp->weightedPred) {
+      putUE(bb, 0);
+      if (vp->chromaArrayType != 0) putUE(bb, 0);
+      for (i = 0; i < vp->numRefIdxDefault[0]; ++i) putBits(bb, 0, vp->chromaArrayType != 0 ? 2 : 1);
+    }
+  }
+  putBits(bb, 0, isIDR ? 2 : 1); /* dec_ref_pic_marking() */
+  if (vp->entropyCodingMode && !isIDR) putUE(bb, 0); /* cabac_init_idc */
+  putSE(bb, 0); /* slice_qp_delta */
+  if (vp->deblockingFilterControlPresent) putUE(bb, 1); /* disable_deblocking_filter_idc */
+  if (vp->entropyCodingMode) putAlignmentBits(bb);
+}
+
+static void putH265SliceHeader(BenchBits* bb, VideoParams const* vp, unsigned sliceSegmentAddress,
+			       unsigned pictureNum, int isIDR) {
+  /* The start of the header of an I (in an IDR picture) or P slice, as "parseH265Slice()" reads
+     it: */
+  putBits(bb, sliceSegmentAddress == 0, 1); /* first_slice_segment_in_pic_flag */
+  if (isIDR) putBits(bb, 0, 1); /* no_output_of_prior_pics_flag */
+  putUE(bb, vp->ppsId);
+  if (sliceSegmentAddress != 0) {
+    if (vp->dependentSliceSegmentsEnabled) putBits(bb, 0, 1);
+    putBits(bb, sliceSegmentAddress, ceilLog2(vp->picSizeInUnits));
+  }
+  putBits(bb, 0, vp->numExtraSliceHeaderBits);
+  putUE(bb, isIDR ? 2/*I*/ : 1/*P*/);
+  if (vp->outputFlagPresent) putBits(bb, 1, 1);
+  if (vp->separateColourPlane) putBits(bb, 0, 2);
+  if (!isIDR) {
+    putBits(bb, 2*pictureNum, vp->log2MaxPocLsb);
+    if (vp->numShortTermRefPicSets > 0) {
+      putBits(bb, 1, 1); /* short_term_ref_pic_set_sps_flag */
+      putBits(bb, 0, ceilLog2(vp->numShortTermRefPicSets));
+    } else {
+      /* A 'st_ref_pic_set()' with just the previous picture: */
+      putBits(bb, 0, 1);
+      putUE(bb, 1); putUE(bb, 0); putUE(bb, 1); putBits(bb, 1, 1);
+    }
+  }
+  putAlignmentBits(bb);
+}
+
+static void putSliceNAL(BenchFile* bf, MetadataRuleTable const* rules, int isH265) {
+  /* A NAL unit that looks like a video slice.  Each picture is "BENCH_SLICES_PER_PICTURE" slices
+     (the last of which begins at the picture's last macroblock or CTB - so that formats with
+     smaller pictures don't fit), and every "BENCH_PICTURES_PER_IDR"th picture is an IDR picture: */
+  unsigned const picture = bf->numSlices/BENCH_SLICES_PER_PICTURE, slice = bf->numSlices%BENCH_SLICES_PER_PICTURE;
+  unsigned const pictureNum = picture%BENCH_PICTURES_PER_IDR;
+  int const isIDR = pictureNum == 0;
+  BenchBits bb;
+
+  memset(&bb, 0, sizeof bb);
+  if (isH265) {
+    putBits(&bb, isIDR ? 0x2601/*IDR_W_RADL*/ : 0x0201/*TRAIL_R*/, 16);
+  } else {
+    putBits(&bb, isIDR ? 0x65 : 0x41, 8);
+  }
+  {
+    unsigned const address = (bf->vp->picSizeInUnits - 1)*slice/(BENCH_SLICES_PER_PICTURE - 1);
+
+    if (isH265) putH265SliceHeader(&bb, bf->vp, address, pictureNum, isIDR);
+    else putH264SliceHeader(&bb, bf->vp, address, pictureNum, isIDR);
+  }
+  putNALWithHeader(bf, rules, bb.data, bb.size);
+  ++bf->numSlices;
+}
+
+static void putBlock(BenchFile* bf, MetadataRuleTable const* rules) {
+  /* A block of non-video data, made from one of the built-in "BLOCK_SKIP" rules: */
+  unsigned const numRules = sizeof builtInBlockRules/sizeof builtInBlockRules[0];
+
+  while (1) {
+    MetadataBlockRule const* rule = &builtInBlockRules[benchRandom(bf)%numRules];
+    unsigned first4Bytes = rule->value | (benchRandom(bf) & ~rule->mask);
+    unsigned next4Bytes = rule->nextValue | (benchRandom(bf) & ~rule->nextMask);
+    unsigned blockSize;
+
+    /* (The repair uses the first rule that matches, which may not be the one we chose: */
+    rule = findBlockRule(rules, first4Bytes, next4Bytes);
+    if (rule == NULL || rule->action != BLOCK_SKIP) continue;
+    blockSize = rule->base + ((first4Bytes>>rule->shift)&rule->fieldMask);
+    if (blockSize < 8 || blockSize > BENCH_MAX_BLOCK_SIZE) continue; /* (some rules' sizes can wrap around) */
+
+    put4Bytes(bf, first4Bytes);
+    put4Bytes(bf, next4Bytes);
+    putRandomData(bf, blockSize - 8);
+    return;
+  }
+}
+
+static void putJPEG(BenchFile* bf, unsigned long size) {
+  /* A JPEG preview: 0xFFD8, then data containing no 0xFF bytes, then 0xFFD9: */
+  static unsigned char const soi[] = { 0xff, 0xd8, 0xff, 0xe0 }, eoi[] = { 0xff, 0xd9 };
+
+  putData(bf, soi, sizeof soi);
+  while (size-- > 0) {
+    unsigned char c = benchRandom(bf);
+
+    fputc(c == 0xff ? 0x00 : c, bf->fid);
+    ++bf->size;
+  }
+  putData(bf, eoi, sizeof eoi);
+}
+
+static void putVideo(BenchFile* bf, MetadataRuleTable const* rules, int repairType,
+		     unsigned long endSize, unsigned long holeSpacing) {
+  /* NAL units - and, for 'type 2', 0x00000002 before each frame; and for 'type 3' and 'type 5',
+     non-video blocks - until the file is "endSize" bytes long.  ('Type 2' and 'type 4' files
+     also get a zero-filled hole every "holeSpacing" bytes.) */
+  int const isH265 = repairType == 5;
+  unsigned long nextHole = bf->size + holeSpacing;
+  unsigned n = 0;
+
+  while (bf->size < endSize) {
+    if ((repairType == 2 || repairType == 4) && bf->size >= nextHole) {
+      putZeroBytes(bf, 4096 + benchRandom(bf)%65536);
+      if (repairType == 4) putNAL(bf, rules, 0x65, 0xb8); /* (what a 'type 4' repair resumes at) */
+      nextHole = bf->size + holeSpacing;
+    }
+    if (repairType == 2 && n%8 == 0) {
+      static unsigned char const frameStart[] = { 0x09, 0x10 };
+
+      put4Bytes(bf, 0x00000002);
+      putData(bf, frameStart, sizeof frameStart);
+    }
+    putSliceNAL(bf, rules, isH265);
+    if ((repairType == 3 || repairType == 5) && n%7 == 3) putBlock(bf, rules);
+    ++n;
+  }
+}
+
+static int generateBenchFile(char const* fileName, int repairType, unsigned long size,
+			     MetadataRuleTable const* rules, unsigned char* pool) {
+  /* Write a synthetic damaged file that needs a 'type "repairType"' repair.  Returns 0 on
+     failure: */
+  BenchFile bf;
+  VideoFormat const* format = NULL;
+  VideoParams vp;
+
+  if (repairType == 4) {
+    /* Begin with the SPS and PPS of the first 'type 2' video format whose SPS the repair
+       will recognize as one: */
+    for (format = formatsForRepairType(2); format->repairType == 2; ++format) {
+      ParameterSet const* sps = &format->parameterSets[0];
+
+      if (checkForVideo(sps->size, bigEndian4(sps->data))) break;
+    }
+    if (format->repairType != 2) return 0;
+  } else if (repairType != 1) {
+    format = findVideoFormat(repairType, benchFormats[repairType][6]); /* (e.g., "type2:0") */
+    if (format == NULL) return 0;
+  }
+  if (format != NULL && loadVideoParams(format, &vp) == 0) return 0;
+
+  bf.fid = fopen(fileName, "wb");
+  if (bf.fid == NULL) return 0;
+  bf.size = 0;
+  bf.seed = 0x9E3779B9ULL*repairType + 1;
+  bf.pool = pool;
+  bf.vp = format != NULL ? &vp : NULL;
+  bf.numSlices = 0;
+
+  switch (repairType) {
+    case 1: {
+      putAtom(&bf, fourcc_ftyp, 24);
+      putAtom(&bf, fourcc_moov, 1000);
+      putAtom(&bf, fourcc_mdat, 0);
+      putAtom(&bf, fourcc_ftyp, 24); /* nested within the 'mdat' */
+      putAtom(&bf, fourcc_moov, 1000);
+      putAtom(&bf, fourcc_mdat, 0);
+      putAtom(&bf, fourcc_ftyp, 24);
+      putRandomData(&bf, size - bf.size);
+      break;
+    }
+    case 2: {
+      putAtom(&bf, fourcc_ftyp, 24);
+      putAtom(&bf, fourcc_moov, 1000);
+      putAtom(&bf, fourcc_mdat, 0);
+      putVideo(&bf, rules, 2, size, size/4);
+      break;
+    }
+    case 3: {
+      putAtom(&bf, fourcc_ftyp, 24);
+      putAtom(&bf, fourcc_moov, 1000);
+      putAtom(&bf, fourcc_mdat, 0);
+      putJPEG(&bf, 20000);
+      putJPEG(&bf, 50000);
+      putVideo(&bf, rules, 3, size, 0);
+      break;
+    }
+    case 4: {
+      putAtom(&bf, fourcc_ftyp, 24);
+      putAtom(&bf, fourcc_moov, 1000);
+      putAtom(&bf, fourcc_mdat, 0);
+      putZeroBytes(&bf, 1000);
+      putTableNAL(&bf, &format->parameterSets[0]);
+      putTableNAL(&bf, &format->parameterSets[1]);
+      putVideo(&bf, rules, 4, size, size/4);
+      break;
+    }
+    case 5: {
+      putAtom(&bf, fourcc_ftyp, 24);
+      putAtom(&bf, fourcc_moov, 1000);
+      putAtom(&bf, fourcc_mdat, 0);
+      putNAL(&bf, rules, 0x28, 0x01); /* what the repair recognizes as 'type 5' H.265 video */
+      putVideo(&bf, rules, 5, size - size/64, 0);
+      putZeroBytes(&bf, size/64);
+      break;
+    }
+  }
+
+  if (fclose(bf.fid) != 0 || bf.size == 0) {
+    remove(fileName);
+    return 0;
+  }
+  return 1;
+}
+
+typedef struct BenchOutput {
+  unsigned long size;
+  unsigned long long checksum;
+  unsigned long long pendingWord; /* the bytes (if any) of the next 8-byte word that we've seen ... */
+  unsigned numPendingBytes; /* ... and how many of them there are */
+} BenchOutput;
+
+#define BENCH_CHECKSUM_START 0xCBF29CE484222325ULL
+#define mixWord(checksum, word) ((checksum) ^ (word))*0x100000001B3ULL
+
+static int checkOutput(void* opaque, void const* data, unsigned long size) {
+  /* Look at every byte of the repaired file (as anything that used it would), computing a
+     simple checksum of it, 8 bytes at a time (so that the checksum depends only on the
+     repaired file, not on how it's passed to us): */
+  BenchOutput* output = (BenchOutput*)opaque;
+  unsigned char const* p = (unsigned char const*)data;
+  unsigned long long checksum = output->checksum, word;
+  unsigned long i = 0;
+
+  while (i < size) {
+    if (output->numPendingBytes == 0 && size - i >= 8) {
+      for (; size - i >= 8; i += 8) {
+	memcpy(&word, &p[i], 8);
+	checksum = mixWord(checksum, word);
+      }
+      continue;
+    }
+    output->pendingWord |= (unsigned long long)p[i++] << (8*output->numPendingBytes);
+    if (++output->numPendingBytes == 8) {
+      checksum = mixWord(checksum, output->pendingWord);
+      output->pendingWord = 0;
+      output->numPendingBytes = 0;
+    }
+  }
+  output->checksum = checksum;
+  output->size += size;
+  return 0;
+}
+
+static double benchTime(void) {
+  /* (Wall-clock time, because "-j" repairs use several threads.) */
+#ifdef HAVE_CLOCK_GETTIME
+  struct timespec ts;
+
+  if (clock_gettime(CLOCK_MONOTONIC, &ts) == 0) return ts.tv_sec + ts.tv_nsec/1e9;
+#endif
+  return (double)clock()/CLOCKS_PER_SEC;
+}
+
+int main(int argc, char** argv) {
+  unsigned long size = BENCH_DEFAULT_SIZE;
+  unsigned numRuns = BENCH_DEFAULT_NUM_RUNS, numThreads = 1;
+  int keepFiles = 0, generateOnly = 0, allAreOK = 1;
+  char const* directory = NULL;
+  char fileName[1000];
+  MetadataRuleTable rules;
+  unsigned char* pool;
+  unsigned long i;
+  int repairType, arg;
+
+  for (arg = 1; arg < argc; ++arg) {
+    if (strcmp(argv[arg], "-s") == 0 && arg+1 < argc && sscanf(argv[arg+1], "%lu", &size) == 1 && size > 0) {
+      ++arg;
+    } else if (strcmp(argv[arg], "-r") == 0 && arg+1 < argc && sscanf(argv[arg+1], "%u", &numRuns) == 1 && numRuns > 0) {
+      ++arg;
+    } else if (strcmp(argv[arg], "-j") == 0 && arg+1 < argc && sscanf(argv[arg+1], "%u", &numThreads) == 1 && numThreads > 0) {
+      ++arg;
+    } else if (strcmp(argv[arg], "-k") == 0) {
+      keepFiles = 1;
+    } else if (strcmp(argv[arg], "-g") == 0) {
+      keepFiles = generateOnly = 1;
+    } else if (argv[arg][0] != '-' && directory == NULL) {
+      directory = argv[arg];
+    } else {
+      fprintf(stderr, "Usage: %s [-s size-in-MBytes] [-r number-of-runs] [-j number-of-threads] [-k] [-g] [directory]\n", argv[0]);
+      fprintf(stderr, "\tThe synthetic files are written to \"directory\" (by default, $TMPDIR or /tmp), and are\n");
+      fprintf(stderr, "\tremoved afterwards unless \"-k\" is given.  \"-g\" generates (and keeps) them, without\n");
+      fprintf(stderr, "\trepairing them.\n");
+      return 1;
+    }
+  }
+  if (directory == NULL) directory = getenv("TMPDIR");
+  if (directory == NULL || directory[0] == '\0') directory = "/tmp";
+  size *= 1024*1024;
+
+  initMetadataRuleTable(&rules);
+  pool = malloc(BENCH_POOL_SIZE);
+  if (pool == NULL) {
+    fprintf(stderr, "Out of memory!\n");
+    return 1;
+  }
+  {
+    BenchFile bf;
+
+    bf.seed = 12345;
+    for (i = 0; i < BENCH_POOL_SIZE; ++i) pool[i] = benchRandom(&bf);
+  }
+
+  if (!generateOnly) printf("djifix version %s; %u run(s) of each repair, using %u thread(s)\n", djifix_version(), numRuns, numThreads);
+  for (repairType = 1; repairType <= 5; ++repairType) {
+    djifix_ctx* dctx;
+    double bestTime = -1.0;
+    BenchOutput output;
+    unsigned long inputSize;
+    struct stat sb;
+    unsigned run;
+
+    snprintf(fileName, sizeof fileName, "%s/djifix-bench-type%d.MP4", directory, repairType);
+    if (!generateBenchFile(fileName, repairType, size, &rules, pool) || stat(fileName, &sb) != 0) {
+      fprintf(stderr, "Failed to write \"%s\": %s\n", fileName, strerror(errno));
+      allAreOK = 0;
+      continue;
+    }
+    inputSize = sb.st_size;
+    if (generateOnly) {
+      printf("type %d: generated \"%s\" (%.1f MBytes)\n", repairType, fileName, inputSize/1000000.0);
+      continue;
+    }
+
+    dctx = djifix_new();
+    if (dctx == NULL) {
+      fprintf(stderr, "Out of memory!\n");
+      return 1;
+    }
+    djifix_set_format(dctx, benchFormats[repairType]);
+    djifix_set_threads(dctx, numThreads);
+
+    if (djifix_probe(dctx, fileName, NULL) != repairType) {
+      printf("type %d: the synthetic file was not recognized as needing this repair!\n", repairType);
+      allAreOK = 0;
+    } else {
+      for (run = 0; run < numRuns; ++run) {
+	double startTime = benchTime(), elapsed;
+
+	memset(&output, 0, sizeof output);
+	output.checksum = BENCH_CHECKSUM_START;
+	if (!djifix_repair(dctx, fileName, checkOutput, &output)) break;
+	output.checksum = mixWord(output.checksum, output.pendingWord ^ output.numPendingBytes);
+	elapsed = benchTime() - startTime;
+	if (bestTime < 0 || elapsed < bestTime) bestTime = elapsed;
+      }
+      if (run < numRuns) {
+	printf("type %d: the repair failed!\n", repairType);
+	allAreOK = 0;
+      } else {
+	printf("type %d: %8.1f MBytes in %8.4f seconds: %8.1f MBytes/second (%.1f MBytes written; checksum %016llx)\n",
+	       repairType, inputSize/1000000.0, bestTime,
+	       bestTime > 0 ? inputSize/1000000.0/bestTime : 0.0, output.size/1000000.0, output.checksum);
+      }
+    }
+    djifix_free(dctx);
+    if (!keepFiles) remove(fileName);
+  }
+
+  free(pool);
+  return allAreOK ? 0 : 1;
+}
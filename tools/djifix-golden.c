@@ -0,0 +1,313 @@
+/**********
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**********/
+/*
+    A check that "djifix" still repairs each file of a corpus exactly as it did before
+    ("make golden").
+
+    Each line of the manifest names a file to repair, the video format to use (as for
+    "djifix -f"; several may be given, separated by commas; "-" means "auto"), and the SHA-256
+    digest of the repaired file:
+	<sha256, as 64 hex digits> <format> <file name (the rest of the line)>
+    (Empty lines, and lines beginning with '#', are ignored.  A relative file name is relative
+    to the manifest's directory, unless "-d" is given.)  Each file is repaired in memory, using
+    the library ("libdjifix"), and we report - for each - whether its digest matched, and how
+    long the repair took (not counting the time taken to compute the digest).  Run this with
+    each build (e.g., with different "CFLAGS"), and with "-j", to check that each gives the
+    same repaired files.
+
+    "-w" instead prints the manifest again, with the digests that we got (for making a new
+    manifest; the digests in the given one may then be anything, e.g., "-").
+
+    Usage: djifix-golden [-j number-of-threads] [-d directory] [-w] manifest-file
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "djifix.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#define HAVE_CLOCK_GETTIME 1
+#endif
+
+#define MAX_LINE_SIZE 4096
+
+/* SHA-256 (FIPS 180-4): */
+
+typedef struct Sha256 {
+  unsigned long state[8]; /* (only the low 32 bits of each are used) */
+  unsigned char block[64];
+  unsigned numBlockBytes;
+  unsigned long long numBytes;
+} Sha256;
+
+static unsigned long const sha256K[64] = {
+  0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+  0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+  0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+  0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+  0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+  0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+  0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+  0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+#define ror32(x, n) ((((x) >> (n)) | ((x) << (32 - (n)))) & 0xFFFFFFFFUL)
+
+static void sha256Init(Sha256* sha) {
+  static unsigned long const initialState[8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+  };
+
+  memcpy(sha->state, initialState, sizeof sha->state);
+  sha->numBlockBytes = 0;
+  sha->numBytes = 0;
+}
+
+static void sha256Block(Sha256* sha, unsigned char const* p) {
+  unsigned long w[64], s[8];
+  unsigned i;
+
+  for (i = 0; i < 16; ++i) {
+    w[i] = ((unsigned long)p[4*i]<<24) | ((unsigned long)p[4*i+1]<<16) | ((unsigned long)p[4*i+2]<<8) | p[4*i+3];
+  }
+  for (i = 16; i < 64; ++i) {
+    unsigned long s0 = ror32(w[i-15], 7) ^ ror32(w[i-15], 18) ^ (w[i-15] >> 3);
+    unsigned long s1 = ror32(w[i-2], 17) ^ ror32(w[i-2], 19) ^ (w[i-2] >> 10);
+
+    w[i] = (w[i-16] + s0 + w[i-7] + s1) & 0xFFFFFFFFUL;
+  }
+
+  memcpy(s, sha->state, sizeof s);
+  for (i = 0; i < 64; ++i) {
+    unsigned long S1 = ror32(s[4], 6) ^ ror32(s[4], 11) ^ ror32(s[4], 25);
+    unsigned long ch = (s[4] & s[5]) ^ (~s[4] & s[6]);
+    unsigned long t1 = (s[7] + S1 + ch + sha256K[i] + w[i]) & 0xFFFFFFFFUL;
+    unsigned long S0 = ror32(s[0], 2) ^ ror32(s[0], 13) ^ ror32(s[0], 22);
+    unsigned long maj = (s[0] & s[1]) ^ (s[0] & s[2]) ^ (s[1] & s[2]);
+    unsigned long t2 = (S0 + maj) & 0xFFFFFFFFUL;
+
+    s[7] = s[6]; s[6] = s[5]; s[5] = s[4];
+    s[4] = (s[3] + t1) & 0xFFFFFFFFUL;
+    s[3] = s[2]; s[2] = s[1]; s[1] = s[0];
+    s[0] = (t1 + t2) & 0xFFFFFFFFUL;
+  }
+  for (i = 0; i < 8; ++i) sha->state[i] = (sha->state[i] + s[i]) & 0xFFFFFFFFUL;
+}
+
+static void sha256Update(Sha256* sha, unsigned char const* data, unsigned long size) {
+  sha->numBytes += size;
+  if (sha->numBlockBytes > 0) {
+    unsigned numToCopy = 64 - sha->numBlockBytes;
+
+    if (numToCopy > size) numToCopy = size;
+    memcpy(&sha->block[sha->numBlockBytes], data, numToCopy);
+    sha->numBlockBytes += numToCopy;
+    data += numToCopy;
+    size -= numToCopy;
+    if (sha->numBlockBytes < 64) return;
+    sha256Block(sha, sha->block);
+    sha->numBlockBytes = 0;
+  }
+  for (; size >= 64; data += 64, size -= 64) sha256Block(sha, data);
+  memcpy(sha->block, data, size);
+  sha->numBlockBytes = size;
+}
+
+static void sha256Final(Sha256* sha, char hex[65]) {
+  unsigned long long const numBits = sha->numBytes*8;
+  unsigned char padding[72];
+  unsigned numPaddingBytes = (sha->numBlockBytes < 56 ? 56 : 120) - sha->numBlockBytes;
+  unsigned i;
+
+  memset(padding, 0, sizeof padding);
+  padding[0] = 0x80;
+  for (i = 0; i < 8; ++i) padding[numPaddingBytes + i] = (unsigned char)(numBits >> (56 - 8*i));
+  sha256Update(sha, padding, numPaddingBytes + 8);
+  for (i = 0; i < 8; ++i) sprintf(&hex[8*i], "%08lx", sha->state[i]);
+}
+
+/* Repairing each file of the corpus: */
+
+static double goldenTime(void) {
+#ifdef HAVE_CLOCK_GETTIME
+  struct timespec ts;
+
+  if (clock_gettime(CLOCK_MONOTONIC, &ts) == 0) return ts.tv_sec + ts.tv_nsec/1e9;
+#endif
+  return (double)clock()/CLOCKS_PER_SEC;
+}
+
+typedef struct GoldenOutput {
+  Sha256 sha;
+  unsigned long size;
+  double hashTime; /* the time spent computing the digest (which we don't count as the repair's) */
+} GoldenOutput;
+
+static int hashOutput(void* opaque, void const* data, unsigned long size) {
+  GoldenOutput* output = (GoldenOutput*)opaque;
+  double const startTime = goldenTime();
+
+  sha256Update(&output->sha, (unsigned char const*)data, size);
+  output->size += size;
+  output->hashTime += goldenTime() - startTime;
+  return 0;
+}
+
+static int setFormats(djifix_ctx* dctx, char* formats) {
+  /* "formats" is one or more "-f" values, separated by commas ("-" for the default): */
+  char* format;
+
+  djifix_set_format(dctx, "auto");
+  if (strcmp(formats, "-") == 0) return 1;
+  for (format = strtok(formats, ","); format != NULL; format = strtok(NULL, ",")) {
+    if (!djifix_set_format(dctx, format)) return 0;
+  }
+  return 1;
+}
+
+static void usage(char const* progName) {
+  fprintf(stderr, "Usage: %s [-j number-of-threads] [-d directory] [-w] manifest-file\n", progName);
+  fprintf(stderr, "\tEach line of \"manifest-file\" is: <sha256> <format (as for \"djifix -f\"), or \"-\"> <file name>\n");
+  fprintf(stderr, "\t-j number-of-threads: Repair each file using this many threads (as for \"djifix -j\").\n");
+  fprintf(stderr, "\t-d directory: Relative file names are relative to this (instead of the manifest's directory).\n");
+  fprintf(stderr, "\t-w: Print the manifest, with the digests that we got, instead of checking them.\n");
+}
+
+int main(int argc, char** argv) {
+  unsigned numThreads = 1;
+  char const* directory = NULL;
+  char const* manifestName = NULL;
+  int writeManifest = 0;
+  char line[MAX_LINE_SIZE], path[2*MAX_LINE_SIZE];
+  unsigned long lineNumber = 0;
+  unsigned numCases = 0, numPassed = 0;
+  double totalTime = 0.0;
+  FILE* manifest;
+  djifix_ctx* dctx;
+  int arg;
+
+  for (arg = 1; arg < argc; ++arg) {
+    if (strcmp(argv[arg], "-j") == 0 && arg+1 < argc && sscanf(argv[arg+1], "%u", &numThreads) == 1 && numThreads > 0) {
+      ++arg;
+    } else if (strcmp(argv[arg], "-d") == 0 && arg+1 < argc) {
+      directory = argv[++arg];
+    } else if (strcmp(argv[arg], "-w") == 0) {
+      writeManifest = 1;
+    } else if (argv[arg][0] != '-' && manifestName == NULL) {
+      manifestName = argv[arg];
+    } else {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+  if (manifestName == NULL) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  manifest = fopen(manifestName, "r");
+  if (manifest == NULL) {
+    perror(manifestName);
+    return 1;
+  }
+  dctx = djifix_new();
+  if (dctx == NULL) {
+    fprintf(stderr, "Out of memory!\n");
+    return 1;
+  }
+  djifix_set_threads(dctx, numThreads);
+
+  if (!writeManifest) {
+    printf("djifix version %s; using %u thread(s)\n", djifix_version(), numThreads);
+  }
+  while (fgets(line, sizeof line, manifest) != NULL) {
+    char expectedDigest[MAX_LINE_SIZE], formats[MAX_LINE_SIZE], formatList[MAX_LINE_SIZE], digest[65];
+    char const* fileName;
+    int nameOffset = 0;
+    size_t len = strlen(line);
+    GoldenOutput output;
+    double startTime, elapsed;
+    int repairIsOK, passed;
+
+    ++lineNumber;
+    while (len > 0 && (line[len-1] == '\n' || line[len-1] == '\r')) line[--len] = '\0';
+    if (line[strspn(line, " \t")] == '\0' || line[0] == '#') {
+      if (writeManifest) printf("%s\n", line);
+      continue;
+    }
+    if (sscanf(line, "%s %s %n", expectedDigest, formats, &nameOffset) != 2 || nameOffset == 0
+	|| line[nameOffset] == '\0') {
+      fprintf(stderr, "%s, line %lu: expected \"<sha256> <format> <file name>\"\n", manifestName, lineNumber);
+      fclose(manifest);
+      djifix_free(dctx);
+      return 1;
+    }
+    fileName = &line[nameOffset];
+
+    /* Find the file (relative to the manifest's directory, or "-d"): */
+    if (fileName[0] == '/') {
+      snprintf(path, sizeof path, "%s", fileName);
+    } else if (directory != NULL) {
+      snprintf(path, sizeof path, "%s/%s", directory, fileName);
+    } else {
+      char const* slash = strrchr(manifestName, '/');
+
+      snprintf(path, sizeof path, "%.*s%s", slash == NULL ? 0 : (int)(slash - manifestName + 1), manifestName, fileName);
+    }
+
+    if (!writeManifest) printf("%-50s ", fileName);
+    fflush(stdout);
+    strcpy(formatList, formats); /* (because "setFormats()" modifies it) */
+    if (!setFormats(dctx, formatList)) {
+      printf("FAIL (unknown video format \"%s\")\n", formats);
+      ++numCases;
+      continue;
+    }
+    sha256Init(&output.sha);
+    output.size = 0;
+    output.hashTime = 0.0;
+    startTime = goldenTime();
+    repairIsOK = djifix_repair(dctx, path, hashOutput, &output);
+    elapsed = goldenTime() - startTime - output.hashTime;
+    totalTime += elapsed;
+    sha256Final(&output.sha, digest);
+    ++numCases;
+
+    if (writeManifest) {
+      if (!repairIsOK) fprintf(stderr, "%s: not repaired\n", path);
+      printf("%s %s %s\n", repairIsOK ? digest : "-", formats, fileName);
+      continue;
+    }
+    passed = repairIsOK && strcmp(digest, expectedDigest) == 0;
+    if (passed) ++numPassed;
+    printf("%s %8.4f seconds (%.1f MBytes written", passed ? "ok  " : "FAIL", elapsed, output.size/1000000.0);
+    if (elapsed > 0 && repairIsOK) printf("; %.1f MBytes/second", output.size/1000000.0/elapsed);
+    printf(")");
+    if (!repairIsOK) {
+      printf(": not repaired");
+    } else if (!passed) {
+      printf(": expected %s, got %s", expectedDigest, digest);
+    }
+    printf("\n");
+  }
+
+  fclose(manifest);
+  djifix_free(dctx);
+  if (writeManifest) return 0;
+  printf("%u of %u cases passed (in %.3f seconds)\n", numPassed, numCases, totalTime);
+  return numPassed == numCases ? 0 : 1;
+}